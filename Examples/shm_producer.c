@@ -0,0 +1,141 @@
+/*
+ * Example producer for the shared memory feed (POSIX systems), see
+ * Source/plotter_shm.h for the layout. Writes a damped oscillator at a fixed
+ * rate into a segment, attach to it from the Data window of Plotter with the
+ * same name.
+ *
+ * Usage: shm_producer [name] [rows per second] [capacity]
+ *        shm_producer /plotter_demo 100000 1000000
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "plotter_shm.h"
+
+static volatile sig_atomic_t running = 1;
+
+static void OnSignal(int sig)
+{
+    running = 0;
+}
+
+static void StoreRelease(uint64_t* value, uint64_t newValue)
+{
+    __atomic_store_n(value, newValue, __ATOMIC_RELEASE);
+}
+
+int main(int argc, char** argv)
+{
+    const char* name = argc > 1 ? argv[1] : "/plotter_demo";
+    double rate = argc > 2 ? atof(argv[2]) : 100000.0;
+    uint64_t capacity = argc > 3 ? strtoull(argv[3], NULL, 10) : 1000000;
+    if(rate <= 0 || capacity == 0)
+    {
+        fprintf(stderr, "Usage: %s [name] [rows per second] [capacity]\n", argv[0]);
+        return 1;
+    }
+    
+    /* Time and position as floats, velocity as doubles to show both types */
+    const char* names[] = { "t", "x", "v" };
+    const uint32_t types[] = { PlotterShm_F32, PlotterShm_F32, PlotterShm_F64 };
+    const uint32_t columnCount = 3;
+    
+    uint64_t offsets[3];
+    uint64_t size = PlotterShmAlign(sizeof(PlotterShmHeader));
+    for(uint32_t c = 0; c < columnCount; ++c)
+    {
+        offsets[c] = size;
+        size = PlotterShmAlign(size + capacity * PlotterShmTypeSize(types[c]));
+    }
+    
+    /* The segment is reused if it's there, so an attached Plotter follows the restart */
+    int fd = shm_open(name, O_RDWR | O_CREAT, 0600);
+    if(fd == -1)
+    {
+        perror("shm_open");
+        return 1;
+    }
+    
+    struct stat info;
+    if(fstat(fd, &info) != 0 || ((uint64_t)info.st_size < size && ftruncate(fd, (off_t)size) != 0))
+    {
+        perror("ftruncate");
+        return 1;
+    }
+    if((uint64_t)info.st_size > size) size = (uint64_t)info.st_size;
+    
+    PlotterShmHeader* header = (PlotterShmHeader*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(header == MAP_FAILED)
+    {
+        perror("mmap");
+        return 1;
+    }
+    
+    /* Odd while the schema is being written */
+    uint64_t sequence = header->magic == PlotterShm_Magic ? (header->schemaSequence + 2) | 1 : 1;
+    StoreRelease(&header->schemaSequence, sequence);
+    
+    header->magic = PlotterShm_Magic;
+    header->version = PlotterShm_Version;
+    header->headerSize = sizeof(PlotterShmHeader);
+    header->segmentSize = size;
+    header->capacity = capacity;
+    header->columnCount = columnCount;
+    memset(header->columns, 0, sizeof(header->columns));
+    for(uint32_t c = 0; c < columnCount; ++c)
+    {
+        snprintf(header->columns[c].name, sizeof(header->columns[c].name), "%s", names[c]);
+        header->columns[c].type = types[c];
+        header->columns[c].offset = offsets[c];
+    }
+    header->writeCursor = 0;
+    StoreRelease(&header->schemaSequence, sequence + 1);
+    
+    float* ts = (float*)((char*)header + offsets[0]);
+    float* xs = (float*)((char*)header + offsets[1]);
+    double* vs = (double*)((char*)header + offsets[2]);
+    
+    signal(SIGINT, OnSignal);
+    signal(SIGTERM, OnSignal);
+    printf("Writing %.0f rows/s to %s, ctrl+c to stop\n", rate, name);
+    
+    /* Rows are published in batches, one per millisecond */
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t row = 0;
+    while(running)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        double elapsed = (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) * 1e-9;
+        uint64_t target = (uint64_t)(elapsed * rate);
+        
+        for(; row < target; ++row)
+        {
+            double t = row / rate;
+            double envelope = exp(-0.05 * fmod(t, 60.0));
+            uint64_t slot = row % capacity;
+            ts[slot] = (float)t;
+            xs[slot] = (float)(envelope * sin(2.0 * t));
+            vs[slot] = envelope * (2.0 * cos(2.0 * t) - 0.05 * sin(2.0 * t));
+        }
+        StoreRelease(&header->writeCursor, row);
+        
+        struct timespec pause = { 0, 1000000 };
+        nanosleep(&pause, NULL);
+    }
+    
+    /* The segment is left in place for the next run, shm_unlink it to clean up */
+    printf("\n%llu rows written\n", (unsigned long long)row);
+    munmap(header, size);
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,404 @@
+#include "analysis.h"
+#include "core.h"
+#include "interpreter.h"
+
+#include <math.h>
+#include <string.h>
+#include <memory>
+
+#ifndef IMGUI_DEFINE_MATH_OPERATORS
+#define IMGUI_DEFINE_MATH_OPERATORS
+#endif
+#include "imgui.h"
+
+#define Analysis_MaxIterations 100
+#define Analysis_TileStored (Analysis_TileSamples + 2)  // One more sample on each side
+
+// What a tile job needs, copied so the curves can change while it runs. The
+// samples start one before the tile: ys[j] is the sample first - 1 + j.
+struct TileCurve
+{
+    uint32_t id;
+    Program program;
+    Program slope;
+    double ys[Analysis_TileStored];
+    int known[2];  // Range of ys taken from the drawn samples, the others are evaluated
+};
+
+struct TileTask
+{
+    uint64_t key;
+    double step;
+    int64_t first;
+    std::vector<double> params;
+    TileCurve curves[2];
+    int numCurves;  // 1 for zeros and extrema, 2 for intersections
+};
+
+static int64_t FloorDiv(int64_t a, int64_t b)
+{
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+// Newton's method safeguarded by bisection, for a root of eval(x, &value,
+// &derivative) in [lo, hi] where the values at the ends have opposite signs
+template<typename T>
+static double RefineRoot(T eval, double lo, double hi, double valueLo)
+{
+    // Oriented so the value is negative at lo
+    if(valueLo > 0.0)
+    {
+        double swap = lo;
+        lo = hi;
+        hi = swap;
+    }
+    
+    double x = 0.5 * (lo + hi);
+    double stepOld = fabs(hi - lo);
+    double step = stepOld;
+    double value, derivative;
+    eval(x, &value, &derivative);
+    
+    for(int i = 0; i < Analysis_MaxIterations; ++i)
+    {
+        bool outside = ((x - hi) * derivative - value) * ((x - lo) * derivative - value) > 0.0;
+        bool slow = fabs(2.0 * value) > fabs(stepOld * derivative);
+        if(outside || slow || !isfinite(derivative) || derivative == 0.0)
+        {
+            stepOld = step;
+            step = 0.5 * (hi - lo);
+            x = lo + step;
+        }
+        else
+        {
+            stepOld = step;
+            step = value / derivative;
+            x -= step;
+        }
+        
+        if(fabs(step) <= 4e-16 * fabs(x) || fabs(step) < 1e-300) break;
+        
+        eval(x, &value, &derivative);
+        if(value == 0.0) break;
+        if(value < 0.0) lo = x;
+        else hi = x;
+    }
+    
+    return x;
+}
+
+static void AddPoint(std::vector<PointOfInterest>* points, PointKind kind, double x, double y, uint32_t other)
+{
+    if(points->size() < Analysis_MaxPointsPerTile && isfinite(x) && isfinite(y))
+        points->push_back({ kind, x, y, other });
+}
+
+// Sign changes of diff(j), refined with eval. Sign changes through a pole or
+// a jump leave a value far from zero, and are dropped.
+template<typename D, typename T>
+static void FindRoots(const TileTask* task, D diff, T eval, PointKind kind, uint32_t other, std::vector<PointOfInterest>* points)
+{
+    const TileCurve* curve = &task->curves[0];
+    for(int j = 1; j <= Analysis_TileSamples; ++j)
+    {
+        double x = (task->first - 1 + j) * task->step;
+        double a = diff(j);
+        double b = diff(j + 1);
+        
+        // Touching zero, or a root right on a sample
+        if(a == 0.0)
+        {
+            if(diff(j - 1) != 0.0 || b != 0.0) AddPoint(points, kind, x, curve->ys[j], other);
+            continue;
+        }
+        if(!(a * b < 0.0) || !isfinite(a) || !isfinite(b)) continue;
+        
+        double root = RefineRoot(eval, x, x + task->step, a);
+        double value, derivative;
+        eval(root, &value, &derivative);
+        if(!(fabs(value) <= 1e-6 * fmax(fabs(a), fabs(b)))) continue;
+        
+        double vars[Var_Count] = { root, 0.0, 0.0 };
+        double y = kind == Point_Zero ? 0.0 : EvalScalar(&curve->program, vars, task->params.data());
+        AddPoint(points, kind, root, y, other);
+    }
+}
+
+// Turning points of the samples, refined as roots of the first derivative
+static void FindExtrema(const TileTask* task, std::vector<PointOfInterest>* points)
+{
+    const TileCurve* curve = &task->curves[0];
+    const double* params = task->params.data();
+    auto slope = [&](double x, double* value, double* derivative)
+    {
+        double vars[Var_Count] = { x, 0.0, 0.0 };
+        double outputs[2];
+        EvalScalar(&curve->slope, vars, params, outputs);
+        *value = outputs[0];
+        *derivative = outputs[1];
+    };
+    
+    for(int j = 1; j <= Analysis_TileSamples; ++j)
+    {
+        double before = curve->ys[j] - curve->ys[j - 1];
+        double after = curve->ys[j + 1] - curve->ys[j];
+        bool maximum = before > 0.0 && after <= 0.0;
+        bool minimum = before < 0.0 && after >= 0.0;
+        if(!maximum && !minimum) continue;
+        
+        // The derivative has to change sign in one of the two intervals around the sample
+        double x = (task->first - 1 + j) * task->step;
+        double xs[3] = { x - task->step, x, x + task->step };
+        double values[3], unused;
+        for(int i = 0; i < 3; ++i)
+            slope(xs[i], &values[i], &unused);
+        
+        int interval = values[0] * values[1] <= 0.0 ? 0 : (values[1] * values[2] <= 0.0 ? 1 : -1);
+        if(interval < 0) continue;
+        
+        double root = values[interval] == 0.0 ? xs[interval] :
+                      values[interval + 1] == 0.0 ? xs[interval + 1] :
+                      RefineRoot(slope, xs[interval], xs[interval + 1], values[interval]);
+        
+        // Poles where the derivative changes sign aren't extrema
+        double vars[Var_Count] = { root, 0.0, 0.0 };
+        double y = EvalScalar(&curve->program, vars, params);
+        double neighbours = maximum ? fmax(curve->ys[j - 1], curve->ys[j + 1]) : fmin(curve->ys[j - 1], curve->ys[j + 1]);
+        if(!isfinite(y) || (maximum ? y < neighbours : y > neighbours)) continue;
+        
+        AddPoint(points, maximum ? Point_Maximum : Point_Minimum, root, y, 0);
+    }
+}
+
+static void FillSamples(const TileTask* task, TileCurve* curve)
+{
+    // The drawn samples cover a contiguous range, at most the two ends are missing
+    int ranges[2][2] = { { 0, curve->known[0] }, { curve->known[1], Analysis_TileStored } };
+    for(const int* range : ranges)
+    {
+        int count = range[1] - range[0];
+        if(count <= 0) continue;
+        
+        double start = (task->first - 1 + range[0]) * task->step;
+        EvalInput vars[Var_Count] = { EvalRamp(start, task->step), EvalConstant(0.0), EvalConstant(0.0) };
+        double* outputs[1] = { curve->ys + range[0] };
+        EvalBatch(&curve->program, vars, task->params.data(), count, outputs);
+    }
+}
+
+static void RunTileTask(Analyzer* analyzer, TileTask* task)
+{
+    for(int c = 0; c < task->numCurves; ++c)
+        FillSamples(task, &task->curves[c]);
+    
+    const double* params = task->params.data();
+    const TileCurve* a = &task->curves[0];
+    const TileCurve* b = &task->curves[1];
+    auto evalCurve = [&](const TileCurve* curve, double x, double* value, double* derivative)
+    {
+        double vars[Var_Count] = { x, 0.0, 0.0 };
+        double outputs[2];
+        *value = EvalScalar(&curve->program, vars, params);
+        EvalScalar(&curve->slope, vars, params, outputs);
+        *derivative = outputs[0];
+    };
+    
+    std::vector<PointOfInterest> points;
+    if(task->numCurves == 1)
+    {
+        auto value = [&](int j) { return a->ys[j]; };
+        auto eval = [&](double x, double* value, double* derivative) { evalCurve(a, x, value, derivative); };
+        FindRoots(task, value, eval, Point_Zero, 0, &points);
+        FindExtrema(task, &points);
+    }
+    else
+    {
+        auto difference = [&](int j) { return a->ys[j] - b->ys[j]; };
+        auto eval = [&](double x, double* value, double* derivative)
+        {
+            double valueB, derivativeB;
+            evalCurve(a, x, value, derivative);
+            evalCurve(b, x, &valueB, &derivativeB);
+            *value -= valueB;
+            *derivative -= derivativeB;
+        };
+        FindRoots(task, difference, eval, Point_Intersection, b->id, &points);
+    }
+    
+    std::lock_guard<std::mutex> lock(analyzer->mutex);
+    auto found = analyzer->tiles.find(task->key);
+    if(found == analyzer->tiles.end()) return;  // Evicted meanwhile
+    found->second.points = std::move(points);
+    found->second.done = true;
+}
+
+static void CopyTileCurve(const Curve* curve, int64_t first, TileCurve* out)
+{
+    out->id = curve->id;
+    out->program = curve->program;
+    out->slope = curve->slope;
+    
+    int64_t begin = first - 1 - curve->firstSample;  // In the drawn samples
+    int64_t known0 = begin < 0 ? -begin : 0;
+    int64_t known1 = (int64_t)curve->ys.size() - begin;
+    if(known1 > Analysis_TileStored) known1 = Analysis_TileStored;
+    if(known1 < known0) known1 = known0;
+    for(int64_t j = known0; j < known1; ++j)
+        out->ys[j] = curve->ys[begin + j];
+    
+    out->known[0] = (int)known0;
+    out->known[1] = (int)known1;
+}
+
+void UpdateAnalysis(Analyzer* analyzer, const CurveList* list, const PlotView* view)
+{
+    ++analyzer->frame;
+    analyzer->visible.clear();
+    analyzer->pendingTiles = 0;
+    
+    const Curve* selected = FindCurve(list, analyzer->selected);
+    if(!selected)
+    {
+        analyzer->selected = 0;
+        return;
+    }
+    if(!selected->visible || selected->def.kind != Def_Explicit || selected->listParam >= 0 || selected->ys.empty()) return;
+    
+    // Other explicit curves are sampled on the same grid
+    std::vector<const Curve*> others;
+    for(const Curve* curve : list->curves)
+    {
+        if(curve != selected && curve->visible && curve->def.kind == Def_Explicit && curve->listParam < 0 && !curve->ys.empty())
+            others.push_back(curve);
+    }
+    
+    uint64_t paramsHash = HashBytes(Hash_Seed, list->params.values.data(), list->params.values.size() * sizeof(double));
+    int64_t firstTile = FloorDiv(selected->firstSample, Analysis_TileSamples);
+    int64_t lastTile = FloorDiv(selected->firstSample + (int64_t)selected->ys.size() - 1, Analysis_TileSamples);
+    
+    std::vector<TileTask*> tasks;
+    {
+        std::lock_guard<std::mutex> lock(analyzer->mutex);
+        for(int64_t tile = firstTile; tile <= lastTile; ++tile)
+        {
+            for(int pass = 0; pass <= (int)others.size(); ++pass)
+            {
+                const Curve* curves[2] = { selected, pass > 0 ? others[pass - 1] : nullptr };
+                int numCurves = pass > 0 ? 2 : 1;
+                
+                uint64_t key = HashBytes(paramsHash, &selected->sampleLevel, sizeof(int));
+                key = HashBytes(key, &tile, sizeof(tile));
+                for(int c = 0; c < numCurves; ++c)
+                {
+                    key = HashBytes(key, &curves[c]->id, sizeof(uint32_t));
+                    key = HashBytes(key, &curves[c]->version, sizeof(uint32_t));
+                }
+                
+                auto found = analyzer->tiles.find(key);
+                if(found == analyzer->tiles.end())
+                {
+                    AnalysisTile* entry = &analyzer->tiles[key];
+                    entry->done = false;
+                    entry->lastUsed = analyzer->frame;
+                    
+                    TileTask* task = new TileTask();
+                    task->key = key;
+                    task->step = selected->sampleStep;
+                    task->first = tile * Analysis_TileSamples;
+                    task->params = list->params.values;
+                    task->numCurves = numCurves;
+                    for(int c = 0; c < numCurves; ++c)
+                        CopyTileCurve(curves[c], task->first, &task->curves[c]);
+                    tasks.push_back(task);
+                    ++analyzer->pendingTiles;
+                    continue;
+                }
+                
+                found->second.lastUsed = analyzer->frame;
+                if(!found->second.done)
+                {
+                    ++analyzer->pendingTiles;
+                    continue;
+                }
+                
+                for(const PointOfInterest& point : found->second.points)
+                {
+                    if(point.x >= view->xMin && point.x <= view->xMax)
+                        analyzer->visible.push_back(point);
+                }
+            }
+        }
+        
+        // Tiles out of use go once there are too many, the running ones are kept for their jobs
+        if(analyzer->tiles.size() > Analysis_MaxTiles)
+        {
+            for(auto it = analyzer->tiles.begin(); it != analyzer->tiles.end();)
+            {
+                if(it->second.done && it->second.lastUsed != analyzer->frame) it = analyzer->tiles.erase(it);
+                else ++it;
+            }
+        }
+    }
+    
+    // Queued outside of the lock, jobs run inline without a job system
+    for(TileTask* task : tasks)
+    {
+        RunBackgroundJob([analyzer, task]()
+        {
+            RunTileTask(analyzer, task);
+            delete task;
+        }, &analyzer->jobs);
+    }
+}
+
+void HandleAnalysisClick(Analyzer* analyzer, const CurveList* list, const PlotView* view)
+{
+    ImGuiIO& io = ImGui::GetIO();
+    if(io.WantCaptureMouse || io.DisplaySize.x <= 0 || io.DisplaySize.y <= 0) return;
+    if(!ImGui::IsMouseReleased(ImGuiMouseButton_Left)) return;
+    
+    // Releasing a drag pans, it isn't a click
+    ImVec2 drag = ImGui::GetMouseDragDelta(ImGuiMouseButton_Left, 0.0f);
+    if(drag.x * drag.x + drag.y * drag.y > 9.0f) return;
+    
+    double x = view->xMin + io.MousePos.x / io.DisplaySize.x * (view->xMax - view->xMin);
+    double y = view->yMax - io.MousePos.y / io.DisplaySize.y * (view->yMax - view->yMin);
+    Curve* curve = PickCurve(list, view, x, y);
+    analyzer->selected = curve ? curve->id : 0;
+}
+
+void DrawAnalysis(const Analyzer* analyzer, const CurveList* list, const PlotView* view)
+{
+    static const char* kindNames[] = { "Zero", "Minimum", "Maximum", "Intersection" };
+    const Curve* selected = FindCurve(list, analyzer->selected);
+    ImGuiIO& io = ImGui::GetIO();
+    double rangeX = view->xMax - view->xMin;
+    double rangeY = view->yMax - view->yMin;
+    if(!selected || io.DisplaySize.x <= 0 || io.DisplaySize.y <= 0) return;
+    
+    ImDrawList* drawList = ImGui::GetBackgroundDrawList();
+    ImU32 fill = ImGui::GetColorU32(ImVec4(selected->color[0], selected->color[1], selected->color[2], 1.0f));
+    const PointOfInterest* hovered = nullptr;
+    for(const PointOfInterest& point : analyzer->visible)
+    {
+        ImVec2 center((float)((point.x - view->xMin) / rangeX * io.DisplaySize.x),
+                      (float)((view->yMax - point.y) / rangeY * io.DisplaySize.y));
+        drawList->AddCircleFilled(center, 5.0f, IM_COL32(255, 255, 255, 255));
+        drawList->AddCircleFilled(center, 3.5f, fill);
+        
+        ImVec2 delta = center - io.MousePos;
+        if(delta.x * delta.x + delta.y * delta.y < 36.0f) hovered = &point;
+    }
+    
+    if(hovered && !io.WantCaptureMouse)
+    {
+        const Curve* other = hovered->kind == Point_Intersection ? FindCurve(list, hovered->other) : nullptr;
+        if(other) ImGui::SetTooltip("%s with %s\n(%.10g, %.10g)", kindNames[hovered->kind], other->text, hovered->x, hovered->y);
+        else ImGui::SetTooltip("%s\n(%.10g, %.10g)", kindNames[hovered->kind], hovered->x, hovered->y);
+    }
+}
+
+void ShutdownAnalyzer(Analyzer* analyzer)
+{
+    WaitForJobs(&analyzer->jobs);
+}
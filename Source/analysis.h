@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+
+#include "jobs.h"
+#include "curves.h"
+
+// Zeros, extrema and intersections of the selected explicit curve, found in
+// the background. The sample grid of the curves is split in tiles of
+// Analysis_TileSamples samples. Every tile is a job that brackets sign
+// changes in the samples already taken for drawing (evaluating only the ones
+// off screen), then refines them with Newton's method on the derivative
+// programs, falling back to bisection when a step leaves the bracket.
+// Results are cached per tile, for the curve text, the parameter values and
+// the sampling level, so panning and coming back only runs the new tiles.
+
+#define Analysis_TileSamples 256
+#define Analysis_MaxPointsPerTile 64
+#define Analysis_MaxTiles 4096
+
+enum PointKind
+{
+    Point_Zero = 0,
+    Point_Minimum,
+    Point_Maximum,
+    Point_Intersection,
+};
+
+struct PointOfInterest
+{
+    PointKind kind;
+    double x;
+    double y;
+    uint32_t other;  // Intersections: id of the other curve
+};
+
+struct AnalysisTile
+{
+    bool done;
+    uint64_t lastUsed;  // Frame
+    std::vector<PointOfInterest> points;
+};
+
+struct Analyzer
+{
+    uint32_t selected = 0;  // Curve id, 0 for none
+    uint64_t frame = 0;
+    
+    std::mutex mutex;  // Guards the tiles, which the jobs fill in
+    std::unordered_map<uint64_t, AnalysisTile> tiles;
+    JobCounter jobs;
+    
+    std::vector<PointOfInterest> visible;  // Of the selected curve, for drawing
+    int pendingTiles = 0;
+};
+
+// Selects the curve under a click on the plot, or clears the selection
+void HandleAnalysisClick(Analyzer* analyzer, const CurveList* list, const PlotView* view);
+// Queues the tiles of the view that aren't cached yet, and gathers the points found so far
+void UpdateAnalysis(Analyzer* analyzer, const CurveList* list, const PlotView* view);
+void DrawAnalysis(const Analyzer* analyzer, const CurveList* list, const PlotView* view);
+// Waits for the jobs still running
+void ShutdownAnalyzer(Analyzer* analyzer);
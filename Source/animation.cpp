@@ -0,0 +1,269 @@
+#include "animation.h"
+#include "core.h"
+
+#include <math.h>
+#include <string.h>
+#include <memory>
+
+struct BakeTask
+{
+    uint64_t key;
+    std::shared_ptr<const std::vector<Curve>> curves;  // Copies without samples, shared by the frames of an update
+    ParamTable params;
+    PlotView view;
+};
+
+int GetAnimationFrames(const Animator* animator)
+{
+    int frames = (int)(animator->seconds * Animation_FramesPerSecond);
+    return frames > 2 ? frames : 2;
+}
+
+double GetAnimationValue(const Animator* animator, int frame)
+{
+    double t = (double)frame / (GetAnimationFrames(animator) - 1);
+    return animator->min + (animator->max - animator->min) * t;
+}
+
+// Everything the frames depend on besides the animated parameter
+static uint64_t SceneKey(const Animator* animator, const CurveList* list, const PlotView* view)
+{
+    std::vector<double> values = list->params.values;
+    values[animator->param] = 0.0;
+    uint64_t key = HashBytes(Hash_Seed, values.data(), values.size() * sizeof(double));
+    key = HashBytes(key, &list->params.listVersion, sizeof(list->params.listVersion));
+    
+    double range[3] = { animator->min, animator->max, animator->seconds };
+    key = HashBytes(key, range, sizeof(range));
+    key = HashBytes(key, view, sizeof(*view));
+    for(const Curve* curve : list->curves)
+    {
+        if(!curve->visible) continue;
+        key = HashBytes(key, &curve->id, sizeof(curve->id));
+        key = HashBytes(key, &curve->version, sizeof(curve->version));
+        key = HashBytes(key, &curve->pending, sizeof(curve->pending));  // Compiled by the next SampleCurves
+    }
+    return key;
+}
+
+static uint64_t FrameKey(uint64_t scene, int frame)
+{
+    return HashBytes(scene, &frame, sizeof(frame));
+}
+
+static void TakeSamples(Curve* curve, AnimationSamples* out)
+{
+    out->curve = curve->id;
+    out->version = curve->version;
+    out->sampleLevel = curve->sampleLevel;
+    out->sampleStep = curve->sampleStep;
+    out->firstSample = curve->firstSample;
+    out->doubleDouble = curve->doubleDouble;
+    out->sampleKey = curve->sampleKey;
+    memcpy(out->sampleArea, curve->sampleArea, sizeof(out->sampleArea));
+    out->listParam = curve->listParam;
+    out->listRows = curve->listRows;
+    out->xs.swap(curve->xs);
+    out->ys.swap(curve->ys);
+}
+
+// Copied rather than moved, the frame stays cached for scrubbing back
+static void PutSamples(const AnimationSamples* samples, Curve* curve)
+{
+    curve->sampleLevel = samples->sampleLevel;
+    curve->sampleStep = samples->sampleStep;
+    curve->firstSample = samples->firstSample;
+    curve->doubleDouble = samples->doubleDouble;
+    curve->sampleKey = samples->sampleKey;
+    memcpy(curve->sampleArea, samples->sampleArea, sizeof(curve->sampleArea));
+    curve->listParam = samples->listParam;
+    curve->listRows = samples->listRows;
+    curve->xs = samples->xs;
+    curve->ys = samples->ys;
+}
+
+static void BakeFrame(Animator* animator, const BakeTask* task)
+{
+    std::vector<AnimationSamples> baked(task->curves->size());
+    int64_t numSamples = 0;
+    for(size_t c = 0; c < baked.size(); ++c)
+    {
+        Curve scratch = (*task->curves)[c];
+        SampleCurve(&scratch, &task->params, &task->view);
+        TakeSamples(&scratch, &baked[c]);
+        numSamples += (int64_t)baked[c].ys.size();
+    }
+    
+    std::lock_guard<std::mutex> lock(animator->mutex);
+    auto found = animator->frames.find(task->key);
+    if(found == animator->frames.end()) return;  // Evicted meanwhile
+    found->second.curves = std::move(baked);
+    found->second.numSamples = numSamples;
+    found->second.done = true;
+}
+
+// How far a frame is from the shown one, either way around the loop
+static int FrameDistance(int a, int b, int numFrames)
+{
+    int distance = a > b ? a - b : b - a;
+    return distance < numFrames - distance ? distance : numFrames - distance;
+}
+
+// Makes room for one more frame, dropping the finished ones of other scenes
+// first, then the ones farthest from playback. False when what's left is
+// all needed ahead of playback.
+static bool EvictFrames(Animator* animator, uint64_t scene, int numFrames)
+{
+    for(;;)
+    {
+        int64_t numSamples = 0;
+        for(const auto& entry : animator->frames)
+            numSamples += entry.second.numSamples;
+        if(animator->frames.size() < Animation_MaxFrames && numSamples < Animation_MaxSamples) return true;
+        
+        auto victim = animator->frames.end();
+        int farthest = Animation_Ahead;
+        for(auto it = animator->frames.begin(); it != animator->frames.end(); ++it)
+        {
+            if(!it->second.done) continue;
+            
+            int distance = it->second.scene != scene ? numFrames : FrameDistance(it->second.index, animator->frame, numFrames);
+            if(distance > farthest)
+            {
+                farthest = distance;
+                victim = it;
+            }
+        }
+        if(victim == animator->frames.end()) return false;
+        animator->frames.erase(victim);
+    }
+}
+
+void UpdateAnimation(Animator* animator, CurveList* list, const PlotView* view, double seconds)
+{
+    animator->bakedAhead = 0;
+    
+    // Lists can't be animated, they're not one value
+    ParamTable* params = &list->params;
+    if(animator->param >= (int)params->names.size() || (animator->param >= 0 && !params->lists[animator->param].empty()))
+        animator->param = -1;
+    if(animator->param < 0)
+    {
+        animator->playing = false;
+        std::lock_guard<std::mutex> lock(animator->mutex);
+        for(auto it = animator->frames.begin(); it != animator->frames.end();)
+        {
+            if(it->second.done) it = animator->frames.erase(it);
+            else ++it;
+        }
+        return;
+    }
+    
+    int numFrames = GetAnimationFrames(animator);
+    if(animator->frame < 0 || animator->frame >= numFrames) animator->frame = 0;
+    uint64_t scene = SceneKey(animator, list, view);
+    
+    std::vector<BakeTask*> tasks;
+    {
+        std::lock_guard<std::mutex> lock(animator->mutex);
+        
+        // Playback moves on to the frames that are ready, and waits for the others
+        const double frameSeconds = 1.0 / Animation_FramesPerSecond;
+        if(animator->playing) animator->time += seconds;
+        while(animator->playing && animator->time >= frameSeconds)
+        {
+            int next = (animator->frame + 1) % numFrames;
+            auto found = animator->frames.find(FrameKey(scene, next));
+            if(found == animator->frames.end() || !found->second.done)
+            {
+                animator->time = frameSeconds;
+                break;
+            }
+            animator->frame = next;
+            animator->time -= frameSeconds;
+        }
+        
+        auto shown = animator->frames.find(FrameKey(scene, animator->frame));
+        if(shown != animator->frames.end() && shown->second.done)
+        {
+            for(const AnimationSamples& samples : shown->second.curves)
+            {
+                Curve* curve = FindCurve(list, samples.curve);
+                if(curve && curve->version == samples.version && curve->sampleKey != samples.sampleKey)
+                    PutSamples(&samples, curve);
+            }
+        }
+        
+        // In order from the shown frame, a few jobs at a time so the nearest come first
+        int inFlight = 0;
+        for(const auto& entry : animator->frames)
+            inFlight += entry.second.done ? 0 : 1;
+        
+        std::shared_ptr<std::vector<Curve>> snapshot;
+        int ahead = Animation_Ahead < numFrames ? Animation_Ahead : numFrames;
+        bool inRow = true;
+        for(int k = 0; k < ahead; ++k)
+        {
+            int index = (animator->frame + k) % numFrames;
+            uint64_t key = FrameKey(scene, index);
+            auto found = animator->frames.find(key);
+            if(found != animator->frames.end())
+            {
+                inRow = inRow && found->second.done;
+                if(inRow) ++animator->bakedAhead;
+                continue;
+            }
+            
+            inRow = false;
+            if(inFlight >= GetNumJobThreads() || !EvictFrames(animator, scene, numFrames)) continue;
+            
+            if(!snapshot)
+            {
+                snapshot = std::make_shared<std::vector<Curve>>();
+                for(const Curve* curve : list->curves)
+                {
+                    if(!curve->visible || (curve->def.kind != Def_Explicit && curve->def.kind != Def_Parametric)) continue;
+                    
+                    snapshot->push_back(*curve);
+                    snapshot->back().specialized.clear();
+                    snapshot->back().xs.clear();
+                    snapshot->back().ys.clear();
+                    snapshot->back().sampleKey = 0;
+                }
+            }
+            
+            AnimationFrame* frame = &animator->frames[key];
+            frame->scene = scene;
+            frame->index = index;
+            frame->done = false;
+            frame->numSamples = 0;
+            
+            BakeTask* task = new BakeTask();
+            task->key = key;
+            task->curves = snapshot;
+            task->params = *params;
+            task->params.values[animator->param] = GetAnimationValue(animator, index);
+            task->view = *view;
+            tasks.push_back(task);
+            ++inFlight;
+        }
+    }
+    
+    // The parameter of the shown frame, whether its samples were ready or not
+    params->values[animator->param] = GetAnimationValue(animator, animator->frame);
+    
+    // Queued outside of the lock, jobs run inline without a job system
+    for(BakeTask* task : tasks)
+    {
+        RunBackgroundJob([animator, task]()
+        {
+            BakeFrame(animator, task);
+            delete task;
+        }, &animator->jobs);
+    }
+}
+
+void ShutdownAnimator(Animator* animator)
+{
+    WaitForJobs(&animator->jobs);
+}
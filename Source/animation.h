@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+
+#include "jobs.h"
+#include "curves.h"
+
+// Playback of a parameter sweeping a range. The sweep is cut in frames, the
+// parameter at Animation_FramesPerSecond, and the frames ahead of playback
+// are sampled by jobs on copies of the curves (see SampleCurve) into a
+// bounded cache. Playing a frame copies its samples into the curves with
+// their sample keys, so SampleCurves finds them current and evaluates
+// nothing on the main thread. Playback waits on frames that aren't ready
+// rather than sampling them itself, and scrubbing back shows cached frames.
+//
+// Frames are cached for everything else they depend on: the view, the text
+// and visibility of the curves, the other parameters and the range. Changing
+// any of it starts a new cache, the old frames go as the new ones come in.
+
+#define Animation_FramesPerSecond 30
+#define Animation_Ahead 60               // Frames baked ahead of playback
+#define Animation_MaxFrames 600          // Cached, the farthest from playback go first
+#define Animation_MaxSamples (1 << 23)   // Cached, over all frames and curves
+
+// What SampleCurve leaves in a curve
+struct AnimationSamples
+{
+    uint32_t curve;  // Id
+    uint32_t version;
+    int sampleLevel;
+    double sampleStep;
+    int64_t firstSample;
+    bool doubleDouble;
+    uint64_t sampleKey;
+    double sampleArea[4];
+    int listParam;
+    int64_t listRows;
+    std::vector<double> xs;
+    std::vector<double> ys;
+};
+
+struct AnimationFrame
+{
+    uint64_t scene;  // Key of everything besides the parameter
+    int index;
+    bool done;
+    int64_t numSamples;
+    std::vector<AnimationSamples> curves;
+};
+
+struct Animator
+{
+    int param = -1;  // Animated parameter, -1 for none
+    double min = 0.0;
+    double max = 10.0;
+    double seconds = 5.0;  // For the whole range
+    bool playing = false;
+    int frame = 0;      // Shown, in [0, GetAnimationFrames())
+    double time = 0.0;  // Seconds into the frame
+    
+    std::mutex mutex;  // Guards the frames, which the jobs fill in
+    std::unordered_map<uint64_t, AnimationFrame> frames;
+    JobCounter jobs;
+    
+    int bakedAhead = 0;  // Frames ready in a row from the shown one, for display
+};
+
+int GetAnimationFrames(const Animator* animator);
+double GetAnimationValue(const Animator* animator, int frame);
+
+// Advances playback by seconds, queues the frames ahead and sets the
+// parameter, putting the samples of the frame in the curves when they're
+// baked. Before SampleCurves.
+void UpdateAnimation(Animator* animator, CurveList* list, const PlotView* view, double seconds);
+// Waits for the jobs still running
+void ShutdownAnimator(Animator* animator);
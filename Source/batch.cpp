@@ -0,0 +1,560 @@
+#include "batch.h"
+#include "core.h"
+#include "os.h"
+#include "jobs.h"
+#include "parser.h"
+#include "compiler.h"
+#include "interpreter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+
+// The expression file has one definition per line, empty lines and lines
+// starting with '#' are skipped. Assignments (a = 2) set parameters for the
+// definitions which follow, lists (a = [1...10]) set them to their first
+// element, and a parameter can be assigned again further down. Each
+// plottable definition produces a table:
+//
+//   explicit    y = f(x)       columns x, y       (samples rows)
+//   parametric  (x(t), y(t))   columns t, x, y    (samples rows)
+//   implicit    f(x, y) = 0    columns x, y, f    (grid * grid rows, y major)
+//   complex     f(z) = g(z)    columns x, y, re, im (grid * grid rows, z = x + iy)
+//
+// CSV output has a "# expression" line and a header before each table.
+// Binary output (f32, f64) has the same rows packed as native floats,
+// tables one after the other with no headers, the layout is printed to stderr.
+// When writing binary to a file, the file is sized upfront and memory mapped
+// so that worker threads write their rows in place.
+
+static const char* batchUsage =
+    "Usage: plotter --batch <expression file> [options]\n"
+    "  --x min:max      Range of x (default -10:10)\n"
+    "  --y min:max      Range of y for implicit and complex definitions (default -10:10)\n"
+    "  --t min:max      Range of t for parametric definitions (default 0:2pi)\n"
+    "  --samples N      Samples per curve (default 1000)\n"
+    "  --grid N         Implicit and complex definitions are sampled on a N x N grid (default 256)\n"
+    "  --format F       csv, f32 or f64 (default csv)\n"
+    "  --output path    Output file, - for stdout (default)\n"
+    "  --set name=v     Sets a parameter, overriding assignments in the file\n"
+    "  --threads N      Number of threads (default: all)\n"
+    "  --quiet          Don't print the layout summary to stderr\n"
+    "Ranges and values can be constant expressions, e.g. --t 0:2pi\n";
+
+enum BatchFormat
+{
+    Batch_CSV,
+    Batch_F32,
+    Batch_F64,
+};
+
+struct BatchOptions
+{
+    const char* inputPath;
+    const char* outputPath;
+    BatchFormat format;
+    double range[Var_Count][2];
+    int64_t samples;
+    int64_t grid;
+    int threads;
+    bool quiet;
+    std::vector<std::string> sets;
+};
+
+struct BatchTable
+{
+    int line;
+    std::string text;
+    Definition def;
+    Program program;
+    std::vector<double> params;  // Values when the definition was read
+    int64_t rows;
+    int numColumns;
+    const char* header;
+    uint64_t byteOffset;  // Binary output only
+};
+
+#define Batch_MaxColumns 4
+#define Batch_ChunkRows 16384  // Rows per parallel task
+#define Batch_EvalRows 1024    // Rows evaluated at once by a task, buffers live on the stack
+
+static bool EvalConstantExpr(const char* text, double* out)
+{
+    ParamTable params;
+    Definition def;
+    if(!ParseDefinition(text, &params, &def) || def.kind != Def_Explicit || !params.names.empty())
+        return false;
+    if(AstDependsOn(&def.ast, def.roots[0], Op_Var, Var_X))
+        return false;
+    
+    Program program;
+    CompileDefinition(&def, &program);
+    double vars[Var_Count] = { 0 };
+    *out = EvalScalar(&program, vars, nullptr);
+    return true;
+}
+
+static bool ParseRange(const char* text, double range[2])
+{
+    const char* colon = strchr(text, ':');
+    if(!colon) return false;
+    
+    std::string min(text, colon - text);
+    std::string max(colon + 1);
+    return EvalConstantExpr(min.c_str(), &range[0]) && EvalConstantExpr(max.c_str(), &range[1]);
+}
+
+static bool ParseBatchOptions(int argc, char** argv, BatchOptions* options)
+{
+    options->inputPath = nullptr;
+    options->outputPath = "-";
+    options->format = Batch_CSV;
+    options->range[Var_X][0] = -10.0;
+    options->range[Var_X][1] = 10.0;
+    options->range[Var_Y][0] = -10.0;
+    options->range[Var_Y][1] = 10.0;
+    options->range[Var_T][0] = 0.0;
+    options->range[Var_T][1] = 2.0 * 3.14159265358979323846;
+    options->samples = 1000;
+    options->grid = 256;
+    options->threads = 0;
+    options->quiet = false;
+    
+    for(int i = 0; i < argc; ++i)
+    {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        bool ok = true;
+        
+        if(strcmp(arg, "--quiet") == 0)
+        {
+            options->quiet = true;
+            continue;
+        }
+        
+        if(arg[0] != '-' || arg[1] != '-')
+        {
+            if(options->inputPath) return false;
+            options->inputPath = arg;
+            continue;
+        }
+        
+        if(!value) return false;
+        ++i;
+        
+        if(strcmp(arg, "--x") == 0)            ok = ParseRange(value, options->range[Var_X]);
+        else if(strcmp(arg, "--y") == 0)       ok = ParseRange(value, options->range[Var_Y]);
+        else if(strcmp(arg, "--t") == 0)       ok = ParseRange(value, options->range[Var_T]);
+        else if(strcmp(arg, "--samples") == 0) ok = (options->samples = atoll(value)) >= 2;
+        else if(strcmp(arg, "--grid") == 0)    ok = (options->grid = atoll(value)) >= 2;
+        else if(strcmp(arg, "--threads") == 0) ok = (options->threads = atoi(value)) >= 1;
+        else if(strcmp(arg, "--output") == 0)  options->outputPath = value;
+        else if(strcmp(arg, "--set") == 0)
+        {
+            ok = strchr(value, '=') != nullptr;
+            options->sets.push_back(value);
+        }
+        else if(strcmp(arg, "--format") == 0)
+        {
+            if(strcmp(value, "csv") == 0)      options->format = Batch_CSV;
+            else if(strcmp(value, "f32") == 0) options->format = Batch_F32;
+            else if(strcmp(value, "f64") == 0) options->format = Batch_F64;
+            else ok = false;
+        }
+        else
+        {
+            ok = false;
+        }
+        
+        if(!ok)
+        {
+            fprintf(stderr, "Invalid argument: %s %s\n", arg, value);
+            return false;
+        }
+    }
+    
+    return options->inputPath != nullptr;
+}
+
+static bool ReadTextFile(const char* path, std::string* out)
+{
+    FILE* file = fopen(path, "rb");
+    if(!file) return false;
+    
+    char buffer[4096];
+    size_t read;
+    while((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        out->append(buffer, read);
+    
+    fclose(file);
+    return true;
+}
+
+// Fills in the input variables for rows [begin, begin + count) of a table
+static void GetTableInputs(const BatchTable* table, const BatchOptions* options, int64_t begin, int64_t count,
+                           double* inputs[Var_Count])
+{
+    const double (*range)[2] = options->range;
+    switch(table->def.kind)
+    {
+        case Def_Explicit:
+        {
+            double step = (range[Var_X][1] - range[Var_X][0]) / (options->samples - 1);
+            for(int64_t i = 0; i < count; ++i)
+                inputs[Var_X][i] = range[Var_X][0] + (begin + i) * step;
+            break;
+        }
+        case Def_Parametric:
+        {
+            double step = (range[Var_T][1] - range[Var_T][0]) / (options->samples - 1);
+            for(int64_t i = 0; i < count; ++i)
+                inputs[Var_T][i] = range[Var_T][0] + (begin + i) * step;
+            break;
+        }
+        case Def_Implicit:
+        case Def_Complex:
+        {
+            double stepX = (range[Var_X][1] - range[Var_X][0]) / (options->grid - 1);
+            double stepY = (range[Var_Y][1] - range[Var_Y][0]) / (options->grid - 1);
+            for(int64_t i = 0; i < count; ++i)
+            {
+                int64_t row = begin + i;
+                inputs[Var_X][i] = range[Var_X][0] + (row % options->grid) * stepX;
+                inputs[Var_Y][i] = range[Var_Y][0] + (row / options->grid) * stepY;
+            }
+            break;
+        }
+        default: break;
+    }
+}
+
+// Evaluates rows [begin, end) of a table and hands each row's columns to emit
+template<typename T>
+static void EvalTableRows(const BatchTable* table, const BatchOptions* options, const double* params,
+                          int64_t begin, int64_t end, T emit)
+{
+    double inputStorage[Var_Count][Batch_EvalRows];
+    double outputStorage[Def_MaxRoots][Batch_EvalRows];
+    double* inputs[Var_Count];
+    double* outputs[Def_MaxRoots];
+    for(int i = 0; i < Var_Count; ++i) inputs[i] = inputStorage[i];
+    for(int i = 0; i < Def_MaxRoots; ++i) outputs[i] = outputStorage[i];
+    
+    for(int64_t chunk = begin; chunk < end; chunk += Batch_EvalRows)
+    {
+        int64_t count = end - chunk < Batch_EvalRows ? end - chunk : Batch_EvalRows;
+        GetTableInputs(table, options, chunk, count, inputs);
+        
+        EvalInput vars[Var_Count];
+        for(int i = 0; i < Var_Count; ++i) vars[i] = EvalArray(inputs[i]);
+        EvalBatch(&table->program, vars, params, count, outputs);
+        
+        for(int64_t i = 0; i < count; ++i)
+        {
+            double row[Batch_MaxColumns];
+            switch(table->def.kind)
+            {
+                case Def_Explicit:
+                    row[0] = inputs[Var_X][i];
+                    row[1] = outputs[0][i];
+                    break;
+                case Def_Parametric:
+                    row[0] = inputs[Var_T][i];
+                    row[1] = outputs[0][i];
+                    row[2] = outputs[1][i];
+                    break;
+                case Def_Complex:
+                    row[0] = inputs[Var_X][i];
+                    row[1] = inputs[Var_Y][i];
+                    row[2] = outputs[0][i];
+                    row[3] = outputs[1][i];
+                    break;
+                default:
+                    row[0] = inputs[Var_X][i];
+                    row[1] = inputs[Var_Y][i];
+                    row[2] = outputs[0][i];
+                    break;
+            }
+            
+            emit(chunk + i, row);
+        }
+    }
+}
+
+static void WriteTableBinaryMapped(const BatchTable* table, const BatchOptions* options, const double* params, uint8_t* base)
+{
+    int numColumns = table->numColumns;
+    bool f32 = options->format == Batch_F32;
+    uint8_t* dst = base + table->byteOffset;
+    
+    ParallelFor(table->rows, Batch_ChunkRows, [&](int64_t begin, int64_t end, int task)
+    {
+        EvalTableRows(table, options, params, begin, end, [&](int64_t row, const double* values)
+        {
+            if(f32)
+            {
+                float* out = (float*)dst + row * numColumns;
+                for(int i = 0; i < numColumns; ++i) out[i] = (float)values[i];
+            }
+            else
+            {
+                double* out = (double*)dst + row * numColumns;
+                for(int i = 0; i < numColumns; ++i) out[i] = values[i];
+            }
+        });
+    }, options->threads);
+}
+
+// Writes the table to a stream, rows are produced in parallel a block at a time
+static bool WriteTableStream(const BatchTable* table, const BatchOptions* options, const double* params, FILE* file)
+{
+    const int64_t blockRows = Batch_ChunkRows * 64;
+    int numColumns = table->numColumns;
+    
+    if(options->format == Batch_CSV)
+    {
+        fprintf(file, "# %s\n%s\n", table->text.c_str(), table->header);
+        
+        std::vector<std::string> chunks;
+        for(int64_t block = 0; block < table->rows; block += blockRows)
+        {
+            int64_t blockEnd = block + blockRows < table->rows ? block + blockRows : table->rows;
+            chunks.assign((blockEnd - block + Batch_ChunkRows - 1) / Batch_ChunkRows, std::string());
+            
+            ParallelFor(blockEnd - block, Batch_ChunkRows, [&](int64_t begin, int64_t end, int task)
+            {
+                std::string* text = &chunks[begin / Batch_ChunkRows];
+                EvalTableRows(table, options, params, block + begin, block + end, [&](int64_t row, const double* values)
+                {
+                    char line[128];
+                    int length = 0;
+                    for(int i = 0; i < numColumns; ++i)
+                        length += snprintf(line + length, sizeof(line) - length, i > 0 ? ",%.17g" : "%.17g", values[i]);
+                    line[length++] = '\n';
+                    text->append(line, length);
+                });
+            }, options->threads);
+            
+            for(const std::string& chunk : chunks)
+            {
+                if(fwrite(chunk.data(), 1, chunk.size(), file) != chunk.size())
+                    return false;
+            }
+        }
+        
+        fprintf(file, "\n");
+        return true;
+    }
+    
+    size_t valueSize = options->format == Batch_F32 ? sizeof(float) : sizeof(double);
+    size_t rowSize = valueSize * numColumns;
+    std::vector<uint8_t> buffer(blockRows * rowSize);
+    for(int64_t block = 0; block < table->rows; block += blockRows)
+    {
+        int64_t blockEnd = block + blockRows < table->rows ? block + blockRows : table->rows;
+        ParallelFor(blockEnd - block, Batch_ChunkRows, [&](int64_t begin, int64_t end, int task)
+        {
+            EvalTableRows(table, options, params, block + begin, block + end, [&](int64_t row, const double* values)
+            {
+                uint8_t* dst = buffer.data() + (row - block) * rowSize;
+                if(valueSize == sizeof(float))
+                {
+                    for(int i = 0; i < numColumns; ++i) ((float*)dst)[i] = (float)values[i];
+                }
+                else
+                {
+                    for(int i = 0; i < numColumns; ++i) ((double*)dst)[i] = values[i];
+                }
+            });
+        }, options->threads);
+        
+        size_t size = (blockEnd - block) * rowSize;
+        if(fwrite(buffer.data(), 1, size, file) != size)
+            return false;
+    }
+    
+    return true;
+}
+
+int RunBatchMode(int argc, char** argv)
+{
+    BatchOptions options;
+    if(!ParseBatchOptions(argc, argv, &options))
+    {
+        fprintf(stderr, "%s", batchUsage);
+        return 1;
+    }
+    
+    std::string source;
+    if(!ReadTextFile(options.inputPath, &source))
+    {
+        fprintf(stderr, "Could not read '%s'\n", options.inputPath);
+        return 1;
+    }
+    
+    // Parameters set from the command line take precedence
+    ParamTable params;
+    std::vector<bool> overridden;
+    for(const std::string& set : options.sets)
+    {
+        size_t equal = set.find('=');
+        double value;
+        if(!EvalConstantExpr(set.c_str() + equal + 1, &value))
+        {
+            fprintf(stderr, "Invalid value in --set %s\n", set.c_str());
+            return 1;
+        }
+        
+        int param = FindOrAddParam(&params, set.c_str(), (int)equal);
+        params.values[param] = value;
+        overridden.resize(params.names.size(), false);
+        overridden[param] = true;
+    }
+    
+    std::vector<BatchTable> tables;
+    std::vector<bool> assigned = overridden;
+    std::vector<bool> usedUnassigned;
+    int lineNumber = 0;
+    size_t lineStart = 0;
+    while(lineStart < source.size())
+    {
+        size_t lineEnd = source.find('\n', lineStart);
+        if(lineEnd == std::string::npos) lineEnd = source.size();
+        std::string line = source.substr(lineStart, lineEnd - lineStart);
+        lineStart = lineEnd + 1;
+        ++lineNumber;
+        
+        size_t first = line.find_first_not_of(" \t\r");
+        if(first == std::string::npos || line[first] == '#') continue;
+        while(!line.empty() && (line.back() == '\r' || line.back() == ' ')) line.pop_back();
+        
+        BatchTable table;
+        table.line = lineNumber;
+        table.text = line;
+        if(!ParseDefinition(line.c_str(), &params, &table.def))
+        {
+            fprintf(stderr, "%s:%d:%d: %s\n", options.inputPath, lineNumber, table.def.errorPos + 1, table.def.error);
+            return 1;
+        }
+        
+        if(table.def.kind == Def_Regression)
+        {
+            fprintf(stderr, "%s:%d: regressions need a data table, skipped\n", options.inputPath, lineNumber);
+            continue;
+        }
+        
+        if(table.def.kind == Def_SlopeField || table.def.kind == Def_VectorField)
+        {
+            fprintf(stderr, "%s:%d: differential equations are only drawn in the plot, skipped\n", options.inputPath, lineNumber);
+            continue;
+        }
+        
+        if(table.def.kind == Def_Iteration)
+        {
+            fprintf(stderr, "%s:%d: iterated maps are only drawn in the plot, skipped\n", options.inputPath, lineNumber);
+            continue;
+        }
+        
+        CompileDefinition(&table.def, &table.program);
+        assigned.resize(params.names.size(), false);
+        usedUnassigned.resize(params.names.size(), false);
+        
+        if(table.def.kind == Def_Assignment || table.def.kind == Def_List)
+        {
+            int param = table.def.param;
+            if(!overridden.empty() && param < (int)overridden.size() && overridden[param]) continue;
+            
+            double vars[Var_Count] = { 0 };
+            params.values[param] = EvalScalar(&table.program, vars, params.values.data());
+            assigned[param] = true;
+            continue;
+        }
+        
+        switch(table.def.kind)
+        {
+            case Def_Explicit:   table.rows = options.samples;             table.numColumns = 2; table.header = "x,y";   break;
+            case Def_Parametric: table.rows = options.samples;             table.numColumns = 3; table.header = "t,x,y"; break;
+            case Def_Complex:    table.rows = options.grid * options.grid; table.numColumns = 4; table.header = "x,y,re,im"; break;
+            default:             table.rows = options.grid * options.grid; table.numColumns = 3; table.header = "x,y,f"; break;
+        }
+        
+        for(size_t i = 0; i < params.names.size(); ++i)
+        {
+            for(uint32_t r = 0; r < table.def.numRoots && !assigned[i]; ++r)
+                if(AstDependsOn(&table.def.ast, table.def.roots[r], Op_Param, (uint32_t)i)) usedUnassigned[i] = true;
+        }
+        
+        table.params = params.values;
+        tables.push_back(std::move(table));
+    }
+    
+    for(size_t i = 0; i < usedUnassigned.size(); ++i)
+    {
+        if(usedUnassigned[i])
+            fprintf(stderr, "Warning: parameter '%s' used before it has a value, using 0\n", params.names[i].c_str());
+    }
+    
+    // Only now the worker threads are spun up
+    InitJobSystem(options.threads > 0 ? options.threads - 1 : -1);
+    
+    size_t valueSize = options.format == Batch_F32 ? sizeof(float) : sizeof(double);
+    uint64_t totalBytes = 0;
+    for(BatchTable& table : tables)
+    {
+        table.byteOffset = totalBytes;
+        totalBytes += (uint64_t)table.rows * table.numColumns * valueSize;
+    }
+    
+    if(!options.quiet)
+    {
+        for(const BatchTable& table : tables)
+        {
+            fprintf(stderr, "line %d: %lld rows of %s", table.line, (long long)table.rows, table.header);
+            if(options.format != Batch_CSV)
+                fprintf(stderr, " at byte %llu", (unsigned long long)table.byteOffset);
+            fprintf(stderr, "  (%s)\n", table.text.c_str());
+        }
+    }
+    
+    bool toStdout = strcmp(options.outputPath, "-") == 0;
+    bool ok = true;
+    
+    if(options.format != Batch_CSV && !toStdout)
+    {
+        MappedFile output;
+        ok = MapFileWrite(options.outputPath, totalBytes, &output);
+        if(ok)
+        {
+            for(const BatchTable& table : tables)
+                WriteTableBinaryMapped(&table, &options, table.params.data(), (uint8_t*)output.data);
+            UnmapFile(&output);
+        }
+    }
+    else
+    {
+        FILE* file = stdout;
+        if(toStdout)
+        {
+            if(options.format != Batch_CSV) SetStdoutBinary();
+        }
+        else
+        {
+            file = fopen(options.outputPath, "wb");
+        }
+        
+        ok = file != nullptr;
+        for(size_t i = 0; ok && i < tables.size(); ++i)
+            ok = WriteTableStream(&tables[i], &options, tables[i].params.data(), file);
+        
+        if(file && !toStdout) ok &= fclose(file) == 0;
+        else if(file) ok &= fflush(file) == 0;
+    }
+    
+    if(!ok) fprintf(stderr, "Could not write '%s'\n", options.outputPath);
+    
+    ShutdownJobSystem();
+    return ok ? 0 : 1;
+}
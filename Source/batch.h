@@ -0,0 +1,6 @@
+#pragma once
+
+// Command line batch evaluation, no window or GPU is created.
+// Usage: plotter --batch <expression file> [options], see batch.cpp
+// args should not include the program name and "--batch".
+int RunBatchMode(int argc, char** argv);
@@ -0,0 +1,945 @@
+// Headless benchmark of the evaluation engine. Runs a fixed corpus of
+// expressions through the parser, the compiler (with and without
+// optimizations) and the interpreter paths, then measures how batch
+// evaluation scales with the number of threads. Numbers are printed
+// as a table, and optionally written as JSON so they can be compared
+// between versions. The "folded a" column is the batch path again, with the
+// parameter a compiled in as a constant (see CompileSpecialized) instead of
+// loaded for every batch.
+//
+// The ingestion cases measure how fast live data can be moved from a
+// producer thread to the render thread, through the stream ring or through
+// a shared memory feed. The fitting cases time least squares fits of a
+// linear and two nonlinear models on a synthetic table of the same size as
+// the point grid. The binning cases time histograms of the grid, and the
+// rebinning of a zoom sequence from the cache.
+//
+// --check runs the differential checks of check.cpp instead of timing
+// anything, and fails when the evaluation paths disagree.
+//
+// Usage: plotter_bench [--points N] [--repeat N] [--threads 1,2,4] [--filter text] [--json file] [--check]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include "core.h"
+#include "jobs.h"
+#include "check.h"
+#include "parser.h"
+#include "compiler.h"
+#include "interpreter.h"
+#include "streaming.h"
+#include "shmfeed.h"
+#include "fit.h"
+#include "histogram.h"
+#include "ode.h"
+
+struct BenchCase
+{
+    const char* category;
+    const char* text;
+};
+
+static const BenchCase benchCorpus[] =
+{
+    { "polynomial", "y = 3x^5 - 2x^4 + x^3 - 7x^2 + 4x - 1" },
+    { "polynomial", "y = (x-1)(x+2)(x-3)(x+4)(x-5)/120" },
+    { "trig",       "y = sin(x) + cos(2x)/2 + sin(3x)/3 + cos(4x)/4" },
+    { "trig",       "y = sin(x)^2 cos(a x) + tan(x/4) + atan2(x, a)" },
+    { "piecewise",  "y = {x<0: -x, x<2: x^2, 4}" },
+    { "piecewise",  "y = {sin(x) > 0: sqrt(abs(x)), -ln(1 + x^2)}" },
+    { "implicit",   "x^2 + y^2 = 25" },
+    { "implicit",   "sin(x y) = cos(x) + sin(y)" },
+    { "parametric", "(cos(3t) cos(t), cos(3t) sin(t))" },
+    { "parametric", "(t - a sin(t), 1 - a cos(t))" },
+    { "polar",      "r = 1 + cos(7t) / (a + 3)" },
+    { "calculus",   "y = integral(exp(-x^2), 0, x)" },
+    { "calculus",   "y = sum(n, 1, 20, sin(n x)/n)" },
+    { "complex",    "f(z) = (z^3 - 1)/(z^2 + a i)" },
+    { "complex",    "f(z) = sin(z) exp(1/z)" },
+};
+
+struct ThreadResult
+{
+    int threads;
+    double nsPerPoint;
+    double pointsPerSecond;
+    double pointsPerSecondPerCore;
+    double speedup;
+};
+
+struct BenchResult
+{
+    const BenchCase* benchCase;
+    const char* kind;
+    double parseNs;
+    double compileNs;
+    double compileUnoptimizedNs;
+    uint32_t instructions;
+    uint32_t instructionsUnoptimized;
+    uint32_t registers;
+    double scalarNsPerPoint;
+    double batchUnoptimizedNsPerPoint;
+    double batchNsPerPoint;
+    double specializeNs;  // Compiling with the parameters folded, see CompileSpecialized
+    uint32_t instructionsSpecialized;
+    double batchSpecializedNsPerPoint;
+    bool mismatch;
+    std::vector<ThreadResult> threads;
+};
+
+struct IngestResult
+{
+    const char* name;
+    double rowsPerSecond;
+};
+
+struct OdeBenchResult
+{
+    const char* name;
+    double stepsPerSecond;  // Over all lanes
+};
+
+struct BinningResult
+{
+    const char* name;
+    double ms;
+    int64_t rowsRead;
+};
+
+struct FitCase
+{
+    const char* text;
+    const char* params[3];
+    double start[3];
+};
+
+static const FitCase fitCases[] =
+{
+    { "y1 ~ a x1^2 + b x1 + c", { "a", "b", "c" }, { 1.0, 1.0, 1.0 } },
+    { "y1 ~ a exp(k x1) + c",   { "a", "k", "c" }, { 1.0, -0.2, 0.0 } },
+    { "y2 ~ A sin(w x1 + f)",   { "A", "w", "f" }, { 1.0, 1.9, 0.0 } },
+};
+
+struct FitBenchResult
+{
+    const FitCase* fitCase;
+    FitResult fit;
+    bool ok;
+};
+
+struct BenchOptions
+{
+    int64_t points;
+    int repeat;
+    std::vector<int> threadCounts;
+    const char* filter;
+    const char* jsonPath;
+    bool check;
+};
+
+// Inputs shared by all cases of the same kind
+struct BenchInputs
+{
+    std::vector<double> gridX;
+    std::vector<double> gridY;
+};
+
+static const char* DefinitionKindName(DefinitionKind kind)
+{
+    switch(kind)
+    {
+        case Def_Explicit:   return "explicit";
+        case Def_Implicit:   return "implicit";
+        case Def_Parametric: return "parametric";
+        case Def_Assignment: return "assignment";
+        case Def_Regression: return "regression";
+        case Def_SlopeField: return "slope field";
+        case Def_VectorField: return "vector field";
+        case Def_Complex:    return "complex";
+        case Def_Iteration:  return "iteration";
+        case Def_List:       return "list";
+        default:             return "invalid";
+    }
+}
+
+static void GetInputs(DefinitionKind kind, BenchInputs* inputs, int64_t count, EvalInput vars[Var_Count])
+{
+    for(int i = 0; i < Var_Count; ++i)
+        vars[i] = EvalConstant(0.0);
+    
+    switch(kind)
+    {
+        case Def_Implicit:
+        case Def_Complex:
+        {
+            // Square grid over [-10, 10]^2, flattened
+            vars[Var_X] = EvalArray(inputs->gridX.data());
+            vars[Var_Y] = EvalArray(inputs->gridY.data());
+            break;
+        }
+        case Def_Parametric:
+        {
+            vars[Var_T] = EvalRamp(0.0, 2.0 * 3.14159265358979323846 / count);
+            break;
+        }
+        default:
+        {
+            vars[Var_X] = EvalRamp(-10.0, 20.0 / count);
+            break;
+        }
+    }
+}
+
+// Best time out of a few runs, in nanoseconds
+template<typename T>
+static double MeasureNs(int repeat, T func)
+{
+    double best = 1e300;
+    for(int i = 0; i < repeat; ++i)
+    {
+        uint64_t start = GetTimeNs();
+        func();
+        double elapsed = (double)(GetTimeNs() - start);
+        if(elapsed < best) best = elapsed;
+    }
+    
+    return best;
+}
+
+static bool NearlyEqual(double a, double b)
+{
+    if(isnan(a) || isnan(b)) return isnan(a) && isnan(b);
+    if(a == b) return true;
+    return fabs(a - b) <= 1e-9 * (fabs(a) > fabs(b) ? fabs(a) : fabs(b));
+}
+
+static void RunBenchCase(const BenchCase* benchCase, const BenchOptions* options, BenchInputs* inputs, BenchResult* result)
+{
+    result->benchCase = benchCase;
+    
+    ParamTable params;
+    int a = FindOrAddParam(&params, "a", 1);
+    params.values[a] = 1.5;
+    
+    Definition def;
+    const int parseRepeat = 1000;
+    double parseTotal = MeasureNs(options->repeat, [&]
+    {
+        for(int i = 0; i < parseRepeat; ++i)
+            ParseDefinition(benchCase->text, &params, &def);
+    });
+    result->parseNs = parseTotal / parseRepeat;
+    result->kind = DefinitionKindName(def.kind);
+    
+    if(def.kind == Def_Invalid)
+    {
+        fprintf(stderr, "Could not parse '%s': %s\n", benchCase->text, def.error);
+        return;
+    }
+    
+    Program program;
+    Program unoptimized;
+    const int compileRepeat = 1000;
+    result->compileNs = MeasureNs(options->repeat, [&]
+    {
+        for(int i = 0; i < compileRepeat; ++i)
+            CompileDefinition(&def, &program, true);
+    }) / compileRepeat;
+    result->compileUnoptimizedNs = MeasureNs(options->repeat, [&]
+    {
+        for(int i = 0; i < compileRepeat; ++i)
+            CompileDefinition(&def, &unoptimized, false);
+    }) / compileRepeat;
+    
+    result->instructions = (uint32_t)program.code.size();
+    result->instructionsUnoptimized = (uint32_t)unoptimized.code.size();
+    result->registers = program.numRegs;
+    
+    int64_t count = options->points;
+    EvalInput vars[Var_Count];
+    GetInputs(def.kind, inputs, count, vars);
+    
+    std::vector<double> outputStorage[Program_MaxOutputs];
+    double* outputs[Program_MaxOutputs];
+    for(uint32_t i = 0; i < program.numOutputs; ++i)
+    {
+        outputStorage[i].resize(count);
+        outputs[i] = outputStorage[i].data();
+    }
+    
+    // Scalar interpreter, on a subset of the points since it's slow
+    int64_t scalarCount = count < 100000 ? count : 100000;
+    std::vector<double> scalarResults(scalarCount);
+    double scalarNs = MeasureNs(options->repeat, [&]
+    {
+        for(int64_t i = 0; i < scalarCount; ++i)
+        {
+            double point[Var_Count];
+            for(int v = 0; v < Var_Count; ++v)
+                point[v] = vars[v].array ? vars[v].array[i] : vars[v].start + i * vars[v].step;
+            scalarResults[i] = EvalScalar(&program, point, params.values.data());
+        }
+    });
+    result->scalarNsPerPoint = scalarNs / scalarCount;
+    
+    result->batchUnoptimizedNsPerPoint = MeasureNs(options->repeat, [&]
+    {
+        EvalBatch(&unoptimized, vars, params.values.data(), count, outputs);
+    }) / count;
+    
+    result->batchNsPerPoint = MeasureNs(options->repeat, [&]
+    {
+        EvalBatch(&program, vars, params.values.data(), count, outputs);
+    }) / count;
+    
+    // Optimized and unoptimized programs, scalar and batch paths should all agree
+    result->mismatch = false;
+    for(int64_t i = 0; i < scalarCount; ++i)
+        result->mismatch |= !NearlyEqual(scalarResults[i], outputs[0][i]);
+    
+    // The parameter folded instead of loaded from a register, like the curves do while it doesn't change
+    Program specialized;
+    result->specializeNs = MeasureNs(options->repeat, [&]
+    {
+        for(int i = 0; i < compileRepeat; ++i)
+            CompileSpecialized(&def.ast, def.roots, def.numRoots, params.values.data(), &specialized);
+    }) / compileRepeat;
+    result->instructionsSpecialized = (uint32_t)specialized.code.size();
+    result->batchSpecializedNsPerPoint = MeasureNs(options->repeat, [&]
+    {
+        EvalBatch(&specialized, vars, params.values.data(), count, outputs);
+    }) / count;
+    for(int64_t i = 0; i < scalarCount; ++i)
+        result->mismatch |= !NearlyEqual(scalarResults[i], outputs[0][i]);
+    
+    double single = 0.0;
+    for(int threads : options->threadCounts)
+    {
+        double ns = MeasureNs(options->repeat, [&]
+        {
+            EvalBatchParallel(&program, vars, params.values.data(), count, outputs, threads);
+        });
+        
+        ThreadResult t;
+        t.threads = threads;
+        t.nsPerPoint = ns / count;
+        t.pointsPerSecond = count / (ns * 1e-9);
+        t.pointsPerSecondPerCore = t.pointsPerSecond / threads;
+        if(single == 0.0) single = t.pointsPerSecond / threads;
+        t.speedup = t.pointsPerSecond / single;
+        result->threads.push_back(t);
+    }
+}
+
+// Producer thread -> ring -> rolling window, like a live stream minus the pipe
+static double BenchStreamRing(int64_t rows)
+{
+    const uint32_t channels = 2;
+    const int64_t block = 4096;
+    
+    SampleRing ring;
+    InitSampleRing(&ring, channels, Stream_RingRecords);
+    StreamWindow window;
+    InitStreamWindow(&window, channels, 1 << 20);
+    
+    uint64_t start = GetTimeNs();
+    std::thread producer([&]()
+    {
+        std::vector<double> records(block * channels);
+        for(int64_t row = 0; row < rows; row += block)
+        {
+            int64_t count = std::min(block, rows - row);
+            for(int64_t i = 0; i < count; ++i)
+            {
+                records[i * channels + 0] = (double)(row + i);
+                records[i * channels + 1] = sin((double)(row + i));
+            }
+            
+            for(int64_t pushed = 0; pushed < count;)
+                pushed += RingPush(&ring, records.data() + pushed * channels, count - pushed);
+        }
+    });
+    
+    while(window.total < rows)
+    {
+        uint64_t count = RingReadable(&ring);
+        AppendToWindow(&window, &ring, count);
+        RingConsume(&ring, count);
+        if(count == 0) std::this_thread::yield();
+    }
+    
+    producer.join();
+    double seconds = (GetTimeNs() - start) / 1e9;
+    FreeSampleRing(&ring);
+    return rows / seconds;
+}
+
+// Shared memory feed with two float columns and a double one. The consumer
+// copies the new rows of the float columns like the GPU uploads would, and
+// holds the producer back so every row goes through (the real protocol doesn't).
+static double BenchShmFeed(int64_t rows)
+{
+    const int64_t capacity = 1 << 20;
+    const int64_t block = 4096;
+    const uint32_t types[] = { PlotterShm_F32, PlotterShm_F32, PlotterShm_F64 };
+    const uint32_t columnCount = ArrayCount(types);
+    
+    uint64_t size = PlotterShmAlign(sizeof(PlotterShmHeader));
+    uint64_t offsets[columnCount];
+    for(uint32_t c = 0; c < columnCount; ++c)
+    {
+        offsets[c] = size;
+        size = PlotterShmAlign(size + capacity * PlotterShmTypeSize(types[c]));
+    }
+    
+    SharedMemory memory;
+    if(!CreateSharedMemory("/plotter_bench", size, &memory)) return 0.0;
+    
+    PlotterShmHeader* header = (PlotterShmHeader*)memory.data;
+    std::atomic<uint64_t>* sequence = reinterpret_cast<std::atomic<uint64_t>*>(&header->schemaSequence);
+    std::atomic<uint64_t>* cursor = reinterpret_cast<std::atomic<uint64_t>*>(&header->writeCursor);
+    sequence->store(1);
+    header->magic = PlotterShm_Magic;
+    header->version = PlotterShm_Version;
+    header->headerSize = sizeof(PlotterShmHeader);
+    header->segmentSize = size;
+    header->capacity = capacity;
+    header->columnCount = columnCount;
+    for(uint32_t c = 0; c < columnCount; ++c)
+    {
+        snprintf(header->columns[c].name, sizeof(header->columns[c].name), "c%u", c);
+        header->columns[c].type = types[c];
+        header->columns[c].offset = offsets[c];
+    }
+    sequence->store(2, std::memory_order_release);
+    
+    ShmFeed* feed = OpenShmFeed("/plotter_bench", nullptr, 0);
+    if(!feed)
+    {
+        CloseSharedMemory(&memory);
+        return 0.0;
+    }
+    
+    std::atomic<int64_t> consumed(0);
+    std::vector<float> uploaded(capacity * 2);
+    
+    uint64_t start = GetTimeNs();
+    std::thread producer([&]()
+    {
+        float* xs = (float*)((char*)memory.data + offsets[0]);
+        float* ys = (float*)((char*)memory.data + offsets[1]);
+        double* zs = (double*)((char*)memory.data + offsets[2]);
+        for(int64_t row = 0; row < rows; row += block)
+        {
+            int64_t count = std::min(block, rows - row);
+            while(row + count - consumed.load(std::memory_order_acquire) > capacity)
+                std::this_thread::yield();
+            
+            for(int64_t i = 0; i < count; ++i)
+            {
+                int64_t slot = (row + i) % capacity;
+                xs[slot] = (float)(row + i);
+                ys[slot] = (float)sin((double)(row + i));
+                zs[slot] = cos((double)(row + i));
+            }
+            cursor->store(row + count, std::memory_order_release);
+        }
+    });
+    
+    while(feed->total < rows)
+    {
+        int64_t first = feed->total;
+        if(UpdateShmFeed(feed) <= 0)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        
+        for(int64_t row = first; row < feed->total;)
+        {
+            int64_t slot = row % capacity;
+            int64_t count = std::min(feed->total - row, capacity - slot);
+            memcpy(uploaded.data() + slot, ShmFeedColumn(feed, 0) + slot, count * sizeof(float));
+            memcpy(uploaded.data() + capacity + slot, ShmFeedColumn(feed, 1) + slot, count * sizeof(float));
+            row += count;
+        }
+        consumed.store(feed->total, std::memory_order_release);
+    }
+    
+    producer.join();
+    double seconds = (GetTimeNs() - start) / 1e9;
+    CloseShmFeed(feed);
+    CloseSharedMemory(&memory);
+    return rows / seconds;
+}
+
+// Parsing of the text protocol, in reader sized blocks
+static double BenchStreamText(int64_t rows)
+{
+    std::string text;
+    char line[64];
+    for(int64_t i = 0; i < rows; ++i)
+    {
+        int length = snprintf(line, sizeof(line), "%lld %.6g\n", (long long)i, sin((double)i) * 100.0);
+        text.append(line, length);
+    }
+    
+    std::vector<double> values;
+    int64_t parsed = 0;
+    uint64_t start = GetTimeNs();
+    for(int64_t offset = 0; offset < (int64_t)text.size();)
+    {
+        int64_t size = std::min((int64_t)text.size() - offset, (int64_t)1 << 16);
+        int64_t consumed = ParseStreamText(text.data() + offset, size, 2, &values);
+        if(consumed == 0) break;
+        parsed += values.size() / 2;
+        offset += consumed;
+    }
+    double seconds = (GetTimeNs() - start) / 1e9;
+    
+    return parsed == rows ? parsed / seconds : 0.0;
+}
+
+// Histograms over the columns of the grid, with the best time of a few runs
+static void BenchBinning(const BenchOptions* options, const BenchInputs* inputs, std::vector<BinningResult>* results)
+{
+    const double* xs = inputs->gridX.data();
+    const double* ys = inputs->gridY.data();
+    int64_t rows = options->points;
+    std::vector<int64_t> counts;
+    
+    auto best = [&](const char* name, int64_t rowsRead, auto run)
+    {
+        double ms = INFINITY;
+        for(int r = 0; r < options->repeat; ++r)
+        {
+            uint64_t start = GetTimeNs();
+            run();
+            ms = std::min(ms, (GetTimeNs() - start) / 1e6);
+        }
+        results->push_back({ name, ms, rowsRead });
+    };
+    
+    best("histogram, 1024 bins", rows, [&]() { ComputeHistogram(xs, rows, -10.0, 10.0, 1024, &counts); });
+    best("histogram, fine bins", rows, [&]() { ComputeHistogram(xs, rows, -10.0, 10.0, Histogram_FineBins, &counts); });
+    best("2D bins, 256 x 256", rows, [&]() { ComputeHistogram2D(xs, ys, rows, -10.0, 10.0, -10.0, 10.0, 256, 256, &counts); });
+    
+    // Zooming in 20% per step around a point off center, like the mouse wheel
+    HistogramCache cache;
+    InitHistogramCache(&cache, xs, rows, -10.0, 10.0);
+    std::vector<double> heights;
+    const int steps = 40;
+    double ms = 0.0;
+    for(int step = 0; step < steps; ++step)
+    {
+        double width = 20.0 * pow(0.8, step);
+        uint64_t start = GetTimeNs();
+        QueryHistogram(&cache, 1.234 - width * 0.3, 1.234 + width * 0.7, 200, &heights);
+        ms += (GetTimeNs() - start) / 1e6;
+    }
+    results->push_back({ "zoom step, 200 bins (cached)", ms / steps, (cache.rescans - 1) * rows / steps });
+    
+    best("density, 200 bins", 0, [&]() { QueryDensity(&cache, -10.0, 10.0, 200, 0.0, &heights); });
+}
+
+// Two columns from known models with a little deterministic noise, so the
+// nonlinear fits take a realistic number of iterations
+static void BenchFits(int64_t rows, std::vector<FitBenchResult>* results)
+{
+    std::vector<double> x1(rows), y1(rows), y2(rows);
+    for(int64_t i = 0; i < rows; ++i)
+    {
+        double x = -5.0 + 10.0 * i / rows;
+        double noise = 0.01 * sin(i * 12.9898);
+        x1[i] = x;
+        y1[i] = 2.5 * exp(-0.7 * x) + 1.0 + noise;
+        y2[i] = 1.5 * sin(2.0 * x + 0.3) + noise;
+    }
+    
+    DataTable table;
+    table.rowCount = rows;
+    const char* names[] = { "x1", "y1", "y2" };
+    const double* columns[] = { x1.data(), y1.data(), y2.data() };
+    for(int c = 0; c < 3; ++c)
+    {
+        DataColumn column = {};
+        snprintf(column.name, sizeof(column.name), "%s", names[c]);
+        column.values = columns[c];
+        table.columns.push_back(column);
+    }
+    
+    for(size_t i = 0; i < ArrayCount(fitCases); ++i)
+    {
+        const FitCase* fitCase = &fitCases[i];
+        ParamTable params;
+        for(int p = 0; p < 3; ++p)
+        {
+            const char* name = fitCase->params[p];
+            params.values[FindOrAddParam(&params, name, (int)strlen(name))] = fitCase->start[p];
+        }
+        
+        FitBenchResult result = {};
+        result.fitCase = fitCase;
+        char error[256];
+        result.ok = FitRegression(fitCase->text, &table, &params, &result.fit, error, sizeof(error));
+        if(!result.ok) fprintf(stderr, "%s: %s\n", fitCase->text, error);
+        results->push_back(result);
+    }
+}
+
+// Concentric circles from many start points at once, the lanes of the solver
+static void BenchOde(int starts, std::vector<OdeBenchResult>* results)
+{
+    ParamTable params;
+    Definition def;
+    Program program;
+    ParseDefinition("(x', y') = (-y, x)", &params, &def);
+    CompileDefinition(&def, &program);
+    
+    std::vector<double> points(2 * starts);
+    for(int i = 0; i < starts; ++i)
+    {
+        points[2 * i] = 0.01 + 1.5 * i / starts;
+        points[2 * i + 1] = 0.0;
+    }
+    
+    static const char* names[Ode_MethodCount] = { "RK4", "Dormand-Prince" };
+    for(int method = 0; method < Ode_MethodCount; ++method)
+    {
+        OdeOptions options = { (OdeMethod)method, { -2.0, 2.0, -2.0, 2.0 }, 0.005, 1e-8, 2000 };
+        std::vector<double> xs, ys;
+        OdeStats stats = {};
+        uint64_t start = GetTimeNs();
+        SolveOde(&program, params.values.data(), points.data(), starts, &options, &xs, &ys, &stats);
+        double seconds = (GetTimeNs() - start) * 1e-9;
+        results->push_back({ names[method], stats.steps / seconds });
+    }
+}
+
+// Cost of double-double over double, single threaded on the explicit inputs
+static void BenchPrecision(const BenchOptions* options, BenchInputs* inputs)
+{
+    static const char* texts[] =
+    {
+        "y = x^7 - 7x^6 + 21x^5 - 35x^4 + 35x^3 - 21x^2 + 7x - 1",
+        "y = (x^2 + 1) / (x - 0.5) + sqrt(abs(x))",
+        "y = sin(x) exp(-x^2 / 10)",
+        "y = atan(x) + ln(x^2 + 1)",
+    };
+    
+    int64_t count = options->points / 16;
+    std::vector<double> values(count);
+    double* outputs[1] = { values.data() };
+    printf("\n%-50s %10s %10s %8s\n", "double-double", "double", "dd", "ratio");
+    printf("%-50s %10s %10s\n", "", "(ns/pt)", "(ns/pt)");
+    for(const char* text : texts)
+    {
+        ParamTable params;
+        Definition def;
+        Program program;
+        if(!ParseDefinition(text, &params, &def)) continue;
+        CompileDefinition(&def, &program);
+        
+        EvalInput vars[Var_Count];
+        GetInputs(def.kind, inputs, count, vars);
+        double plain = MeasureNs(options->repeat, [&]() { EvalBatch(&program, vars, params.values.data(), count, outputs); }) / count;
+        double dd = MeasureNs(options->repeat, [&]() { EvalBatchDD(&program, vars, nullptr, params.values.data(), count, outputs); }) / count;
+        printf("%-50.50s %10.2f %10.2f %7.1fx\n", text, plain, dd, dd / plain);
+    }
+}
+
+static void WriteJsonString(FILE* file, const char* str)
+{
+    fputc('"', file);
+    for(const char* c = str; *c; ++c)
+    {
+        if(*c == '"' || *c == '\\') fprintf(file, "\\%c", *c);
+        else if((unsigned char)*c < 0x20) fprintf(file, "\\u%04x", *c);
+        else fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+static bool WriteJson(const char* path, const BenchOptions* options, const std::vector<BenchResult>& results,
+                      const std::vector<IngestResult>& ingestion, const std::vector<BinningResult>& binning,
+                      const std::vector<FitBenchResult>& fits)
+{
+    FILE* file = fopen(path, "wb");
+    if(!file) return false;
+    
+    fprintf(file, "{\n  \"version\": \"%s\",\n", Plotter_Version);
+    fprintf(file, "  \"points\": %lld,\n", (long long)options->points);
+    fprintf(file, "  \"hardware_threads\": %u,\n", std::thread::hardware_concurrency());
+    fprintf(file, "  \"batch_size\": %d,\n", Eval_BatchSize);
+    fprintf(file, "  \"cases\": [\n");
+    
+    for(size_t i = 0; i < results.size(); ++i)
+    {
+        const BenchResult* r = &results[i];
+        fprintf(file, "    {\n      \"category\": ");
+        WriteJsonString(file, r->benchCase->category);
+        fprintf(file, ",\n      \"expression\": ");
+        WriteJsonString(file, r->benchCase->text);
+        fprintf(file, ",\n      \"kind\": \"%s\",\n", r->kind);
+        fprintf(file, "      \"parse_ns\": %.1f,\n", r->parseNs);
+        fprintf(file, "      \"compile_ns\": %.1f,\n", r->compileNs);
+        fprintf(file, "      \"compile_unoptimized_ns\": %.1f,\n", r->compileUnoptimizedNs);
+        fprintf(file, "      \"instructions\": %u,\n", r->instructions);
+        fprintf(file, "      \"instructions_unoptimized\": %u,\n", r->instructionsUnoptimized);
+        fprintf(file, "      \"registers\": %u,\n", r->registers);
+        fprintf(file, "      \"scalar_ns_per_point\": %.3f,\n", r->scalarNsPerPoint);
+        fprintf(file, "      \"batch_unoptimized_ns_per_point\": %.3f,\n", r->batchUnoptimizedNsPerPoint);
+        fprintf(file, "      \"batch_ns_per_point\": %.3f,\n", r->batchNsPerPoint);
+        fprintf(file, "      \"specialize_ns\": %.1f,\n", r->specializeNs);
+        fprintf(file, "      \"instructions_specialized\": %u,\n", r->instructionsSpecialized);
+        fprintf(file, "      \"batch_specialized_ns_per_point\": %.3f,\n", r->batchSpecializedNsPerPoint);
+        fprintf(file, "      \"jit_ns_per_point\": null,\n");
+        fprintf(file, "      \"results_match\": %s,\n", r->mismatch ? "false" : "true");
+        fprintf(file, "      \"threads\": [");
+        for(size_t j = 0; j < r->threads.size(); ++j)
+        {
+            const ThreadResult* t = &r->threads[j];
+            fprintf(file, "%s\n        { \"threads\": %d, \"ns_per_point\": %.3f, \"points_per_second\": %.0f, "
+                    "\"points_per_second_per_core\": %.0f, \"speedup\": %.2f }",
+                    j > 0 ? "," : "", t->threads, t->nsPerPoint, t->pointsPerSecond, t->pointsPerSecondPerCore, t->speedup);
+        }
+        fprintf(file, "\n      ]\n    }%s\n", i + 1 < results.size() ? "," : "");
+    }
+    
+    fprintf(file, "  ],\n  \"ingestion\": [");
+    for(size_t i = 0; i < ingestion.size(); ++i)
+    {
+        fprintf(file, "%s\n    { \"name\": ", i > 0 ? "," : "");
+        WriteJsonString(file, ingestion[i].name);
+        fprintf(file, ", \"rows_per_second\": %.0f }", ingestion[i].rowsPerSecond);
+    }
+    
+    fprintf(file, "\n  ],\n  \"binning\": [");
+    for(size_t i = 0; i < binning.size(); ++i)
+    {
+        fprintf(file, "%s\n    { \"name\": ", i > 0 ? "," : "");
+        WriteJsonString(file, binning[i].name);
+        fprintf(file, ", \"ms\": %.4f, \"rows_read\": %lld }", binning[i].ms, (long long)binning[i].rowsRead);
+    }
+    
+    fprintf(file, "\n  ],\n  \"fitting\": [");
+    for(size_t i = 0; i < fits.size(); ++i)
+    {
+        const FitResult* fit = &fits[i].fit;
+        fprintf(file, "%s\n    { \"regression\": ", i > 0 ? "," : "");
+        WriteJsonString(file, fits[i].fitCase->text);
+        if(!fits[i].ok)
+        {
+            fprintf(file, ", \"ok\": false }");
+            continue;
+        }
+        fprintf(file, ", \"ok\": true, \"linear\": %s, \"iterations\": %d, \"rows\": %lld, \"ms\": %.3f, "
+                "\"r_squared\": %.9f, \"converged\": %s }", fit->linear ? "true" : "false", fit->iterations,
+                (long long)fit->rows, fit->seconds * 1e3, fit->rSquared, fit->converged ? "true" : "false");
+    }
+    fprintf(file, "\n  ]\n}\n");
+    fclose(file);
+    return true;
+}
+
+static void PrintUsage()
+{
+    printf("Usage: plotter_bench [--points N] [--repeat N] [--threads 1,2,4] [--filter text] [--json file] [--check]\n");
+}
+
+int main(int argc, char** argv)
+{
+    int hardwareThreads = (int)std::thread::hardware_concurrency();
+    if(hardwareThreads < 1) hardwareThreads = 1;
+    
+    BenchOptions options;
+    options.points = 1 << 20;
+    options.repeat = 5;
+    options.filter = nullptr;
+    options.jsonPath = nullptr;
+    options.check = false;
+    
+    for(int i = 1; i < argc; ++i)
+    {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if(strcmp(arg, "--points") == 0 && hasValue)       options.points = atoll(argv[++i]);
+        else if(strcmp(arg, "--repeat") == 0 && hasValue)  options.repeat = atoi(argv[++i]);
+        else if(strcmp(arg, "--filter") == 0 && hasValue)  options.filter = argv[++i];
+        else if(strcmp(arg, "--json") == 0 && hasValue)    options.jsonPath = argv[++i];
+        else if(strcmp(arg, "--check") == 0)               options.check = true;
+        else if(strcmp(arg, "--threads") == 0 && hasValue)
+        {
+            for(char* s = argv[++i]; *s;)
+            {
+                int threads = (int)strtol(s, &s, 10);
+                if(threads > 0) options.threadCounts.push_back(threads);
+                if(*s == ',') ++s;
+                else break;
+            }
+        }
+        else
+        {
+            PrintUsage();
+            return strcmp(arg, "--help") == 0 ? 0 : 1;
+        }
+    }
+    
+    if(options.points < Eval_BatchSize) options.points = Eval_BatchSize;
+    if(options.repeat < 1) options.repeat = 1;
+    
+    if(options.threadCounts.empty())
+    {
+        for(int threads = 1; threads < hardwareThreads; threads *= 2)
+            options.threadCounts.push_back(threads);
+        options.threadCounts.push_back(hardwareThreads);
+    }
+    
+    int maxThreads = 1;
+    for(int threads : options.threadCounts)
+        if(threads > maxThreads) maxThreads = threads;
+    InitJobSystem(maxThreads - 1);
+    
+    if(options.check)
+    {
+        int mismatches = RunEngineChecks();
+        ShutdownJobSystem();
+        return mismatches == 0 ? 0 : 1;
+    }
+    
+    BenchInputs inputs;
+    int64_t side = (int64_t)sqrt((double)options.points);
+    options.points = side * side;
+    inputs.gridX.resize(options.points);
+    inputs.gridY.resize(options.points);
+    for(int64_t j = 0; j < side; ++j)
+    {
+        for(int64_t i = 0; i < side; ++i)
+        {
+            inputs.gridX[j * side + i] = -10.0 + 20.0 * i / side;
+            inputs.gridY[j * side + i] = -10.0 + 20.0 * j / side;
+        }
+    }
+    
+    printf("Plotter %s, %lld points, %d hardware threads, best of %d\n", Plotter_Version, (long long)options.points, hardwareThreads, options.repeat);
+    printf("JIT: not available, only the interpreter paths are measured\n\n");
+    printf("%-11s %-50s %8s %8s %9s %8s %8s %8s %9s %8s\n",
+           "category", "expression", "parse", "compile", "instrs", "scalar", "batch-O0", "batch", "folded a", "best MT");
+    printf("%-11s %-50s %8s %8s %9s %8s %8s %8s %9s %8s\n",
+           "", "", "(us)", "(us)", "(O0->O)", "(ns/pt)", "(ns/pt)", "(ns/pt)", "(ns/pt)", "(ns/pt)");
+    
+    std::vector<BenchResult> results;
+    for(size_t i = 0; i < ArrayCount(benchCorpus); ++i)
+    {
+        const BenchCase* benchCase = &benchCorpus[i];
+        if(options.filter && !strstr(benchCase->text, options.filter) && !strstr(benchCase->category, options.filter))
+            continue;
+        
+        BenchResult result = {};
+        RunBenchCase(benchCase, &options, &inputs, &result);
+        if(result.threads.empty()) continue;
+        
+        const ThreadResult* best = &result.threads[0];
+        for(const ThreadResult& t : result.threads)
+            if(t.nsPerPoint < best->nsPerPoint) best = &t;
+        
+        char instrs[32];
+        snprintf(instrs, sizeof(instrs), "%u->%u", result.instructionsUnoptimized, result.instructions);
+        printf("%-11s %-50.50s %8.2f %8.2f %9s %8.2f %8.2f %8.2f %9.2f %8.3f%s\n",
+               benchCase->category, benchCase->text, result.parseNs / 1000.0, result.compileNs / 1000.0, instrs,
+               result.scalarNsPerPoint, result.batchUnoptimizedNsPerPoint, result.batchNsPerPoint,
+               result.batchSpecializedNsPerPoint, best->nsPerPoint, result.mismatch ? "  (results don't match!)" : "");
+        results.push_back(result);
+    }
+    
+    // Thread scaling
+    printf("\n%-50s", "scaling (points/s per core, speedup)");
+    for(int threads : options.threadCounts)
+        printf(" %14d", threads);
+    printf("\n");
+    for(const BenchResult& result : results)
+    {
+        printf("%-50.50s", result.benchCase->text);
+        for(const ThreadResult& t : result.threads)
+            printf(" %8.1fM %4.1fx", t.pointsPerSecondPerCore / 1e6, t.speedup);
+        printf("\n");
+    }
+    
+    // Ingestion
+    std::vector<IngestResult> ingestion;
+    if(!options.filter || strstr("ingestion stream shm", options.filter))
+    {
+        int64_t rows = options.points * 8;
+        ingestion.push_back({ "stream ring (2 channels)", BenchStreamRing(rows) });
+        ingestion.push_back({ "stream text parse (2 channels)", BenchStreamText(rows / 4) });
+        ingestion.push_back({ "shared memory (2 f32 + 1 f64 columns)", BenchShmFeed(rows) });
+        
+        printf("\n%-50s %14s\n", "ingestion", "rows/s");
+        for(const IngestResult& result : ingestion)
+            printf("%-50s %13.1fM\n", result.name, result.rowsPerSecond / 1e6);
+    }
+    
+    // Extended precision
+    if(!options.filter || strstr("precision double-double", options.filter))
+        BenchPrecision(&options, &inputs);
+    
+    // Differential equations
+    if(!options.filter || strstr("ode differential", options.filter))
+    {
+        std::vector<OdeBenchResult> ode;
+        BenchOde(1000, &ode);
+        
+        printf("\n%-50s %14s\n", "ode, 1000 starts", "steps/s");
+        for(const OdeBenchResult& result : ode)
+            printf("%-50s %13.1fM\n", result.name, result.stepsPerSecond / 1e6);
+    }
+    
+    // Binning
+    std::vector<BinningResult> binning;
+    if(!options.filter || strstr("binning histogram density", options.filter))
+    {
+        BenchBinning(&options, &inputs, &binning);
+        
+        printf("\n%-50s %10s %12s %10s\n", "binning", "time (ms)", "rows read/s", "rows read");
+        for(const BinningResult& result : binning)
+        {
+            printf("%-50s %10.3f %11.1fM %10lld\n", result.name, result.ms,
+                   result.rowsRead / (result.ms * 1e-3) / 1e6, (long long)result.rowsRead);
+        }
+    }
+    
+    // Fitting
+    std::vector<FitBenchResult> fits;
+    if(!options.filter || strstr("fitting regression", options.filter))
+    {
+        BenchFits(options.points, &fits);
+        
+        printf("\n%-50s %6s %6s %10s %12s %10s\n", "fitting", "method", "passes", "time (ms)", "rows/s/iter", "R^2");
+        for(const FitBenchResult& result : fits)
+        {
+            if(!result.ok) continue;
+            const FitResult* fit = &result.fit;
+            printf("%-50s %6s %6d %10.2f %11.1fM %10.6f%s\n", result.fitCase->text, fit->linear ? "QR" : "LM",
+                   fit->iterations, fit->seconds * 1e3, fit->rows * fit->iterations / fit->seconds / 1e6, fit->rSquared,
+                   fit->converged ? "" : "  (not converged)");
+        }
+    }
+    
+    bool ok = true;
+    if(options.jsonPath)
+    {
+        ok = WriteJson(options.jsonPath, &options, results, ingestion, binning, fits);
+        if(!ok) fprintf(stderr, "Could not write '%s'\n", options.jsonPath);
+    }
+    
+    ShutdownJobSystem();
+    return ok ? 0 : 1;
+}
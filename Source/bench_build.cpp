@@ -0,0 +1,18 @@
+// Unity build of the headless benchmark, no window or GPU required
+#include "bench.cpp"
+#include "check.cpp"
+#include "core.cpp"
+#include "jobs.cpp"
+#include "parser.cpp"
+#include "compiler.cpp"
+#include "interpreter.cpp"
+#include "interval.cpp"
+#include "ddouble.cpp"
+#include "os.cpp"
+#include "pyramid.cpp"
+#include "datatable.cpp"
+#include "streaming.cpp"
+#include "shmfeed.cpp"
+#include "fit.cpp"
+#include "histogram.cpp"
+#include "ode.cpp"
@@ -0,0 +1,303 @@
+#include "check.h"
+#include "core.h"
+#include "parser.h"
+#include "compiler.h"
+#include "interpreter.h"
+#include "datatable.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+
+// Every expression is evaluated by each path that should give the same
+// values, against the scalar interpreter running the unoptimized program:
+// the optimized program in scalar and in batches, the unoptimized one in
+// batches, the parameters folded (see CompileSpecialized), split over the
+// job system, and in double-double. Double-double only has to agree to
+// Check_DoubleDoubleTolerance, it's the more precise one, but it has to be
+// defined (not NaN) at the same points. The inputs are multiples of powers
+// of two, exact in both precisions.
+//
+// The number parser of the importers (ParseNumber) is compared with strtod
+// on generated decimal strings, both the value (to the bit) and the length.
+
+#define Check_Points 4096  // 64 x 64 for the grids
+#define Check_Tolerance 1e-9
+#define Check_DoubleDoubleTolerance 1e-6
+#define Check_MaxReported 3  // Per expression and path
+#define Check_Numbers 200000
+
+static const char* checkCorpus[] =
+{
+    "y = 3x^5 - 2x^4 + x^3 - 7x^2 + 4x - 1",
+    "y = (x-1)(x+2)(x-3)(x+4)(x-5)/120",
+    "y = x^7 - 7x^6 + 21x^5 - 35x^4 + 35x^3 - 21x^2 + 7x - 1",
+    "y = sin(x)^2 cos(a x) + tan(x/4) + atan2(x, a)",
+    "y = (x^2 + 1) / (x - 0.5) + sqrt(abs(x))",
+    "y = atan(x) + ln(x^2 + 1) - log(abs(x)) + log2(x)",
+    "y = sinh(x/3) - cosh(x/4) + tanh(a x) + exp(-x^2)",
+    "y = asin(x/10) + acos(x/11) + floor(x) - ceil(x/2) + round(x a)",
+    "y = sign(x) mod(x, 3) + x^-2 + x^0.5 + 2^x",
+    "y = {x<0: -x, x<2: x^2, 4}",
+    "y = {sin(x) > 0: sqrt(abs(x)), -ln(1 + x^2)}",
+    "y = {x < -1: 1/x, -1 <= x <= 1: a, x = 5: 100}",
+    "y = max(0, log2(x)) + min(x, a)",
+    "y = max(log2(x), 0) - min(sqrt(x), 1)",
+    "y = min(1, sqrt(-x)) + max(2, 3)",
+    "y = integral(exp(-x^2), 0, x)",
+    "y = integral(2/x, 0.7, x)",
+    "y = integral(sqrt(abs(x)), -1, x) + integral(a x, x, 1)",
+    "y = sum(n, 1, 20, sin(n x)/n)",
+    "y = sum(k, 0, floor(abs(x)), k^2)",
+    "x^2 + y^2 = 25",
+    "sin(x y) = cos(x) + sin(y)",
+    "max(x, y) = min(x^2, a y)",
+    "(cos(3t) cos(t), cos(3t) sin(t))",
+    "(t - a sin(t), 1 - a cos(t))",
+    "r = 1 + cos(7t) / (a + 3)",
+    "f(z) = (z^3 - 1)/(z^2 + a i)",
+    "f(z) = sin(z) exp(1/z)",
+    "f(z) = (i)^2 z + (z + i)^3 + z^-2",
+    "f(z) = sqrt(z) + ln(z) + z^z",
+};
+
+struct CheckInputs
+{
+    std::vector<double> gridX;
+    std::vector<double> gridY;
+};
+
+static void GetCheckInputs(DefinitionKind kind, const CheckInputs* inputs, EvalInput vars[Var_Count])
+{
+    for(int i = 0; i < Var_Count; ++i)
+        vars[i] = EvalConstant(0.0);
+    
+    switch(kind)
+    {
+        case Def_Implicit:
+        case Def_Complex:
+        {
+            vars[Var_X] = EvalArray(inputs->gridX.data());
+            vars[Var_Y] = EvalArray(inputs->gridY.data());
+            break;
+        }
+        case Def_Parametric:
+        {
+            vars[Var_T] = EvalRamp(0.0, 1.0 / 512.0);
+            break;
+        }
+        default:
+        {
+            vars[Var_X] = EvalRamp(-10.0, 20.0 / Check_Points);
+            break;
+        }
+    }
+}
+
+static bool CheckEqual(double expected, double actual, double tolerance)
+{
+    if(isnan(expected) || isnan(actual)) return isnan(expected) && isnan(actual);
+    if(expected == actual) return true;
+    double scale = fmax(1.0, fmax(fabs(expected), fabs(actual)));
+    return fabs(expected - actual) <= tolerance * scale;
+}
+
+// Compares the outputs of one path with the expected ones, returns the number of mismatches
+static int CompareOutputs(const char* text, const char* path, const EvalInput vars[Var_Count], uint32_t numOutputs,
+                          const std::vector<double>* expected, const std::vector<double>* actual, double tolerance)
+{
+    int mismatches = 0;
+    for(uint32_t r = 0; r < numOutputs; ++r)
+    {
+        for(int64_t i = 0; i < Check_Points; ++i)
+        {
+            if(CheckEqual(expected[r][i], actual[r][i], tolerance)) continue;
+            
+            if(mismatches++ < Check_MaxReported)
+            {
+                printf("  %-12s %s\n", path, text);
+                printf("  %-12s output %u at", "", r);
+                for(int v = 0; v < Var_Count; ++v)
+                {
+                    if(vars[v].array || vars[v].step != 0.0)
+                        printf(" %s = %.17g", varNames[v], vars[v].array ? vars[v].array[i] : vars[v].start + i * vars[v].step);
+                }
+                printf(": %.17g instead of %.17g\n", actual[r][i], expected[r][i]);
+            }
+        }
+    }
+    
+    return mismatches;
+}
+
+static int CheckExpression(const char* text, const CheckInputs* inputs)
+{
+    ParamTable params;
+    int a = FindOrAddParam(&params, "a", 1);
+    params.values[a] = 1.5;
+    
+    Definition def;
+    if(!ParseDefinition(text, &params, &def))
+    {
+        printf("  %-12s %s: %s\n", "parse", text, def.error);
+        return 1;
+    }
+    
+    Program unoptimized, program, specialized;
+    CompileDefinition(&def, &unoptimized, false);
+    CompileDefinition(&def, &program, true);
+    CompileSpecialized(&def.ast, def.roots, def.numRoots, params.values.data(), &specialized);
+    
+    EvalInput vars[Var_Count];
+    GetCheckInputs(def.kind, inputs, vars);
+    
+    uint32_t numOutputs = program.numOutputs;
+    std::vector<double> expected[Program_MaxOutputs], actual[Program_MaxOutputs];
+    double* outputs[Program_MaxOutputs];
+    for(uint32_t r = 0; r < numOutputs; ++r)
+    {
+        expected[r].resize(Check_Points);
+        actual[r].resize(Check_Points);
+        outputs[r] = actual[r].data();
+    }
+    
+    // Scalar, one point at a time
+    auto evalScalar = [&](const Program* p, std::vector<double>* out)
+    {
+        for(int64_t i = 0; i < Check_Points; ++i)
+        {
+            double point[Var_Count];
+            double values[Program_MaxOutputs];
+            for(int v = 0; v < Var_Count; ++v)
+                point[v] = vars[v].array ? vars[v].array[i] : vars[v].start + i * vars[v].step;
+            EvalScalar(p, point, params.values.data(), values);
+            for(uint32_t r = 0; r < numOutputs; ++r)
+                out[r][i] = values[r];
+        }
+    };
+    
+    evalScalar(&unoptimized, expected);
+    
+    int mismatches = 0;
+    evalScalar(&program, actual);
+    mismatches += CompareOutputs(text, "scalar", vars, numOutputs, expected, actual, Check_Tolerance);
+    EvalBatch(&unoptimized, vars, params.values.data(), Check_Points, outputs);
+    mismatches += CompareOutputs(text, "batch -O0", vars, numOutputs, expected, actual, Check_Tolerance);
+    EvalBatch(&program, vars, params.values.data(), Check_Points, outputs);
+    mismatches += CompareOutputs(text, "batch", vars, numOutputs, expected, actual, Check_Tolerance);
+    EvalBatch(&specialized, vars, params.values.data(), Check_Points, outputs);
+    mismatches += CompareOutputs(text, "folded", vars, numOutputs, expected, actual, Check_Tolerance);
+    EvalBatchParallel(&program, vars, params.values.data(), Check_Points, outputs);
+    mismatches += CompareOutputs(text, "threads", vars, numOutputs, expected, actual, Check_Tolerance);
+    EvalBatchDD(&program, vars, nullptr, params.values.data(), Check_Points, outputs);
+    mismatches += CompareOutputs(text, "dd", vars, numOutputs, expected, actual, Check_DoubleDoubleTolerance);
+    return mismatches;
+}
+
+// xorshift64, the same strings on every run
+static uint64_t NextRandom(uint64_t* state)
+{
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+static void AppendDigits(std::string* out, int count, uint64_t* state)
+{
+    for(int i = 0; i < count; ++i)
+        out->push_back((char)('0' + NextRandom(state) % 10));
+}
+
+static int CheckNumber(const char* text)
+{
+    size_t length = strlen(text);
+    double value = 0.0;
+    int consumed = ParseNumber(text, text + length, &value);
+    
+    char* end;
+    double reference = strtod(text, &end);
+    if(consumed == (int)(end - text) && (consumed == 0 || memcmp(&value, &reference, sizeof(double)) == 0))
+        return 0;
+    
+    printf("  %-12s '%s': %.17g (%d characters) instead of %.17g (%d characters)\n", "ParseNumber", text,
+           value, consumed, reference, (int)(end - text));
+    return 1;
+}
+
+static int CheckNumbers()
+{
+    static const char* edgeCases[] =
+    {
+        "0", "-0", "+0.0", "1", "-1", ".5", "5.", "0.1", "0.3", "1e22", "1e23", "-1e-22", "9007199254740992",
+        "9007199254740993", "9007199254740995", "4503599627370496.5", "123456789012345678901234567890",
+        "0.000000000000000000000000000001", "1.7976931348623157e308", "1.7976931348623159e308", "1e309",
+        "2.2250738585072011e-308", "2.2250738585072014e-308", "4.9406564584124654e-324", "2e-324", "1e-400",
+        "00000000000000000000000000001.5", "1e", "1e+", "1.5e-", "3E5", "7e+0005", "-.25e-2",
+    };
+    
+    int mismatches = 0;
+    for(const char* text : edgeCases)
+        mismatches += CheckNumber(text);
+    
+    // Short and long mantissas, with and without exponents, small exponents most of the time
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    std::string text;
+    for(int n = 0; n < Check_Numbers && mismatches < Check_MaxReported * 4; ++n)
+    {
+        text.clear();
+        uint64_t shape = NextRandom(&state);
+        if(shape & 1) text.push_back((shape & 2) ? '-' : '+');
+        
+        int intDigits = (int)(NextRandom(&state) % ((shape & 4) ? 25 : 8));
+        int fracDigits = (shape & 8) ? (int)(NextRandom(&state) % ((shape & 16) ? 25 : 8)) : 0;
+        if(intDigits + fracDigits == 0) intDigits = 1;
+        AppendDigits(&text, intDigits, &state);
+        if(shape & 8)
+        {
+            text.push_back('.');
+            AppendDigits(&text, fracDigits, &state);
+        }
+        
+        if(shape & 32)
+        {
+            int exponent = (int)(NextRandom(&state) % ((shape & 64) ? 700 : 50)) - ((shape & 64) ? 350 : 25);
+            char buffer[16];
+            snprintf(buffer, sizeof(buffer), "e%d", exponent);
+            text += buffer;
+        }
+        
+        mismatches += CheckNumber(text.c_str());
+    }
+    
+    return mismatches;
+}
+
+int RunEngineChecks()
+{
+    CheckInputs inputs;
+    inputs.gridX.resize(Check_Points);
+    inputs.gridY.resize(Check_Points);
+    for(int j = 0; j < 64; ++j)
+    {
+        for(int i = 0; i < 64; ++i)
+        {
+            inputs.gridX[j * 64 + i] = -10.0 + 20.0 * i / 64;
+            inputs.gridY[j * 64 + i] = -10.0 + 20.0 * j / 64;
+        }
+    }
+    
+    int mismatches = 0;
+    for(const char* text : checkCorpus)
+        mismatches += CheckExpression(text, &inputs);
+    printf("expressions: %d cases, %d mismatches\n", (int)ArrayCount(checkCorpus), mismatches);
+    
+    int numbers = CheckNumbers();
+    printf("numbers: %d mismatches\n", numbers);
+    return mismatches + numbers;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+// Differential checks of the evaluation engine, run by plotter_bench --check.
+// Returns the number of mismatches, the first ones of each case are printed.
+// The job system has to be running.
+int RunEngineChecks();
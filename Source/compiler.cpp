@@ -0,0 +1,482 @@
+#include "compiler.h"
+
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include <unordered_map>
+
+double ApplyOp(OpCode op, double a, double b, double c)
+{
+    switch(op)
+    {
+        case Op_Neg:          return -a;
+        case Op_Add:          return a + b;
+        case Op_Sub:          return a - b;
+        case Op_Mul:          return a * b;
+        case Op_Div:          return a / b;
+        case Op_Pow:          return pow(a, b);
+        case Op_Sqrt:         return sqrt(a);
+        case Op_Abs:          return fabs(a);
+        case Op_Exp:          return exp(a);
+        case Op_Ln:           return log(a);
+        case Op_Log10:        return log10(a);
+        case Op_Log2:         return log2(a);
+        case Op_Sin:          return sin(a);
+        case Op_Cos:          return cos(a);
+        case Op_Tan:          return tan(a);
+        case Op_Asin:         return asin(a);
+        case Op_Acos:         return acos(a);
+        case Op_Atan:         return atan(a);
+        case Op_Atan2:        return atan2(a, b);
+        case Op_Sinh:         return sinh(a);
+        case Op_Cosh:         return cosh(a);
+        case Op_Tanh:         return tanh(a);
+        case Op_Floor:        return floor(a);
+        case Op_Ceil:         return ceil(a);
+        case Op_Round:        return floor(a + 0.5);
+        case Op_Sign:         return a > 0.0 ? 1.0 : (a < 0.0 ? -1.0 : a);
+        case Op_Min:          return a < b || a != a ? a : b;  // NaN on either side, so the order doesn't matter
+        case Op_Max:          return a > b || a != a ? a : b;
+        case Op_Mod:          return a - b * floor(a / b);
+        case Op_Less:         return a < b ? 1.0 : 0.0;
+        case Op_LessEqual:    return a <= b ? 1.0 : 0.0;
+        case Op_Greater:      return a > b ? 1.0 : 0.0;
+        case Op_GreaterEqual: return a >= b ? 1.0 : 0.0;
+        case Op_Equal:        return a == b ? 1.0 : 0.0;
+        case Op_And:          return a != 0.0 && b != 0.0 ? 1.0 : 0.0;
+        case Op_Select:       return a != 0.0 ? b : c;
+        default: assert(false && "Not an operation"); return NAN;
+    }
+}
+
+struct ValueKey
+{
+    OpCode op;
+    uint32_t src[Ast_MaxChildren];
+    uint64_t valueBits;
+    uint32_t index;
+    
+    bool operator==(const ValueKey& other) const
+    {
+        return op == other.op && src[0] == other.src[0] && src[1] == other.src[1] && src[2] == other.src[2] &&
+               valueBits == other.valueBits && index == other.index;
+    }
+};
+
+struct ValueKeyHash
+{
+    size_t operator()(const ValueKey& key) const
+    {
+        uint64_t hash = 14695981039346656037ull;
+        auto mix = [&](uint64_t v) { hash = (hash ^ v) * 1099511628211ull; };
+        mix(key.op);
+        mix(key.src[0]);
+        mix(key.src[1]);
+        mix(key.src[2]);
+        mix(key.valueBits);
+        mix(key.index);
+        return (size_t)hash;
+    }
+};
+
+// SSA values, before register allocation
+struct IRValue
+{
+    OpCode op;
+    uint32_t src[Ast_MaxChildren];
+    double value;
+    uint32_t index;
+};
+
+struct IRBuilder
+{
+    const Ast* ast;
+    bool optimize;
+    const double* params;  // Folded as constants when not null
+    std::vector<Program>* kernels;
+    std::vector<IRValue> values;
+    std::vector<uint32_t> astToValue;
+    std::unordered_map<ValueKey, uint32_t, ValueKeyHash> cse;
+};
+
+#define IR_None UINT32_MAX
+
+static bool IsConst(IRBuilder* b, uint32_t v, double* value = nullptr)
+{
+    if(v == IR_None || b->values[v].op != Op_Const) return false;
+    if(value) *value = b->values[v].value;
+    return true;
+}
+
+static bool IsConstValue(IRBuilder* b, uint32_t v, double value)
+{
+    double c;
+    return IsConst(b, v, &c) && c == value;
+}
+
+static uint32_t Emit(IRBuilder* b, OpCode op, uint32_t s0 = IR_None, uint32_t s1 = IR_None, uint32_t s2 = IR_None,
+                     double value = 0.0, uint32_t index = 0);
+
+static uint32_t EmitConst(IRBuilder* b, double value)
+{
+    return Emit(b, Op_Const, IR_None, IR_None, IR_None, value);
+}
+
+// x^n for small integer n, as a sequence of multiplications
+static uint32_t EmitIntPow(IRBuilder* b, uint32_t base, int n)
+{
+    bool negative = n < 0;
+    if(negative) n = -n;
+    
+    uint32_t result = IR_None;
+    uint32_t square = base;
+    while(n > 0)
+    {
+        if(n & 1) result = result == IR_None ? square : Emit(b, Op_Mul, result, square);
+        n >>= 1;
+        if(n > 0) square = Emit(b, Op_Mul, square, square);
+    }
+    
+    if(result == IR_None) result = EmitConst(b, 1.0);
+    if(negative) result = Emit(b, Op_Div, EmitConst(b, 1.0), result);
+    return result;
+}
+
+// Returns IR_None if no simplification applies
+static uint32_t Simplify(IRBuilder* b, OpCode op, uint32_t s0, uint32_t s1)
+{
+    double c;
+    switch(op)
+    {
+        case Op_Add:
+        {
+            if(IsConstValue(b, s1, 0.0)) return s0;
+            if(IsConstValue(b, s0, 0.0)) return s1;
+            if(b->values[s1].op == Op_Neg) return Emit(b, Op_Sub, s0, b->values[s1].src[0]);
+            break;
+        }
+        case Op_Sub:
+        {
+            if(IsConstValue(b, s1, 0.0)) return s0;
+            if(IsConstValue(b, s0, 0.0)) return Emit(b, Op_Neg, s1);
+            break;
+        }
+        case Op_Mul:
+        {
+            // x*0 is not folded, it would hide NaNs (and holes in the plot)
+            if(IsConstValue(b, s1, 1.0)) return s0;
+            if(IsConstValue(b, s0, 1.0)) return s1;
+            if(IsConstValue(b, s1, -1.0)) return Emit(b, Op_Neg, s0);
+            if(IsConstValue(b, s0, -1.0)) return Emit(b, Op_Neg, s1);
+            break;
+        }
+        case Op_Div:
+        {
+            if(IsConstValue(b, s1, 1.0)) return s0;
+            // Division by a constant is a multiplication by its reciprocal, when that's exact
+            if(IsConst(b, s1, &c) && c != 0.0)
+            {
+                int exponent;
+                double mantissa = frexp(c, &exponent);
+                if(mantissa == 0.5) return Emit(b, Op_Mul, s0, EmitConst(b, 1.0 / c));
+            }
+            break;
+        }
+        case Op_Neg:
+        {
+            if(b->values[s0].op == Op_Neg) return b->values[s0].src[0];
+            break;
+        }
+        case Op_Pow:
+        {
+            if(!IsConst(b, s1, &c)) break;
+            if(c == 0.0) return EmitConst(b, 1.0);
+            if(c == 0.5) return Emit(b, Op_Sqrt, s0);
+            if(c == floor(c) && fabs(c) <= 16.0) return EmitIntPow(b, s0, (int)c);
+            break;
+        }
+        default: break;
+    }
+    
+    return IR_None;
+}
+
+static bool IsCommutative(OpCode op)
+{
+    return op == Op_Add || op == Op_Mul || op == Op_Min || op == Op_Max || op == Op_Equal || op == Op_And;
+}
+
+static uint32_t Emit(IRBuilder* b, OpCode op, uint32_t s0, uint32_t s1, uint32_t s2, double value, uint32_t index)
+{
+    bool binding = op == Op_Integral || op == Op_Sum;
+    if(b->optimize && op != Op_Const && op != Op_Var && op != Op_Param && op != Op_Bound && !binding)
+    {
+        // Constant folding
+        int arity = opInfos[op].arity;
+        bool allConst = true;
+        double args[Ast_MaxChildren] = { 0.0, 0.0, 0.0 };
+        uint32_t srcs[Ast_MaxChildren] = { s0, s1, s2 };
+        for(int i = 0; i < arity; ++i)
+            allConst &= IsConst(b, srcs[i], &args[i]);
+        
+        if(allConst) return EmitConst(b, ApplyOp(op, args[0], args[1], args[2]));
+        
+        if(op == Op_Select && IsConst(b, s0, &args[0]))
+            return args[0] != 0.0 ? s1 : s2;
+        
+        uint32_t simplified = Simplify(b, op, s0, s1);
+        if(simplified != IR_None) return simplified;
+        
+        // Canonical operand order, so that a+b and b+a are recognized as the same value
+        if(IsCommutative(op) && s0 > s1)
+        {
+            uint32_t tmp = s0;
+            s0 = s1;
+            s1 = tmp;
+        }
+    }
+    
+    ValueKey key = {};
+    key.op = op;
+    key.src[0] = s0;
+    key.src[1] = s1;
+    key.src[2] = s2;
+    memcpy(&key.valueBits, &value, sizeof(double));
+    key.index = index;
+    
+    if(b->optimize)
+    {
+        auto found = b->cse.find(key);
+        if(found != b->cse.end()) return found->second;
+    }
+    
+    IRValue v;
+    v.op = op;
+    v.src[0] = s0;
+    v.src[1] = s1;
+    v.src[2] = s2;
+    v.value = value;
+    v.index = index;
+    b->values.push_back(v);
+    
+    uint32_t result = (uint32_t)b->values.size() - 1;
+    if(b->optimize) b->cse[key] = result;
+    return result;
+}
+
+// Whether the body of a binding reads anything else than its own variable and the parameters
+static bool DependsOnOuter(const Ast* ast, AstRef ref, uint32_t slot)
+{
+    const AstNode* node = &ast->nodes[ref];
+    if(node->op == Op_Var) return true;
+    if(node->op == Op_Bound) return node->index < slot;
+    
+    for(int i = 0; i < node->childCount; ++i)
+    {
+        if(DependsOnOuter(ast, node->children[i], slot))
+            return true;
+    }
+    
+    return false;
+}
+
+static void CompileRoots(const Ast* ast, const AstRef* roots, uint32_t numRoots, const double* params, bool optimize,
+                         Program* out);
+
+static uint32_t BuildValue(IRBuilder* b, AstRef ref)
+{
+    if(b->astToValue[ref] != IR_None) return b->astToValue[ref];
+    
+    const AstNode* node = &b->ast->nodes[ref];
+    uint32_t result;
+    switch(node->op)
+    {
+        case Op_Const: result = EmitConst(b, node->value); break;
+        case Op_Param:
+        {
+            if(b->params) result = EmitConst(b, b->params[node->index]);
+            else result = Emit(b, node->op, IR_None, IR_None, IR_None, 0.0, node->index);
+            break;
+        }
+        case Op_Var:
+        case Op_Bound: result = Emit(b, node->op, IR_None, IR_None, IR_None, 0.0, node->index); break;
+        case Op_Integral:
+        case Op_Sum:
+        {
+            uint32_t first = BuildValue(b, node->children[0]);
+            uint32_t last = BuildValue(b, node->children[1]);
+            
+            Program kernel;
+            CompileRoots(b->ast, &node->children[2], 1, b->params, b->optimize, &kernel);
+            kernel.binding = node->index;
+            kernel.outerFree = !DependsOnOuter(b->ast, node->children[2], node->index);
+            b->kernels->push_back(std::move(kernel));
+            
+            uint32_t index = (uint32_t)b->kernels->size() - 1;
+            result = Emit(b, node->op, first, last, IR_None, 0.0, index);
+            break;
+        }
+        default:
+        {
+            uint32_t srcs[Ast_MaxChildren] = { IR_None, IR_None, IR_None };
+            for(int i = 0; i < node->childCount; ++i)
+                srcs[i] = BuildValue(b, node->children[i]);
+            
+            result = Emit(b, node->op, srcs[0], srcs[1], srcs[2]);
+            break;
+        }
+    }
+    
+    b->astToValue[ref] = result;
+    return result;
+}
+
+static void CompileRoots(const Ast* ast, const AstRef* roots, uint32_t numRoots, const double* params, bool optimize,
+                         Program* out)
+{
+    assert(numRoots <= Program_MaxOutputs);
+    
+    IRBuilder b;
+    b.ast = ast;
+    b.optimize = optimize;
+    b.params = params;
+    b.astToValue.assign(ast->nodes.size(), IR_None);
+    b.kernels = &out->kernels;
+    out->kernels.clear();
+    out->binding = 0;
+    out->outerFree = false;
+    out->conditional = false;
+    
+    uint32_t outputs[Program_MaxOutputs];
+    for(uint32_t i = 0; i < numRoots; ++i)
+        outputs[i] = BuildValue(&b, roots[i]);
+    
+    // Simplifications can leave dead values behind
+    uint32_t count = (uint32_t)b.values.size();
+    std::vector<bool> live(count, false);
+    for(uint32_t i = 0; i < numRoots; ++i)
+        live[outputs[i]] = true;
+    
+    for(int64_t i = count - 1; i >= 0; --i)
+    {
+        if(!live[i]) continue;
+        for(int j = 0; j < opInfos[b.values[i].op].arity; ++j)
+            live[b.values[i].src[j]] = true;
+    }
+    
+    // Last use of each value, outputs stay alive until the end
+    std::vector<uint32_t> lastUse(count, 0);
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        if(!live[i]) continue;
+        for(int j = 0; j < opInfos[b.values[i].op].arity; ++j)
+            lastUse[b.values[i].src[j]] = i;
+    }
+    for(uint32_t i = 0; i < numRoots; ++i)
+        lastUse[outputs[i]] = UINT32_MAX;
+    
+    // Linear scan register allocation. The destination never shares
+    // a register with its own operands, so the interpreter loops don't alias.
+    std::vector<uint16_t> regOf(count, 0);
+    std::vector<uint16_t> freeRegs;
+    uint32_t numRegs = 0;
+    
+    out->code.clear();
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        if(!live[i]) continue;
+        IRValue* v = &b.values[i];
+        
+        Instr instr = {};
+        instr.op = v->op;
+        instr.value = v->value;
+        instr.index = v->index;
+        
+        int arity = opInfos[v->op].arity;
+        for(int j = 0; j < arity; ++j)
+            instr.src[j] = regOf[v->src[j]];
+        
+        if(freeRegs.empty())
+        {
+            assert(numRegs < UINT16_MAX);
+            instr.dst = (uint16_t)numRegs++;
+        }
+        else
+        {
+            instr.dst = freeRegs.back();
+            freeRegs.pop_back();
+        }
+        regOf[i] = instr.dst;
+        
+        for(int j = 0; j < arity; ++j)
+        {
+            uint32_t src = v->src[j];
+            bool seen = false;
+            for(int k = 0; k < j; ++k) seen |= v->src[k] == src;
+            if(!seen && lastUse[src] == i) freeRegs.push_back(regOf[src]);
+        }
+        
+        out->code.push_back(instr);
+        out->conditional |= instr.op == Op_Select;
+    }
+    
+    out->numRegs = numRegs;
+    out->numOutputs = numRoots;
+    for(uint32_t i = 0; i < numRoots; ++i)
+        out->outputs[i] = regOf[outputs[i]];
+}
+
+void CompileProgram(const Ast* ast, const AstRef* roots, uint32_t numRoots, Program* out, bool optimize)
+{
+    CompileRoots(ast, roots, numRoots, nullptr, optimize, out);
+}
+
+void CompileSpecialized(const Ast* ast, const AstRef* roots, uint32_t numRoots, const double* params, Program* out)
+{
+    CompileRoots(ast, roots, numRoots, params, true, out);
+}
+
+void CompileDefinition(const Definition* def, Program* out, bool optimize)
+{
+    CompileProgram(&def->ast, def->roots, def->numRoots, out, optimize);
+}
+
+void PrintProgram(const Program* program, const ParamTable* params, FILE* file)
+{
+    for(const Instr& instr : program->code)
+    {
+        fprintf(file, "    r%-3d = ", instr.dst);
+        switch(instr.op)
+        {
+            case Op_Const: fprintf(file, "%.17g\n", instr.value); break;
+            case Op_Var:   fprintf(file, "%s\n", varNames[instr.index]); break;
+            case Op_Bound: fprintf(file, "bound%u\n", instr.index); break;
+            case Op_Param:
+            {
+                bool named = params && instr.index < params->names.size();
+                fprintf(file, "%s\n", named ? params->names[instr.index].c_str() : "param");
+                break;
+            }
+            default:
+            {
+                fprintf(file, "%s", opInfos[instr.op].name);
+                for(int i = 0; i < opInfos[instr.op].arity; ++i)
+                    fprintf(file, " r%d", instr.src[i]);
+                if(instr.op == Op_Integral || instr.op == Op_Sum)
+                    fprintf(file, " kernel%u", instr.index);
+                fprintf(file, "\n");
+                break;
+            }
+        }
+    }
+    
+    for(uint32_t i = 0; i < program->numOutputs; ++i)
+        fprintf(file, "    out%d = r%d\n", i, program->outputs[i]);
+    
+    for(size_t i = 0; i < program->kernels.size(); ++i)
+    {
+        const Program* kernel = &program->kernels[i];
+        fprintf(file, "  kernel%zu, over bound%u%s:\n", i, kernel->binding, kernel->outerFree ? ", prefixes reused" : "");
+        PrintProgram(kernel, params, file);
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "parser.h"
+
+// Turns expression trees into a flat list of instructions working on
+// registers. When optimizing, constants are folded, simple algebraic
+// identities are applied (x^2 -> x*x, x*1 -> x, ...), common subexpressions
+// are shared and registers are reused as soon as a value is dead.
+// The bodies of integrals and sums are compiled into programs of their own,
+// kernels, which the binding instruction evaluates over many values of its
+// variable for each point.
+
+struct Instr
+{
+    OpCode op;
+    uint16_t dst;
+    uint16_t src[Ast_MaxChildren];
+    double value;    // Op_Const
+    uint32_t index;  // Op_Var, Op_Param, Op_Bound, and the kernel of bindings
+};
+
+// Regressions have one output for the residual and one per parameter derivative
+#define Program_MaxOutputs 16
+
+struct Program
+{
+    std::vector<Instr> code;
+    uint32_t numRegs;
+    uint32_t numOutputs;
+    uint16_t outputs[Program_MaxOutputs];
+    
+    std::vector<Program> kernels;
+    uint32_t binding;  // Kernels: slot of the variable they're evaluated over
+    bool outerFree;    // Kernels: only depends on that variable and the parameters
+    bool conditional;  // Has selects, whose branches batches may skip (see interpreter.h)
+};
+
+// Compiles the given roots, the program has one output for each of them
+void CompileProgram(const Ast* ast, const AstRef* roots, uint32_t numRoots, Program* out, bool optimize = true);
+void CompileDefinition(const Definition* def, Program* out, bool optimize = true);
+// Optimized with the parameters folded as constants, for as long as they
+// keep these values (while a slider is dragged, they're constant for the
+// frame): what only depends on them is computed once instead of per point,
+// and the identities see their values (a x with a = 1 is x).
+void CompileSpecialized(const Ast* ast, const AstRef* roots, uint32_t numRoots, const double* params, Program* out);
+
+// Semantics of each operation on scalars, used for constant folding and by the interpreter
+double ApplyOp(OpCode op, double a, double b, double c);
+
+void PrintProgram(const Program* program, const ParamTable* params, FILE* file);
@@ -1,2 +1,15 @@
+#pragma once
 
-#pragma once
\ No newline at end of file
+#include <stdint.h>
+#include <stddef.h>
+
+#define Plotter_Version "0.1.0"
+
+#define ArrayCount(array) (sizeof(array) / sizeof((array)[0]))
+
+// Monotonic clock, in nanoseconds
+uint64_t GetTimeNs();
+
+// FNV-1a, start from Hash_Seed and chain calls to hash several values
+#define Hash_Seed 0xcbf29ce484222325ull
+uint64_t HashBytes(uint64_t hash, const void* data, size_t size);
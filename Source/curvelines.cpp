@@ -0,0 +1,367 @@
+#include "curvelines.h"
+#include "scatter.h"
+#include "core.h"
+
+#include <math.h>
+#include <string.h>
+
+#ifndef IMGUI_DEFINE_MATH_OPERATORS
+#define IMGUI_DEFINE_MATH_OPERATORS
+#endif
+#include "imgui.h"
+
+// Must match the layouts in curveShader
+struct CurveUniforms
+{
+    float center[4];  // xHi, xLo, yHi, yLo of the view center
+    float scale[2];   // Data units to pixels
+    float size[2];    // Of the view, in pixels
+    float color[4];
+    uint32_t first;   // Ring slot of the first sample drawn
+    uint32_t mask;    // Capacity - 1
+    uint32_t poles;   // Explicit curves: segments across the whole view are poles
+    float halfWidth;  // Pixels
+};
+
+struct CurveSample
+{
+    float x[2];  // High and low floats
+    float y[2];
+};
+
+static const char* curveShader = R"(
+struct Uniforms
+{
+    center: vec4f,
+    scale: vec2f,
+    size: vec2f,
+    color: vec4f,
+    first: u32,
+    mask: u32,
+    poles: u32,
+    halfWidth: f32,
+};
+
+@group(0) @binding(0) var<uniform> u: Uniforms;
+@group(0) @binding(1) var<storage, read> samples: array<vec4f>;
+
+struct VertexOut
+{
+    @builtin(position) position: vec4f,
+    @location(0) local: vec2f,  // Pixels along and across the segment, from its start
+    @location(1) @interpolate(flat) length: f32,
+};
+
+fn IsFinite(v: f32) -> bool
+{
+    return (bitcast<u32>(v) & 0x7f800000u) != 0x7f800000u;
+}
+
+// Pixels from the center of the view, y going up. Each difference is between
+// floats close to each other, only their sum is rounded.
+fn Relative(s: vec4f) -> vec2f
+{
+    let x = (s.x - u.center.x) + (s.y - u.center.y);
+    let y = (s.z - u.center.z) + (s.w - u.center.w);
+    return clamp(vec2f(x, y) * u.scale, vec2f(-1e5), vec2f(1e5));
+}
+
+@vertex
+fn vs_main(@builtin(vertex_index) vertex: u32, @builtin(instance_index) instance: u32) -> VertexOut
+{
+    var corners = array<vec2f, 6>(vec2f(0, -1), vec2f(1, -1), vec2f(0, 1),
+                                  vec2f(0, 1), vec2f(1, -1), vec2f(1, 1));
+
+    var out: VertexOut;
+    out.position = vec4f(2, 2, 2, 1);  // Outside the clip volume
+    out.local = vec2f(0);
+    out.length = 0.0;
+
+    let a = samples[(u.first + instance) & u.mask];
+    let b = samples[(u.first + instance + 1u) & u.mask];
+    if(!IsFinite(a.x) || !IsFinite(a.z) || !IsFinite(b.x) || !IsFinite(b.z)) { return out; }
+
+    let p0 = Relative(a);
+    let p1 = Relative(b);
+
+    // Both ends off screen on the same side, or on opposite sides for a pole
+    let half = u.size * 0.5;
+    if((p0.y > half.y && p1.y > half.y) || (p0.y < -half.y && p1.y < -half.y)) { return out; }
+    if((p0.x > half.x && p1.x > half.x) || (p0.x < -half.x && p1.x < -half.x)) { return out; }
+    if(u.poles != 0u && ((p0.y > half.y && p1.y < -half.y) || (p0.y < -half.y && p1.y > half.y))) { return out; }
+
+    let delta = p1 - p0;
+    let length = length(delta);
+    let axis = select(vec2f(1, 0), delta / length, length > 1e-6);
+    let normal = vec2f(-axis.y, axis.x);
+
+    // One pixel of margin for the antialiasing
+    let extent = u.halfWidth + 1.0;
+    let corner = corners[vertex];
+    let local = vec2f(mix(-extent, length + extent, corner.x), corner.y * extent);
+    let pixel = p0 + axis * local.x + normal * local.y;
+
+    out.position = vec4f(pixel / half, 0, 1);
+    out.local = local;
+    out.length = length;
+    return out;
+}
+
+@fragment
+fn fs_main(in: VertexOut) -> @location(0) vec4f
+{
+    let d = length(vec2f(in.local.x - clamp(in.local.x, 0.0, in.length), in.local.y)) - u.halfWidth;
+    let coverage = clamp(0.5 - d, 0.0, 1.0);
+    if(coverage <= 0.0) { discard; }
+    return vec4f(u.color.rgb, u.color.a * coverage);
+}
+)";
+
+static WGPURenderPipeline CreateLinePipeline(WGPUDevice device, WGPUBindGroupLayout layout, WGPUShaderModule module, WGPUTextureFormat format)
+{
+    WGPUPipelineLayoutDescriptor layoutDesc = WGPU_PIPELINE_LAYOUT_DESCRIPTOR_INIT;
+    layoutDesc.bindGroupLayoutCount = 1;
+    layoutDesc.bindGroupLayouts = &layout;
+    WGPUPipelineLayout pipelineLayout = wgpuDeviceCreatePipelineLayout(device, &layoutDesc);
+    
+    WGPUBlendState alphaBlend = WGPU_BLEND_STATE_INIT;
+    alphaBlend.color.srcFactor = WGPUBlendFactor_SrcAlpha;
+    alphaBlend.color.dstFactor = WGPUBlendFactor_OneMinusSrcAlpha;
+    alphaBlend.alpha.srcFactor = WGPUBlendFactor_One;
+    alphaBlend.alpha.dstFactor = WGPUBlendFactor_OneMinusSrcAlpha;
+    
+    WGPUColorTargetState target = WGPU_COLOR_TARGET_STATE_INIT;
+    target.format = format;
+    target.blend = &alphaBlend;
+    target.writeMask = WGPUColorWriteMask_All;
+    
+    WGPUFragmentState fragment = WGPU_FRAGMENT_STATE_INIT;
+    fragment.module = module;
+    fragment.entryPoint = "fs_main";
+    fragment.targetCount = 1;
+    fragment.targets = &target;
+    
+    WGPURenderPipelineDescriptor desc = WGPU_RENDER_PIPELINE_DESCRIPTOR_INIT;
+    desc.label = "Curve lines";
+    desc.layout = pipelineLayout;
+    desc.vertex.module = module;
+    desc.vertex.entryPoint = "vs_main";
+    desc.primitive.topology = WGPUPrimitiveTopology_TriangleList;
+    desc.primitive.cullMode = WGPUCullMode_None;
+    desc.fragment = &fragment;
+    
+    WGPURenderPipeline pipeline = wgpuDeviceCreateRenderPipeline(device, &desc);
+    wgpuPipelineLayoutRelease(pipelineLayout);
+    return pipeline;
+}
+
+void InitCurveRenderer(CurveRenderer* renderer, WGPUDevice device, WGPUTextureFormat targetFormat)
+{
+    renderer->device = device;
+    renderer->queue = wgpuDeviceGetQueue(device);
+    renderer->lines.clear();
+    
+    WGPUBindGroupLayoutEntry entries[2];
+    for(int i = 0; i < 2; ++i)
+    {
+        entries[i] = WGPU_BIND_GROUP_LAYOUT_ENTRY_INIT;
+        entries[i].binding = i;
+        entries[i].visibility = WGPUShaderStage_Vertex | WGPUShaderStage_Fragment;
+        entries[i].buffer.type = i == 0 ? WGPUBufferBindingType_Uniform : WGPUBufferBindingType_ReadOnlyStorage;
+    }
+    entries[0].buffer.minBindingSize = sizeof(CurveUniforms);
+    
+    WGPUBindGroupLayoutDescriptor layoutDesc = WGPU_BIND_GROUP_LAYOUT_DESCRIPTOR_INIT;
+    layoutDesc.label = "Curve lines";
+    layoutDesc.entryCount = ArrayCount(entries);
+    layoutDesc.entries = entries;
+    renderer->layout = wgpuDeviceCreateBindGroupLayout(device, &layoutDesc);
+    
+    WGPUShaderModule module = CreateShaderModule(device, curveShader, "Curve lines");
+    renderer->pipeline = CreateLinePipeline(device, renderer->layout, module, targetFormat);
+    wgpuShaderModuleRelease(module);
+}
+
+static void ReleaseLines(CurveLines* lines)
+{
+    if(lines->bindGroup) wgpuBindGroupRelease(lines->bindGroup);
+    if(lines->samples) wgpuBufferRelease(lines->samples);
+    if(lines->uniforms) wgpuBufferRelease(lines->uniforms);
+    lines->bindGroup = nullptr;
+    lines->samples = nullptr;
+    lines->uniforms = nullptr;
+}
+
+void CleanupCurveRenderer(CurveRenderer* renderer)
+{
+    for(CurveLines& lines : renderer->lines)
+        ReleaseLines(&lines);
+    renderer->lines.clear();
+    wgpuRenderPipelineRelease(renderer->pipeline);
+    wgpuBindGroupLayoutRelease(renderer->layout);
+    wgpuQueueRelease(renderer->queue);
+}
+
+static void CreateRing(CurveRenderer* renderer, CurveLines* lines, uint32_t capacity)
+{
+    ReleaseLines(lines);
+    
+    WGPUBufferDescriptor desc = WGPU_BUFFER_DESCRIPTOR_INIT;
+    desc.label = "Curve samples";
+    desc.usage = WGPUBufferUsage_Storage | WGPUBufferUsage_CopyDst;
+    desc.size = (uint64_t)capacity * sizeof(CurveSample);
+    lines->samples = wgpuDeviceCreateBuffer(renderer->device, &desc);
+    
+    WGPUBufferDescriptor uniformDesc = WGPU_BUFFER_DESCRIPTOR_INIT;
+    uniformDesc.label = "Curve uniforms";
+    uniformDesc.usage = WGPUBufferUsage_Uniform | WGPUBufferUsage_CopyDst;
+    uniformDesc.size = sizeof(CurveUniforms);
+    lines->uniforms = wgpuDeviceCreateBuffer(renderer->device, &uniformDesc);
+    
+    WGPUBindGroupEntry entries[2];
+    entries[0] = WGPU_BIND_GROUP_ENTRY_INIT;
+    entries[0].binding = 0;
+    entries[0].buffer = lines->uniforms;
+    entries[0].size = sizeof(CurveUniforms);
+    entries[1] = WGPU_BIND_GROUP_ENTRY_INIT;
+    entries[1].binding = 1;
+    entries[1].buffer = lines->samples;
+    entries[1].size = desc.size;
+    
+    WGPUBindGroupDescriptor groupDesc = WGPU_BIND_GROUP_DESCRIPTOR_INIT;
+    groupDesc.layout = renderer->layout;
+    groupDesc.entryCount = ArrayCount(entries);
+    groupDesc.entries = entries;
+    lines->bindGroup = wgpuDeviceCreateBindGroup(renderer->device, &groupDesc);
+    lines->capacity = capacity;
+}
+
+// Far out values are kept finite so the segments going there are still drawn
+static void SplitFloat(double value, float* out)
+{
+    if(isfinite(value)) value = fmin(fmax(value, -1e30), 1e30);
+    float hi = (float)value;
+    out[0] = hi;
+    out[1] = isfinite(value) ? (float)(value - hi) : 0.0f;
+}
+
+// Samples [begin, end) by index, at most two writes when the ring wraps around
+static void UploadSamples(CurveRenderer* renderer, CurveLines* lines, const Curve* curve, int64_t begin, int64_t end)
+{
+    std::vector<CurveSample> converted;
+    int64_t index = begin;
+    while(index < end)
+    {
+        uint32_t slot = (uint32_t)(index & (lines->capacity - 1));
+        int64_t count = end - index < lines->capacity - slot ? end - index : lines->capacity - slot;
+        converted.resize(count);
+        for(int64_t i = 0; i < count; ++i)
+        {
+            size_t sample = (size_t)(index + i - curve->firstSample);
+            SplitFloat(curve->xs[sample], converted[i].x);
+            SplitFloat(curve->ys[sample], converted[i].y);
+        }
+        
+        wgpuQueueWriteBuffer(renderer->queue, lines->samples, (uint64_t)slot * sizeof(CurveSample), converted.data(), count * sizeof(CurveSample));
+        index += count;
+    }
+}
+
+static CurveLines* FindLines(CurveRenderer* renderer, uint32_t curve)
+{
+    for(CurveLines& lines : renderer->lines)
+    {
+        if(lines.curve == curve) return &lines;
+    }
+    
+    CurveLines lines = {};
+    lines.curve = curve;
+    renderer->lines.push_back(lines);
+    return &renderer->lines.back();
+}
+
+void UpdateCurveLines(CurveRenderer* renderer, const CurveList* list, const PlotView* view)
+{
+    for(CurveLines& lines : renderer->lines)
+    {
+        lines.used = false;
+        lines.segments = 0;
+    }
+    
+    double rangeX = view->xMax - view->xMin;
+    double rangeY = view->yMax - view->yMin;
+    ImGuiIO& io = ImGui::GetIO();
+    bool drawable = view->width > 0 && view->height > 0 && rangeX > 0 && rangeY > 0;
+    for(const Curve* curve : list->curves)
+    {
+        if(!drawable || !curve->visible || curve->ys.size() < 2) continue;
+        if(curve->def.kind != Def_Explicit && curve->def.kind != Def_Parametric) continue;
+        
+        CurveLines* lines = FindLines(renderer, curve->id);
+        lines->used = true;
+        
+        int64_t first = curve->firstSample;
+        int64_t end = first + (int64_t)curve->ys.size();
+        if(lines->capacity < curve->ys.size())
+        {
+            uint32_t capacity = lines->capacity ? lines->capacity : CurveLines_MinCapacity;
+            while(capacity < curve->ys.size()) capacity *= 2;
+            CreateRing(renderer, lines, capacity);
+            lines->uploadedFirst = lines->uploadedEnd = 0;
+        }
+        
+        // Only what the ring doesn't hold yet, when it still holds the same curve
+        int64_t keptFirst = first > lines->uploadedFirst ? first : lines->uploadedFirst;
+        int64_t keptEnd = end < lines->uploadedEnd ? end : lines->uploadedEnd;
+        if(lines->key != curve->sampleKey || keptFirst >= keptEnd)
+        {
+            UploadSamples(renderer, lines, curve, first, end);
+        }
+        else
+        {
+            UploadSamples(renderer, lines, curve, first, keptFirst);
+            UploadSamples(renderer, lines, curve, keptEnd, end);
+        }
+        lines->key = curve->sampleKey;
+        lines->uploadedFirst = first;
+        lines->uploadedEnd = end;
+        
+        double centerX = (view->xMin + view->xMax) * 0.5;
+        double centerY = (view->yMin + view->yMax) * 0.5;
+        CurveUniforms uniforms = {};
+        SplitFloat(centerX, &uniforms.center[0]);
+        SplitFloat(centerY, &uniforms.center[2]);
+        uniforms.scale[0] = (float)(view->width / rangeX);
+        uniforms.scale[1] = (float)(view->height / rangeY);
+        uniforms.size[0] = (float)view->width;
+        uniforms.size[1] = (float)view->height;
+        memcpy(uniforms.color, curve->color, sizeof(uniforms.color));
+        uniforms.first = (uint32_t)(first & (lines->capacity - 1));
+        uniforms.mask = lines->capacity - 1;
+        uniforms.poles = curve->def.kind == Def_Explicit;
+        uniforms.halfWidth = CurveLines_Width * 0.5f * (io.DisplaySize.x > 0 ? view->width / io.DisplaySize.x : 1.0f);
+        wgpuQueueWriteBuffer(renderer->queue, lines->uniforms, 0, &uniforms, sizeof(uniforms));
+        lines->segments = (uint32_t)(curve->ys.size() - 1);
+    }
+    
+    // Removed and hidden curves give their buffers back
+    for(size_t i = renderer->lines.size(); i-- > 0;)
+    {
+        if(renderer->lines[i].used) continue;
+        
+        ReleaseLines(&renderer->lines[i]);
+        renderer->lines.erase(renderer->lines.begin() + i);
+    }
+}
+
+void DrawCurveLines(CurveRenderer* renderer, WGPURenderPassEncoder pass)
+{
+    wgpuRenderPassEncoderSetPipeline(pass, renderer->pipeline);
+    for(const CurveLines& lines : renderer->lines)
+    {
+        if(lines.segments == 0) continue;
+        
+        wgpuRenderPassEncoderSetBindGroup(pass, 0, lines.bindGroup, 0, nullptr);
+        wgpuRenderPassEncoderDraw(pass, 6, lines.segments, 0, 0);
+    }
+}
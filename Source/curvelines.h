@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "webgpu/webgpu.h"
+#include "curves.h"
+
+// GPU polylines of the curves. Floats can't hold coordinates far from the
+// origin precisely enough for a deep zoom, so every sample is uploaded as
+// x and y split in high and low floats, and the vertex shader subtracts the
+// view center split the same way before scaling: the two differences of
+// nearby floats are exact, and only the result relative to the view is
+// rounded. The view only moves the uniforms.
+//
+// Samples live in a ring indexed by their sample index (see Curve), which
+// means the same point as long as the sample key doesn't change. Panning
+// only uploads the samples coming into view, a new key or zoom level
+// uploads all of them again. Each segment is an instanced quad, antialiased
+// in the fragment shader like the scatter markers. Curves over a list are
+// all their rows in one ring, the NaN samples between rows drop the segments
+// joining them, so the whole list is a single instanced draw.
+
+#define CurveLines_MinCapacity 1024  // Samples, the ring grows by powers of two
+#define CurveLines_Width 2.0f       // Pixels, at a DPI scale of 1
+
+struct CurveLines
+{
+    uint32_t curve;  // Id
+    bool used;       // This frame
+    
+    uint64_t key;           // Sample key of what the ring holds
+    int64_t uploadedFirst;  // Sample indices the ring holds, [first, end)
+    int64_t uploadedEnd;
+    uint32_t capacity;
+    
+    WGPUBuffer samples;
+    WGPUBuffer uniforms;
+    WGPUBindGroup bindGroup;
+    uint32_t segments;  // To draw this frame
+};
+
+struct CurveRenderer
+{
+    WGPUDevice device;
+    WGPUQueue queue;
+    WGPUBindGroupLayout layout;
+    WGPURenderPipeline pipeline;
+    std::vector<CurveLines> lines;
+};
+
+void InitCurveRenderer(CurveRenderer* renderer, WGPUDevice device, WGPUTextureFormat targetFormat);
+void CleanupCurveRenderer(CurveRenderer* renderer);
+// Uploads the samples the rings don't have yet, and the view
+void UpdateCurveLines(CurveRenderer* renderer, const CurveList* list, const PlotView* view);
+void DrawCurveLines(CurveRenderer* renderer, WGPURenderPassEncoder pass);
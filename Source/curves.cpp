@@ -0,0 +1,828 @@
+#include "curves.h"
+#include "interpreter.h"
+#include "core.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#define Curve_PickPixels 6.0
+
+static const float curvePalette[][4] =
+{
+    { 0.86f, 0.30f, 0.26f, 1.0f },
+    { 0.22f, 0.52f, 0.86f, 1.0f },
+    { 0.26f, 0.70f, 0.36f, 1.0f },
+    { 0.60f, 0.36f, 0.80f, 1.0f },
+    { 0.95f, 0.60f, 0.15f, 1.0f },
+    { 0.20f, 0.72f, 0.72f, 1.0f },
+};
+
+Curve* AddCurve(CurveList* list, const char* text)
+{
+    Curve* curve = new Curve();
+    curve->id = ++list->nextId;
+    curve->visible = true;
+    curve->listParam = -1;
+    memcpy(curve->color, curvePalette[(curve->id - 1) % ArrayCount(curvePalette)], sizeof(curve->color));
+    list->curves.push_back(curve);
+    SetCurveText(list, curve, text);
+    return curve;
+}
+
+// The list a curve defined goes away with its definition
+static void ClearList(CurveList* list, const Curve* curve)
+{
+    if(curve->def.kind != Def_List) return;
+    
+    list->params.lists[curve->def.param].clear();
+    ++list->params.listVersion;
+}
+
+void RemoveCurve(CurveList* list, Curve* curve)
+{
+    for(size_t i = 0; i < list->curves.size(); ++i)
+    {
+        if(list->curves[i] != curve) continue;
+        
+        ClearList(list, curve);
+        list->curves.erase(list->curves.begin() + i);
+        delete curve;
+        return;
+    }
+}
+
+void FreeCurves(CurveList* list)
+{
+    for(Curve* curve : list->curves)
+        delete curve;
+    list->curves.clear();
+}
+
+Curve* FindCurve(const CurveList* list, uint32_t id)
+{
+    for(Curve* curve : list->curves)
+    {
+        if(curve->id == id) return curve;
+    }
+    return nullptr;
+}
+
+// Elements of a list definition, written out or the steps of a range
+static bool EvalList(CurveList* list, Curve* curve)
+{
+    double vars[Var_Count] = { 0 };
+    double roots[Def_MaxRoots];
+    EvalScalar(&curve->program, vars, list->params.values.data(), roots);
+    
+    std::vector<double>& values = list->params.lists[curve->def.param];
+    values.clear();
+    uint32_t numRoots = curve->def.numRoots;
+    if(curve->def.listRange)
+    {
+        double first = roots[0], last = roots[numRoots - 1];
+        double step = numRoots == 3 ? roots[1] - first : (last >= first ? 1.0 : -1.0);
+        double steps = (last - first) / step;
+        if(!isfinite(first) || !isfinite(last) || !isfinite(step) || step == 0.0 || steps < 0.0)
+        {
+            snprintf(curve->error, sizeof(curve->error), "The range doesn't go from %g to %g", first, last);
+            return false;
+        }
+        if(steps >= Curve_MaxList)
+        {
+            snprintf(curve->error, sizeof(curve->error), "Lists have up to %d elements", Curve_MaxList);
+            return false;
+        }
+        
+        // Computed from the start, rather than accumulated, and the last one included despite rounding
+        int64_t count = (int64_t)floor(steps + 1e-9) + 1;
+        for(int64_t i = 0; i < count; ++i)
+            values.push_back(first + i * step);
+    }
+    else
+    {
+        values.assign(roots, roots + numRoots);
+    }
+    
+    for(double value : values)
+    {
+        if(isfinite(value)) continue;
+        snprintf(curve->error, sizeof(curve->error), "List elements have to be finite");
+        return false;
+    }
+    
+    list->params.values[curve->def.param] = values[0];
+    return true;
+}
+
+Curve* AddPendingCurve(CurveList* list, const char* text)
+{
+    Curve* curve = new Curve();
+    curve->id = ++list->nextId;
+    curve->version = 1;
+    curve->visible = true;
+    curve->pending = true;
+    curve->listParam = -1;
+    memcpy(curve->color, curvePalette[(curve->id - 1) % ArrayCount(curvePalette)], sizeof(curve->color));
+    snprintf(curve->text, sizeof(curve->text), "%s", text);
+    list->curves.push_back(curve);
+    return curve;
+}
+
+void SetCurveText(CurveList* list, Curve* curve, const char* text)
+{
+    snprintf(curve->text, sizeof(curve->text), "%s", text);
+    ++curve->version;
+    curve->xs.clear();
+    curve->ys.clear();
+    CompileCurve(list, curve);
+}
+
+void CompileCurve(CurveList* list, Curve* curve)
+{
+    curve->pending = false;
+    curve->error[0] = '\0';
+    ClearList(list, curve);
+    curve->def.kind = Def_Invalid;
+    curve->specialized.clear();
+    
+    const char* text = curve->text;
+    const char* c = text;
+    while(*c == ' ') ++c;
+    if(!*c) return;
+    
+    // New parameters start at 1, zero would hide most of what they do
+    size_t numParams = list->params.names.size();
+    bool ok = ParseDefinition(text, &list->params, &curve->def);
+    for(size_t p = numParams; p < list->params.names.size(); ++p)
+        list->params.values[p] = 1.0;
+    
+    if(!ok)
+    {
+        snprintf(curve->error, sizeof(curve->error), "%s", curve->def.error);
+        curve->def.kind = Def_Invalid;
+        return;
+    }
+    
+    if(curve->def.kind == Def_Regression)
+    {
+        snprintf(curve->error, sizeof(curve->error), "Regressions are fitted to tables, in the Data window");
+        curve->def.kind = Def_Invalid;
+        return;
+    }
+    
+    CompileDefinition(&curve->def, &curve->program);
+    switch(curve->def.kind)
+    {
+        case Def_List:
+        {
+            if(!EvalList(list, curve))
+            {
+                list->params.lists[curve->def.param].clear();
+                curve->def.kind = Def_Invalid;
+            }
+            ++list->params.listVersion;
+            break;
+        }
+        case Def_Assignment:
+        {
+            if(!list->params.lists[curve->def.param].empty())
+            {
+                list->params.lists[curve->def.param].clear();
+                ++list->params.listVersion;
+            }
+            double vars[Var_Count] = { 0 };
+            list->params.values[curve->def.param] = EvalScalar(&curve->program, vars, list->params.values.data());
+            break;
+        }
+        case Def_Explicit:
+        {
+            // Zero derivatives come back as Ast_Null, they're compiled as constants
+            Ast* ast = &curve->def.ast;
+            AstRef first = AstDerivative(ast, curve->def.roots[0], Op_Var, Var_X);
+            AstRef second = first != Ast_Null ? AstDerivative(ast, first, Op_Var, Var_X) : Ast_Null;
+            AstRef roots[2] = { first != Ast_Null ? first : AstConst(ast, 0.0), second != Ast_Null ? second : AstConst(ast, 0.0) };
+            CompileProgram(ast, roots, 2, &curve->slope);
+            break;
+        }
+        case Def_Implicit:
+            snprintf(curve->error, sizeof(curve->error), "Implicit curves aren't drawn yet");
+            break;
+        default:
+            break;
+    }
+}
+
+// Evaluates a few of the count points both ways, pixels is the size of a
+// pixel for each output. Switching back needs a quarter of the threshold, so
+// a curve on the edge doesn't flicker between the two.
+static bool NeedsDoubleDouble(const Curve* curve, const double* params, const EvalInput vars[Var_Count], int64_t count,
+                              const double* pixels)
+{
+    // Integrals and sums stay in double anyway
+    const Program* program = &curve->program;
+    if(count < 2 || program->numOutputs > 2 || !program->kernels.empty()) return false;
+    
+    double probes[Var_Count][Curve_PrecisionProbes];
+    EvalInput probeVars[Var_Count];
+    for(int v = 0; v < Var_Count; ++v)
+    {
+        for(int k = 0; k < Curve_PrecisionProbes; ++k)
+        {
+            // Spread over the samples, off the grid lines where values tend to be exact
+            int64_t i = (count - 1) * (2 * k + 1) / (2 * Curve_PrecisionProbes);
+            probes[v][k] = vars[v].array ? vars[v].array[i] : vars[v].start + i * vars[v].step;
+        }
+        probeVars[v] = EvalArray(probes[v]);
+    }
+    
+    double plain[2][Curve_PrecisionProbes], hi[2][Curve_PrecisionProbes], lo[2][Curve_PrecisionProbes];
+    double* plainOutputs[2] = { plain[0], plain[1] };
+    double* hiOutputs[2] = { hi[0], hi[1] };
+    double* loOutputs[2] = { lo[0], lo[1] };
+    EvalBatch(program, probeVars, params, Curve_PrecisionProbes, plainOutputs);
+    EvalBatchDD(program, probeVars, nullptr, params, Curve_PrecisionProbes, hiOutputs, loOutputs);
+    
+    double threshold = curve->doubleDouble ? Curve_PrecisionPixels * 0.25 : Curve_PrecisionPixels;
+    for(uint32_t o = 0; o < program->numOutputs; ++o)
+    {
+        for(int k = 0; k < Curve_PrecisionProbes; ++k)
+        {
+            // NaN on one side only is a domain edge the doubles got wrong
+            if(isnan(plain[o][k]) != isnan(hi[o][k])) return true;
+            if(isnan(plain[o][k]) || isinf(hi[o][k])) continue;
+            
+            double error = fabs((plain[o][k] - hi[o][k]) - lo[o][k]);
+            if(error > threshold * pixels[o]) return true;
+        }
+    }
+    
+    return false;
+}
+
+// Everything the samples depend on besides their index
+static uint64_t SampleKey(const Curve* curve, const ParamTable* params, int level)
+{
+    uint64_t key = HashBytes(Hash_Seed, params->values.data(), params->values.size() * sizeof(double));
+    key = HashBytes(key, &curve->version, sizeof(curve->version));
+    key = HashBytes(key, &level, sizeof(level));
+    return HashBytes(key, &curve->doubleDouble, sizeof(curve->doubleDouble));
+}
+
+static bool ReadsParams(const Program* program)
+{
+    for(const Instr& instr : program->code)
+    {
+        if(instr.op == Op_Param) return true;
+    }
+    for(const Program& kernel : program->kernels)
+    {
+        if(ReadsParams(&kernel)) return true;
+    }
+    return false;
+}
+
+// The program to sample in double with the current parameter values, moved
+// to the front of the specializations or compiled into them. Double-double
+// keeps the general program, it evaluates the parameter expressions with
+// more digits than the folded constants have. Shared is the definition
+// reading the subexpressions it shares from bound slots.
+static const Program* SpecializedProgram(Curve* curve, const ParamTable* params, bool shared)
+{
+    if(curve->doubleDouble || (!shared && !ReadsParams(&curve->program))) return &curve->program;
+    
+    std::vector<CurveSpecialization>& cache = curve->specialized;
+    uint64_t key = HashBytes(Hash_Seed, params->values.data(), params->values.size() * sizeof(double));
+    key = HashBytes(key, &shared, sizeof(shared));
+    for(size_t i = 0; i < cache.size(); ++i)
+    {
+        if(cache[i].key != key) continue;
+        
+        std::rotate(cache.begin(), cache.begin() + i, cache.begin() + i + 1);
+        return &cache[0].program;
+    }
+    
+    if(cache.size() == Curve_Specializations) cache.pop_back();
+    cache.insert(cache.begin(), CurveSpecialization());
+    cache[0].key = key;
+    if(shared) CompileSpecialized(&curve->sharedAst, &curve->sharedRoot, 1, params->values.data(), &cache[0].program);
+    else CompileSpecialized(&curve->def.ast, curve->def.roots, curve->def.numRoots, params->values.data(), &cache[0].program);
+    return &cache[0].program;
+}
+
+// The explicit sample grid of the view, false past 2^52 steps from the origin
+// where it can't be represented anymore
+static bool ExplicitGrid(const PlotView* view, int* level, int64_t* first, int64_t* count)
+{
+    *level = (int)floor(log2(PlotPixelWidth(view)));
+    double step = ldexp(1.0, *level);
+    double firstIndex = floor(view->xMin / step) - 1.0;
+    double lastIndex = ceil(view->xMax / step) + 1.0;
+    if(!(fabs(firstIndex) < 4e15 && fabs(lastIndex) < 4e15)) return false;
+    
+    *first = (int64_t)firstIndex;
+    *count = (int64_t)lastIndex - *first + 1;
+    return true;
+}
+
+static uint64_t SubtermKey(const ParamTable* params, int level)
+{
+    uint64_t key = HashBytes(Hash_Seed, params->values.data(), params->values.size() * sizeof(double));
+    return HashBytes(key, &level, sizeof(level));
+}
+
+static void EvalSamples(Curve* curve, const ParamTable* paramTable, const SubtermTable* subterms, int64_t begin, int64_t end)
+{
+    if(begin >= end) return;
+    
+    const double* params = paramTable->values.data();
+    EvalInput vars[Var_Count] = { EvalArray(curve->xs.data() + begin), EvalConstant(0.0), EvalConstant(0.0) };
+    double* outputs[1] = { curve->ys.data() + begin };
+    if(curve->doubleDouble)
+    {
+        EvalBatchParallelDD(&curve->program, vars, nullptr, params, end - begin, outputs);
+        return;
+    }
+    
+    // Shared subexpressions, when they've been sampled over these samples
+    EvalInput bound[Ast_MaxBindings] = {};
+    bool shared = subterms && curve->numShared > 0;
+    uint64_t key = SubtermKey(paramTable, curve->sampleLevel);
+    for(uint32_t k = 0; k < curve->numShared && shared; ++k)
+    {
+        auto found = subterms->terms.find(curve->sharedTerms[k]);
+        const Subterm* term = found != subterms->terms.end() ? &found->second : nullptr;
+        int64_t offset = term ? curve->firstSample + begin - term->firstSample : 0;
+        shared = term && term->sampleKey == key && offset >= 0 && offset + (end - begin) <= (int64_t)term->values.size();
+        if(shared) bound[k] = EvalArray(term->values.data() + offset);
+    }
+    
+    if(shared) EvalBatchParallelBound(SpecializedProgram(curve, paramTable, true), vars, bound, params, end - begin, outputs);
+    else EvalBatchParallel(SpecializedProgram(curve, paramTable, false), vars, params, end - begin, outputs);
+}
+
+// Samples still in view are kept while the level and the key don't change,
+// panning only evaluates the ones coming in
+static void SampleExplicit(Curve* curve, const ParamTable* paramTable, const SubtermTable* subterms, const PlotView* view)
+{
+    const double* params = paramTable->values.data();
+    int level;
+    int64_t firstIndex, count;
+    if(!ExplicitGrid(view, &level, &firstIndex, &count))
+    {
+        curve->xs.clear();
+        curve->ys.clear();
+        return;
+    }
+    double step = ldexp(1.0, level);
+    
+    int64_t oldFirst = curve->firstSample;
+    int64_t oldEnd = oldFirst + (int64_t)curve->ys.size();
+    uint64_t oldKey = curve->sampleKey;
+    
+    curve->sampleLevel = level;
+    curve->sampleStep = step;
+    curve->firstSample = firstIndex;
+    curve->xs.resize(count);
+    for(int64_t i = 0; i < count; ++i)
+        curve->xs[i] = (curve->firstSample + i) * step;
+    
+    EvalInput vars[Var_Count] = { EvalArray(curve->xs.data()), EvalConstant(0.0), EvalConstant(0.0) };
+    double pixels[1] = { PlotPixelHeight(view) };
+    curve->doubleDouble = NeedsDoubleDouble(curve, params, vars, count, pixels);
+    curve->sampleKey = SampleKey(curve, paramTable, level);
+    
+    int64_t first = curve->firstSample, end = first + count;
+    int64_t keptFirst = first > oldFirst ? first : oldFirst;
+    int64_t keptEnd = end < oldEnd ? end : oldEnd;
+    if(curve->sampleKey != oldKey || keptFirst >= keptEnd)
+    {
+        curve->ys.resize(count);
+        EvalSamples(curve, paramTable, subterms, 0, count);
+        return;
+    }
+    
+    if(curve->ys.size() < (size_t)count) curve->ys.resize(count);
+    memmove(curve->ys.data() + (keptFirst - first), curve->ys.data() + (keptFirst - oldFirst), (keptEnd - keptFirst) * sizeof(double));
+    curve->ys.resize(count);
+    EvalSamples(curve, paramTable, subterms, 0, keptFirst - first);
+    EvalSamples(curve, paramTable, subterms, keptEnd - first, count);
+}
+
+static void EvalParametric(Curve* curve, const ParamTable* paramTable, const double* ts, int64_t count, double* xs, double* ys)
+{
+    // Both coordinates in the same pass over the program
+    const double* params = paramTable->values.data();
+    EvalInput vars[Var_Count] = { EvalConstant(0.0), EvalConstant(0.0), EvalArray(ts) };
+    double* outputs[2] = { xs, ys };
+    if(curve->doubleDouble) EvalBatchParallelDD(&curve->program, vars, nullptr, params, count, outputs);
+    else EvalBatchParallel(SpecializedProgram(curve, paramTable, false), vars, params, count, outputs);
+}
+
+// Whether the step between samples i and i + 1 needs a sample in between.
+// Points are in pixels, segments far from the area aren't split.
+static bool NeedsSplit(const double* xs, const double* ys, int64_t i, int64_t count, const double* area)
+{
+    double x0 = xs[i], y0 = ys[i], x1 = xs[i + 1], y1 = ys[i + 1];
+    bool finite0 = isfinite(x0) && isfinite(y0), finite1 = isfinite(x1) && isfinite(y1);
+    if(!finite0 || !finite1) return finite0 != finite1;  // Closer to the edge of the domain
+    
+    double dx = x1 - x0, dy = y1 - y0;
+    double length = sqrt(dx * dx + dy * dy);
+    if(fmax(x0, x1) + length < area[0] || fmin(x0, x1) - length > area[2]) return false;
+    if(fmax(y0, y1) + length < area[1] || fmin(y0, y1) - length > area[3]) return false;
+    if(length > Curve_SegmentPixels) return true;
+    if(length < 0.5) return false;
+    
+    // Turns at either end, against the neighbouring segments
+    for(int side = 0; side < 2; ++side)
+    {
+        int64_t j = side == 0 ? i - 1 : i + 2;
+        if(j < 0 || j >= count || !isfinite(xs[j]) || !isfinite(ys[j])) continue;
+        
+        double ex = side == 0 ? x0 - xs[j] : xs[j] - x1;
+        double ey = side == 0 ? y0 - ys[j] : ys[j] - y1;
+        double turn = atan2(fabs(dx * ey - dy * ex), dx * ex + dy * ey);
+        if(turn > Curve_SegmentTurn) return true;
+    }
+    return false;
+}
+
+// A coarse uniform grid, then rounds of halving the steps that are too long or
+// turn too sharply on screen, each round evaluating its new samples in one batch
+static void SampleParametric(Curve* curve, const ParamTable* paramTable, const PlotView* view)
+{
+    const double* params = paramTable->values.data();
+    const int64_t startCount = Curve_ParametricStart + 1;
+    double step = 2.0 * 3.14159265358979323846 / Curve_ParametricStart;
+    
+    EvalInput vars[Var_Count] = { EvalConstant(0.0), EvalConstant(0.0), EvalRamp(0.0, step) };
+    double pixels[2] = { PlotPixelWidth(view), PlotPixelHeight(view) };
+    curve->doubleDouble = NeedsDoubleDouble(curve, params, vars, startCount, pixels);
+    
+    // Refined for the view and as much again around it, so panning a little doesn't start over
+    int levelX = (int)floor(log2(pixels[0])), levelY = (int)floor(log2(pixels[1]));
+    double rangeX = view->xMax - view->xMin, rangeY = view->yMax - view->yMin;
+    uint64_t key = HashBytes(SampleKey(curve, paramTable, levelX), &levelY, sizeof(levelY));
+    const double* area = curve->sampleArea;
+    bool inArea = view->xMin >= area[0] && view->yMin >= area[1] && view->xMax <= area[2] && view->yMax <= area[3];
+    if(inArea && HashBytes(key, area, 4 * sizeof(double)) == curve->sampleKey && curve->ys.size() >= 2) return;
+    
+    double newArea[4] = { view->xMin - rangeX, view->yMin - rangeY, view->xMax + rangeX, view->yMax + rangeY };
+    memcpy(curve->sampleArea, newArea, sizeof(newArea));
+    curve->sampleKey = HashBytes(key, newArea, sizeof(newArea));
+    curve->firstSample = 0;
+    
+    std::vector<double> ts(startCount);
+    for(int64_t i = 0; i < startCount; ++i)
+        ts[i] = i * step;
+    curve->xs.resize(startCount);
+    curve->ys.resize(startCount);
+    EvalParametric(curve, paramTable, ts.data(), startCount, curve->xs.data(), curve->ys.data());
+    
+    double pixelArea[4] = { newArea[0] / pixels[0], newArea[1] / pixels[1], newArea[2] / pixels[0], newArea[3] / pixels[1] };
+    std::vector<double> px, py, midTs, midXs, midYs, nextTs, nextXs, nextYs;
+    std::vector<int64_t> splits;
+    for(int depth = 0; depth < Curve_ParametricDepth; ++depth)
+    {
+        int64_t count = (int64_t)ts.size();
+        px.resize(count);
+        py.resize(count);
+        for(int64_t i = 0; i < count; ++i)
+        {
+            px[i] = curve->xs[i] / pixels[0];
+            py[i] = curve->ys[i] / pixels[1];
+        }
+        
+        splits.clear();
+        for(int64_t i = 0; i + 1 < count && count + (int64_t)splits.size() < Curve_ParametricMaxSamples; ++i)
+        {
+            if(NeedsSplit(px.data(), py.data(), i, count, pixelArea)) splits.push_back(i);
+        }
+        if(splits.empty()) break;
+        
+        int64_t numSplits = (int64_t)splits.size();
+        midTs.resize(numSplits);
+        midXs.resize(numSplits);
+        midYs.resize(numSplits);
+        for(int64_t k = 0; k < numSplits; ++k)
+            midTs[k] = (ts[splits[k]] + ts[splits[k] + 1]) * 0.5;
+        EvalParametric(curve, paramTable, midTs.data(), numSplits, midXs.data(), midYs.data());
+        
+        // Merged in order of t
+        nextTs.clear();
+        nextXs.clear();
+        nextYs.clear();
+        for(int64_t i = 0, k = 0; i < count; ++i)
+        {
+            nextTs.push_back(ts[i]);
+            nextXs.push_back(curve->xs[i]);
+            nextYs.push_back(curve->ys[i]);
+            if(k < numSplits && splits[k] == i)
+            {
+                nextTs.push_back(midTs[k]);
+                nextXs.push_back(midXs[k]);
+                nextYs.push_back(midYs[k]);
+                ++k;
+            }
+        }
+        ts.swap(nextTs);
+        curve->xs.swap(nextXs);
+        curve->ys.swap(nextYs);
+        if((int64_t)ts.size() >= Curve_ParametricMaxSamples) break;
+    }
+}
+
+// First parameter holding a list that the program reads, -1 when there's none
+static int FindListParam(const Program* program, const ParamTable* params)
+{
+    for(const Instr& instr : program->code)
+    {
+        if(instr.op == Op_Param && !params->lists[instr.index].empty()) return (int)instr.index;
+    }
+    for(const Program& kernel : program->kernels)
+    {
+        int param = FindListParam(&kernel, params);
+        if(param >= 0) return param;
+    }
+    return -1;
+}
+
+// One row per element of the list, all of them evaluated again when anything
+// changes: the explicit grid moves when panning, and parametric rows aren't
+// refined for the view
+static void SampleList(Curve* curve, const ParamTable* paramTable, const PlotView* view)
+{
+    const std::vector<double>& list = paramTable->lists[curve->listParam];
+    int64_t rows = (int64_t)list.size();
+    bool parametric = curve->def.kind == Def_Parametric;
+    
+    int level = 0;
+    double start = 0.0, step = 2.0 * 3.14159265358979323846 / Curve_ParametricStart;
+    int64_t count = Curve_ParametricStart + 1;
+    for(level = (int)floor(log2(PlotPixelWidth(view))); !parametric; ++level)
+    {
+        // The grid of SampleExplicit, coarser until all the rows fit
+        step = ldexp(1.0, level);
+        double firstIndex = floor(view->xMin / step) - 1.0;
+        double lastIndex = ceil(view->xMax / step) + 1.0;
+        if(!(fabs(firstIndex) < 4e15 && fabs(lastIndex) < 4e15))
+        {
+            curve->xs.clear();
+            curve->ys.clear();
+            return;
+        }
+        
+        start = firstIndex * step;
+        count = (int64_t)(lastIndex - firstIndex) + 1;
+        if((count + 1) * rows <= Curve_ListMaxSamples || count <= 3) break;
+    }
+    
+    curve->doubleDouble = false;
+    uint64_t key = SampleKey(curve, paramTable, parametric ? 0 : level);
+    key = HashBytes(key, &start, sizeof(start));
+    key = HashBytes(key, &paramTable->listVersion, sizeof(paramTable->listVersion));
+    if(key == curve->sampleKey && curve->listRows == rows && !curve->ys.empty()) return;
+    
+    curve->sampleKey = key;
+    curve->sampleLevel = level;
+    curve->sampleStep = step;
+    curve->firstSample = 0;
+    curve->listRows = rows;
+    
+    // Each row followed by a NaN sample, so the segment to the next one isn't drawn
+    int64_t stride = count + 1;
+    curve->xs.resize(stride * rows);
+    curve->ys.resize(stride * rows);
+    for(int64_t r = 0; r < rows; ++r)
+    {
+        double* xs = curve->xs.data() + r * stride;
+        for(int64_t i = 0; !parametric && i < count; ++i)
+            xs[i] = start + i * step;
+        xs[count] = NAN;
+        curve->ys[r * stride + count] = NAN;
+    }
+    
+    EvalInput vars[Var_Count] = { EvalConstant(0.0), EvalConstant(0.0), EvalConstant(0.0) };
+    vars[parametric ? Var_T : Var_X] = EvalRamp(start, step);
+    double* outputs[2] = { curve->xs.data(), curve->ys.data() };
+    EvalBroadcast(&curve->program, vars, paramTable->values.data(), (int)paramTable->values.size(), curve->listParam,
+                  list.data(), rows, count, stride, parametric ? outputs : outputs + 1);
+}
+
+// Whether the tree has integrals or sums, which use the bound slots
+static bool HasBindings(const Ast* ast, AstRef ref)
+{
+    const AstNode* node = &ast->nodes[ref];
+    if(node->op == Op_Integral || node->op == Op_Sum) return true;
+    for(int i = 0; i < node->childCount; ++i)
+    {
+        if(HasBindings(ast, node->children[i])) return true;
+    }
+    return false;
+}
+
+// Finds the subexpressions the explicit curves share and rewrites the curves
+// to read them, when the curves or the lists changed since the last plan
+static void PlanSubterms(CurveList* list)
+{
+    SubtermTable* table = &list->subterms;
+    uint64_t planKey = HashBytes(Hash_Seed, &list->params.listVersion, sizeof(list->params.listVersion));
+    for(const Curve* curve : list->curves)
+    {
+        planKey = HashBytes(planKey, &curve->id, sizeof(curve->id));
+        planKey = HashBytes(planKey, &curve->version, sizeof(curve->version));
+        planKey = HashBytes(planKey, &curve->visible, sizeof(curve->visible));
+    }
+    if(planKey == table->planKey) return;
+    table->planKey = planKey;
+    
+    // Distinct curves each subexpression is found in
+    std::vector<Curve*> eligible;
+    std::vector<std::vector<SubtermNode>> hashes;
+    std::unordered_map<uint64_t, uint32_t> counts;
+    for(Curve* curve : list->curves)
+    {
+        curve->numShared = 0;
+        curve->specialized.clear();
+        if(!curve->visible || curve->def.kind != Def_Explicit) continue;
+        if(FindListParam(&curve->program, &list->params) >= 0 || HasBindings(&curve->def.ast, curve->def.roots[0])) continue;
+        
+        eligible.push_back(curve);
+        hashes.emplace_back();
+        HashSubterms(&curve->def.ast, curve->def.roots[0], &hashes.back());
+        
+        std::vector<uint64_t> found;
+        for(const SubtermNode& node : hashes.back())
+        {
+            if(node.visited && node.usesX && node.size >= Subterm_MinNodes) found.push_back(node.hash);
+        }
+        std::sort(found.begin(), found.end());
+        found.erase(std::unique(found.begin(), found.end()), found.end());
+        for(uint64_t hash : found)
+            ++counts[hash];
+    }
+    
+    for(auto& entry : table->terms)
+        entry.second.numCurves = 0;
+    
+    // The largest shared subexpressions of each curve, from the root down
+    for(size_t c = 0; c < eligible.size(); ++c)
+    {
+        Curve* curve = eligible[c];
+        const std::vector<SubtermNode>& nodes = hashes[c];
+        std::vector<AstRef> stack(1, curve->def.roots[0]);
+        while(!stack.empty() && curve->numShared < Ast_MaxBindings)
+        {
+            AstRef ref = stack.back();
+            stack.pop_back();
+            const SubtermNode* node = &nodes[ref];
+            if(node->usesX && node->size >= Subterm_MinNodes && counts[node->hash] >= 2)
+            {
+                bool known = false;
+                for(uint32_t k = 0; k < curve->numShared; ++k)
+                    known |= curve->sharedTerms[k] == node->hash;
+                if(!known) curve->sharedTerms[curve->numShared++] = node->hash;
+                continue;
+            }
+            
+            const AstNode* astNode = &curve->def.ast.nodes[ref];
+            for(int i = astNode->childCount - 1; i >= 0; --i)
+                stack.push_back(astNode->children[i]);
+        }
+        if(curve->numShared == 0) continue;
+        
+        curve->sharedAst.nodes.clear();
+        curve->sharedRoot = CopySubterm(&curve->def.ast, curve->def.roots[0], &nodes, curve->sharedTerms, curve->numShared,
+                                        &curve->sharedAst);
+        
+        // New subexpressions are compiled from the first curve they're found in
+        for(uint32_t k = 0; k < curve->numShared; ++k)
+        {
+            auto inserted = table->terms.emplace(curve->sharedTerms[k], Subterm());
+            Subterm* term = &inserted.first->second;
+            ++term->numCurves;
+            if(!inserted.second) continue;
+            
+            for(AstRef ref = 0; ref < (AstRef)nodes.size(); ++ref)
+            {
+                if(!nodes[ref].visited || nodes[ref].hash != curve->sharedTerms[k]) continue;
+                term->root = CopySubterm(&curve->def.ast, ref, &nodes, nullptr, 0, &term->ast);
+                break;
+            }
+            CompileProgram(&term->ast, &term->root, 1, &term->program);
+            term->sampleKey = 0;
+        }
+    }
+    
+    for(auto it = table->terms.begin(); it != table->terms.end();)
+    {
+        if(it->second.numCurves == 0) it = table->terms.erase(it);
+        else ++it;
+    }
+}
+
+// Samples the shared subexpressions on the explicit grid of the view, those
+// still in view are kept while panning like the samples of the curves
+static void SampleSubterms(CurveList* list, const PlotView* view)
+{
+    int level;
+    int64_t first, count;
+    if(!ExplicitGrid(view, &level, &first, &count)) return;
+    
+    double step = ldexp(1.0, level);
+    uint64_t key = SubtermKey(&list->params, level);
+    const double* params = list->params.values.data();
+    for(auto& entry : list->subterms.terms)
+    {
+        Subterm* term = &entry.second;
+        int64_t oldFirst = term->firstSample, oldEnd = oldFirst + (int64_t)term->values.size();
+        int64_t end = first + count;
+        int64_t keptFirst = first > oldFirst ? first : oldFirst;
+        int64_t keptEnd = end < oldEnd ? end : oldEnd;
+        bool keep = term->sampleKey == key && keptFirst < keptEnd;
+        
+        std::vector<double> values(count);
+        if(keep) memcpy(values.data() + (keptFirst - first), term->values.data() + (keptFirst - oldFirst), (keptEnd - keptFirst) * sizeof(double));
+        int64_t ranges[2][2] = { { 0, keep ? keptFirst - first : count }, { keep ? keptEnd - first : count, count } };
+        for(const auto& range : ranges)
+        {
+            if(range[0] >= range[1]) continue;
+            
+            EvalInput vars[Var_Count] = { EvalRamp((first + range[0]) * step, step), EvalConstant(0.0), EvalConstant(0.0) };
+            double* outputs[1] = { values.data() + range[0] };
+            EvalBatchParallel(&term->program, vars, params, range[1] - range[0], outputs);
+        }
+        
+        term->values.swap(values);
+        term->firstSample = first;
+        term->sampleKey = key;
+    }
+}
+
+static void SampleCurveWith(Curve* curve, const ParamTable* params, const SubtermTable* subterms, const PlotView* view)
+{
+    bool drawn = curve->def.kind == Def_Explicit || curve->def.kind == Def_Parametric;
+    curve->listParam = drawn ? FindListParam(&curve->program, params) : -1;
+    if(curve->listParam >= 0) SampleList(curve, params, view);
+    else if(curve->def.kind == Def_Explicit) SampleExplicit(curve, params, subterms, view);
+    else if(curve->def.kind == Def_Parametric) SampleParametric(curve, params, view);
+}
+
+void SampleCurve(Curve* curve, const ParamTable* params, const PlotView* view)
+{
+    SampleCurveWith(curve, params, nullptr, view);
+}
+
+void SampleCurves(CurveList* list, const PlotView* view)
+{
+    for(Curve* curve : list->curves)
+    {
+        if(curve->visible && curve->pending) CompileCurve(list, curve);
+    }
+    
+    PlanSubterms(list);
+    SampleSubterms(list, view);
+    for(Curve* curve : list->curves)
+    {
+        if(curve->visible) SampleCurveWith(curve, &list->params, &list->subterms, view);
+    }
+}
+
+Curve* PickCurve(const CurveList* list, const PlotView* view, double x, double y)
+{
+    double pixelX = PlotPixelWidth(view);
+    double pixelY = PlotPixelHeight(view);
+    Curve* best = nullptr;
+    double bestDistance = Curve_PickPixels;
+    
+    for(Curve* curve : list->curves)
+    {
+        if(!curve->visible || curve->def.kind != Def_Explicit || curve->listParam >= 0 || curve->ys.size() < 2) continue;
+        
+        // Distance in pixels to the segments around x
+        int64_t center = (int64_t)floor(x / curve->sampleStep) - curve->firstSample;
+        int64_t reach = (int64_t)ceil(Curve_PickPixels * pixelX / curve->sampleStep) + 1;
+        int64_t first = center - reach > 0 ? center - reach : 0;
+        int64_t last = center + reach < (int64_t)curve->ys.size() - 1 ? center + reach : (int64_t)curve->ys.size() - 1;
+        for(int64_t i = first; i < last; ++i)
+        {
+            double ax = (curve->xs[i] - x) / pixelX, ay = (curve->ys[i] - y) / pixelY;
+            double bx = (curve->xs[i + 1] - x) / pixelX, by = (curve->ys[i + 1] - y) / pixelY;
+            if(!isfinite(ay) || !isfinite(by)) continue;
+            
+            double dx = bx - ax, dy = by - ay;
+            double lengthSq = dx * dx + dy * dy;
+            double t = lengthSq > 0.0 ? fmin(fmax(-(ax * dx + ay * dy) / lengthSq, 0.0), 1.0) : 0.0;
+            double distance = hypot(ax + t * dx, ay + t * dy);
+            if(distance < bestDistance)
+            {
+                bestDistance = distance;
+                best = curve;
+            }
+        }
+    }
+    
+    return best;
+}
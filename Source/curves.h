@@ -0,0 +1,127 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "parser.h"
+#include "compiler.h"
+#include "plot.h"
+#include "subterms.h"
+
+// Expressions plotted over the data. Explicit curves are sampled every frame
+// on a grid aligned to the origin, with a step that's a power of two between
+// half a pixel and a pixel: samples don't move while panning, and a sample
+// index means the same x until the zoom crosses a power of two. The samples
+// still in view are kept from frame to frame, so panning only evaluates the
+// ones coming in. Parametric and polar curves are sampled over t in
+// [0, 2pi], starting from a coarse uniform grid and splitting the steps whose
+// segments are long on screen or turn sharply, until they're smooth at the
+// current zoom. Only the steps near the view are split, the samples are kept
+// until the zoom crosses a power of two or the view leaves the area they were
+// refined for. Implicit ones aren't drawn yet.
+//
+// Curves using a list parameter (a = [1...1000], y = a x) are one program
+// broadcast over the elements (see EvalBroadcast), not a curve per element:
+// the rows of samples are stored one after the other, each followed by a NaN
+// sample so no segment joins them, and drawn together. Explicit rows share
+// the grid, coarsened when they'd have too many samples in total, and
+// parametric ones use the uniform steps without refinement. Only the first
+// list the program uses is broadcast over, other lists are their first
+// element. Lists are always evaluated in double.
+//
+// While parameters stay the same, explicit and parametric curves are sampled
+// with a program specialized for their values (see CompileSpecialized). The
+// last few are kept, so dragging a slider back and forth or replaying an
+// animation compiles each value once.
+//
+// Subexpressions found in several explicit curves are sampled once and read
+// back by each of them, see subterms.h.
+//
+// A few samples of every curve are also evaluated in double-double. When
+// they differ from the doubles by a visible fraction of a pixel the whole
+// curve is evaluated in double-double, until the difference is well below
+// that again.
+
+#define Curve_MaxText 256
+#define Curve_ParametricStart 256          // Uniform steps the refinement starts from
+#define Curve_ParametricMaxSamples 65536
+#define Curve_ParametricDepth 16           // Times a step can be halved
+#define Curve_SegmentPixels 4.0            // Longest segment on screen
+#define Curve_SegmentTurn 0.1              // Radians, sharpest turn between segments
+#define Curve_MaxList 100000               // Elements of a list
+#define Curve_ListMaxSamples (1 << 21)      // Over all the rows of a list
+#define Curve_Specializations 8            // Programs kept per curve, for recent parameter values
+#define Curve_PrecisionProbes 16
+#define Curve_PrecisionPixels 0.125  // Rounding that shows, in pixels
+
+struct CurveSpecialization
+{
+    uint64_t key;  // Hash of the parameter values
+    Program program;
+};
+
+struct Curve
+{
+    uint32_t id;  // Unique in the list
+    uint32_t version;  // Bumped when the text changes
+    char text[Curve_MaxText];
+    bool visible;
+    bool pending;  // Text not parsed yet, see AddPendingCurve
+    float color[4];
+    
+    Definition def;
+    Program program;
+    Program slope;  // Explicit curves: the first and second derivatives in x
+    std::vector<CurveSpecialization> specialized;  // Most recently used first
+    
+    // Explicit curves sharing subexpressions with others (see subterms.h):
+    // the definition reading them from bound slots, by hash
+    Ast sharedAst;
+    AstRef sharedRoot;
+    uint64_t sharedTerms[Ast_MaxBindings];
+    uint32_t numShared;
+    char error[128];  // Of the last parse
+    std::vector<double> starts;  // Fields: (x, y) points the solutions go through, kept across edits
+    int listParam;  // List the samples are broadcast over, -1 for none
+    int64_t listRows;
+    
+    // Samples of the current view, explicit ones at x = (firstSample + i) * sampleStep
+    int sampleLevel;  // sampleStep is 2^sampleLevel
+    double sampleStep;
+    int64_t firstSample;
+    bool doubleDouble;  // The view is too deep for doubles
+    uint64_t sampleKey;  // Parameters, text, level and precision the samples were taken with
+    double sampleArea[4];  // Parametric: xMin, yMin, xMax and yMax the samples were refined for
+    std::vector<double> xs;
+    std::vector<double> ys;
+};
+
+struct CurveList
+{
+    ParamTable params;
+    std::vector<Curve*> curves;
+    SubtermTable subterms;
+    uint32_t nextId = 0;
+};
+
+Curve* AddCurve(CurveList* list, const char* text);
+void RemoveCurve(CurveList* list, Curve* curve);
+// Parses and compiles the new text, assignments and lists set their parameter
+void SetCurveText(CurveList* list, Curve* curve, const char* text);
+// Adds a curve without parsing its text, SampleCurves compiles it once it's
+// visible. For sessions (see session.h), where most curves may be hidden.
+Curve* AddPendingCurve(CurveList* list, const char* text);
+// Parses and compiles the text as it is, keeping the samples
+void CompileCurve(CurveList* list, Curve* curve);
+void FreeCurves(CurveList* list);
+Curve* FindCurve(const CurveList* list, uint32_t id);
+
+// Samples every visible curve for the view, they're drawn by the GPU (see curvelines.h)
+void SampleCurves(CurveList* list, const PlotView* view);
+// One curve with the given parameters. Only touches the curve, so copies can
+// be sampled on worker threads (see animation.h).
+void SampleCurve(Curve* curve, const ParamTable* params, const PlotView* view);
+
+// Visible explicit curve passing within a few pixels of the point, or null.
+// Curves drawn over a list aren't picked.
+Curve* PickCurve(const CurveList* list, const PlotView* view, double x, double y);
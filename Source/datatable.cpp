@@ -0,0 +1,613 @@
+#include "datatable.h"
+#include "core.h"
+#include "jobs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdarg.h>
+#include <string>
+#include <atomic>
+
+// Tables may be read on any thread
+static std::atomic<uint32_t> nextTableId{0};
+
+static void SetError(char* error, int errorSize, const char* fmt, ...)
+{
+    if(!error || errorSize <= 0) return;
+    
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(error, errorSize, fmt, args);
+    va_end(args);
+}
+
+// SWAR digit parsing: checks and converts 8 ascii digits at a time
+// using 64 bit integer arithmetic (little endian loads).
+static uint64_t LoadEightBytes(const char* str)
+{
+    uint64_t v;
+    memcpy(&v, str, sizeof(uint64_t));
+    return v;
+}
+
+static bool IsEightDigits(uint64_t v)
+{
+    return ((v & 0xF0F0F0F0F0F0F0F0ull) | (((v + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4)) == 0x3333333333333333ull;
+}
+
+static uint32_t ParseEightDigits(uint64_t v)
+{
+    const uint64_t mask = 0x000000FF000000FFull;
+    const uint64_t mul1 = 0x000F424000000064ull;  // 100 + (1000000 << 32)
+    const uint64_t mul2 = 0x0000271000000001ull;  // 1 + (10000 << 32)
+    v -= 0x3030303030303030ull;
+    v = (v * 10) + (v >> 8);
+    v = (((v & mask) * mul1) + (((v >> 16) & mask) * mul2)) >> 32;
+    return (uint32_t)v;
+}
+
+static inline bool IsDigitChar(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+// Scans a run of digits into the mantissa, returns the number of digits.
+// Past 19 significant digits the mantissa can't be exact anymore.
+static int ScanDigits(const char** str, const char* end, uint64_t* mantissa, int* significant, bool* overflow)
+{
+    const char* p = *str;
+    while(end - p >= 8 && *significant + 8 <= 19 && IsEightDigits(LoadEightBytes(p)))
+    {
+        *mantissa = *mantissa * 100000000ull + ParseEightDigits(LoadEightBytes(p));
+        *significant += 8;
+        p += 8;
+    }
+    
+    while(p < end && IsDigitChar(*p))
+    {
+        if(*significant < 19)
+        {
+            *mantissa = *mantissa * 10 + (uint64_t)(*p - '0');
+            if(*mantissa != 0) ++*significant;
+        }
+        else
+        {
+            *overflow = true;
+        }
+        ++p;
+    }
+    
+    int count = (int)(p - *str);
+    *str = p;
+    return count;
+}
+
+int ParseNumber(const char* str, const char* end, double* out)
+{
+    static const double powersOf10[] =
+    {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    
+    const char* p = str;
+    bool negative = false;
+    if(p < end && (*p == '-' || *p == '+'))
+    {
+        negative = *p == '-';
+        ++p;
+    }
+    
+    uint64_t mantissa = 0;
+    int significant = 0;
+    bool overflow = false;
+    int64_t exp10 = 0;
+    
+    int intDigits = ScanDigits(&p, end, &mantissa, &significant, &overflow);
+    int fracDigits = 0;
+    if(p < end && *p == '.')
+    {
+        ++p;
+        fracDigits = ScanDigits(&p, end, &mantissa, &significant, &overflow);
+        exp10 -= fracDigits;
+    }
+    
+    if(intDigits + fracDigits == 0) return 0;
+    
+    if(p < end && (*p == 'e' || *p == 'E'))
+    {
+        const char* e = p + 1;
+        bool negativeExp = false;
+        if(e < end && (*e == '-' || *e == '+'))
+        {
+            negativeExp = *e == '-';
+            ++e;
+        }
+        
+        if(e < end && IsDigitChar(*e))
+        {
+            int64_t exp = 0;
+            while(e < end && IsDigitChar(*e))
+            {
+                if(exp < 100000) exp = exp * 10 + (*e - '0');
+                ++e;
+            }
+            exp10 += negativeExp ? -exp : exp;
+            p = e;
+        }
+    }
+    
+    // Exact when both the mantissa and the power of 10 are exactly representable
+    if(!overflow && mantissa <= (1ull << 53) && exp10 >= -22 && exp10 <= 22)
+    {
+        double value = (double)mantissa;
+        value = exp10 < 0 ? value / powersOf10[-exp10] : value * powersOf10[exp10];
+        *out = negative ? -value : value;
+        return (int)(p - str);
+    }
+    
+    // Slow path for everything else
+    char buffer[128];
+    int length = (int)(p - str);
+    if(length >= (int)sizeof(buffer))
+    {
+        *out = NAN;
+        return length;
+    }
+    
+    memcpy(buffer, str, length);
+    buffer[length] = '\0';
+    *out = strtod(buffer, nullptr);
+    return length;
+}
+
+static bool IsBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// Field with surrounding spaces and quotes stripped
+static void TrimField(const char** start, const char** end)
+{
+    while(*start < *end && IsBlank(**start)) ++*start;
+    while(*end > *start && IsBlank((*end)[-1])) --*end;
+    if(*end - *start >= 2 && **start == '"' && (*end)[-1] == '"')
+    {
+        ++*start;
+        --*end;
+    }
+}
+
+static double ParseField(const char* start, const char* end)
+{
+    TrimField(&start, &end);
+    
+    double value;
+    int consumed = ParseNumber(start, end, &value);
+    if(consumed == 0 || start + consumed != end) return NAN;
+    return value;
+}
+
+static const char* LineEnd(const char* line, const char* end)
+{
+    const char* newline = (const char*)memchr(line, '\n', end - line);
+    return newline ? newline : end;
+}
+
+static bool IsBlankLine(const char* line, const char* lineEnd)
+{
+    return line == lineEnd || (lineEnd - line == 1 && *line == '\r');
+}
+
+// Quoted fields are supported, but not delimiters or newlines inside of quotes
+static void ParseLine(const char* line, const char* lineEnd, char delimiter, DataTable* table, int64_t row)
+{
+    int64_t rowCount = table->rowCount;
+    int columnCount = (int)table->columns.size();
+    double* storage = table->doubleStorage.data();
+    
+    const char* field = line;
+    int column = 0;
+    while(column < columnCount)
+    {
+        const char* fieldEnd = (const char*)memchr(field, delimiter, lineEnd - field);
+        if(!fieldEnd) fieldEnd = lineEnd;
+        
+        storage[column * rowCount + row] = ParseField(field, fieldEnd);
+        ++column;
+        
+        if(fieldEnd == lineEnd) break;
+        field = fieldEnd + 1;
+    }
+    
+    // Missing fields
+    for(; column < columnCount; ++column)
+        storage[column * rowCount + row] = NAN;
+}
+
+static char DetectDelimiter(const char* line, const char* lineEnd)
+{
+    const char candidates[] = { ',', ';', '\t' };
+    char best = ',';
+    int bestCount = 0;
+    for(char candidate : candidates)
+    {
+        int count = 0;
+        for(const char* c = line; c < lineEnd; ++c)
+            count += *c == candidate;
+        
+        if(count > bestCount)
+        {
+            best = candidate;
+            bestCount = count;
+        }
+    }
+    
+    return best;
+}
+
+// Fills in the float copies and the ranges of all columns
+static void FinalizeColumns(DataTable* table)
+{
+    int64_t rowCount = table->rowCount;
+    int numTasks = GetNumJobThreads();
+    std::vector<double> mins(numTasks), maxs(numTasks);
+    
+    for(size_t c = 0; c < table->columns.size(); ++c)
+    {
+        DataColumn* column = &table->columns[c];
+        const double* src = column->values;
+        float* dst = (float*)column->valuesF32;
+        
+        for(int i = 0; i < numTasks; ++i)
+        {
+            mins[i] = INFINITY;
+            maxs[i] = -INFINITY;
+        }
+        
+        ParallelFor(rowCount, 1 << 16, [&](int64_t begin, int64_t end, int task)
+        {
+            double min = mins[task];
+            double max = maxs[task];
+            for(int64_t i = begin; i < end; ++i)
+            {
+                double v = src[i];
+                dst[i] = (float)v;
+                if(isfinite(v))
+                {
+                    min = v < min ? v : min;
+                    max = v > max ? v : max;
+                }
+            }
+            
+            mins[task] = min;
+            maxs[task] = max;
+        });
+        
+        column->min = INFINITY;
+        column->max = -INFINITY;
+        for(int i = 0; i < numTasks; ++i)
+        {
+            if(mins[i] < column->min) column->min = mins[i];
+            if(maxs[i] > column->max) column->max = maxs[i];
+        }
+        
+        if(column->min > column->max)
+        {
+            column->min = NAN;
+            column->max = NAN;
+        }
+    }
+}
+
+// Empty until a column is drawn, see GetDataPyramid
+static void ResetPyramids(DataTable* table)
+{
+    table->pyramids.resize(table->columns.size());
+    for(MinMaxPyramid& pyramid : table->pyramids)
+        ClearPyramid(&pyramid);
+}
+
+static void AllocateColumns(DataTable* table, int columnCount, int64_t rowCount)
+{
+    table->rowCount = rowCount;
+    table->columns.resize(columnCount);
+    table->doubleStorage.resize((size_t)columnCount * rowCount);
+    table->floatStorage.resize((size_t)columnCount * rowCount);
+    for(int i = 0; i < columnCount; ++i)
+    {
+        table->columns[i].values = table->doubleStorage.data() + (size_t)i * rowCount;
+        table->columns[i].valuesF32 = table->floatStorage.data() + (size_t)i * rowCount;
+    }
+}
+
+bool ImportCSV(const char* path, DataTable* out, char* error, int errorSize)
+{
+    FreeDataTable(out);
+    
+    MappedFile file;
+    if(!MapFileRead(path, &file))
+    {
+        SetError(error, errorSize, "Could not open '%s'", path);
+        return false;
+    }
+    
+    const char* start = (const char*)file.data;
+    const char* end = start + file.size;
+    
+    // Skip the UTF-8 byte order mark
+    if(file.size >= 3 && memcmp(start, "\xEF\xBB\xBF", 3) == 0) start += 3;
+    
+    while(start < end && IsBlankLine(start, LineEnd(start, end)))
+    {
+        const char* lineEnd = LineEnd(start, end);
+        start = lineEnd < end ? lineEnd + 1 : end;
+    }
+    
+    if(start >= end)
+    {
+        UnmapFile(&file);
+        SetError(error, errorSize, "'%s' is empty", path);
+        return false;
+    }
+    
+    // The first line is a header if any of its fields is not a number
+    const char* firstEnd = LineEnd(start, end);
+    char delimiter = DetectDelimiter(start, firstEnd);
+    
+    std::vector<std::string> names;
+    bool hasHeader = false;
+    for(const char* field = start;;)
+    {
+        const char* fieldEnd = (const char*)memchr(field, delimiter, firstEnd - field);
+        if(!fieldEnd) fieldEnd = firstEnd;
+        
+        const char* nameStart = field;
+        const char* nameEnd = fieldEnd;
+        TrimField(&nameStart, &nameEnd);
+        names.push_back(std::string(nameStart, nameEnd - nameStart));
+        if(nameEnd > nameStart && isnan(ParseField(field, fieldEnd))) hasHeader = true;
+        
+        if(fieldEnd == firstEnd) break;
+        field = fieldEnd + 1;
+    }
+    
+    int columnCount = (int)names.size();
+    const char* body = hasHeader ? (firstEnd < end ? firstEnd + 1 : end) : start;
+    
+    // Split the body in chunks at line boundaries, one pass counts the rows of
+    // each chunk and the second one parses them straight into their final place
+    int numChunks = GetNumJobThreads() * 4;
+    int64_t bodySize = end - body;
+    if(bodySize < (int64_t)numChunks * 4096) numChunks = 1;
+    
+    std::vector<const char*> chunkStarts(numChunks + 1);
+    chunkStarts[0] = body;
+    chunkStarts[numChunks] = end;
+    for(int i = 1; i < numChunks; ++i)
+    {
+        const char* nominal = body + bodySize * i / numChunks;
+        if(nominal < chunkStarts[i - 1]) nominal = chunkStarts[i - 1];
+        const char* lineEnd = LineEnd(nominal, end);
+        chunkStarts[i] = lineEnd < end ? lineEnd + 1 : end;
+    }
+    
+    std::vector<int64_t> chunkRows(numChunks + 1, 0);
+    ParallelFor(numChunks, 1, [&](int64_t begin, int64_t endChunk, int task)
+    {
+        for(int64_t c = begin; c < endChunk; ++c)
+        {
+            int64_t rows = 0;
+            for(const char* line = chunkStarts[c]; line < chunkStarts[c + 1];)
+            {
+                const char* lineEnd = LineEnd(line, chunkStarts[c + 1]);
+                rows += !IsBlankLine(line, lineEnd);
+                line = lineEnd + 1;
+            }
+            chunkRows[c + 1] = rows;
+        }
+    });
+    
+    for(int i = 0; i < numChunks; ++i)
+        chunkRows[i + 1] += chunkRows[i];
+    
+    AllocateColumns(out, columnCount, chunkRows[numChunks]);
+    for(int i = 0; i < columnCount; ++i)
+    {
+        char* name = out->columns[i].name;
+        if(hasHeader && !names[i].empty())
+            snprintf(name, Data_MaxNameLength, "%s", names[i].c_str());
+        else
+            snprintf(name, Data_MaxNameLength, "c%d", i + 1);
+    }
+    
+    ParallelFor(numChunks, 1, [&](int64_t begin, int64_t endChunk, int task)
+    {
+        for(int64_t c = begin; c < endChunk; ++c)
+        {
+            int64_t row = chunkRows[c];
+            for(const char* line = chunkStarts[c]; line < chunkStarts[c + 1];)
+            {
+                const char* lineEnd = LineEnd(line, chunkStarts[c + 1]);
+                if(!IsBlankLine(line, lineEnd))
+                    ParseLine(line, lineEnd, delimiter, out, row++);
+                line = lineEnd + 1;
+            }
+        }
+    });
+    
+    UnmapFile(&file);
+    FinalizeColumns(out);
+    ResetPyramids(out);
+    snprintf(out->source, sizeof(out->source), "%s", path);
+    out->id = ++nextTableId;
+    return true;
+}
+
+static uint64_t AlignUp(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static bool WritePadding(FILE* file, uint64_t* offset, uint64_t alignment)
+{
+    static const char zeros[Data_FileAlignment] = {0};
+    uint64_t padding = AlignUp(*offset, alignment) - *offset;
+    *offset += padding;
+    return fwrite(zeros, 1, padding, file) == padding;
+}
+
+bool SaveDataTable(const char* path, const DataTable* table)
+{
+    FILE* file = fopen(path, "wb");
+    if(!file) return false;
+    
+    uint32_t columnCount = (uint32_t)table->columns.size();
+    uint64_t rowCount = (uint64_t)table->rowCount;
+    
+    DataFileHeader header = {};
+    memcpy(header.magic, Data_FileMagic, sizeof(Data_FileMagic));
+    header.version = Data_FileVersion;
+    header.columnCount = columnCount;
+    header.rowCount = rowCount;
+    
+    // Layout of the column arrays
+    std::vector<DataFileColumn> descs(columnCount);
+    uint64_t offset = sizeof(DataFileHeader) + columnCount * sizeof(DataFileColumn);
+    for(uint32_t i = 0; i < columnCount; ++i)
+    {
+        offset = AlignUp(offset, Data_FileAlignment);
+        descs[i] = {};
+        memcpy(descs[i].name, table->columns[i].name, Data_MaxNameLength);
+        descs[i].min = table->columns[i].min;
+        descs[i].max = table->columns[i].max;
+        descs[i].doubleOffset = offset;
+        offset += rowCount * sizeof(double);
+    }
+    for(uint32_t i = 0; i < columnCount; ++i)
+    {
+        offset = AlignUp(offset, Data_FileAlignment);
+        descs[i].floatOffset = offset;
+        offset += rowCount * sizeof(float);
+    }
+    
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    if(columnCount > 0) ok &= fwrite(descs.data(), sizeof(DataFileColumn), columnCount, file) == columnCount;
+    
+    uint64_t written = sizeof(DataFileHeader) + columnCount * sizeof(DataFileColumn);
+    for(uint32_t i = 0; ok && i < columnCount; ++i)
+    {
+        ok &= WritePadding(file, &written, Data_FileAlignment);
+        if(rowCount > 0) ok &= fwrite(table->columns[i].values, sizeof(double), rowCount, file) == rowCount;
+        written += rowCount * sizeof(double);
+    }
+    for(uint32_t i = 0; ok && i < columnCount; ++i)
+    {
+        ok &= WritePadding(file, &written, Data_FileAlignment);
+        if(rowCount > 0) ok &= fwrite(table->columns[i].valuesF32, sizeof(float), rowCount, file) == rowCount;
+        written += rowCount * sizeof(float);
+    }
+    
+    ok &= fclose(file) == 0;
+    return ok;
+}
+
+bool LoadDataTable(const char* path, DataTable* out, char* error, int errorSize)
+{
+    FreeDataTable(out);
+    
+    MappedFile file;
+    if(!MapFileRead(path, &file))
+    {
+        SetError(error, errorSize, "Could not open '%s'", path);
+        return false;
+    }
+    
+    auto fail = [&](const char* message)
+    {
+        SetError(error, errorSize, "'%s': %s", path, message);
+        UnmapFile(&file);
+        return false;
+    };
+    
+    if(file.size < sizeof(DataFileHeader)) return fail("Not a data file");
+    
+    const uint8_t* base = (const uint8_t*)file.data;
+    const DataFileHeader* header = (const DataFileHeader*)base;
+    if(memcmp(header->magic, Data_FileMagic, sizeof(Data_FileMagic)) != 0) return fail("Not a data file");
+    if(header->version != Data_FileVersion) return fail("Unsupported version");
+    
+    uint64_t descsEnd = sizeof(DataFileHeader) + (uint64_t)header->columnCount * sizeof(DataFileColumn);
+    if(descsEnd > file.size) return fail("File is truncated");
+    
+    // The columns are used in place, no copies and no parsing. Written so that
+    // sizes from a corrupted header can't overflow.
+    uint64_t rowCount = header->rowCount;
+    auto inFile = [&](uint64_t offset, uint64_t size)
+    {
+        return offset % size == 0 && offset <= file.size && rowCount <= (file.size - offset) / size;
+    };
+    const DataFileColumn* descs = (const DataFileColumn*)(base + sizeof(DataFileHeader));
+    out->columns.resize(header->columnCount);
+    for(uint32_t i = 0; i < header->columnCount; ++i)
+    {
+        const DataFileColumn* desc = &descs[i];
+        if(!inFile(desc->doubleOffset, sizeof(double)) || !inFile(desc->floatOffset, sizeof(float)))
+        {
+            out->columns.clear();
+            return fail("File is truncated or corrupted");
+        }
+        
+        DataColumn* column = &out->columns[i];
+        memcpy(column->name, desc->name, Data_MaxNameLength);
+        column->name[Data_MaxNameLength - 1] = '\0';
+        column->values = (const double*)(base + desc->doubleOffset);
+        column->valuesF32 = (const float*)(base + desc->floatOffset);
+        column->min = desc->min;
+        column->max = desc->max;
+    }
+    
+    out->rowCount = (int64_t)rowCount;
+    out->mapped = file;
+    out->isMapped = true;
+    ResetPyramids(out);
+    snprintf(out->source, sizeof(out->source), "%s", path);
+    out->id = ++nextTableId;
+    return true;
+}
+
+void FreeDataTable(DataTable* table)
+{
+    if(table->isMapped) UnmapFile(&table->mapped);
+    
+    table->columns.clear();
+    table->pyramids.clear();
+    table->rowCount = 0;
+    table->doubleStorage.clear();
+    table->doubleStorage.shrink_to_fit();
+    table->floatStorage.clear();
+    table->floatStorage.shrink_to_fit();
+    table->isMapped = false;
+    table->source[0] = '\0';
+    table->id = 0;
+}
+
+const MinMaxPyramid* GetDataPyramid(DataTable* table, int column)
+{
+    MinMaxPyramid* pyramid = &table->pyramids[column];
+    if(pyramid->count < table->rowCount) UpdatePyramid(pyramid, table->columns[column].values, table->rowCount);
+    return pyramid;
+}
+
+int FindDataColumn(const DataTable* table, const char* name)
+{
+    for(size_t i = 0; i < table->columns.size(); ++i)
+    {
+        if(strcmp(table->columns[i].name, name) == 0)
+            return (int)i;
+    }
+    
+    return -1;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "os.h"
+#include "pyramid.h"
+
+// Tables of numeric data, imported from CSV or from the native columnar
+// format. Every column is kept both as doubles (for evaluation) and as
+// floats (for GPU upload), each as one contiguous array.
+
+#define Data_MaxNameLength 64
+#define Data_MaxPath 512
+
+struct DataColumn
+{
+    char name[Data_MaxNameLength];
+    const double* values;
+    const float* valuesF32;
+    double min;  // Of the finite values, NaN if there are none
+    double max;
+};
+
+struct DataTable
+{
+    std::vector<DataColumn> columns;
+    int64_t rowCount = 0;
+    std::vector<MinMaxPyramid> pyramids;  // One per column, built when it's first drawn (see GetDataPyramid)
+    
+    // Columns point either into these, or straight into the mapped file
+    std::vector<double> doubleStorage;
+    std::vector<float> floatStorage;
+    MappedFile mapped = {};
+    bool isMapped = false;
+    char source[Data_MaxPath] = "";  // File it was read from, sessions open it again
+    uint32_t id = 0;  // Never reused, a new one each time a file is read into the table
+};
+
+// Native format: a header, one descriptor per column, then the column
+// arrays (all doubles, then all floats) aligned to Data_FileAlignment.
+#define Data_FileMagic "PLOTCOL"
+#define Data_FileVersion 1
+#define Data_FileAlignment 64
+#define Data_FileExtension ".pcol"
+
+struct DataFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t columnCount;
+    uint64_t rowCount;
+    uint64_t reserved;
+};
+
+struct DataFileColumn
+{
+    char name[Data_MaxNameLength];
+    double min;
+    double max;
+    uint64_t doubleOffset;  // From the start of the file
+    uint64_t floatOffset;
+};
+
+// Error messages are written to error (if not null) on failure
+bool ImportCSV(const char* path, DataTable* out, char* error, int errorSize);
+bool SaveDataTable(const char* path, const DataTable* table);
+bool LoadDataTable(const char* path, DataTable* out, char* error, int errorSize);
+void FreeDataTable(DataTable* table);
+int FindDataColumn(const DataTable* table, const char* name);
+// Min/max pyramid of the column, summarized on the first call, so opening a
+// table doesn't go through every column. Not thread safe, called when drawing.
+const MinMaxPyramid* GetDataPyramid(DataTable* table, int column);
+
+// Fast path for parsing decimal numbers, returns the number of characters
+// consumed (0 if it's not a number). Exposed for the other text importers.
+int ParseNumber(const char* str, const char* end, double* out);
@@ -0,0 +1,229 @@
+#include "ddouble.h"
+
+#include <math.h>
+
+// Constants rounded to double-double
+static const DoubleDouble ddLn2 = { 0.6931471805599453, 2.3190468138462996e-17 };
+static const DoubleDouble ddLn10 = { 2.302585092994046, -2.1707562233822494e-16 };
+static const DoubleDouble ddTwoPi = { 6.283185307179586, 2.4492935982947064e-16 };
+static const DoubleDouble ddHalfPi = { 1.5707963267948966, 6.123233995736766e-17 };
+static const DoubleDouble ddOne = { 1.0, 0.0 };
+
+#define DD_Factorials 32
+
+struct InverseFactorials
+{
+    DoubleDouble values[DD_Factorials];  // 1 / n!
+};
+
+static InverseFactorials MakeInverseFactorials()
+{
+    InverseFactorials table = {};
+    table.values[0] = ddOne;
+    for(int n = 1; n < DD_Factorials; ++n)
+        table.values[n] = DDDiv(table.values[n - 1], DoubleDouble{ (double)n, 0.0 });
+    return table;
+}
+
+static const DoubleDouble* InverseFactorial()
+{
+    static const InverseFactorials table = MakeInverseFactorials();
+    return table.values;
+}
+
+static DoubleDouble DDLdexp(DoubleDouble a, int exponent)
+{
+    return { ldexp(a.hi, exponent), ldexp(a.lo, exponent) };
+}
+
+// exp(a) = 2^m * exp(r)^1024 with |r| <= ln2 / 2048, where the Taylor series
+// of exp(r) - 1 needs 8 terms. Squaring keeps the form exp - 1 so that
+// nothing cancels: (1 + s)^2 - 1 = 2s + s^2.
+DoubleDouble DDExp(DoubleDouble a)
+{
+    if(a.hi > 709.782712893384) return { INFINITY, 0.0 };
+    if(a.hi < -745.1332191019412) return { 0.0, 0.0 };
+    if(!isfinite(a.hi)) return { exp(a.hi), 0.0 };
+    
+    double m = floor(a.hi / ddLn2.hi + 0.5);
+    DoubleDouble r = DDLdexp(DDSub(a, DDMulDouble(ddLn2, m)), -10);
+    
+    const DoubleDouble* inverse = InverseFactorial();
+    DoubleDouble s = inverse[8];
+    for(int n = 7; n >= 1; --n)
+        s = DDAdd(inverse[n], DDMul(r, s));
+    s = DDMul(r, s);
+    
+    for(int i = 0; i < 10; ++i)
+        s = DDAdd(DDLdexp(s, 1), DDMul(s, s));
+    
+    // In two steps, 2^m alone can overflow when the result doesn't
+    int half = (int)m / 2;
+    return DDLdexp(DDLdexp(DDAddDouble(s, 1.0), half), (int)m - half);
+}
+
+// One Newton step on exp(y) = a from the double logarithm
+DoubleDouble DDLog(DoubleDouble a)
+{
+    if(!(a.hi > 0.0) || !isfinite(a.hi)) return { log(a.hi), 0.0 };
+    if(a.hi == 1.0 && a.lo == 0.0) return { 0.0, 0.0 };
+    
+    DoubleDouble y = { log(a.hi), 0.0 };
+    DoubleDouble correction = DDAddDouble(DDMul(a, DDExp(DDNeg(y))), -1.0);
+    return DDAdd(y, correction);
+}
+
+DoubleDouble DDLog10(DoubleDouble a)
+{
+    DoubleDouble y = DDLog(a);
+    return isfinite(y.hi) ? DDDiv(y, ddLn10) : y;
+}
+
+DoubleDouble DDLog2(DoubleDouble a)
+{
+    DoubleDouble y = DDLog(a);
+    return isfinite(y.hi) ? DDDiv(y, ddLn2) : y;
+}
+
+// Integer exponents by squaring, the rest through exp and log like pow does
+DoubleDouble DDPow(DoubleDouble a, DoubleDouble b)
+{
+    if(b.lo == 0.0 && b.hi == floor(b.hi) && fabs(b.hi) <= 1024.0 && isfinite(a.hi))
+    {
+        int n = (int)fabs(b.hi);
+        DoubleDouble result = ddOne, power = a;
+        while(n > 0)
+        {
+            if(n & 1) result = DDMul(result, power);
+            power = DDMul(power, power);
+            n >>= 1;
+        }
+        
+        if(b.hi < 0.0) result = DDDiv(ddOne, result);
+        return DDOrDouble(result, pow(a.hi, b.hi));
+    }
+    
+    if(!(a.hi > 0.0) || !isfinite(a.hi) || !isfinite(b.hi)) return { pow(a.hi, b.hi), 0.0 };
+    return DDExp(DDMul(b, DDLog(a)));
+}
+
+// Reduced by 2pi, then to the nearest multiple of pi/2. The Taylor series
+// over |t| <= pi/4 need 14 terms each.
+void DDSinCos(DoubleDouble a, DoubleDouble* sine, DoubleDouble* cosine)
+{
+    if(!isfinite(a.hi))
+    {
+        *sine = { NAN, 0.0 };
+        *cosine = { NAN, 0.0 };
+        return;
+    }
+    
+    DoubleDouble r = DDSub(a, DDMulDouble(ddTwoPi, nearbyint(a.hi / ddTwoPi.hi)));
+    double quadrant = nearbyint(r.hi / ddHalfPi.hi);
+    DoubleDouble t = DDSub(r, DDMulDouble(ddHalfPi, quadrant));
+    DoubleDouble u = DDMul(t, t);
+    
+    const DoubleDouble* inverse = InverseFactorial();
+    DoubleDouble s = inverse[29], c = inverse[28];
+    for(int k = 13; k >= 0; --k)
+    {
+        s = DDSub(inverse[2 * k + 1], DDMul(u, s));
+        c = DDSub(inverse[2 * k], DDMul(u, c));
+    }
+    s = DDMul(t, s);
+    
+    switch(((int)quadrant % 4 + 4) % 4)
+    {
+        case 0: *sine = s; *cosine = c; break;
+        case 1: *sine = c; *cosine = DDNeg(s); break;
+        case 2: *sine = DDNeg(s); *cosine = DDNeg(c); break;
+        default: *sine = DDNeg(c); *cosine = s; break;
+    }
+}
+
+DoubleDouble DDSin(DoubleDouble a)
+{
+    DoubleDouble sine, cosine;
+    DDSinCos(a, &sine, &cosine);
+    return sine;
+}
+
+DoubleDouble DDCos(DoubleDouble a)
+{
+    DoubleDouble sine, cosine;
+    DDSinCos(a, &sine, &cosine);
+    return cosine;
+}
+
+DoubleDouble DDTan(DoubleDouble a)
+{
+    DoubleDouble sine, cosine;
+    DDSinCos(a, &sine, &cosine);
+    return DDDiv(sine, cosine);
+}
+
+// One Newton step from the double angle, on the coordinate that's better conditioned
+DoubleDouble DDAtan2(DoubleDouble y, DoubleDouble x)
+{
+    double angle = atan2(y.hi, x.hi);
+    if(!isfinite(x.hi) || !isfinite(y.hi) || (x.hi == 0.0 && y.hi == 0.0)) return { angle, 0.0 };
+    
+    DoubleDouble radius = DDSqrt(DDAdd(DDMul(x, x), DDMul(y, y)));
+    DoubleDouble unitX = DDDiv(x, radius), unitY = DDDiv(y, radius);
+    DoubleDouble z = { angle, 0.0 };
+    DoubleDouble sine, cosine;
+    DDSinCos(z, &sine, &cosine);
+    if(fabs(x.hi) > fabs(y.hi)) return DDAdd(z, DDDiv(DDSub(unitY, sine), cosine));
+    return DDSub(z, DDDiv(DDSub(unitX, cosine), sine));
+}
+
+DoubleDouble DDAtan(DoubleDouble a)
+{
+    return DDAtan2(a, ddOne);
+}
+
+DoubleDouble DDAsin(DoubleDouble a)
+{
+    if(fabs(a.hi) > 1.0 || !isfinite(a.hi)) return { asin(a.hi), 0.0 };
+    return DDAtan2(a, DDSqrt(DDSub(ddOne, DDMul(a, a))));
+}
+
+DoubleDouble DDAcos(DoubleDouble a)
+{
+    if(fabs(a.hi) > 1.0 || !isfinite(a.hi)) return { acos(a.hi), 0.0 };
+    return DDAtan2(DDSqrt(DDSub(ddOne, DDMul(a, a))), a);
+}
+
+// Near zero (e^a - e^-a) / 2 cancels, the Taylor series doesn't
+DoubleDouble DDSinh(DoubleDouble a)
+{
+    if(!isfinite(a.hi) || fabs(a.hi) > 710.0) return { sinh(a.hi), 0.0 };
+    
+    if(fabs(a.hi) < 0.5)
+    {
+        const DoubleDouble* inverse = InverseFactorial();
+        DoubleDouble u = DDMul(a, a);
+        DoubleDouble s = inverse[27];
+        for(int k = 12; k >= 0; --k)
+            s = DDAdd(inverse[2 * k + 1], DDMul(u, s));
+        return DDMul(a, s);
+    }
+    
+    DoubleDouble e = DDExp(a);
+    return DDLdexp(DDSub(e, DDDiv(ddOne, e)), -1);
+}
+
+DoubleDouble DDCosh(DoubleDouble a)
+{
+    if(!isfinite(a.hi) || fabs(a.hi) > 710.0) return { cosh(a.hi), 0.0 };
+    
+    DoubleDouble e = DDExp(a);
+    return DDLdexp(DDAdd(e, DDDiv(ddOne, e)), -1);
+}
+
+DoubleDouble DDTanh(DoubleDouble a)
+{
+    // Past that 1 - tanh is below the precision
+    if(!isfinite(a.hi) || fabs(a.hi) > 40.0) return { tanh(a.hi), 0.0 };
+    return DDDiv(DDSinh(a), DDCosh(a));
+}
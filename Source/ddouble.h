@@ -0,0 +1,152 @@
+#pragma once
+
+#include <math.h>
+
+// Double-double arithmetic: a value is the unevaluated sum hi + lo with
+// |lo| <= ulp(hi) / 2, which gives about 32 significant digits with the
+// range of a double. The basic operations are inline and branch free so the
+// batch interpreter's loops over them still vectorize. They rely on strict
+// IEEE rounding (no fast math, no contraction into fma), and products use
+// Dekker's split rather than fma, which isn't a single instruction on every
+// target. The elementary functions are in ddouble.cpp: the argument is
+// reduced, then either summed as a Taylor series or refined from the double
+// result with a Newton step.
+
+struct DoubleDouble
+{
+    double hi;
+    double lo;
+};
+
+// Error free transformations, a op b = result.hi + result.lo exactly
+static inline DoubleDouble TwoSum(double a, double b)
+{
+    double s = a + b;
+    double v = s - a;
+    return { s, (a - (s - v)) + (b - v) };
+}
+
+// Only when |a| >= |b|
+static inline DoubleDouble QuickTwoSum(double a, double b)
+{
+    double s = a + b;
+    return { s, b - (s - a) };
+}
+
+static inline DoubleDouble TwoProd(double a, double b)
+{
+    const double splitter = 134217729.0;  // 2^27 + 1
+    double ta = splitter * a, tb = splitter * b;
+    double aHi = ta - (ta - a), bHi = tb - (tb - b);
+    double aLo = a - aHi, bLo = b - bHi;
+    double p = a * b;
+    return { p, ((aHi * bHi - p) + aHi * bLo + aLo * bHi) + aLo * bLo };
+}
+
+static inline DoubleDouble DDNeg(DoubleDouble a)
+{
+    return { -a.hi, -a.lo };
+}
+
+static inline DoubleDouble DDAdd(DoubleDouble a, DoubleDouble b)
+{
+    DoubleDouble s = TwoSum(a.hi, b.hi);
+    DoubleDouble t = TwoSum(a.lo, b.lo);
+    s = QuickTwoSum(s.hi, s.lo + t.hi);
+    return QuickTwoSum(s.hi, s.lo + t.lo);
+}
+
+static inline DoubleDouble DDSub(DoubleDouble a, DoubleDouble b)
+{
+    return DDAdd(a, DDNeg(b));
+}
+
+static inline DoubleDouble DDAddDouble(DoubleDouble a, double b)
+{
+    DoubleDouble s = TwoSum(a.hi, b);
+    return QuickTwoSum(s.hi, s.lo + a.lo);
+}
+
+static inline DoubleDouble DDMul(DoubleDouble a, DoubleDouble b)
+{
+    DoubleDouble p = TwoProd(a.hi, b.hi);
+    return QuickTwoSum(p.hi, p.lo + (a.hi * b.lo + a.lo * b.hi));
+}
+
+static inline DoubleDouble DDMulDouble(DoubleDouble a, double b)
+{
+    DoubleDouble p = TwoProd(a.hi, b);
+    return QuickTwoSum(p.hi, p.lo + a.lo * b);
+}
+
+// Long division, three quotient digits
+static inline DoubleDouble DDDiv(DoubleDouble a, DoubleDouble b)
+{
+    double q1 = a.hi / b.hi;
+    DoubleDouble r = DDSub(a, DDMulDouble(b, q1));
+    double q2 = r.hi / b.hi;
+    r = DDSub(r, DDMulDouble(b, q2));
+    double q3 = r.hi / b.hi;
+    return DDAddDouble(QuickTwoSum(q1, q2), q3);
+}
+
+// Newton step from the double root, zero, negative and infinite values give the double result
+static inline DoubleDouble DDSqrt(DoubleDouble a)
+{
+    double root = sqrt(a.hi);
+    DoubleDouble square = TwoProd(root, root);
+    double correction = ((a.hi - square.hi) - square.lo + a.lo) * (0.5 / root);
+    DoubleDouble refined = QuickTwoSum(root, correction);
+    return a.hi > 0.0 && a.hi < INFINITY ? refined : DoubleDouble{ root, 0.0 };
+}
+
+static inline bool DDLess(DoubleDouble a, DoubleDouble b)
+{
+    return a.hi < b.hi || (a.hi == b.hi && a.lo < b.lo);
+}
+
+static inline bool DDEqual(DoubleDouble a, DoubleDouble b)
+{
+    return a.hi == b.hi && a.lo == b.lo;
+}
+
+static inline DoubleDouble DDAbs(DoubleDouble a)
+{
+    return a.hi < 0.0 ? DDNeg(a) : a;
+}
+
+static inline DoubleDouble DDFloor(DoubleDouble a)
+{
+    double hi = floor(a.hi);
+    return hi == a.hi ? QuickTwoSum(hi, floor(a.lo)) : DoubleDouble{ hi, 0.0 };
+}
+
+static inline DoubleDouble DDCeil(DoubleDouble a)
+{
+    double hi = ceil(a.hi);
+    return hi == a.hi ? QuickTwoSum(hi, ceil(a.lo)) : DoubleDouble{ hi, 0.0 };
+}
+
+// Infinities, NaNs and overflows of the splitting in TwoProd: the double result instead
+static inline DoubleDouble DDOrDouble(DoubleDouble result, double plain)
+{
+    return isfinite(result.hi) ? result : DoubleDouble{ plain, 0.0 };
+}
+
+// Scalar elementary functions, same domains and special values as their double versions
+DoubleDouble DDExp(DoubleDouble a);
+DoubleDouble DDLog(DoubleDouble a);
+DoubleDouble DDLog10(DoubleDouble a);
+DoubleDouble DDLog2(DoubleDouble a);
+DoubleDouble DDPow(DoubleDouble a, DoubleDouble b);
+void DDSinCos(DoubleDouble a, DoubleDouble* sine, DoubleDouble* cosine);
+DoubleDouble DDSin(DoubleDouble a);
+DoubleDouble DDCos(DoubleDouble a);
+DoubleDouble DDTan(DoubleDouble a);
+DoubleDouble DDAtan2(DoubleDouble y, DoubleDouble x);
+DoubleDouble DDAtan(DoubleDouble a);
+DoubleDouble DDAsin(DoubleDouble a);
+DoubleDouble DDAcos(DoubleDouble a);
+DoubleDouble DDSinh(DoubleDouble a);
+DoubleDouble DDCosh(DoubleDouble a);
+DoubleDouble DDTanh(DoubleDouble a);
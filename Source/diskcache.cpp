@@ -0,0 +1,138 @@
+#include "diskcache.h"
+#include "core.h"
+#include "os.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+static void EntryPath(const DiskCache* cache, uint64_t hash, char* out, int size)
+{
+    snprintf(out, size, "%s/%016llx%s", cache->directory, (unsigned long long)hash, DiskCache_Extension);
+}
+
+bool OpenDiskCache(DiskCache* cache, const char* directory)
+{
+    cache->enabled = false;
+    if(directory)
+    {
+        snprintf(cache->directory, sizeof(cache->directory), "%s", directory);
+    }
+    else
+    {
+        // The user's cache directory may not exist yet on a fresh system
+        char base[384];
+        if(!GetCacheDirectory(base, sizeof(base)) || !MakeDirectory(base)) return false;
+        snprintf(cache->directory, sizeof(cache->directory), "%s/Plotter", base);
+    }
+    if(!MakeDirectory(cache->directory)) return false;
+    
+    // Oldest first, until what's left fits
+    std::vector<DirectoryEntry> entries;
+    ListDirectory(cache->directory, &entries);
+    std::sort(entries.begin(), entries.end(), [](const DirectoryEntry& a, const DirectoryEntry& b)
+    {
+        return a.modified < b.modified;
+    });
+    
+    uint64_t total = 0;
+    for(const DirectoryEntry& entry : entries)
+        total += entry.size;
+    for(size_t i = 0; i < entries.size() && total > DiskCache_MaxBytes; ++i)
+    {
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/%s", cache->directory, entries[i].name);
+        if(remove(path) == 0) total -= entries[i].size;
+    }
+    
+    cache->enabled = true;
+    return true;
+}
+
+// Different versions, different keys with the same hash and damaged files
+// don't match. The data isn't checked against the checksum here.
+static bool MatchEntry(const MappedFile* file, const void* key, size_t keySize)
+{
+    const DiskCacheHeader* header = (const DiskCacheHeader*)file->data;
+    const uint8_t* storedKey = (const uint8_t*)file->data + sizeof(DiskCacheHeader);
+    return file->size >= sizeof(DiskCacheHeader) + keySize &&
+           memcmp(header->magic, DiskCache_Magic, sizeof(DiskCache_Magic)) == 0 &&
+           strncmp(header->version, Plotter_Version, sizeof(header->version)) == 0 &&
+           header->keySize == keySize && header->dataSize == file->size - sizeof(DiskCacheHeader) - keySize &&
+           memcmp(storedKey, key, keySize) == 0;
+}
+
+bool ReadDiskCache(DiskCache* cache, const void* key, size_t keySize, std::vector<uint8_t>* out)
+{
+    if(!cache->enabled) return false;
+    
+    char path[640];
+    EntryPath(cache, HashBytes(Hash_Seed, key, keySize), path, sizeof(path));
+    MappedFile file;
+    if(!MapFileRead(path, &file))
+    {
+        ++cache->misses;
+        return false;
+    }
+    
+    const DiskCacheHeader* header = (const DiskCacheHeader*)file.data;
+    const uint8_t* data = (const uint8_t*)file.data + sizeof(DiskCacheHeader) + keySize;
+    bool valid = MatchEntry(&file, key, keySize) && header->checksum == HashBytes(Hash_Seed, data, header->dataSize);
+    if(valid) out->assign(data, data + header->dataSize);
+    
+    UnmapFile(&file);
+    if(valid) ++cache->hits;
+    else ++cache->misses;
+    return valid;
+}
+
+bool SizeOfDiskCache(DiskCache* cache, const void* key, size_t keySize, size_t* size)
+{
+    if(!cache->enabled) return false;
+    
+    char path[640];
+    EntryPath(cache, HashBytes(Hash_Seed, key, keySize), path, sizeof(path));
+    MappedFile file;
+    if(!MapFileRead(path, &file))
+    {
+        ++cache->misses;
+        return false;
+    }
+    
+    bool valid = MatchEntry(&file, key, keySize);
+    if(valid) *size = ((const DiskCacheHeader*)file.data)->dataSize;
+    else ++cache->misses;
+    
+    UnmapFile(&file);
+    return valid;
+}
+
+void WriteDiskCache(DiskCache* cache, const void* key, size_t keySize, const void* data, size_t size)
+{
+    if(!cache->enabled) return;
+    
+    uint64_t hash = HashBytes(Hash_Seed, key, keySize);
+    char path[640], temporary[704];
+    EntryPath(cache, hash, path, sizeof(path));
+    snprintf(temporary, sizeof(temporary), "%s/%016llx.%llx.%u.tmp", cache->directory, (unsigned long long)hash,
+             (unsigned long long)GetTimeNs(), (unsigned)cache->nextTemporary++);
+    
+    FILE* file = fopen(temporary, "wb");
+    if(!file) return;
+    
+    DiskCacheHeader header = {};
+    memcpy(header.magic, DiskCache_Magic, sizeof(DiskCache_Magic));
+    snprintf(header.version, sizeof(header.version), "%s", Plotter_Version);
+    header.keySize = keySize;
+    header.dataSize = size;
+    header.checksum = HashBytes(Hash_Seed, data, size);
+    
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    if(keySize > 0) ok &= fwrite(key, 1, keySize, file) == keySize;
+    if(size > 0) ok &= fwrite(data, 1, size, file) == size;
+    ok &= fclose(file) == 0;
+    
+    // Another thread or process may have just written the same entry, either one is fine
+    if(ok && ReplaceFileWith(path, temporary)) ++cache->writes;
+    else remove(temporary);
+}
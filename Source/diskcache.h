@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <atomic>
+
+// Results that are slow to compute again, kept on disk between runs: the
+// compiled shaders and pipelines (Dawn hands them over through its blob
+// cache, see InitWGPU) and the tiles of complex functions and iterated maps
+// rendered on the CPU (see domain.h). Entries are addressed by content,
+// each is a file named by the hash of its key holding the key itself, a
+// checksum of the data and the Plotter_Version that wrote it. An entry of
+// another version, or one that doesn't check out, is a miss and is written
+// over. Writes go to a temporary file renamed into place, so readers (on
+// other threads or in other processes) see whole entries or none. Opening
+// the cache trims it to DiskCache_MaxBytes, the oldest entries first.
+//
+// Reads and writes are safe from any thread.
+
+#define DiskCache_Magic "PLOTCAC"
+#define DiskCache_Extension ".bin"
+#define DiskCache_MaxBytes (512ull << 20)
+
+struct DiskCacheHeader
+{
+    char magic[8];
+    char version[16];  // Plotter_Version
+    uint64_t keySize;
+    uint64_t dataSize;
+    uint64_t checksum;  // Of the data
+};
+
+struct DiskCache
+{
+    char directory[512];
+    bool enabled = false;  // Off when the directory can't be created
+    
+    std::atomic<uint32_t> nextTemporary{0};  // Names the files being written
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> writes{0};
+};
+
+// Null for the user's cache directory (see GetCacheDirectory)
+bool OpenDiskCache(DiskCache* cache, const char* directory);
+// False when there's no valid entry for the key
+bool ReadDiskCache(DiskCache* cache, const void* key, size_t keySize, std::vector<uint8_t>* out);
+// Size of the entry from its header alone, for callers that ask before
+// reading. Misses are counted here, hits by the read that follows.
+bool SizeOfDiskCache(DiskCache* cache, const void* key, size_t keySize, size_t* size);
+void WriteDiskCache(DiskCache* cache, const void* key, size_t keySize, const void* data, size_t size);
@@ -0,0 +1,1009 @@
+#include "domain.h"
+#include "scatter.h"
+#include "interpreter.h"
+#include "jobs.h"
+#include "core.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <string>
+#include <algorithm>
+
+// Must match Tile in the generated shaders, which only use the first fields, and in fractalShader
+struct DomainComputeUniforms
+{
+    float origin[2];  // Top left corner of the tile, from the reference point for iterated maps
+    float step[2];    // Pixel size, y going down the texture
+    
+    // Iterated maps only
+    float series[3][2];  // A, B and C at the skipped iteration, times scale to the powers 1 to 3
+    float factor[2];     // Of c
+    uint32_t skip;
+    uint32_t maxIterations;
+    uint32_t degree;
+    uint32_t length;
+    float scale;         // Of the offsets in the series
+    uint32_t padding;
+};
+
+// Must match Uniforms in domainShader
+struct DomainDrawUniforms
+{
+    float rect[4];  // Left, bottom, right and top, in clip space
+};
+
+struct DomainTask
+{
+    // The tile it was queued for, which may have been reused by the time it's done
+    uint32_t tile;
+    int64_t column;
+    int64_t row;
+    int levelX;
+    int levelY;
+    uint32_t curve;
+    uint64_t content;
+    
+    Program program;  // Functions
+    std::vector<double> params;
+    std::shared_ptr<const FractalReference> reference;  // Iterated maps
+    std::vector<uint32_t> pixels;
+    
+    DiskCache* diskCache;  // Null for none
+    std::string diskKey;
+};
+
+static const char* domainShader = R"(
+struct Uniforms
+{
+    rect: vec4f,
+};
+
+@group(0) @binding(0) var<uniform> u: Uniforms;
+@group(0) @binding(1) var tileTexture: texture_2d<f32>;
+@group(0) @binding(2) var tileSampler: sampler;
+
+struct VertexOut
+{
+    @builtin(position) position: vec4f,
+    @location(0) uv: vec2f,
+};
+
+@vertex
+fn vs_main(@builtin(vertex_index) vertex: u32) -> VertexOut
+{
+    var corners = array<vec2f, 6>(vec2f(0, 0), vec2f(1, 0), vec2f(0, 1),
+                                  vec2f(0, 1), vec2f(1, 0), vec2f(1, 1));
+
+    var out: VertexOut;
+    let corner = corners[vertex];
+    out.position = vec4f(mix(u.rect.xy, u.rect.zw, corner), 0, 1);
+    out.uv = vec2f(corner.x, 1.0 - corner.y);
+    return out;
+}
+
+@fragment
+fn fs_main(in: VertexOut) -> @location(0) vec4f
+{
+    return textureSample(tileTexture, tileSampler, in.uv);
+}
+)";
+
+// Helpers of the generated shaders. Pow follows pow() on negative bases, the
+// colors follow DomainColor below.
+static const char* domainHelpers = R"(
+struct Tile
+{
+    origin: vec2f,
+    step: vec2f,
+};
+
+@group(0) @binding(0) var<uniform> tile: Tile;
+@group(0) @binding(1) var<storage, read> params: array<f32>;
+@group(0) @binding(2) var output: texture_storage_2d<rgba8unorm, write>;
+
+fn IsFinite(v: f32) -> bool
+{
+    return (bitcast<u32>(v) & 0x7f800000u) != 0x7f800000u;
+}
+
+fn Pow(a: f32, b: f32) -> f32
+{
+    if(b == 0.0) { return 1.0; }
+    let magnitude = exp2(b * log2(abs(a)));
+    if(a >= 0.0) { return magnitude; }
+    if(b != floor(b)) { return bitcast<f32>(0x7fc00000u); }
+    return select(magnitude, -magnitude, b - 2.0 * floor(b * 0.5) == 1.0);
+}
+
+fn DomainColor(re: f32, im: f32) -> vec4f
+{
+    if(re != re || im != im) { return vec4f(0); }
+    if(!IsFinite(re) || !IsFinite(im)) { return vec4f(1); }
+    let large = max(abs(re), abs(im));
+    if(large == 0.0) { return vec4f(0, 0, 0, 1); }
+
+    let small = min(abs(re), abs(im)) / large;
+    let magnitude = log2(large) + 0.5 * log2(1.0 + small * small);
+    let value = 0.6 + 0.4 * (magnitude - floor(magnitude));
+    let hue = atan2(im, re) * 0.15915494 + 1.0;
+    let rgb = clamp(abs(fract(vec3f(hue) + vec3f(1.0, 2.0 / 3.0, 1.0 / 3.0)) * 6.0 - 3.0) - 1.0, vec3f(0), vec3f(1));
+    return vec4f(value * mix(vec3f(1), rgb, 0.85), 1);
+}
+)";
+
+// Iterated maps with the same steps as IterateFractalRow, the reference
+// orbit holds Z then the coefficients P^(j)(Z) / j! for each iteration. The
+// colors follow FractalColor.
+static const char* fractalShader = R"(
+struct Tile
+{
+    origin: vec2f,
+    step: vec2f,
+    seriesA: vec2f,
+    seriesB: vec2f,
+    seriesC: vec2f,
+    factor: vec2f,
+    skip: u32,
+    maxIterations: u32,
+    degree: u32,
+    length: u32,
+    scale: f32,
+    padding: u32,
+};
+
+@group(0) @binding(0) var<uniform> tile: Tile;
+@group(0) @binding(1) var<storage, read> orbit: array<vec2f>;
+@group(0) @binding(2) var output: texture_storage_2d<rgba8unorm, write>;
+
+fn Mul(a: vec2f, b: vec2f) -> vec2f
+{
+    return vec2f(a.x * b.x - a.y * b.y, a.x * b.y + a.y * b.x);
+}
+
+fn FractalColor(iterations: f32) -> vec4f
+{
+    if(iterations < 0.0) { return vec4f(0, 0, 0, 1); }
+    let phase = vec3f(iterations / 32.0) + vec3f(0.0, 0.15, 0.3);
+    return vec4f(0.5 + 0.5 * cos(6.2831853 * phase), 1);
+}
+
+@compute @workgroup_size(8, 8)
+fn cs_main(@builtin(global_invocation_id) id: vec3u)
+{
+    let dc = tile.origin + vec2f((f32(id.x) + 0.5) * tile.step.x, -(f32(id.y) + 0.5) * tile.step.y);
+    let u = dc / tile.scale;
+    var d = Mul(u, tile.seriesA + Mul(u, tile.seriesB + Mul(u, tile.seriesC)));
+    let stride = tile.degree + 1u;
+    let bailout = 256.0;  // Fractal_Bailout
+
+    var n = tile.skip;
+    var iteration = tile.skip;
+    var result = -1.0;
+    loop
+    {
+        let z = orbit[n * stride] + d;
+        let norm = dot(z, z);
+        if(norm > bailout * bailout)
+        {
+            result = f32(iteration) + 1.0 - log(0.5 * log(norm) / log(bailout)) / log(f32(tile.degree));
+            break;
+        }
+        if(iteration >= tile.maxIterations) { break; }
+
+        let start = z - orbit[0];
+        if(dot(start, start) < dot(d, d) || n == tile.length)
+        {
+            d = start;
+            n = 0u;
+        }
+
+        let at = n * stride;
+        var acc = orbit[at + tile.degree];
+        for(var j = tile.degree - 1u; j >= 1u; j--)
+        {
+            acc = Mul(acc, d) + orbit[at + j];
+        }
+        d = Mul(acc, d) + Mul(tile.factor, dc);
+        n++;
+        iteration++;
+    }
+
+    textureStore(output, vec2i(id.xy), FractalColor(result));
+}
+)";
+
+// Same colors as the shaders
+static uint32_t DomainColor(double re, double im)
+{
+    if(isnan(re) || isnan(im)) return 0;
+    if(!isfinite(re) || !isfinite(im)) return 0xffffffffu;
+    double large = fmax(fabs(re), fabs(im));
+    if(large == 0.0) return 0xff000000u;
+    
+    double small = fmin(fabs(re), fabs(im)) / large;
+    double magnitude = log2(large) + 0.5 * log2(1.0 + small * small);
+    double value = 0.6 + 0.4 * (magnitude - floor(magnitude));
+    double hue = atan2(im, re) * 0.15915494309189533577 + 1.0;
+    const double offsets[3] = { 1.0, 2.0 / 3.0, 1.0 / 3.0 };
+    
+    uint32_t color = 0xff000000u;
+    for(int i = 0; i < 3; ++i)
+    {
+        double shifted = hue + offsets[i];
+        double channel = fmin(fmax(fabs((shifted - floor(shifted)) * 6.0 - 3.0) - 1.0, 0.0), 1.0);
+        double level = value * (0.15 + 0.85 * channel);
+        color |= (uint32_t)(level * 255.0 + 0.5) << (8 * i);
+    }
+    
+    return color;
+}
+
+static void AppendLiteral(std::string* out, double value)
+{
+    char buffer[64];
+    if(isnan(value)) snprintf(buffer, sizeof(buffer), "bitcast<f32>(0x7fc00000u)");
+    else if(fabs(value) > FLT_MAX) snprintf(buffer, sizeof(buffer), "bitcast<f32>(%s)", value > 0.0 ? "0x7f800000u" : "0xff800000u");
+    else if(fabs(value) < FLT_MIN) snprintf(buffer, sizeof(buffer), "0.0");
+    else snprintf(buffer, sizeof(buffer), "f32(%.9g)", value);
+    out->append(buffer);
+}
+
+// One statement per instruction, on registers declared as variables since
+// the compiler reuses them. False for integrals and sums, which stay on the CPU.
+static bool GenerateDomainShader(const Program* program, std::string* out)
+{
+    if(!program->kernels.empty() || program->numOutputs != 2) return false;
+    
+    out->assign(domainHelpers);
+    out->append("\n@compute @workgroup_size(8, 8)\nfn cs_main(@builtin(global_invocation_id) id: vec3u)\n{\n");
+    out->append("    let x = tile.origin.x + (f32(id.x) + 0.5) * tile.step.x;\n");
+    out->append("    let y = tile.origin.y - (f32(id.y) + 0.5) * tile.step.y;\n");
+    
+    char line[256];
+    for(uint32_t i = 0; i < program->numRegs; ++i)
+    {
+        snprintf(line, sizeof(line), "    var r%u: f32;\n", i);
+        out->append(line);
+    }
+    
+    for(const Instr& instr : program->code)
+    {
+        char a[16], b[16], c[16];
+        snprintf(a, sizeof(a), "r%d", instr.src[0]);
+        snprintf(b, sizeof(b), "r%d", instr.src[1]);
+        snprintf(c, sizeof(c), "r%d", instr.src[2]);
+        
+        line[0] = '\0';
+        switch(instr.op)
+        {
+            case Op_Const:
+            {
+                snprintf(line, sizeof(line), "    r%d = ", instr.dst);
+                out->append(line);
+                AppendLiteral(out, instr.value);
+                out->append(";\n");
+                continue;
+            }
+            case Op_Var:
+            {
+                const char* names[Var_Count] = { "x", "y", "0.0" };
+                snprintf(line, sizeof(line), "%s", names[instr.index]);
+                break;
+            }
+            case Op_Param:        snprintf(line, sizeof(line), "params[%u]", instr.index); break;
+            case Op_Neg:          snprintf(line, sizeof(line), "-%s", a); break;
+            case Op_Add:          snprintf(line, sizeof(line), "%s + %s", a, b); break;
+            case Op_Sub:          snprintf(line, sizeof(line), "%s - %s", a, b); break;
+            case Op_Mul:          snprintf(line, sizeof(line), "%s * %s", a, b); break;
+            case Op_Div:          snprintf(line, sizeof(line), "%s / %s", a, b); break;
+            case Op_Pow:          snprintf(line, sizeof(line), "Pow(%s, %s)", a, b); break;
+            case Op_Ln:           snprintf(line, sizeof(line), "log(%s)", a); break;
+            case Op_Log10:        snprintf(line, sizeof(line), "log(%s) * 0.4342944819", a); break;
+            case Op_Round:        snprintf(line, sizeof(line), "floor(%s + 0.5)", a); break;
+            case Op_Sign:         snprintf(line, sizeof(line), "select(select(%s, -1.0, %s < 0.0), 1.0, %s > 0.0)", a, a, a); break;
+            case Op_Min:          snprintf(line, sizeof(line), "select(%s, %s, %s < %s)", b, a, a, b); break;
+            case Op_Max:          snprintf(line, sizeof(line), "select(%s, %s, %s > %s)", b, a, a, b); break;
+            case Op_Mod:          snprintf(line, sizeof(line), "%s - %s * floor(%s / %s)", a, b, a, b); break;
+            case Op_Less:         snprintf(line, sizeof(line), "select(0.0, 1.0, %s < %s)", a, b); break;
+            case Op_LessEqual:    snprintf(line, sizeof(line), "select(0.0, 1.0, %s <= %s)", a, b); break;
+            case Op_Greater:      snprintf(line, sizeof(line), "select(0.0, 1.0, %s > %s)", a, b); break;
+            case Op_GreaterEqual: snprintf(line, sizeof(line), "select(0.0, 1.0, %s >= %s)", a, b); break;
+            case Op_Equal:        snprintf(line, sizeof(line), "select(0.0, 1.0, %s == %s)", a, b); break;
+            case Op_And:          snprintf(line, sizeof(line), "select(0.0, 1.0, %s != 0.0 && %s != 0.0)", a, b); break;
+            case Op_Select:       snprintf(line, sizeof(line), "select(%s, %s, %s != 0.0)", c, b, a); break;
+            case Op_Atan2:        snprintf(line, sizeof(line), "atan2(%s, %s)", a, b); break;
+            default:
+            {
+                // Same name in WGSL
+                if(opInfos[instr.op].arity != 1) return false;
+                snprintf(line, sizeof(line), "%s(%s)", opInfos[instr.op].name, a);
+                break;
+            }
+        }
+        
+        char statement[320];
+        snprintf(statement, sizeof(statement), "    r%d = %s;\n", instr.dst, line);
+        out->append(statement);
+    }
+    
+    snprintf(line, sizeof(line), "    textureStore(output, vec2i(id.xy), DomainColor(r%d, r%d));\n}\n", program->outputs[0], program->outputs[1]);
+    out->append(line);
+    return true;
+}
+
+static WGPURenderPipeline CreateTilePipeline(WGPUDevice device, WGPUBindGroupLayout layout, WGPUShaderModule module, WGPUTextureFormat format)
+{
+    WGPUPipelineLayoutDescriptor layoutDesc = WGPU_PIPELINE_LAYOUT_DESCRIPTOR_INIT;
+    layoutDesc.bindGroupLayoutCount = 1;
+    layoutDesc.bindGroupLayouts = &layout;
+    WGPUPipelineLayout pipelineLayout = wgpuDeviceCreatePipelineLayout(device, &layoutDesc);
+    
+    // Undefined values are transparent
+    WGPUBlendState alphaBlend = WGPU_BLEND_STATE_INIT;
+    alphaBlend.color.srcFactor = WGPUBlendFactor_SrcAlpha;
+    alphaBlend.color.dstFactor = WGPUBlendFactor_OneMinusSrcAlpha;
+    alphaBlend.alpha.srcFactor = WGPUBlendFactor_One;
+    alphaBlend.alpha.dstFactor = WGPUBlendFactor_OneMinusSrcAlpha;
+    
+    WGPUColorTargetState target = WGPU_COLOR_TARGET_STATE_INIT;
+    target.format = format;
+    target.blend = &alphaBlend;
+    target.writeMask = WGPUColorWriteMask_All;
+    
+    WGPUFragmentState fragment = WGPU_FRAGMENT_STATE_INIT;
+    fragment.module = module;
+    fragment.entryPoint = "fs_main";
+    fragment.targetCount = 1;
+    fragment.targets = &target;
+    
+    WGPURenderPipelineDescriptor desc = WGPU_RENDER_PIPELINE_DESCRIPTOR_INIT;
+    desc.label = "Domain tiles";
+    desc.layout = pipelineLayout;
+    desc.vertex.module = module;
+    desc.vertex.entryPoint = "vs_main";
+    desc.primitive.topology = WGPUPrimitiveTopology_TriangleList;
+    desc.primitive.cullMode = WGPUCullMode_None;
+    desc.fragment = &fragment;
+    
+    WGPURenderPipeline pipeline = wgpuDeviceCreateRenderPipeline(device, &desc);
+    wgpuPipelineLayoutRelease(pipelineLayout);
+    return pipeline;
+}
+
+void InitDomainRenderer(DomainRenderer* renderer, WGPUDevice device, WGPUTextureFormat targetFormat)
+{
+    renderer->device = device;
+    renderer->queue = wgpuDeviceGetQueue(device);
+    renderer->tiles.clear();
+    renderer->tiles.reserve(Domain_MaxTiles);  // Tiles are pointed to while the pool grows
+    renderer->frame = 0;
+    renderer->curve = 0;
+    renderer->pipelineCurve = 0;
+    renderer->computePipeline = nullptr;
+    renderer->storage = nullptr;
+    renderer->storageCapacity = 0;
+    renderer->reference = nullptr;
+    renderer->jobs = new DomainJobs();
+    renderer->jobs->running = 0;
+    
+    WGPUSamplerDescriptor samplerDesc = WGPU_SAMPLER_DESCRIPTOR_INIT;
+    samplerDesc.magFilter = WGPUFilterMode_Linear;
+    samplerDesc.minFilter = WGPUFilterMode_Linear;
+    renderer->sampler = wgpuDeviceCreateSampler(device, &samplerDesc);
+    
+    // Drawing: uniforms, the tile and the sampler
+    {
+        WGPUBindGroupLayoutEntry entries[3];
+        for(int i = 0; i < 3; ++i)
+        {
+            entries[i] = WGPU_BIND_GROUP_LAYOUT_ENTRY_INIT;
+            entries[i].binding = i;
+            entries[i].visibility = i == 0 ? WGPUShaderStage_Vertex : WGPUShaderStage_Fragment;
+        }
+        entries[0].buffer.type = WGPUBufferBindingType_Uniform;
+        entries[0].buffer.minBindingSize = sizeof(DomainDrawUniforms);
+        entries[1].texture.sampleType = WGPUTextureSampleType_Float;
+        entries[1].texture.viewDimension = WGPUTextureViewDimension_2D;
+        entries[2].sampler.type = WGPUSamplerBindingType_Filtering;
+        
+        WGPUBindGroupLayoutDescriptor desc = WGPU_BIND_GROUP_LAYOUT_DESCRIPTOR_INIT;
+        desc.label = "Domain tiles";
+        desc.entryCount = ArrayCount(entries);
+        desc.entries = entries;
+        renderer->drawLayout = wgpuDeviceCreateBindGroupLayout(device, &desc);
+    }
+    
+    WGPUShaderModule module = CreateShaderModule(device, domainShader, "Domain tiles");
+    renderer->drawPipeline = CreateTilePipeline(device, renderer->drawLayout, module, targetFormat);
+    wgpuShaderModuleRelease(module);
+    
+    // Generated shaders: tile, parameters or orbit, and the output
+    {
+        WGPUBindGroupLayoutEntry entries[3];
+        for(int i = 0; i < 3; ++i)
+        {
+            entries[i] = WGPU_BIND_GROUP_LAYOUT_ENTRY_INIT;
+            entries[i].binding = i;
+            entries[i].visibility = WGPUShaderStage_Compute;
+        }
+        entries[0].buffer.type = WGPUBufferBindingType_Uniform;
+        entries[0].buffer.minBindingSize = sizeof(DomainComputeUniforms);
+        entries[1].buffer.type = WGPUBufferBindingType_ReadOnlyStorage;
+        entries[2].storageTexture.access = WGPUStorageTextureAccess_WriteOnly;
+        entries[2].storageTexture.format = WGPUTextureFormat_RGBA8Unorm;
+        entries[2].storageTexture.viewDimension = WGPUTextureViewDimension_2D;
+        
+        WGPUBindGroupLayoutDescriptor desc = WGPU_BIND_GROUP_LAYOUT_DESCRIPTOR_INIT;
+        desc.label = "Domain compute";
+        desc.entryCount = ArrayCount(entries);
+        desc.entries = entries;
+        renderer->computeLayout = wgpuDeviceCreateBindGroupLayout(device, &desc);
+    }
+}
+
+static void ReleaseComputePipeline(DomainRenderer* renderer)
+{
+    if(renderer->computePipeline) wgpuComputePipelineRelease(renderer->computePipeline);
+    renderer->computePipeline = nullptr;
+    renderer->pipelineCurve = 0;
+}
+
+void StopDomainJobs(DomainRenderer* renderer)
+{
+    WaitForJobs(&renderer->jobs->counter);
+}
+
+void CleanupDomainRenderer(DomainRenderer* renderer)
+{
+    StopDomainJobs(renderer);
+    for(DomainTask* task : renderer->jobs->finished)
+        delete task;
+    delete renderer->jobs;
+    renderer->jobs = nullptr;
+    renderer->reference = nullptr;
+    
+    for(DomainTile& tile : renderer->tiles)
+    {
+        wgpuBindGroupRelease(tile.drawGroup);
+        wgpuBufferRelease(tile.computeUniforms);
+        wgpuBufferRelease(tile.drawUniforms);
+        wgpuTextureViewRelease(tile.view);
+        wgpuTextureRelease(tile.texture);
+    }
+    renderer->tiles.clear();
+    
+    ReleaseComputePipeline(renderer);
+    if(renderer->storage) wgpuBufferRelease(renderer->storage);
+    wgpuBindGroupLayoutRelease(renderer->computeLayout);
+    wgpuRenderPipelineRelease(renderer->drawPipeline);
+    wgpuBindGroupLayoutRelease(renderer->drawLayout);
+    wgpuSamplerRelease(renderer->sampler);
+    wgpuQueueRelease(renderer->queue);
+}
+
+static void CreateTile(DomainRenderer* renderer, DomainTile* tile)
+{
+    WGPUTextureDescriptor desc = WGPU_TEXTURE_DESCRIPTOR_INIT;
+    desc.label = "Domain tile";
+    desc.usage = WGPUTextureUsage_TextureBinding | WGPUTextureUsage_StorageBinding | WGPUTextureUsage_CopyDst;
+    desc.dimension = WGPUTextureDimension_2D;
+    desc.size = { Domain_TileSize, Domain_TileSize, 1 };
+    desc.format = WGPUTextureFormat_RGBA8Unorm;
+    desc.mipLevelCount = 1;
+    desc.sampleCount = 1;
+    tile->texture = wgpuDeviceCreateTexture(renderer->device, &desc);
+    tile->view = wgpuTextureCreateView(tile->texture, nullptr);
+    
+    WGPUBufferDescriptor bufferDesc = WGPU_BUFFER_DESCRIPTOR_INIT;
+    bufferDesc.label = "Domain tile uniforms";
+    bufferDesc.usage = WGPUBufferUsage_Uniform | WGPUBufferUsage_CopyDst;
+    bufferDesc.size = sizeof(DomainDrawUniforms);
+    tile->drawUniforms = wgpuDeviceCreateBuffer(renderer->device, &bufferDesc);
+    bufferDesc.size = sizeof(DomainComputeUniforms);
+    tile->computeUniforms = wgpuDeviceCreateBuffer(renderer->device, &bufferDesc);
+    
+    WGPUBindGroupEntry entries[3];
+    for(int i = 0; i < 3; ++i)
+    {
+        entries[i] = WGPU_BIND_GROUP_ENTRY_INIT;
+        entries[i].binding = i;
+    }
+    entries[0].buffer = tile->drawUniforms;
+    entries[0].size = sizeof(DomainDrawUniforms);
+    entries[1].textureView = tile->view;
+    entries[2].sampler = renderer->sampler;
+    
+    WGPUBindGroupDescriptor groupDesc = WGPU_BIND_GROUP_DESCRIPTOR_INIT;
+    groupDesc.layout = renderer->drawLayout;
+    groupDesc.entryCount = ArrayCount(entries);
+    groupDesc.entries = entries;
+    tile->drawGroup = wgpuDeviceCreateBindGroup(renderer->device, &groupDesc);
+}
+
+// The least recently used tile not needed this frame, or a new one while the pool isn't full
+static DomainTile* AcquireTile(DomainRenderer* renderer)
+{
+    if(renderer->tiles.size() < Domain_MaxTiles)
+    {
+        DomainTile tile = {};
+        CreateTile(renderer, &tile);
+        renderer->tiles.push_back(tile);
+        return &renderer->tiles.back();
+    }
+    
+    DomainTile* oldest = nullptr;
+    for(DomainTile& tile : renderer->tiles)
+    {
+        if(tile.lastUsed != renderer->frame && (!oldest || tile.lastUsed < oldest->lastUsed))
+            oldest = &tile;
+    }
+    return oldest;
+}
+
+static bool UpdateComputePipeline(DomainRenderer* renderer, const Curve* curve)
+{
+    if(renderer->computePipeline && renderer->pipelineCurve == curve->id && renderer->pipelineVersion == curve->version)
+        return true;
+    
+    ReleaseComputePipeline(renderer);
+    std::string code = fractalShader;
+    if(curve->def.kind != Def_Iteration && !GenerateDomainShader(&curve->program, &code)) return false;
+    
+    WGPUPipelineLayoutDescriptor layoutDesc = WGPU_PIPELINE_LAYOUT_DESCRIPTOR_INIT;
+    layoutDesc.bindGroupLayoutCount = 1;
+    layoutDesc.bindGroupLayouts = &renderer->computeLayout;
+    WGPUPipelineLayout pipelineLayout = wgpuDeviceCreatePipelineLayout(renderer->device, &layoutDesc);
+    
+    WGPUShaderModule module = CreateShaderModule(renderer->device, code.c_str(), "Domain function");
+    WGPUComputePipelineDescriptor desc = WGPU_COMPUTE_PIPELINE_DESCRIPTOR_INIT;
+    desc.label = "Domain function";
+    desc.layout = pipelineLayout;
+    desc.compute.module = module;
+    desc.compute.entryPoint = "cs_main";
+    renderer->computePipeline = wgpuDeviceCreateComputePipeline(renderer->device, &desc);
+    wgpuShaderModuleRelease(module);
+    wgpuPipelineLayoutRelease(pipelineLayout);
+    
+    renderer->pipelineCurve = curve->id;
+    renderer->pipelineVersion = curve->version;
+    return true;
+}
+
+static void UploadStorage(DomainRenderer* renderer, const std::vector<double>& values)
+{
+    uint32_t count = (uint32_t)values.size();
+    if(!renderer->storage || renderer->storageCapacity < count)
+    {
+        if(renderer->storage) wgpuBufferRelease(renderer->storage);
+        renderer->storageCapacity = 16;
+        while(renderer->storageCapacity < count) renderer->storageCapacity *= 2;
+        
+        WGPUBufferDescriptor desc = WGPU_BUFFER_DESCRIPTOR_INIT;
+        desc.label = "Domain storage";
+        desc.usage = WGPUBufferUsage_Storage | WGPUBufferUsage_CopyDst;
+        desc.size = renderer->storageCapacity * sizeof(float);
+        renderer->storage = wgpuDeviceCreateBuffer(renderer->device, &desc);
+    }
+    
+    std::vector<float> floats(values.begin(), values.end());
+    if(count > 0) wgpuQueueWriteBuffer(renderer->queue, renderer->storage, 0, floats.data(), count * sizeof(float));
+}
+
+static double TileSpan(int level)
+{
+    return ldexp((double)Domain_TileSize, level);
+}
+
+static bool TileMatches(const DomainTile* tile, int64_t column, int64_t row, int levelX, int levelY, uint32_t curve, uint64_t content)
+{
+    return tile->column == column && tile->row == row && tile->levelX == levelX && tile->levelY == levelY &&
+           tile->curve == curve && tile->content == content;
+}
+
+// A row of pixels at a time, each row is one batch
+static void RenderDomainTask(DomainTask* task)
+{
+    task->pixels.resize(Domain_TileSize * Domain_TileSize);
+    const size_t tileBytes = task->pixels.size() * sizeof(uint32_t);
+    std::vector<uint8_t> cached;
+    if(task->diskCache && ReadDiskCache(task->diskCache, task->diskKey.data(), task->diskKey.size(), &cached) &&
+       cached.size() == tileBytes)
+    {
+        memcpy(task->pixels.data(), cached.data(), tileBytes);
+        return;
+    }
+    
+    double stepX = ldexp(1.0, task->levelX), stepY = ldexp(1.0, task->levelY);
+    double left = task->column * TileSpan(task->levelX);
+    double top = (task->row + 1) * TileSpan(task->levelY);
+    
+    const FractalReference* reference = task->reference.get();
+    FractalSkip skip = {};
+    if(reference)
+    {
+        // Offsets from the reference point, exact while they're small
+        left -= reference->center[0];
+        top -= reference->center[1];
+        double right = left + TileSpan(task->levelX), bottom = top - TileSpan(task->levelY);
+        double corners[4][2] = { { left, top }, { right, top }, { left, bottom }, { right, bottom } };
+        skip = FindFractalSkip(reference, corners);
+    }
+    
+    double re[Domain_TileSize], im[Domain_TileSize];
+    double* outputs[2] = { re, im };
+    float iterations[Domain_TileSize];
+    for(int row = 0; row < Domain_TileSize; ++row)
+    {
+        uint32_t* out = task->pixels.data() + row * Domain_TileSize;
+        double y = top - (row + 0.5) * stepY;
+        if(reference)
+        {
+            IterateFractalRow(reference, &skip, left + 0.5 * stepX, stepX, y, Domain_TileSize, iterations);
+            for(int i = 0; i < Domain_TileSize; ++i)
+                out[i] = FractalColor(iterations[i]);
+            continue;
+        }
+        
+        EvalInput vars[Var_Count] = { EvalRamp(left + 0.5 * stepX, stepX), EvalConstant(y), EvalConstant(0.0) };
+        EvalBatch(&task->program, vars, task->params.data(), Domain_TileSize, outputs);
+        for(int i = 0; i < Domain_TileSize; ++i)
+            out[i] = DomainColor(re[i], im[i]);
+    }
+    
+    if(task->diskCache) WriteDiskCache(task->diskCache, task->diskKey.data(), task->diskKey.size(), task->pixels.data(), tileBytes);
+}
+
+// What the pixels of a CPU tile depend on, by content: the text rather than
+// the id and version, which start over every run
+static void DomainTileKey(const Curve* curve, const DomainTask* task, std::string* out)
+{
+    auto append = [out](const void* data, size_t size) { out->append((const char*)data, size); };
+    const int tileSize = Domain_TileSize;
+    out->assign("domain tile");
+    append(curve->text, strlen(curve->text) + 1);
+    append(task->params.data(), task->params.size() * sizeof(double));
+    append(&tileSize, sizeof(tileSize));
+    append(&task->column, sizeof(task->column));
+    append(&task->row, sizeof(task->row));
+    append(&task->levelX, sizeof(task->levelX));
+    append(&task->levelY, sizeof(task->levelY));
+    if(task->reference)
+    {
+        append(&task->reference->maxIterations, sizeof(task->reference->maxIterations));
+        append(task->reference->center, sizeof(task->reference->center));
+    }
+}
+
+// Uploads what the jobs finished, into the tiles still waiting for it
+static void CollectDomainTasks(DomainRenderer* renderer)
+{
+    std::vector<DomainTask*> finished;
+    {
+        std::lock_guard<std::mutex> lock(renderer->jobs->mutex);
+        finished.swap(renderer->jobs->finished);
+    }
+    
+    WGPUTextureDataLayout layout = WGPU_TEXTURE_DATA_LAYOUT_INIT;
+    layout.bytesPerRow = Domain_TileSize * sizeof(uint32_t);
+    layout.rowsPerImage = Domain_TileSize;
+    WGPUExtent3D size = { Domain_TileSize, Domain_TileSize, 1 };
+    for(DomainTask* task : finished)
+    {
+        --renderer->jobs->running;
+        DomainTile* tile = &renderer->tiles[task->tile];
+        if(!tile->ready && TileMatches(tile, task->column, task->row, task->levelX, task->levelY, task->curve, task->content))
+        {
+            WGPUImageCopyTexture destination = WGPU_IMAGE_COPY_TEXTURE_INIT;
+            destination.texture = tile->texture;
+            wgpuQueueWriteTexture(renderer->queue, &destination, task->pixels.data(), task->pixels.size() * sizeof(uint32_t), &layout, &size);
+            tile->ready = true;
+        }
+        delete task;
+    }
+}
+
+static void WriteDrawRect(DomainRenderer* renderer, const DomainTile* tile, const PlotView* view)
+{
+    double spanX = TileSpan(tile->levelX), spanY = TileSpan(tile->levelY);
+    double rangeX = view->xMax - view->xMin, rangeY = view->yMax - view->yMin;
+    double left = tile->column * spanX, bottom = tile->row * spanY;
+    
+    DomainDrawUniforms uniforms;
+    uniforms.rect[0] = (float)((left - view->xMin) / rangeX * 2.0 - 1.0);
+    uniforms.rect[1] = (float)((bottom - view->yMin) / rangeY * 2.0 - 1.0);
+    uniforms.rect[2] = (float)((left + spanX - view->xMin) / rangeX * 2.0 - 1.0);
+    uniforms.rect[3] = (float)((bottom + spanY - view->yMin) / rangeY * 2.0 - 1.0);
+    wgpuQueueWriteBuffer(renderer->queue, tile->drawUniforms, 0, &uniforms, sizeof(uniforms));
+}
+
+static bool TileInView(const DomainTile* tile, const PlotView* view)
+{
+    double spanX = TileSpan(tile->levelX), spanY = TileSpan(tile->levelY);
+    double left = tile->column * spanX, bottom = tile->row * spanY;
+    return left < view->xMax && left + spanX > view->xMin && bottom < view->yMax && bottom + spanY > view->yMin;
+}
+
+// Iterated maps are drawn relative to a reference orbit computed again when
+// the map changes, the view moves away from it, or the zoom changes while it
+// escapes before the iteration limit
+static bool UpdateFractalReference(DomainRenderer* renderer, const Curve* curve, const double* params, uint64_t content,
+                                   const PlotView* view, int level)
+{
+    FractalMap map;
+    if(!EvalFractalMap(&curve->program, params, &map)) return false;
+    
+    const FractalReference* current = renderer->reference.get();
+    double rangeX = view->xMax - view->xMin, rangeY = view->yMax - view->yMin;
+    double centerX = (view->xMin + view->xMax) * 0.5, centerY = (view->yMin + view->yMax) * 0.5;
+    if(current && renderer->referenceContent == content && fabs(current->center[0] - centerX) <= rangeX &&
+       fabs(current->center[1] - centerY) <= rangeY && (renderer->referenceLevel == level || current->length == current->maxIterations))
+        return true;
+    
+    std::shared_ptr<FractalReference> reference = std::make_shared<FractalReference>();
+    double viewMin[2] = { view->xMin, view->yMin }, viewMax[2] = { view->xMax, view->yMax };
+    ComputeFractalReference(reference.get(), &map, viewMin, viewMax, renderer->maxIterations);
+    renderer->reference = reference;
+    renderer->referenceContent = content;
+    renderer->referenceLevel = level;
+    return true;
+}
+
+static void WriteFractalUniforms(const FractalReference* reference, const DomainTile* tile, DomainComputeUniforms* uniforms)
+{
+    double spanX = TileSpan(tile->levelX), spanY = TileSpan(tile->levelY);
+    double left = tile->column * spanX - reference->center[0];
+    double top = (tile->row + 1) * spanY - reference->center[1];
+    double corners[4][2] = { { left, top }, { left + spanX, top }, { left, top - spanY }, { left + spanX, top - spanY } };
+    FractalSkip skip = FindFractalSkip(reference, corners);
+    
+    // Offsets in tile spans in the series, their powers would overflow floats deep down
+    double scale = fmax(spanX, spanY), power = scale;
+    uniforms->origin[0] = (float)left;
+    uniforms->origin[1] = (float)top;
+    for(int k = 0; k < 3; ++k)
+    {
+        uniforms->series[k][0] = (float)(skip.series[k][0] * power);
+        uniforms->series[k][1] = (float)(skip.series[k][1] * power);
+        power *= scale;
+    }
+    uniforms->factor[0] = (float)reference->map.factor[0];
+    uniforms->factor[1] = (float)reference->map.factor[1];
+    uniforms->skip = (uint32_t)skip.iterations;
+    uniforms->maxIterations = (uint32_t)reference->maxIterations;
+    uniforms->degree = (uint32_t)reference->map.degree;
+    uniforms->length = (uint32_t)reference->length;
+    uniforms->scale = (float)scale;
+}
+
+void UpdateDomainTiles(DomainRenderer* renderer, const CurveList* list, const PlotView* view)
+{
+    ++renderer->frame;
+    renderer->drawn.clear();
+    renderer->gpuPending.clear();
+    renderer->curve = 0;
+    renderer->pendingTiles = 0;
+    CollectDomainTasks(renderer);
+    
+    const Curve* curve = nullptr;
+    for(const Curve* candidate : list->curves)
+    {
+        if(candidate->visible && (candidate->def.kind == Def_Complex || candidate->def.kind == Def_Iteration))
+            curve = candidate;
+    }
+    
+    double rangeX = view->xMax - view->xMin, rangeY = view->yMax - view->yMin;
+    if(!curve || view->width <= 0 || view->height <= 0 || !(rangeX > 0) || !(rangeY > 0)) return;
+    renderer->curve = curve->id;
+    bool fractal = curve->def.kind == Def_Iteration;
+    
+    // Coarser pixels when the view needs more tiles than the pool has
+    int levelX = (int)floor(log2(PlotPixelWidth(view)));
+    int levelY = (int)floor(log2(PlotPixelHeight(view)));
+    int64_t firstColumn, lastColumn, firstRow, lastRow;
+    for(;;)
+    {
+        firstColumn = (int64_t)floor(view->xMin / TileSpan(levelX));
+        lastColumn = (int64_t)floor(view->xMax / TileSpan(levelX));
+        firstRow = (int64_t)floor(view->yMin / TileSpan(levelY));
+        lastRow = (int64_t)floor(view->yMax / TileSpan(levelY));
+        if((lastColumn - firstColumn + 1) * (lastRow - firstRow + 1) <= Domain_MaxTiles) break;
+        ++levelX;
+        ++levelY;
+    }
+    
+    uint64_t content = HashBytes(Hash_Seed, list->params.values.data(), list->params.values.size() * sizeof(double));
+    content = HashBytes(content, &curve->version, sizeof(curve->version));
+    if(fractal)
+    {
+        content = HashBytes(content, &renderer->maxIterations, sizeof(renderer->maxIterations));
+        if(!UpdateFractalReference(renderer, curve, list->params.values.data(), content, view, levelX)) return;
+    }
+    
+    // Floats hold the coordinates of the pixels to about 2^-24 of their magnitude,
+    // iterated maps only need them relative to the reference
+    double extentX = fmax(fabs(view->xMin), fabs(view->xMax));
+    double extentY = fmax(fabs(view->yMin), fabs(view->yMax));
+    bool precise = fractal || (ldexp(1.0, levelX) >= extentX * Domain_GpuPrecision && ldexp(1.0, levelY) >= extentY * Domain_GpuPrecision);
+    renderer->onGpu = renderer->useGpu && precise && UpdateComputePipeline(renderer, curve);
+    
+    // Tiles already rendered or being rendered, then the missing ones nearest to the center first
+    std::vector<DomainTile*> current;
+    std::vector<int64_t> missing;  // Column and row pairs
+    for(int64_t row = firstRow; row <= lastRow; ++row)
+    {
+        for(int64_t column = firstColumn; column <= lastColumn; ++column)
+        {
+            DomainTile* found = nullptr;
+            for(DomainTile& tile : renderer->tiles)
+            {
+                if(TileMatches(&tile, column, row, levelX, levelY, curve->id, content) && (!found || tile.ready))
+                    found = &tile;
+            }
+            
+            if(!found)
+            {
+                missing.push_back(column);
+                missing.push_back(row);
+                continue;
+            }
+            
+            found->lastUsed = renderer->frame;
+            if(found->ready) current.push_back(found);
+            else ++renderer->pendingTiles;
+        }
+    }
+    
+    double centerColumn = (view->xMin + view->xMax) * 0.5 / TileSpan(levelX) - 0.5;
+    double centerRow = (view->yMin + view->yMax) * 0.5 / TileSpan(levelY) - 0.5;
+    std::vector<int> order(missing.size() / 2);
+    for(size_t i = 0; i < order.size(); ++i) order[i] = (int)i;
+    std::sort(order.begin(), order.end(), [&](int a, int b)
+    {
+        double da = fabs(missing[2 * a] - centerColumn) + fabs(missing[2 * a + 1] - centerRow);
+        double db = fabs(missing[2 * b] - centerColumn) + fabs(missing[2 * b + 1] - centerRow);
+        return da < db;
+    });
+    
+    // Every tile of a function fits in a frame on the GPU, iterated maps are
+    // limited by their iterations, and the jobs by the number of threads
+    const int64_t tilePixels = Domain_TileSize * Domain_TileSize;
+    int budget = (int)order.size();
+    if(renderer->onGpu && fractal) budget = (int)std::max<int64_t>(1, Domain_GpuIterations / (tilePixels * renderer->maxIterations));
+    if(!renderer->onGpu) budget = Domain_CpuTilesPerThread * GetNumJobThreads() - renderer->jobs->running;
+    
+    std::vector<DomainTask*> tasks;
+    int queued = 0;
+    for(int index : order)
+    {
+        if(queued >= budget) break;
+        
+        DomainTile* tile = AcquireTile(renderer);
+        if(!tile) break;
+        ++queued;
+        
+        tile->column = missing[2 * index];
+        tile->row = missing[2 * index + 1];
+        tile->levelX = levelX;
+        tile->levelY = levelY;
+        tile->curve = curve->id;
+        tile->content = content;
+        tile->lastUsed = renderer->frame;
+        tile->ready = false;
+        
+        if(renderer->onGpu)
+        {
+            // Dispatched before the frame's render pass, so it's ready to draw
+            DomainComputeUniforms uniforms = {};
+            uniforms.origin[0] = (float)(tile->column * TileSpan(levelX));
+            uniforms.origin[1] = (float)((tile->row + 1) * TileSpan(levelY));
+            uniforms.step[0] = (float)ldexp(1.0, levelX);
+            uniforms.step[1] = (float)ldexp(1.0, levelY);
+            if(fractal) WriteFractalUniforms(renderer->reference.get(), tile, &uniforms);
+            wgpuQueueWriteBuffer(renderer->queue, tile->computeUniforms, 0, &uniforms, sizeof(uniforms));
+            renderer->gpuPending.push_back((uint32_t)(tile - renderer->tiles.data()));
+            tile->ready = true;
+            current.push_back(tile);
+            continue;
+        }
+        
+        DomainTask* task = new DomainTask();
+        task->tile = (uint32_t)(tile - renderer->tiles.data());
+        task->column = tile->column;
+        task->row = tile->row;
+        task->levelX = levelX;
+        task->levelY = levelY;
+        task->curve = curve->id;
+        task->content = content;
+        if(fractal) task->reference = renderer->reference;
+        else task->program = curve->program;
+        task->params = list->params.values;
+        task->diskCache = renderer->diskCache;
+        if(task->diskCache) DomainTileKey(curve, task, &task->diskKey);
+        tasks.push_back(task);
+        ++renderer->pendingTiles;
+    }
+    renderer->pendingTiles += (int)order.size() - queued;
+    
+    if(!renderer->gpuPending.empty()) UploadStorage(renderer, fractal ? renderer->reference->orbit : list->params.values);
+    
+    renderer->jobs->running += (int)tasks.size();
+    for(DomainTask* task : tasks)
+    {
+        DomainJobs* jobs = renderer->jobs;
+        RunBackgroundJob([jobs, task]()
+        {
+            RenderDomainTask(task);
+            std::lock_guard<std::mutex> lock(jobs->mutex);
+            jobs->finished.push_back(task);
+        }, &jobs->counter);
+    }
+    
+    // Older tiles of the function fill in below, those far off the current level are too blurry or too small to help
+    for(DomainTile& tile : renderer->tiles)
+    {
+        if(!tile.ready || tile.lastUsed == renderer->frame || tile.curve != curve->id) continue;
+        if(abs(tile.levelX - levelX) > 2 || abs(tile.levelY - levelY) > 2 || !TileInView(&tile, view)) continue;
+        
+        WriteDrawRect(renderer, &tile, view);
+        renderer->drawn.push_back((uint32_t)(&tile - renderer->tiles.data()));
+    }
+    
+    for(DomainTile* tile : current)
+    {
+        WriteDrawRect(renderer, tile, view);
+        renderer->drawn.push_back((uint32_t)(tile - renderer->tiles.data()));
+    }
+}
+
+void PrepareDomainTiles(DomainRenderer* renderer, WGPUCommandEncoder encoder)
+{
+    if(renderer->gpuPending.empty()) return;
+    
+    WGPUComputePassDescriptor passDesc = WGPU_COMPUTE_PASS_DESCRIPTOR_INIT;
+    passDesc.label = "Domain tiles";
+    WGPUComputePassEncoder pass = wgpuCommandEncoderBeginComputePass(encoder, &passDesc);
+    wgpuComputePassEncoderSetPipeline(pass, renderer->computePipeline);
+    for(uint32_t index : renderer->gpuPending)
+    {
+        const DomainTile* tile = &renderer->tiles[index];
+        WGPUBindGroupEntry entries[3];
+        for(int i = 0; i < 3; ++i)
+        {
+            entries[i] = WGPU_BIND_GROUP_ENTRY_INIT;
+            entries[i].binding = i;
+        }
+        entries[0].buffer = tile->computeUniforms;
+        entries[0].size = sizeof(DomainComputeUniforms);
+        entries[1].buffer = renderer->storage;
+        entries[1].size = renderer->storageCapacity * sizeof(float);
+        entries[2].textureView = tile->view;
+        
+        WGPUBindGroupDescriptor groupDesc = WGPU_BIND_GROUP_DESCRIPTOR_INIT;
+        groupDesc.layout = renderer->computeLayout;
+        groupDesc.entryCount = ArrayCount(entries);
+        groupDesc.entries = entries;
+        WGPUBindGroup group = wgpuDeviceCreateBindGroup(renderer->device, &groupDesc);
+        
+        wgpuComputePassEncoderSetBindGroup(pass, 0, group, 0, nullptr);
+        wgpuComputePassEncoderDispatchWorkgroups(pass, Domain_TileSize / 8, Domain_TileSize / 8, 1);
+        wgpuBindGroupRelease(group);
+    }
+    wgpuComputePassEncoderEnd(pass);
+    wgpuComputePassEncoderRelease(pass);
+    renderer->gpuPending.clear();
+}
+
+void DrawDomainTiles(DomainRenderer* renderer, WGPURenderPassEncoder pass)
+{
+    if(renderer->drawn.empty()) return;
+    
+    wgpuRenderPassEncoderSetPipeline(pass, renderer->drawPipeline);
+    for(uint32_t index : renderer->drawn)
+    {
+        wgpuRenderPassEncoderSetBindGroup(pass, 0, renderer->tiles[index].drawGroup, 0, nullptr);
+        wgpuRenderPassEncoderDraw(pass, 6, 1, 0, 0);
+    }
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <mutex>
+#include <memory>
+
+#include "webgpu/webgpu.h"
+#include "curves.h"
+#include "fractal.h"
+#include "jobs.h"
+#include "diskcache.h"
+
+// Domain coloring of complex functions, f(z) = ... in the curve list, and
+// escape-time plots of iterated maps, z -> ... (the last visible one of
+// either is drawn, under everything else). For functions the hue is the
+// argument of f(z) and the brightness climbs through each power of two of
+// its modulus, so zeros and poles are where all the hues meet and the bands
+// crowd. For iterated maps the color cycles with the smooth count of
+// iterations before the orbit escapes (see fractal.h), black if it doesn't.
+//
+// The plane is cut into tiles of Domain_TileSize pixels on a grid aligned to
+// the origin, with power of two pixel sizes between half a pixel and a pixel
+// of the view, like the curve samples. A tile keeps its place and its pixels
+// while panning: only the tiles coming into view are rendered, the others
+// stay in a pool of textures until the function, the parameters or the zoom
+// level change. Until the new tiles are ready the old ones of the same
+// function, from the previous level or parameters, are drawn in their place.
+//
+// Tiles of functions are rendered by a compute shader generated from the
+// compiled program when floats are precise enough for the view, and tiles of
+// iterated maps by a fixed shader iterating the perturbations in floats at
+// any zoom. Otherwise, and for programs with integrals or sums, they're
+// rendered a row at a time in background jobs, by the batch interpreter or
+// the CPU iteration, and uploaded when done. The jobs in flight and the
+// iterations dispatched to the GPU per frame are limited so the plot stays
+// responsive; the rest of the tiles come in over the next frames. The tiles
+// rendered on the CPU are also kept in the disk cache when there's one, by
+// the text of the function and everything else their pixels depend on, so
+// opening the same view again reads them back instead.
+
+#define Domain_TileSize 256
+#define Domain_MaxTiles 192
+#define Domain_CpuTilesPerThread 2           // In flight
+#define Domain_GpuIterations (1 << 28)       // Per frame, at most, for iterated maps
+#define Domain_GpuPrecision (1.0 / 65536.0)  // Smallest pixel size relative to the coordinates for floats
+
+struct DomainTile
+{
+    int64_t column;  // Position in tiles, row 0 is above y = 0
+    int64_t row;
+    int levelX;  // Pixel sizes are 2^level
+    int levelY;
+    uint32_t curve;
+    uint64_t content;  // Text and parameters of the function
+    bool ready;        // Not ready with the rest matching means a job renders it
+    uint64_t lastUsed;  // Frame
+    
+    WGPUTexture texture;
+    WGPUTextureView view;
+    WGPUBuffer drawUniforms;
+    WGPUBuffer computeUniforms;
+    WGPUBindGroup drawGroup;
+};
+
+struct DomainTask;  // A tile rendered by a job, see domain.cpp
+
+struct DomainJobs
+{
+    std::mutex mutex;  // Guards finished, which the jobs fill in
+    std::vector<DomainTask*> finished;
+    int running;  // Jobs in flight
+    JobCounter counter;
+};
+
+struct DomainRenderer
+{
+    WGPUDevice device;
+    WGPUQueue queue;
+    WGPUSampler sampler;
+    WGPUBindGroupLayout drawLayout;
+    WGPURenderPipeline drawPipeline;
+    WGPUBindGroupLayout computeLayout;
+    
+    // Generated from the program being drawn, or the iteration shader
+    uint32_t pipelineCurve;
+    uint32_t pipelineVersion;
+    WGPUComputePipeline computePipeline;
+    WGPUBuffer storage;  // The parameters of functions, the reference orbit of iterated maps
+    uint32_t storageCapacity;
+    
+    std::vector<DomainTile> tiles;
+    std::vector<uint32_t> gpuPending;  // Tiles to dispatch in PrepareDomainTiles
+    std::vector<uint32_t> drawn;       // Tiles to draw this frame, the previous level first
+    uint64_t frame;
+    
+    // Of iterated maps, shared with the jobs rendering with it
+    std::shared_ptr<const FractalReference> reference;
+    uint64_t referenceContent;
+    int referenceLevel;
+    
+    DomainJobs* jobs;  // Apart, the renderer is copied around with the rest of the GPU state
+    DiskCache* diskCache = nullptr;  // For the CPU tiles, when set
+    
+    bool useGpu = true;
+    int maxIterations = Fractal_DefaultIterations;
+    // Of the last update
+    uint32_t curve;  // Id of the function or map drawn, 0 if none
+    bool onGpu;
+    int pendingTiles;
+};
+
+void InitDomainRenderer(DomainRenderer* renderer, WGPUDevice device, WGPUTextureFormat targetFormat);
+// Waits for the tiles being rendered on the CPU, before the job system shuts down
+void StopDomainJobs(DomainRenderer* renderer);
+void CleanupDomainRenderer(DomainRenderer* renderer);
+// Uploads the tiles the jobs finished, then queues the missing ones of the view for the GPU or the jobs
+void UpdateDomainTiles(DomainRenderer* renderer, const CurveList* list, const PlotView* view);
+// Encodes the compute passes of the queued tiles, has to be called before the frame's render pass begins
+void PrepareDomainTiles(DomainRenderer* renderer, WGPUCommandEncoder encoder);
+// Draws into the frame's render pass, before anything else
+void DrawDomainTiles(DomainRenderer* renderer, WGPURenderPassEncoder pass);
@@ -0,0 +1,512 @@
+#include "fields.h"
+#include "scatter.h"
+#include "core.h"
+#include "interpreter.h"
+
+#include <math.h>
+#include <string.h>
+
+#ifndef IMGUI_DEFINE_MATH_OPERATORS
+#define IMGUI_DEFINE_MATH_OPERATORS
+#endif
+#include "imgui.h"
+
+// Must match the layouts in fieldShader
+struct FieldUniforms
+{
+    float size[2];  // Of the view, in pixels
+    float padding[2];
+};
+
+struct FieldArrow
+{
+    float center[2];     // Pixels from the top left corner
+    float direction[2];  // Pixels, the whole length of the arrow
+    float color[4];
+    float head;          // 0 for a plain segment
+    float padding[3];
+};
+
+static const char* fieldShader = R"(
+struct Uniforms
+{
+    size: vec2f,
+};
+
+struct Arrow
+{
+    center: vec2f,
+    direction: vec2f,
+    color: vec4f,
+    head: f32,
+};
+
+@group(0) @binding(0) var<uniform> u: Uniforms;
+@group(0) @binding(1) var<storage, read> arrows: array<Arrow>;
+
+struct VertexOut
+{
+    @builtin(position) position: vec4f,
+    @location(0) local: vec2f,  // Pixels along and across the arrow, from its center
+    @location(1) @interpolate(flat) shape: vec2f,  // Half length, head
+    @location(2) @interpolate(flat) color: vec4f,
+};
+
+@vertex
+fn vs_main(@builtin(vertex_index) vertex: u32, @builtin(instance_index) instance: u32) -> VertexOut
+{
+    var corners = array<vec2f, 6>(vec2f(-1, -1), vec2f(1, -1), vec2f(-1, 1),
+                                  vec2f(-1, 1), vec2f(1, -1), vec2f(1, 1));
+
+    let arrow = arrows[instance];
+    let halfLength = length(arrow.direction) * 0.5;
+    let axis = arrow.direction / max(halfLength * 2.0, 1e-6);
+    let normal = vec2f(-axis.y, axis.x);
+
+    // One pixel of margin for the antialiasing
+    let extent = vec2f(halfLength + 1.0, select(1.5, 4.5, arrow.head > 0.0));
+    let local = corners[vertex] * extent;
+    let pixel = arrow.center + axis * local.x + normal * local.y;
+
+    var out: VertexOut;
+    out.position = vec4f(pixel.x / u.size.x * 2.0 - 1.0, 1.0 - pixel.y / u.size.y * 2.0, 0, 1);
+    out.local = local;
+    out.shape = vec2f(halfLength, arrow.head);
+    out.color = arrow.color;
+    return out;
+}
+
+@fragment
+fn fs_main(in: VertexOut) -> @location(0) vec4f
+{
+    let p = in.local;
+    let halfLength = in.shape.x;
+
+    // Shaft, a capsule ending under the head if there is one
+    let headLength = min(in.shape.y, halfLength);
+    let shaftEnd = halfLength - headLength * 0.5;
+    var d = length(vec2f(p.x - clamp(p.x, -halfLength, shaftEnd), p.y)) - 0.75;
+
+    // Head, a triangle with its tip at the end
+    if(headLength > 0.0)
+    {
+        let headWidth = headLength * 0.5;
+        let side = (abs(p.y) * headLength - headWidth * (halfLength - p.x)) / length(vec2f(headLength, headWidth));
+        d = min(d, max(halfLength - headLength - p.x, side));
+    }
+
+    let coverage = clamp(0.5 - d, 0.0, 1.0);
+    if(coverage <= 0.0) { discard; }
+    return vec4f(in.color.rgb, in.color.a * coverage);
+}
+)";
+
+static WGPURenderPipeline CreateArrowPipeline(WGPUDevice device, WGPUBindGroupLayout layout, WGPUShaderModule module, WGPUTextureFormat format)
+{
+    WGPUPipelineLayoutDescriptor layoutDesc = WGPU_PIPELINE_LAYOUT_DESCRIPTOR_INIT;
+    layoutDesc.bindGroupLayoutCount = 1;
+    layoutDesc.bindGroupLayouts = &layout;
+    WGPUPipelineLayout pipelineLayout = wgpuDeviceCreatePipelineLayout(device, &layoutDesc);
+    
+    WGPUBlendState alphaBlend = WGPU_BLEND_STATE_INIT;
+    alphaBlend.color.srcFactor = WGPUBlendFactor_SrcAlpha;
+    alphaBlend.color.dstFactor = WGPUBlendFactor_OneMinusSrcAlpha;
+    alphaBlend.alpha.srcFactor = WGPUBlendFactor_One;
+    alphaBlend.alpha.dstFactor = WGPUBlendFactor_OneMinusSrcAlpha;
+    
+    WGPUColorTargetState target = WGPU_COLOR_TARGET_STATE_INIT;
+    target.format = format;
+    target.blend = &alphaBlend;
+    target.writeMask = WGPUColorWriteMask_All;
+    
+    WGPUFragmentState fragment = WGPU_FRAGMENT_STATE_INIT;
+    fragment.module = module;
+    fragment.entryPoint = "fs_main";
+    fragment.targetCount = 1;
+    fragment.targets = &target;
+    
+    WGPURenderPipelineDescriptor desc = WGPU_RENDER_PIPELINE_DESCRIPTOR_INIT;
+    desc.label = "Field arrows";
+    desc.layout = pipelineLayout;
+    desc.vertex.module = module;
+    desc.vertex.entryPoint = "vs_main";
+    desc.primitive.topology = WGPUPrimitiveTopology_TriangleList;
+    desc.primitive.cullMode = WGPUCullMode_None;
+    desc.fragment = &fragment;
+    
+    WGPURenderPipeline pipeline = wgpuDeviceCreateRenderPipeline(device, &desc);
+    wgpuPipelineLayoutRelease(pipelineLayout);
+    return pipeline;
+}
+
+void InitFieldRenderer(FieldRenderer* renderer, WGPUDevice device, WGPUTextureFormat targetFormat)
+{
+    memset(renderer, 0, sizeof(FieldRenderer));
+    renderer->device = device;
+    renderer->queue = wgpuDeviceGetQueue(device);
+    
+    WGPUBindGroupLayoutEntry entries[2];
+    for(int i = 0; i < 2; ++i)
+    {
+        entries[i] = WGPU_BIND_GROUP_LAYOUT_ENTRY_INIT;
+        entries[i].binding = i;
+        entries[i].visibility = WGPUShaderStage_Vertex;
+        entries[i].buffer.type = i == 0 ? WGPUBufferBindingType_Uniform : WGPUBufferBindingType_ReadOnlyStorage;
+    }
+    entries[0].buffer.minBindingSize = sizeof(FieldUniforms);
+    
+    WGPUBindGroupLayoutDescriptor layoutDesc = WGPU_BIND_GROUP_LAYOUT_DESCRIPTOR_INIT;
+    layoutDesc.label = "Field arrows";
+    layoutDesc.entryCount = ArrayCount(entries);
+    layoutDesc.entries = entries;
+    renderer->layout = wgpuDeviceCreateBindGroupLayout(device, &layoutDesc);
+    
+    WGPUShaderModule module = CreateShaderModule(device, fieldShader, "Field arrows");
+    renderer->pipeline = CreateArrowPipeline(device, renderer->layout, module, targetFormat);
+    wgpuShaderModuleRelease(module);
+    
+    WGPUBufferDescriptor bufferDesc = WGPU_BUFFER_DESCRIPTOR_INIT;
+    bufferDesc.label = "Field uniforms";
+    bufferDesc.usage = WGPUBufferUsage_Uniform | WGPUBufferUsage_CopyDst;
+    bufferDesc.size = sizeof(FieldUniforms);
+    renderer->uniforms = wgpuDeviceCreateBuffer(device, &bufferDesc);
+}
+
+static void ReleaseArrowBuffer(FieldRenderer* renderer)
+{
+    if(renderer->bindGroup) wgpuBindGroupRelease(renderer->bindGroup);
+    if(renderer->arrows) wgpuBufferRelease(renderer->arrows);
+    renderer->bindGroup = nullptr;
+    renderer->arrows = nullptr;
+    renderer->capacity = 0;
+}
+
+void CleanupFieldRenderer(FieldRenderer* renderer)
+{
+    ReleaseArrowBuffer(renderer);
+    wgpuBufferRelease(renderer->uniforms);
+    wgpuRenderPipelineRelease(renderer->pipeline);
+    wgpuBindGroupLayoutRelease(renderer->layout);
+    wgpuQueueRelease(renderer->queue);
+    memset(renderer, 0, sizeof(FieldRenderer));
+}
+
+// Grows by doubling, the arrows of a frame are rewritten whole
+static void ReserveArrows(FieldRenderer* renderer, uint32_t count)
+{
+    if(count <= renderer->capacity) return;
+    
+    uint32_t capacity = renderer->capacity * 2 > count ? renderer->capacity * 2 : count;
+    ReleaseArrowBuffer(renderer);
+    
+    WGPUBufferDescriptor desc = WGPU_BUFFER_DESCRIPTOR_INIT;
+    desc.label = "Field arrows";
+    desc.usage = WGPUBufferUsage_Storage | WGPUBufferUsage_CopyDst;
+    desc.size = (uint64_t)capacity * sizeof(FieldArrow);
+    renderer->arrows = wgpuDeviceCreateBuffer(renderer->device, &desc);
+    renderer->capacity = capacity;
+    
+    WGPUBindGroupEntry entries[2];
+    entries[0] = WGPU_BIND_GROUP_ENTRY_INIT;
+    entries[0].binding = 0;
+    entries[0].buffer = renderer->uniforms;
+    entries[0].size = sizeof(FieldUniforms);
+    entries[1] = WGPU_BIND_GROUP_ENTRY_INIT;
+    entries[1].binding = 1;
+    entries[1].buffer = renderer->arrows;
+    entries[1].size = desc.size;
+    
+    WGPUBindGroupDescriptor groupDesc = WGPU_BIND_GROUP_DESCRIPTOR_INIT;
+    groupDesc.layout = renderer->layout;
+    groupDesc.entryCount = ArrayCount(entries);
+    groupDesc.entries = entries;
+    renderer->bindGroup = wgpuDeviceCreateBindGroup(renderer->device, &groupDesc);
+}
+
+static bool IsField(const Curve* curve)
+{
+    return curve->def.kind == Def_SlopeField || curve->def.kind == Def_VectorField;
+}
+
+void UpdateFieldArrows(FieldRenderer* renderer, const CurveList* list, const PlotView* view)
+{
+    renderer->count = 0;
+    double pixelX = PlotPixelWidth(view);
+    double pixelY = PlotPixelHeight(view);
+    if(view->width <= 0 || view->height <= 0 || !(pixelX > 0) || !(pixelY > 0)) return;
+    
+    // Same power of two grid as the curve samples, separately in x and y
+    double stepX = ldexp(1.0, (int)floor(log2(Field_Spacing * pixelX)));
+    double stepY = ldexp(1.0, (int)floor(log2(Field_Spacing * pixelY)));
+    double firstX = ceil(view->xMin / stepX), lastX = floor(view->xMax / stepX);
+    double firstY = ceil(view->yMin / stepY), lastY = floor(view->yMax / stepY);
+    if(!(lastX >= firstX && lastY >= firstY) || (lastX - firstX + 1) * (lastY - firstY + 1) > Field_MaxArrows) return;
+    
+    int columns = (int)(lastX - firstX) + 1;
+    int rows = (int)(lastY - firstY) + 1;
+    int count = columns * rows;
+    std::vector<double> gridX(count), gridY(count);
+    for(int r = 0; r < rows; ++r)
+    {
+        for(int c = 0; c < columns; ++c)
+        {
+            gridX[r * columns + c] = (firstX + c) * stepX;
+            gridY[r * columns + c] = (firstY + r) * stepY;
+        }
+    }
+    
+    // Arrows fit in the smaller of the two spacings, in pixels
+    double spacing = fmin(stepX / pixelX, stepY / pixelY);
+    std::vector<double> dx(count), dy(count);
+    std::vector<FieldArrow> arrows;
+    for(const Curve* curve : list->curves)
+    {
+        if(!curve->visible || !IsField(curve)) continue;
+        
+        EvalInput vars[Var_Count] = { EvalArray(gridX.data()), EvalArray(gridY.data()), EvalConstant(0.0) };
+        double* outputs[2] = { dx.data(), dy.data() };
+        EvalBatch(&curve->program, vars, list->params.values.data(), count, outputs);
+        
+        // Directions in pixels, y goes down on screen
+        double longest = 0.0;
+        for(int i = 0; i < count; ++i)
+        {
+            dx[i] /= pixelX;
+            dy[i] /= -pixelY;
+            double length = hypot(dx[i], dy[i]);
+            if(isfinite(length) && length > longest) longest = length;
+        }
+        if(!(longest > 0.0) || !isfinite(longest)) continue;
+        
+        bool vector = curve->def.kind == Def_VectorField;
+        for(int i = 0; i < count; ++i)
+        {
+            double length = hypot(dx[i], dy[i]);
+            if(!(length > 0.0) || !isfinite(length)) continue;
+            
+            double size = vector ? spacing * (0.2 + 0.6 * length / longest) : spacing * 0.6;
+            FieldArrow arrow = {};
+            arrow.center[0] = (float)((gridX[i] - view->xMin) / pixelX);
+            arrow.center[1] = (float)((view->yMax - gridY[i]) / pixelY);
+            arrow.direction[0] = (float)(dx[i] / length * size);
+            arrow.direction[1] = (float)(dy[i] / length * size);
+            arrow.color[0] = curve->color[0];
+            arrow.color[1] = curve->color[1];
+            arrow.color[2] = curve->color[2];
+            arrow.color[3] = curve->color[3] * 0.6f;
+            arrow.head = vector ? 7.0f : 0.0f;
+            arrows.push_back(arrow);
+        }
+    }
+    
+    if(arrows.empty()) return;
+    
+    ReserveArrows(renderer, (uint32_t)arrows.size());
+    FieldUniforms uniforms = { { (float)view->width, (float)view->height }, { 0, 0 } };
+    wgpuQueueWriteBuffer(renderer->queue, renderer->uniforms, 0, &uniforms, sizeof(uniforms));
+    wgpuQueueWriteBuffer(renderer->queue, renderer->arrows, 0, arrows.data(), arrows.size() * sizeof(FieldArrow));
+    renderer->count = (uint32_t)arrows.size();
+}
+
+void DrawFieldArrows(FieldRenderer* renderer, WGPURenderPassEncoder pass)
+{
+    if(renderer->count == 0) return;
+    
+    wgpuRenderPassEncoderSetPipeline(pass, renderer->pipeline);
+    wgpuRenderPassEncoderSetBindGroup(pass, 0, renderer->bindGroup, 0, nullptr);
+    wgpuRenderPassEncoderDraw(pass, 6, renderer->count, 0, 0);
+}
+
+void HandleFieldClick(CurveList* list, const PlotView* view)
+{
+    ImGuiIO& io = ImGui::GetIO();
+    if(io.WantCaptureMouse || io.DisplaySize.x <= 0 || io.DisplaySize.y <= 0) return;
+    if(!ImGui::IsMouseReleased(ImGuiMouseButton_Left)) return;
+    
+    // Releasing a drag pans, it isn't a click
+    ImVec2 drag = ImGui::GetMouseDragDelta(ImGuiMouseButton_Left, 0.0f);
+    if(drag.x * drag.x + drag.y * drag.y > 9.0f) return;
+    
+    // Clicks on explicit curves select them for analysis instead
+    double x = view->xMin + io.MousePos.x / io.DisplaySize.x * (view->xMax - view->xMin);
+    double y = view->yMax - io.MousePos.y / io.DisplaySize.y * (view->yMax - view->yMin);
+    if(PickCurve(list, view, x, y)) return;
+    
+    for(size_t i = list->curves.size(); i-- > 0;)
+    {
+        Curve* curve = list->curves[i];
+        if(!curve->visible || !IsField(curve)) continue;
+        
+        curve->starts.push_back(x);
+        curve->starts.push_back(y);
+        return;
+    }
+}
+
+struct FieldTask
+{
+    uint32_t curve;
+    uint64_t key;
+    Program program;
+    std::vector<double> params;
+    std::vector<double> starts;
+    OdeOptions options;
+};
+
+static FieldSolutions* FindSolutions(FieldSolver* solver, uint32_t curve)
+{
+    for(FieldSolutions& solutions : solver->solutions)
+    {
+        if(solutions.curve == curve) return &solutions;
+    }
+    return nullptr;
+}
+
+static void RunFieldTask(FieldSolver* solver, const FieldTask* task)
+{
+    std::vector<double> xs, ys;
+    int count = (int)(task->starts.size() / 2);
+    SolveOde(&task->program, task->params.data(), task->starts.data(), count, &task->options, &xs, &ys);
+    
+    std::lock_guard<std::mutex> lock(solver->mutex);
+    FieldSolutions* solutions = FindSolutions(solver, task->curve);
+    if(!solutions) return;
+    
+    solutions->key = task->key;
+    memcpy(solutions->box, task->options.box, sizeof(solutions->box));
+    solutions->xs.swap(xs);
+    solutions->ys.swap(ys);
+    solutions->running = false;
+}
+
+void UpdateFieldSolutions(FieldSolver* solver, const CurveList* list, const PlotView* view)
+{
+    double rangeX = view->xMax - view->xMin;
+    double rangeY = view->yMax - view->yMin;
+    if(view->width <= 0 || view->height <= 0 || !(rangeX > 0) || !(rangeY > 0)) return;
+    
+    std::vector<FieldTask*> tasks;
+    {
+        std::lock_guard<std::mutex> lock(solver->mutex);
+        
+        // Removed curves go once their job is done
+        for(size_t i = solver->solutions.size(); i-- > 0;)
+        {
+            const FieldSolutions* solutions = &solver->solutions[i];
+            const Curve* curve = FindCurve(list, solutions->curve);
+            if(!solutions->running && (!curve || !IsField(curve)))
+                solver->solutions.erase(solver->solutions.begin() + i);
+        }
+        
+        uint64_t paramsHash = HashBytes(Hash_Seed, list->params.values.data(), list->params.values.size() * sizeof(double));
+        for(const Curve* curve : list->curves)
+        {
+            if(!curve->visible || !IsField(curve)) continue;
+            
+            uint64_t key = HashBytes(paramsHash, &curve->version, sizeof(curve->version));
+            key = HashBytes(key, &solver->method, sizeof(solver->method));
+            key = HashBytes(key, curve->starts.data(), curve->starts.size() * sizeof(double));
+            
+            FieldSolutions* solutions = FindSolutions(solver, curve->id);
+            if(!solutions)
+            {
+                solver->solutions.push_back(FieldSolutions());
+                solutions = &solver->solutions.back();
+                solutions->curve = curve->id;
+                solutions->key = ~key;
+            }
+            if(solutions->running) continue;
+            
+            bool inside = view->xMin >= solutions->box[0] && view->xMax <= solutions->box[1] &&
+                          view->yMin >= solutions->box[2] && view->yMax <= solutions->box[3];
+            if(solutions->key == key && (inside || curve->starts.empty())) continue;
+            
+            // Nothing to solve, no need for a job
+            if(curve->starts.empty())
+            {
+                solutions->key = key;
+                solutions->xs.clear();
+                solutions->ys.clear();
+                continue;
+            }
+            
+            FieldTask* task = new FieldTask();
+            task->curve = curve->id;
+            task->key = key;
+            task->program = curve->program;
+            task->params = list->params.values;
+            task->starts = curve->starts;
+            task->options.method = solver->method;
+            task->options.box[0] = view->xMin - rangeX;
+            task->options.box[1] = view->xMax + rangeX;
+            task->options.box[2] = view->yMin - rangeY;
+            task->options.box[3] = view->yMax + rangeY;
+            task->options.maxStep = Field_StepPixels / (3.0 * fmax(view->width, view->height));
+            task->options.tolerance = Field_Tolerance;
+            task->options.maxSteps = Field_MaxSteps;
+            solutions->running = true;
+            tasks.push_back(task);
+        }
+    }
+    
+    // Queued outside of the lock, jobs run inline without a job system
+    for(FieldTask* task : tasks)
+    {
+        RunBackgroundJob([solver, task]()
+        {
+            RunFieldTask(solver, task);
+            delete task;
+        }, &solver->jobs);
+    }
+}
+
+void DrawFieldSolutions(FieldSolver* solver, const CurveList* list, const PlotView* view)
+{
+    ImGuiIO& io = ImGui::GetIO();
+    ImVec2 size = io.DisplaySize;
+    double rangeX = view->xMax - view->xMin;
+    double rangeY = view->yMax - view->yMin;
+    if(size.x <= 0 || size.y <= 0 || !(rangeX > 0) || !(rangeY > 0)) return;
+    
+    std::lock_guard<std::mutex> lock(solver->mutex);
+    ImDrawList* drawList = ImGui::GetBackgroundDrawList();
+    for(const FieldSolutions& solutions : solver->solutions)
+    {
+        const Curve* curve = FindCurve(list, solutions.curve);
+        if(!curve || !curve->visible || !IsField(curve)) continue;
+        
+        ImU32 color = ImGui::GetColorU32(ImVec4(curve->color[0], curve->color[1], curve->color[2], curve->color[3]));
+        for(size_t i = 1; i < solutions.xs.size(); ++i)
+        {
+            double x0 = solutions.xs[i - 1], y0 = solutions.ys[i - 1];
+            double x1 = solutions.xs[i], y1 = solutions.ys[i];
+            if(!isfinite(x0) || !isfinite(x1)) continue;
+            if((x0 < view->xMin && x1 < view->xMin) || (x0 > view->xMax && x1 > view->xMax)) continue;
+            if((y0 < view->yMin && y1 < view->yMin) || (y0 > view->yMax && y1 > view->yMax)) continue;
+            
+            ImVec2 a((float)((x0 - view->xMin) / rangeX * size.x), (float)((view->yMax - y0) / rangeY * size.y));
+            ImVec2 b((float)((x1 - view->xMin) / rangeX * size.x), (float)((view->yMax - y1) / rangeY * size.y));
+            drawList->AddLine(a, b, color, 2.0f);
+        }
+    }
+    
+    // Start points, on top of their solutions
+    for(const Curve* curve : list->curves)
+    {
+        if(!curve->visible || !IsField(curve)) continue;
+        
+        ImU32 fill = ImGui::GetColorU32(ImVec4(curve->color[0], curve->color[1], curve->color[2], 1.0f));
+        for(size_t i = 0; i + 1 < curve->starts.size(); i += 2)
+        {
+            ImVec2 center((float)((curve->starts[i] - view->xMin) / rangeX * size.x),
+                          (float)((view->yMax - curve->starts[i + 1]) / rangeY * size.y));
+            drawList->AddCircleFilled(center, 4.0f, IM_COL32(255, 255, 255, 255));
+            drawList->AddCircleFilled(center, 2.5f, fill);
+        }
+    }
+}
+
+void ShutdownFieldSolver(FieldSolver* solver)
+{
+    WaitForJobs(&solver->jobs);
+}
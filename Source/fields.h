@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <mutex>
+
+#include "webgpu/webgpu.h"
+#include "jobs.h"
+#include "curves.h"
+#include "ode.h"
+
+// Slope and vector fields of the differential equations in the curve list.
+// The arrows are evaluated every frame on a grid of the view, one batch per
+// field, and drawn as instanced quads with the shape computed in the fragment
+// shader, like the scatter markers. The grid spacing is a power of two in data
+// units, so arrows don't move while panning. Slope fields get plain segments,
+// vector fields arrows whose length follows the magnitude.
+//
+// Clicking the plot away from the explicit curves adds a solution through
+// that point to the last visible field. The solutions of a field are solved
+// together as a job (see ode.h) over a box three times the size of the view,
+// and the previous ones stay on screen until it's done. They're solved again
+// when the text, the parameters, the method or the start points change, or
+// when the view leaves the box.
+
+#define Field_Spacing 48.0        // Most pixels between arrows, the least is half that
+#define Field_MaxArrows 16384
+#define Field_StepPixels 2.0      // Longest step of the solutions, in pixels of the view
+#define Field_Tolerance 1e-6      // Dormand-Prince, relative to the box
+#define Field_MaxSteps 8192       // Per direction of a solution
+
+struct FieldRenderer
+{
+    WGPUDevice device;
+    WGPUQueue queue;
+    WGPUBindGroupLayout layout;
+    WGPURenderPipeline pipeline;
+    WGPUBuffer uniforms;
+    WGPUBuffer arrows;
+    WGPUBindGroup bindGroup;
+    uint32_t capacity;  // Arrows the buffer holds
+    uint32_t count;     // Arrows to draw this frame
+};
+
+struct FieldSolutions
+{
+    uint32_t curve;
+    uint64_t key;       // Of the solved text, parameters, method and start points
+    double box[4];      // Solved over, xMin, xMax, yMin, yMax
+    bool running;
+    std::vector<double> xs;  // Polylines separated by NaN
+    std::vector<double> ys;
+};
+
+struct FieldSolver
+{
+    OdeMethod method = Ode_DormandPrince;
+    
+    std::mutex mutex;  // Guards the solutions, which the jobs fill in
+    std::vector<FieldSolutions> solutions;
+    JobCounter jobs;
+};
+
+void InitFieldRenderer(FieldRenderer* renderer, WGPUDevice device, WGPUTextureFormat targetFormat);
+void CleanupFieldRenderer(FieldRenderer* renderer);
+// Evaluates the arrows of the visible fields for the view and uploads them
+void UpdateFieldArrows(FieldRenderer* renderer, const CurveList* list, const PlotView* view);
+void DrawFieldArrows(FieldRenderer* renderer, WGPURenderPassEncoder pass);
+
+// Adds a start point to the last visible field under a click on the plot
+void HandleFieldClick(CurveList* list, const PlotView* view);
+// Queues the fields whose solutions are out of date
+void UpdateFieldSolutions(FieldSolver* solver, const CurveList* list, const PlotView* view);
+void DrawFieldSolutions(FieldSolver* solver, const CurveList* list, const PlotView* view);
+// Waits for the jobs still running
+void ShutdownFieldSolver(FieldSolver* solver);
@@ -0,0 +1,551 @@
+#include "fit.h"
+#include "core.h"
+#include "jobs.h"
+#include "interpreter.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+#define Fit_GrainRows (Eval_BatchSize * 64)
+
+// Regression compiled against a table, the columns it uses are mapped to variables
+struct FitModel
+{
+    Program jacobian;  // Residual (model - data), then its derivative for each parameter
+    Program residual;
+    Program stats;  // Residual and data
+    const double* columns[Var_Count];
+    int64_t rows;
+    
+    uint32_t numParams;
+    int params[Fit_MaxParams];  // In the values below
+    std::vector<double> values;  // All parameters
+};
+
+// Per task partial sums, on their own cache lines
+struct alignas(64) NormalSums
+{
+    double jtj[Fit_MaxParams * Fit_MaxParams];  // Upper triangle
+    double jtr[Fit_MaxParams];
+    int64_t rows;
+    
+    // Over the rows where the residual alone is finite, to compare with ResidualSumOfSquares
+    double rss;
+    int64_t residualRows;
+};
+
+#define QR_Width (Fit_MaxParams + 1)
+
+struct alignas(64) QRSums
+{
+    double r[QR_Width * QR_Width];  // Upper triangular factor of [J | -r]
+    int64_t rows;
+};
+
+struct alignas(64) StatSums
+{
+    double rss;
+    int64_t rows;
+    double mean;  // Of the data, accumulated with Welford's method
+    double m2;
+};
+
+// Calls func(task, outputs, n) for every batch of rows, split over the job system
+template<typename T>
+static void ForEachBatch(const FitModel* model, const Program* program, T func)
+{
+    ParallelFor(model->rows, Fit_GrainRows, [&](int64_t begin, int64_t end, int task)
+    {
+        double storage[Program_MaxOutputs * Eval_BatchSize];
+        double* outputs[Program_MaxOutputs];
+        for(uint32_t i = 0; i < program->numOutputs; ++i)
+            outputs[i] = storage + i * Eval_BatchSize;
+        
+        for(int64_t offset = begin; offset < end; offset += Eval_BatchSize)
+        {
+            int n = (int)(end - offset < Eval_BatchSize ? end - offset : Eval_BatchSize);
+            EvalInput vars[Var_Count];
+            for(int v = 0; v < Var_Count; ++v)
+                vars[v] = model->columns[v] ? EvalArray(model->columns[v] + offset) : EvalConstant(0.0);
+            
+            EvalBatch(program, vars, model->values.data(), n, outputs);
+            func(task, outputs, n);
+        }
+    });
+}
+
+// Rows where any output isn't finite (missing data, out of the model's domain)
+// are zeroed so they don't contribute, returns the number of remaining rows
+static int MaskBatch(double* const* outputs, uint32_t numOutputs, int n)
+{
+    int valid = 0;
+    for(int i = 0; i < n; ++i)
+    {
+        bool finite = true;
+        for(uint32_t o = 0; o < numOutputs; ++o)
+            finite &= isfinite(outputs[o][i]);
+        
+        if(finite)
+        {
+            ++valid;
+            continue;
+        }
+        
+        for(uint32_t o = 0; o < numOutputs; ++o)
+            outputs[o][i] = 0.0;
+    }
+    
+    return valid;
+}
+
+static double Dot(const double* a, const double* b, int n)
+{
+    double sum = 0.0;
+    for(int i = 0; i < n; ++i)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+// J^T J, J^T r and r^T r at the current parameters
+static void NormalEquations(const FitModel* model, NormalSums* out)
+{
+    uint32_t k = model->numParams;
+    std::vector<NormalSums> partials(GetNumJobThreads());
+    memset(partials.data(), 0, partials.size() * sizeof(NormalSums));
+    
+    ForEachBatch(model, &model->jacobian, [&](int task, double* const* outputs, int n)
+    {
+        NormalSums* sums = &partials[task];
+        const double* r = outputs[0];
+        for(int i = 0; i < n; ++i)
+        {
+            if(!isfinite(r[i])) continue;
+            sums->rss += r[i] * r[i];
+            ++sums->residualRows;
+        }
+        
+        sums->rows += MaskBatch(outputs, k + 1, n);
+        const double* const* jac = outputs + 1;
+        for(uint32_t a = 0; a < k; ++a)
+        {
+            for(uint32_t b = a; b < k; ++b)
+                sums->jtj[a * k + b] += Dot(jac[a], jac[b], n);
+            sums->jtr[a] += Dot(jac[a], r, n);
+        }
+    });
+    
+    memset(out, 0, sizeof(NormalSums));
+    for(const NormalSums& sums : partials)
+    {
+        for(uint32_t i = 0; i < k * k; ++i) out->jtj[i] += sums.jtj[i];
+        for(uint32_t i = 0; i < k; ++i) out->jtr[i] += sums.jtr[i];
+        out->rows += sums.rows;
+        out->rss += sums.rss;
+        out->residualRows += sums.residualRows;
+    }
+}
+
+static double ResidualSumOfSquares(const FitModel* model, int64_t* rows)
+{
+    std::vector<StatSums> partials(GetNumJobThreads());
+    memset(partials.data(), 0, partials.size() * sizeof(StatSums));
+    
+    ForEachBatch(model, &model->residual, [&](int task, double* const* outputs, int n)
+    {
+        partials[task].rows += MaskBatch(outputs, 1, n);
+        partials[task].rss += Dot(outputs[0], outputs[0], n);
+    });
+    
+    double rss = 0.0;
+    *rows = 0;
+    for(const StatSums& sums : partials)
+    {
+        rss += sums.rss;
+        *rows += sums.rows;
+    }
+    return rss;
+}
+
+// Solves a x = b for a symmetric positive definite k x k matrix (upper
+// triangle read), a is overwritten by its factor and b by the solution
+static bool SolveCholesky(double* a, double* b, uint32_t k)
+{
+    // a = U^T U, stored in the upper triangle
+    for(uint32_t i = 0; i < k; ++i)
+    {
+        double diagonal = a[i * k + i];
+        for(uint32_t m = 0; m < i; ++m)
+            diagonal -= a[m * k + i] * a[m * k + i];
+        if(!(diagonal > 0.0)) return false;
+        
+        diagonal = sqrt(diagonal);
+        a[i * k + i] = diagonal;
+        for(uint32_t j = i + 1; j < k; ++j)
+        {
+            double value = a[i * k + j];
+            for(uint32_t m = 0; m < i; ++m)
+                value -= a[m * k + i] * a[m * k + j];
+            a[i * k + j] = value / diagonal;
+        }
+    }
+    
+    for(uint32_t i = 0; i < k; ++i)
+    {
+        for(uint32_t m = 0; m < i; ++m)
+            b[i] -= a[m * k + i] * b[m];
+        b[i] /= a[i * k + i];
+    }
+    
+    for(int i = (int)k - 1; i >= 0; --i)
+    {
+        for(uint32_t m = i + 1; m < k; ++m)
+            b[i] -= a[i * k + m] * b[m];
+        b[i] /= a[i * k + i];
+    }
+    
+    return true;
+}
+
+// Returns an error message on failure
+static const char* FitLevenbergMarquardt(FitModel* model, FitResult* result)
+{
+    uint32_t k = model->numParams;
+    NormalSums normal;
+    NormalEquations(model, &normal);
+    result->iterations = 1;
+    if(normal.rows == 0) return "The model isn't defined on any row at the starting point";
+    
+    double cost = normal.rss;
+    double lambda = 1e-3;
+    double previous[Fit_MaxParams];
+    
+    while(result->iterations < Fit_MaxIterations && cost > 0.0)
+    {
+        // Marquardt's scaling, with a floor for the parameters that barely matter
+        double maxDiagonal = 0.0;
+        for(uint32_t i = 0; i < k; ++i)
+            maxDiagonal = fmax(maxDiagonal, normal.jtj[i * k + i]);
+        
+        bool accepted = false;
+        while(!accepted && lambda < 1e16)
+        {
+            double matrix[Fit_MaxParams * Fit_MaxParams];
+            double step[Fit_MaxParams];
+            memcpy(matrix, normal.jtj, k * k * sizeof(double));
+            for(uint32_t i = 0; i < k; ++i)
+            {
+                matrix[i * k + i] += lambda * fmax(normal.jtj[i * k + i], maxDiagonal * 1e-12);
+                step[i] = -normal.jtr[i];
+            }
+            
+            if(!SolveCholesky(matrix, step, k))
+            {
+                lambda *= 10.0;
+                continue;
+            }
+            
+            for(uint32_t i = 0; i < k; ++i)
+            {
+                previous[i] = model->values[model->params[i]];
+                model->values[model->params[i]] += step[i];
+            }
+            
+            // Steps which push rows out of the model's domain aren't improvements
+            int64_t rows;
+            double trial = ResidualSumOfSquares(model, &rows);
+            if(rows == normal.residualRows && trial < cost)
+            {
+                accepted = true;
+                lambda = fmax(lambda * 0.1, 1e-12);
+                
+                bool smallStep = true;
+                for(uint32_t i = 0; i < k; ++i)
+                    smallStep &= fabs(step[i]) <= 1e-10 * (fabs(model->values[model->params[i]]) + 1e-10);
+                
+                result->converged = smallStep || cost - trial <= 1e-12 * cost;
+                cost = trial;
+            }
+            else
+            {
+                for(uint32_t i = 0; i < k; ++i)
+                    model->values[model->params[i]] = previous[i];
+                lambda *= 10.0;
+            }
+        }
+        
+        // Nothing improves on the current point
+        if(!accepted)
+        {
+            result->converged = true;
+            break;
+        }
+        if(result->converged) break;
+        
+        NormalEquations(model, &normal);
+        ++result->iterations;
+    }
+    
+    if(cost == 0.0) result->converged = true;
+    return nullptr;
+}
+
+// Rotates the row v into the triangle r, both are QR_Width wide
+static void GivensRow(double* r, double* v, uint32_t width)
+{
+    for(uint32_t j = 0; j < width; ++j)
+    {
+        if(v[j] == 0.0) continue;
+        
+        double* row = r + j * QR_Width;
+        double h = sqrt(row[j] * row[j] + v[j] * v[j]);
+        double c = row[j] / h;
+        double s = v[j] / h;
+        for(uint32_t m = j; m < width; ++m)
+        {
+            double a = row[m];
+            double b = v[m];
+            row[m] = c * a + s * b;
+            v[m] = c * b - s * a;
+        }
+    }
+}
+
+// The model is J p + r(0), so the parameters are the least squares solution of J p = -r(0)
+static const char* FitLinear(FitModel* model, FitResult* result)
+{
+    uint32_t k = model->numParams;
+    uint32_t width = k + 1;
+    for(uint32_t i = 0; i < k; ++i)
+        model->values[model->params[i]] = 0.0;
+    
+    std::vector<QRSums> partials(GetNumJobThreads());
+    memset(partials.data(), 0, partials.size() * sizeof(QRSums));
+    
+    ForEachBatch(model, &model->jacobian, [&](int task, double* const* outputs, int n)
+    {
+        QRSums* sums = &partials[task];
+        sums->rows += MaskBatch(outputs, width, n);
+        for(int i = 0; i < n; ++i)
+        {
+            double v[QR_Width];
+            for(uint32_t j = 0; j < k; ++j)
+                v[j] = outputs[j + 1][i];
+            v[k] = -outputs[0][i];
+            GivensRow(sums->r, v, width);
+        }
+    });
+    result->iterations = 1;
+    
+    // Merges the triangles of the other tasks into the first one
+    QRSums* total = &partials[0];
+    for(size_t t = 1; t < partials.size(); ++t)
+    {
+        total->rows += partials[t].rows;
+        for(uint32_t j = 0; j < width; ++j)
+        {
+            double v[QR_Width] = {};
+            memcpy(v + j, partials[t].r + j * QR_Width + j, (width - j) * sizeof(double));
+            GivensRow(total->r, v, width);
+        }
+    }
+    if(total->rows == 0) return "The model isn't defined on any row";
+    
+    // Back substitution, a tiny pivot means some combination of the parameters has no effect
+    double maxPivot = 0.0;
+    for(uint32_t j = 0; j < k; ++j)
+        maxPivot = fmax(maxPivot, fabs(total->r[j * QR_Width + j]));
+    
+    double solution[Fit_MaxParams];
+    for(int j = (int)k - 1; j >= 0; --j)
+    {
+        const double* row = total->r + j * QR_Width;
+        if(!(fabs(row[j]) > maxPivot * 1e-13)) return "The parameters can't be told apart with this data";
+        
+        double value = row[k];
+        for(uint32_t m = j + 1; m < k; ++m)
+            value -= row[m] * solution[m];
+        solution[j] = value / row[j];
+    }
+    
+    for(uint32_t i = 0; i < k; ++i)
+        model->values[model->params[i]] = solution[i];
+    result->converged = true;
+    return nullptr;
+}
+
+static void ComputeStats(const FitModel* model, FitResult* result)
+{
+    std::vector<StatSums> partials(GetNumJobThreads());
+    memset(partials.data(), 0, partials.size() * sizeof(StatSums));
+    
+    ForEachBatch(model, &model->stats, [&](int task, double* const* outputs, int n)
+    {
+        StatSums* sums = &partials[task];
+        for(int i = 0; i < n; ++i)
+        {
+            double r = outputs[0][i];
+            double y = outputs[1][i];
+            if(!isfinite(r) || !isfinite(y)) continue;
+            
+            sums->rss += r * r;
+            ++sums->rows;
+            double delta = y - sums->mean;
+            sums->mean += delta / sums->rows;
+            sums->m2 += delta * (y - sums->mean);
+        }
+    });
+    
+    // Chan's combination of the partial variances
+    StatSums total = {};
+    for(const StatSums& sums : partials)
+    {
+        if(sums.rows == 0) continue;
+        
+        int64_t rows = total.rows + sums.rows;
+        double delta = sums.mean - total.mean;
+        total.m2 += sums.m2 + delta * delta * ((double)total.rows * sums.rows / rows);
+        total.mean += delta * sums.rows / rows;
+        total.rss += sums.rss;
+        total.rows = rows;
+    }
+    
+    result->rows = total.rows;
+    result->rss = total.rss;
+    result->rSquared = total.m2 > 0.0 ? 1.0 - total.rss / total.m2 : NAN;
+}
+
+static bool FitError(char* error, int errorSize, const char* message, const char* name = "")
+{
+    if(error) snprintf(error, errorSize, message, name);
+    return false;
+}
+
+bool FitRegression(const char* text, const DataTable* table, ParamTable* params,
+                   FitResult* result, char* error, int errorSize)
+{
+    uint64_t start = GetTimeNs();
+    memset(result, 0, sizeof(FitResult));
+    
+    // Parsed against a copy, names of columns shouldn't end up as parameters
+    ParamTable scratch = *params;
+    Definition def;
+    if(!ParseDefinition(text, &scratch, &def)) return FitError(error, errorSize, "%s", def.error);
+    if(def.kind != Def_Regression) return FitError(error, errorSize, "Expected a regression, like y1 ~ a x1 + b");
+    if(table->rowCount == 0) return FitError(error, errorSize, "The table is empty");
+    
+    Ast* ast = &def.ast;
+    AstRef data = def.roots[0];
+    AstRef model = def.roots[1];
+    auto usedBy = [&](OpCode op, uint32_t index)
+    {
+        return AstDependsOn(ast, data, op, index) || AstDependsOn(ast, model, op, index);
+    };
+    
+    FitModel fit = {};
+    fit.rows = table->rowCount;
+    
+    // Columns are variables from now on, in the order they're found
+    int slotOfVar[Var_Count];
+    std::vector<int> slotOfParam(scratch.names.size(), -1);
+    int columns[Var_Count];
+    int numColumns = 0;
+    auto useColumn = [&](const char* name, int* slot)
+    {
+        int column = FindDataColumn(table, name);
+        if(column < 0) return false;
+        
+        for(int i = 0; i < numColumns; ++i)
+        {
+            if(columns[i] == column) *slot = i;
+        }
+        if(*slot >= 0) return true;
+        if(numColumns == Var_Count) return false;
+        
+        columns[numColumns] = column;
+        *slot = numColumns++;
+        return true;
+    };
+    
+    for(int v = 0; v < Var_Count; ++v)
+    {
+        slotOfVar[v] = -1;
+        if(!usedBy(Op_Var, v) || useColumn(varNames[v], &slotOfVar[v])) continue;
+        if(FindDataColumn(table, varNames[v]) < 0) return FitError(error, errorSize, "No column named '%s'", varNames[v]);
+        return FitError(error, errorSize, "Too many columns in the regression");
+    }
+    
+    for(uint32_t p = 0; p < scratch.names.size(); ++p)
+    {
+        if(!usedBy(Op_Param, p) || useColumn(scratch.names[p].c_str(), &slotOfParam[p])) continue;
+        if(FindDataColumn(table, scratch.names[p].c_str()) >= 0)
+            return FitError(error, errorSize, "Too many columns in the regression");
+        
+        if(AstDependsOn(ast, data, Op_Param, p))
+            return FitError(error, errorSize, "'%s' is not a column, the data side can't have parameters", scratch.names[p].c_str());
+        if(fit.numParams == Fit_MaxParams)
+            return FitError(error, errorSize, "Too many parameters");
+        fit.params[fit.numParams++] = (int)p;
+    }
+    if(fit.numParams == 0) return FitError(error, errorSize, "Nothing to fit, every name is a column");
+    
+    for(AstNode& node : ast->nodes)
+    {
+        if(node.op == Op_Var && slotOfVar[node.index] >= 0)
+        {
+            node.index = slotOfVar[node.index];
+        }
+        else if(node.op == Op_Param && node.index < slotOfParam.size() && slotOfParam[node.index] >= 0)
+        {
+            node.op = Op_Var;
+            node.index = slotOfParam[node.index];
+        }
+    }
+    for(int i = 0; i < numColumns; ++i)
+        fit.columns[i] = table->columns[columns[i]].values;
+    
+    // Residual and its derivatives, linear models have derivatives without parameters
+    AstRef roots[Program_MaxOutputs];
+    roots[0] = AstOp(ast, Op_Sub, model, data);
+    result->linear = true;
+    for(uint32_t i = 0; i < fit.numParams; ++i)
+    {
+        roots[i + 1] = AstDerivative(ast, model, Op_Param, fit.params[i]);
+        if(roots[i + 1] == Ast_Null)
+            return FitError(error, errorSize, "'%s' has no effect on the model", scratch.names[fit.params[i]].c_str());
+        
+        for(uint32_t j = 0; j < fit.numParams; ++j)
+            result->linear &= !AstDependsOn(ast, roots[i + 1], Op_Param, fit.params[j]);
+    }
+    
+    CompileProgram(ast, roots, fit.numParams + 1, &fit.jacobian);
+    CompileProgram(ast, roots, 1, &fit.residual);
+    AstRef statRoots[2] = { roots[0], data };
+    CompileProgram(ast, statRoots, 2, &fit.stats);
+    
+    // New parameters start at 1, zero would cancel out products
+    fit.values = scratch.values;
+    for(uint32_t i = 0; i < fit.numParams; ++i)
+    {
+        if(fit.params[i] >= (int)params->names.size())
+            fit.values[fit.params[i]] = 1.0;
+    }
+    
+    const char* failure = result->linear ? FitLinear(&fit, result) : FitLevenbergMarquardt(&fit, result);
+    if(failure) return FitError(error, errorSize, "%s", failure);
+    
+    ComputeStats(&fit, result);
+    result->seconds = (GetTimeNs() - start) / 1e9;
+    
+    result->numParams = fit.numParams;
+    for(uint32_t i = 0; i < fit.numParams; ++i)
+    {
+        const std::string& name = scratch.names[fit.params[i]];
+        int param = FindOrAddParam(params, name.c_str(), (int)name.size());
+        params->values[param] = fit.values[fit.params[i]];
+        result->params[i] = param;
+    }
+    
+    return true;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "compiler.h"
+#include "datatable.h"
+
+// Least squares fits of regressions (y1 ~ a x1^2 + b) to the columns of a
+// table. Names in the regression that match a column are data, the others
+// are parameters. The residual and its derivatives with respect to every
+// parameter are differentiated symbolically and compiled into one program,
+// which is evaluated in batches over the rows, split over the job system.
+// Rows are reduced as they're evaluated, the Jacobian is never stored.
+//
+// Models that are linear in their parameters are solved directly, with a
+// QR factorization built by Givens rotations (each task factors its rows,
+// then the triangles are merged). The others go through Levenberg-Marquardt
+// from the current parameter values.
+
+#define Fit_MaxParams (Program_MaxOutputs - 1)
+#define Fit_MaxIterations 200
+
+struct FitResult
+{
+    bool linear;
+    int iterations;  // Levenberg-Marquardt steps, 1 for linear models
+    int64_t rows;  // The ones where the model and the data are finite
+    double seconds;
+    double rss;  // Residual sum of squares
+    double rSquared;
+    bool converged;
+    
+    uint32_t numParams;
+    int params[Fit_MaxParams];  // Indices in the parameter table
+};
+
+// Parameters of the table are the starting point and receive the results,
+// the ones seen for the first time start at 1. Error messages go to error.
+bool FitRegression(const char* text, const DataTable* table, ParamTable* params,
+                   FitResult* result, char* error, int errorSize);
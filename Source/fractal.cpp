@@ -0,0 +1,316 @@
+#include "fractal.h"
+#include "interpreter.h"
+#include "ddouble.h"
+
+#include <math.h>
+#include <string.h>
+
+static inline void FractalMul(const double* a, const double* b, double* out)
+{
+    double re = a[0] * b[0] - a[1] * b[1];
+    double im = a[0] * b[1] + a[1] * b[0];
+    out[0] = re;
+    out[1] = im;
+}
+
+bool EvalFractalMap(const Program* program, const double* params, FractalMap* out)
+{
+    double vars[Var_Count] = { 0 };
+    double outputs[Program_MaxOutputs];
+    EvalScalar(program, vars, params, outputs);
+    
+    // Roots are the factor of c, then the coefficients
+    int degree = (int)program->numOutputs / 2 - 2;
+    while(degree >= 0 && outputs[2 + 2 * degree] == 0.0 && outputs[3 + 2 * degree] == 0.0) --degree;
+    if(degree < 2) return false;
+    
+    for(int i = 0; i < 2 * degree + 4; ++i)
+        if(!isfinite(outputs[i])) return false;
+    
+    memset(out, 0, sizeof(FractalMap));
+    out->degree = degree;
+    out->factor[0] = outputs[0];
+    out->factor[1] = outputs[1];
+    out->julia = outputs[0] == 0.0 && outputs[1] == 0.0;
+    for(int j = 0; j <= degree; ++j)
+    {
+        out->coefficients[j][0] = outputs[2 + 2 * j];
+        out->coefficients[j][1] = outputs[3 + 2 * j];
+    }
+    return true;
+}
+
+// Iterations before the orbit of a point escapes, in doubles
+static int EscapeIterations(const FractalMap* map, double x, double y, int maxIterations)
+{
+    double c[2] = { x, y }, kc[2];
+    FractalMul(map->factor, c, kc);
+    double z[2] = { map->julia ? x : 0.0, map->julia ? y : 0.0 };
+    for(int n = 0; n < maxIterations; ++n)
+    {
+        if(z[0] * z[0] + z[1] * z[1] > Fractal_Bailout * Fractal_Bailout) return n;
+        
+        double acc[2] = { map->coefficients[map->degree][0], map->coefficients[map->degree][1] };
+        for(int j = map->degree - 1; j >= 0; --j)
+        {
+            FractalMul(acc, z, acc);
+            acc[0] += map->coefficients[j][0];
+            acc[1] += map->coefficients[j][1];
+        }
+        z[0] = acc[0] + kc[0];
+        z[1] = acc[1] + kc[1];
+    }
+    return maxIterations;
+}
+
+void ComputeFractalReference(FractalReference* ref, const FractalMap* map, const double viewMin[2], const double viewMax[2],
+                             int maxIterations)
+{
+    // The center unless another point lasts longer, orbits which escape
+    // early make the pixels rebase all the time
+    double centerX = (viewMin[0] + viewMax[0]) * 0.5, centerY = (viewMin[1] + viewMax[1]) * 0.5;
+    int best = EscapeIterations(map, centerX, centerY, maxIterations);
+    for(int i = 0; i < Fractal_Candidates * Fractal_Candidates && best < maxIterations; ++i)
+    {
+        double x = viewMin[0] + (viewMax[0] - viewMin[0]) * ((i % Fractal_Candidates) + 0.5) / Fractal_Candidates;
+        double y = viewMin[1] + (viewMax[1] - viewMin[1]) * ((i / Fractal_Candidates) + 0.5) / Fractal_Candidates;
+        int iterations = EscapeIterations(map, x, y, maxIterations);
+        if(iterations > best)
+        {
+            best = iterations;
+            centerX = x;
+            centerY = y;
+        }
+    }
+    
+    ref->map = *map;
+    ref->center[0] = centerX;
+    ref->center[1] = centerY;
+    ref->maxIterations = maxIterations;
+    ref->orbit.clear();
+    ref->series.clear();
+    
+    int degree = map->degree;
+    DoubleDouble zRe = { map->julia ? centerX : 0.0, 0.0 }, zIm = { map->julia ? centerY : 0.0, 0.0 };
+    DoubleDouble kcRe = DDSub(TwoProd(map->factor[0], centerX), TwoProd(map->factor[1], centerY));
+    DoubleDouble kcIm = DDAdd(TwoProd(map->factor[0], centerY), TwoProd(map->factor[1], centerX));
+    double a[2] = { map->julia ? 1.0 : 0.0, 0.0 }, b[2] = { 0.0, 0.0 }, c[2] = { 0.0, 0.0 };
+    for(int n = 0;; ++n)
+    {
+        // Taylor coefficients of P at Z, by repeated synthetic division
+        double z[2] = { zRe.hi, zIm.hi };
+        double taylor[Def_MaxDegree + 1][2];
+        memcpy(taylor, map->coefficients, sizeof(taylor));
+        for(int j = 0; j < degree; ++j)
+        {
+            for(int i = degree - 1; i >= j; --i)
+            {
+                double product[2];
+                FractalMul(taylor[i + 1], z, product);
+                taylor[i][0] += product[0];
+                taylor[i][1] += product[1];
+            }
+        }
+        
+        ref->orbit.insert(ref->orbit.end(), z, z + 2);
+        for(int j = 1; j <= degree; ++j)
+            ref->orbit.insert(ref->orbit.end(), taylor[j], taylor[j] + 2);
+        ref->series.insert(ref->series.end(), { a[0], a[1], b[0], b[1], c[0], c[1] });
+        
+        // At least one step, so that rebased pixels can always move on
+        if(n > 0 && (n == maxIterations || z[0] * z[0] + z[1] * z[1] > Fractal_Bailout * Fractal_Bailout))
+        {
+            ref->length = n;
+            break;
+        }
+        
+        // A' = P1 A + k, B' = P1 B + P2 A^2, C' = P1 C + 2 P2 A B + P3 A^3
+        double zero[2] = { 0.0, 0.0 };
+        const double* p1 = taylor[1];
+        const double* p2 = taylor[2];
+        const double* p3 = degree >= 3 ? taylor[3] : zero;
+        double square[2], cube[2], ab[2], t0[2], t1[2], t2[2];
+        FractalMul(a, a, square);
+        FractalMul(square, a, cube);
+        FractalMul(a, b, ab);
+        
+        double nextA[2], nextB[2], nextC[2];
+        FractalMul(p1, a, nextA);
+        nextA[0] += map->factor[0];
+        nextA[1] += map->factor[1];
+        FractalMul(p1, b, t0);
+        FractalMul(p2, square, t1);
+        nextB[0] = t0[0] + t1[0];
+        nextB[1] = t0[1] + t1[1];
+        FractalMul(p1, c, t0);
+        FractalMul(p2, ab, t1);
+        FractalMul(p3, cube, t2);
+        nextC[0] = t0[0] + 2.0 * t1[0] + t2[0];
+        nextC[1] = t0[1] + 2.0 * t1[1] + t2[1];
+        memcpy(a, nextA, sizeof(a));
+        memcpy(b, nextB, sizeof(b));
+        memcpy(c, nextC, sizeof(c));
+        
+        // Z' = P(Z) + k C in double-double, by Horner
+        DoubleDouble accRe = { map->coefficients[degree][0], 0.0 }, accIm = { map->coefficients[degree][1], 0.0 };
+        for(int j = degree - 1; j >= 0; --j)
+        {
+            DoubleDouble re = DDSub(DDMul(accRe, zRe), DDMul(accIm, zIm));
+            DoubleDouble im = DDAdd(DDMul(accRe, zIm), DDMul(accIm, zRe));
+            accRe = DDAddDouble(re, map->coefficients[j][0]);
+            accIm = DDAddDouble(im, map->coefficients[j][1]);
+        }
+        zRe = DDAdd(accRe, kcRe);
+        zIm = DDAdd(accIm, kcIm);
+    }
+}
+
+// d' from d at iteration n of the reference
+static inline void FractalStep(const FractalReference* ref, int n, const double* d, const double* dc, double* out)
+{
+    int degree = ref->map.degree;
+    const double* at = ref->orbit.data() + n * 2 * (degree + 1);
+    double acc[2] = { at[2 * degree], at[2 * degree + 1] };
+    for(int j = degree - 1; j >= 1; --j)
+    {
+        FractalMul(acc, d, acc);
+        acc[0] += at[2 * j];
+        acc[1] += at[2 * j + 1];
+    }
+    
+    double kdc[2];
+    FractalMul(acc, d, acc);
+    FractalMul(ref->map.factor, dc, kdc);
+    out[0] = acc[0] + kdc[0];
+    out[1] = acc[1] + kdc[1];
+}
+
+static inline void FractalSeries(const double series[3][2], const double* dc, double* out)
+{
+    double acc[2] = { series[2][0], series[2][1] };
+    FractalMul(acc, dc, acc);
+    acc[0] += series[1][0];
+    acc[1] += series[1][1];
+    FractalMul(acc, dc, acc);
+    acc[0] += series[0][0];
+    acc[1] += series[0][1];
+    FractalMul(acc, dc, out);
+}
+
+FractalSkip FindFractalSkip(const FractalReference* ref, const double corners[4][2])
+{
+    FractalSkip skip = {};
+    const FractalMap* map = &ref->map;
+    double probes[4][2];
+    for(int k = 0; k < 4; ++k)
+    {
+        probes[k][0] = map->julia ? corners[k][0] : 0.0;
+        probes[k][1] = map->julia ? corners[k][1] : 0.0;
+    }
+    
+    const double bailout = Fractal_Bailout * Fractal_Bailout;
+    const double* orbit = ref->orbit.data();
+    int stride = 2 * (map->degree + 1);
+    for(int n = 0; n < ref->length; ++n)
+    {
+        const double* series = ref->series.data() + 6 * n;
+        bool agrees = true, last = false;
+        for(int k = 0; k < 4 && agrees; ++k)
+        {
+            double estimate[2];
+            FractalSeries((const double(*)[2])series, corners[k], estimate);
+            double errorRe = estimate[0] - probes[k][0], errorIm = estimate[1] - probes[k][1];
+            double norm = probes[k][0] * probes[k][0] + probes[k][1] * probes[k][1];
+            agrees = errorRe * errorRe + errorIm * errorIm <= Fractal_SeriesTolerance * Fractal_SeriesTolerance * norm;
+            
+            // The probes stop where pixels would escape or rebase, past that the series means nothing
+            double z[2] = { orbit[n * stride] + probes[k][0], orbit[n * stride + 1] + probes[k][1] };
+            double start[2] = { z[0] - orbit[0], z[1] - orbit[1] };
+            last |= z[0] * z[0] + z[1] * z[1] > bailout || start[0] * start[0] + start[1] * start[1] < norm;
+        }
+        if(!agrees) break;
+        
+        skip.iterations = n;
+        memcpy(skip.series, series, sizeof(skip.series));
+        if(last) break;
+        
+        for(int k = 0; k < 4; ++k)
+            FractalStep(ref, n, probes[k], corners[k], probes[k]);
+    }
+    
+    return skip;
+}
+
+// One iteration of every lane per pass, the lanes which are done sit out
+void IterateFractalRow(const FractalReference* ref, const FractalSkip* skip, double left, double step, double offsetY,
+                       int count, float* out)
+{
+    const double bailout = Fractal_Bailout * Fractal_Bailout;
+    const double logBailout = log(Fractal_Bailout), logDegree = log((double)ref->map.degree);
+    const double* orbit = ref->orbit.data();
+    int stride = 2 * (ref->map.degree + 1);
+    int maxIterations = ref->maxIterations;
+    
+    for(int begin = 0; begin < count; begin += Fractal_Lanes)
+    {
+        int lanes = count - begin < Fractal_Lanes ? count - begin : Fractal_Lanes;
+        double d[Fractal_Lanes][2], dc[Fractal_Lanes][2];
+        int n[Fractal_Lanes], iteration[Fractal_Lanes];
+        bool done[Fractal_Lanes];
+        for(int i = 0; i < lanes; ++i)
+        {
+            dc[i][0] = left + (begin + i) * step;
+            dc[i][1] = offsetY;
+            FractalSeries(skip->series, dc[i], d[i]);
+            n[i] = skip->iterations;
+            iteration[i] = skip->iterations;
+            done[i] = false;
+        }
+        
+        int active = lanes;
+        while(active > 0)
+        {
+            for(int i = 0; i < lanes; ++i)
+            {
+                if(done[i]) continue;
+                
+                const double* at = orbit + n[i] * stride;
+                double z[2] = { at[0] + d[i][0], at[1] + d[i][1] };
+                double norm = z[0] * z[0] + z[1] * z[1];
+                if(norm > bailout || iteration[i] >= maxIterations)
+                {
+                    out[begin + i] = norm > bailout ? (float)(iteration[i] + 1 - log(0.5 * log(norm) / logBailout) / logDegree) : -1.0f;
+                    done[i] = true;
+                    --active;
+                    continue;
+                }
+                
+                double start[2] = { z[0] - orbit[0], z[1] - orbit[1] };
+                if(start[0] * start[0] + start[1] * start[1] < d[i][0] * d[i][0] + d[i][1] * d[i][1] || n[i] == ref->length)
+                {
+                    d[i][0] = start[0];
+                    d[i][1] = start[1];
+                    n[i] = 0;
+                }
+                
+                FractalStep(ref, n[i], d[i], dc[i], d[i]);
+                ++n[i];
+                ++iteration[i];
+            }
+        }
+    }
+}
+
+uint32_t FractalColor(float iterations)
+{
+    if(iterations < 0.0f) return 0xff000000u;
+    
+    const double offsets[3] = { 0.0, 0.15, 0.3 };
+    uint32_t color = 0xff000000u;
+    for(int i = 0; i < 3; ++i)
+    {
+        double level = 0.5 + 0.5 * cos(6.28318530717958647693 * (iterations / 32.0 + offsets[i]));
+        color |= (uint32_t)(level * 255.0 + 0.5) << (8 * i);
+    }
+    return color;
+}
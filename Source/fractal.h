@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "compiler.h"
+
+// Escape-time plots of iterated maps, z -> P(z) + k c (see Def_Iteration).
+// Iterating each pixel on its own stops working long before the view runs
+// out of precision: neighbouring orbits differ by less than their rounding
+// errors, which every iteration amplifies. Instead one reference orbit Z is
+// computed in double-double, and the pixels only iterate their difference
+// with it, d = z - Z (perturbation):
+//
+//     d' = P(Z + d) - P(Z) + k dc = sum over j of P^(j)(Z) / j! d^j + k dc
+//
+// with dc the offset of the pixel from the reference point. The coefficients
+// are computed once per iteration of the reference, and d stays about as
+// small as dc so it keeps its relative precision. When a pixel comes closer
+// to the start of the orbit than to the reference, or the reference escapes,
+// its difference is rebased onto the start of the reference.
+//
+// The first iterations of a tile are skipped with a cubic series in dc,
+// d = A dc + B dc^2 + C dc^3, whose coefficients follow the reference, for
+// as long as it agrees with probes iterated at the corners of the tile.
+//
+// Julia sets, where k is zero, are the same with the pixel as the starting
+// point: the first difference is the offset of the pixel instead of zero.
+
+#define Fractal_Bailout 256.0         // Escape radius, large so that the smooth counts are smooth
+#define Fractal_Lanes 8               // Pixels iterated together on the CPU
+#define Fractal_SeriesTolerance 1e-12  // Relative, between the series and the probes
+#define Fractal_Candidates 5          // Per side of the grid of points tried as the reference
+#define Fractal_DefaultIterations 500
+
+// The map with the parameters of the frame
+struct FractalMap
+{
+    int degree;
+    double coefficients[Def_MaxDegree + 1][2];  // Of z^j, real and imaginary parts
+    double factor[2];                           // k
+    bool julia;                                 // k is zero
+};
+
+struct FractalReference
+{
+    FractalMap map;
+    double center[2];  // The point of the reference orbit
+    int maxIterations;
+    int length;        // Last iteration stored, the one which escaped or the limit
+    
+    // Per iteration up to length: Z then P^(j)(Z) / j! for j = 1..degree,
+    // and A, B and C of the series. Complex values as two doubles.
+    std::vector<double> orbit;
+    std::vector<double> series;
+};
+
+struct FractalSkip
+{
+    int iterations;
+    double series[3][2];  // A, B and C at that iteration
+};
+
+// False when the map isn't at least quadratic with these parameters
+bool EvalFractalMap(const Program* program, const double* params, FractalMap* out);
+// Picks the point of the view whose orbit lasts longest as the reference
+void ComputeFractalReference(FractalReference* ref, const FractalMap* map, const double viewMin[2], const double viewMax[2],
+                             int maxIterations);
+// Iterations the series skips over a tile, corners are offsets from the reference point
+FractalSkip FindFractalSkip(const FractalReference* ref, const double corners[4][2]);
+// Smooth iteration counts of count pixels at offsets (left + i step, offsetY)
+// from the reference point, negative for the ones which don't escape
+void IterateFractalRow(const FractalReference* ref, const FractalSkip* skip, double left, double step, double offsetY,
+                       int count, float* out);
+// RGBA, the shader of the GPU tiles uses the same palette
+uint32_t FractalColor(float iterations);
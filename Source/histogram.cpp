@@ -0,0 +1,314 @@
+#include "histogram.h"
+#include "jobs.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#define Histogram_GrainRows (1 << 16)
+#define Histogram_Block 256
+#define Histogram_Lanes 4
+
+// Lane counts are 32 bits, and moved to the totals before they can overflow
+#define Histogram_FlushRows (0xffffffffll - Histogram_GrainRows)
+
+struct alignas(64) HistogramPartial
+{
+    std::vector<uint32_t> lanes;  // Histogram_Lanes interleaved copies of the bins, plus the discard bin
+    std::vector<int64_t> totals;
+    int64_t pending;  // Rows in the lanes since the last flush
+};
+
+static void FlushLanes(HistogramPartial* partial, int lanes, int bins)
+{
+    for(int l = 0; l < lanes; ++l)
+    {
+        uint32_t* lane = partial->lanes.data() + l * (bins + 1);
+        for(int b = 0; b < bins; ++b)
+            partial->totals[b] += lane[b];
+    }
+    memset(partial->lanes.data(), 0, partial->lanes.size() * sizeof(uint32_t));
+    partial->pending = 0;
+}
+
+// Values out of [min, max] and NaNs go to the extra bin past the end. No
+// branches or integer conversions of out of range values, so it vectorizes.
+static inline void BinRange(const double* values, int n, double min, double scale, int bins, uint32_t* index)
+{
+    double last = bins - 1;
+    double discard = bins;
+    for(int i = 0; i < n; ++i)
+    {
+        double t = (values[i] - min) * scale;
+        double inRange = t < last ? t : last;
+        double bin = t >= 0.0 && t <= discard ? inRange : discard;
+        index[i] = (uint32_t)(int32_t)bin;
+    }
+}
+
+static void BinIndices(const double* values, int n, double min, double scale, int bins, uint32_t* index)
+{
+    // Full blocks have a constant trip count, the vectorizer wants one at -O2
+    if(n == Histogram_Block) BinRange(values, Histogram_Block, min, scale, bins, index);
+    else BinRange(values, n, min, scale, bins, index);
+}
+
+// Counts the rows over a few lanes, consecutive rows go to different lanes
+static void CountIndices(const uint32_t* index, int n, uint32_t* lanes, int lanesUsed, int stride)
+{
+    int i = 0;
+    if(lanesUsed == Histogram_Lanes)
+    {
+        for(; i + Histogram_Lanes <= n; i += Histogram_Lanes)
+        {
+            ++lanes[index[i]];
+            ++lanes[stride + index[i + 1]];
+            ++lanes[2 * stride + index[i + 2]];
+            ++lanes[3 * stride + index[i + 3]];
+        }
+    }
+    for(; i < n; ++i)
+        ++lanes[index[i]];
+}
+
+// Runs the partial histograms of total bins over the rows, index(begin, n, out) filling the bins of a block
+template<typename T>
+static void CountRows(int64_t count, int bins, int lanes, std::vector<int64_t>* counts, T index)
+{
+    std::vector<HistogramPartial> partials(GetNumJobThreads());
+    ParallelFor(count, Histogram_GrainRows, [&](int64_t begin, int64_t end, int task)
+    {
+        HistogramPartial* partial = &partials[task];
+        if(partial->totals.empty())
+        {
+            partial->lanes.resize((size_t)lanes * (bins + 1));
+            partial->totals.resize(bins);
+        }
+        if(partial->pending > Histogram_FlushRows) FlushLanes(partial, lanes, bins);
+        
+        uint32_t block[Histogram_Block];
+        for(int64_t row = begin; row < end; row += Histogram_Block)
+        {
+            int n = (int)std::min<int64_t>(end - row, Histogram_Block);
+            index(row, n, block);
+            CountIndices(block, n, partial->lanes.data(), lanes, bins + 1);
+        }
+        partial->pending += end - begin;
+    });
+    
+    counts->assign(bins, 0);
+    for(HistogramPartial& partial : partials)
+    {
+        if(partial.totals.empty()) continue;
+        
+        FlushLanes(&partial, lanes, bins);
+        for(int b = 0; b < bins; ++b)
+            (*counts)[b] += partial.totals[b];
+    }
+}
+
+void ComputeHistogram(const double* values, int64_t count, double min, double max, int bins, std::vector<int64_t>* counts)
+{
+    double scale = max > min ? bins / (max - min) : 0.0;
+    
+    // Lanes only pay off while they all stay in cache
+    int lanes = bins <= Histogram_FineBins ? Histogram_Lanes : 1;
+    CountRows(count, bins, lanes, counts, [&](int64_t row, int n, uint32_t* index)
+    {
+        BinIndices(values + row, n, min, scale, bins, index);
+    });
+}
+
+void ComputeHistogram2D(const double* xs, const double* ys, int64_t count, double xMin, double xMax,
+                        double yMin, double yMax, int binsX, int binsY, std::vector<int64_t>* counts)
+{
+    double scaleX = xMax > xMin ? binsX / (xMax - xMin) : 0.0;
+    double scaleY = yMax > yMin ? binsY / (yMax - yMin) : 0.0;
+    int bins = binsX * binsY;
+    
+    CountRows(count, bins, 1, counts, [&](int64_t row, int n, uint32_t* index)
+    {
+        uint32_t column[Histogram_Block];
+        BinIndices(xs + row, n, xMin, scaleX, binsX, column);
+        BinIndices(ys + row, n, yMin, scaleY, binsY, index);
+        for(int i = 0; i < n; ++i)
+        {
+            bool inside = column[i] < (uint32_t)binsX && index[i] < (uint32_t)binsY;
+            index[i] = inside ? index[i] * binsX + column[i] : bins;
+        }
+    });
+}
+
+static void BuildFineBins(HistogramCache* cache, double min, double max)
+{
+    // Columns with a single value still need a range
+    if(!(max > min))
+    {
+        min -= 0.5;
+        max += 0.5;
+    }
+    
+    std::vector<int64_t> counts;
+    ComputeHistogram(cache->values, cache->count, min, max, Histogram_FineBins, &counts);
+    
+    cache->min = min;
+    cache->max = max;
+    cache->prefix.resize(Histogram_FineBins + 1);
+    cache->prefix[0] = 0.0;
+    for(int b = 0; b < Histogram_FineBins; ++b)
+        cache->prefix[b + 1] = cache->prefix[b] + (double)counts[b];
+    ++cache->rescans;
+}
+
+// Count of the fine bins below x, assuming the values are spread evenly within each bin
+static double CumulativeCount(const HistogramCache* cache, double x)
+{
+    double t = (x - cache->min) / (cache->max - cache->min) * Histogram_FineBins;
+    if(!(t > 0.0)) return 0.0;
+    if(t >= Histogram_FineBins) return cache->prefix[Histogram_FineBins];
+    
+    int bin = (int)t;
+    double fraction = t - bin;
+    return cache->prefix[bin] + fraction * (cache->prefix[bin + 1] - cache->prefix[bin]);
+}
+
+// Value below which a fraction of the column lies, from the first build
+static double Quantile(const HistogramCache* cache, double fraction)
+{
+    double target = fraction * cache->prefix[Histogram_FineBins];
+    int bin = (int)(std::upper_bound(cache->prefix.begin(), cache->prefix.end(), target) - cache->prefix.begin()) - 1;
+    bin = std::min(std::max(bin, 0), Histogram_FineBins - 1);
+    
+    double inBin = cache->prefix[bin + 1] - cache->prefix[bin];
+    double offset = inBin > 0.0 ? (target - cache->prefix[bin]) / inBin : 0.0;
+    return cache->min + (bin + offset) * (cache->max - cache->min) / Histogram_FineBins;
+}
+
+void InitHistogramCache(HistogramCache* cache, const double* values, int64_t count, double min, double max)
+{
+    cache->values = values;
+    cache->count = count;
+    cache->dataMin = min;
+    cache->dataMax = max;
+    cache->rescans = 0;
+    cache->total = 0;
+    cache->bandwidth = 1.0;
+    if(!isfinite(min) || !isfinite(max))
+    {
+        // No finite values, the fine bins stay empty
+        cache->dataMin = 0.0;
+        cache->dataMax = 0.0;
+        cache->min = 0.0;
+        cache->max = 1.0;
+        cache->prefix.assign(Histogram_FineBins + 1, 0.0);
+        return;
+    }
+    
+    BuildFineBins(cache, min, max);
+    cache->total = (int64_t)cache->prefix[Histogram_FineBins];
+    if(cache->total == 0) return;
+    
+    // Moments from the bin centers, the error is a tiny fraction of a bin
+    double width = (cache->max - cache->min) / Histogram_FineBins;
+    double mean = 0.0;
+    double m2 = 0.0;
+    for(int b = 0; b < Histogram_FineBins; ++b)
+        mean += (cache->prefix[b + 1] - cache->prefix[b]) * (cache->min + (b + 0.5) * width);
+    mean /= cache->total;
+    for(int b = 0; b < Histogram_FineBins; ++b)
+    {
+        double delta = cache->min + (b + 0.5) * width - mean;
+        m2 += (cache->prefix[b + 1] - cache->prefix[b]) * delta * delta;
+    }
+    
+    double sigma = sqrt(m2 / cache->total);
+    double spread = (Quantile(cache, 0.75) - Quantile(cache, 0.25)) / 1.34;
+    if(spread > 0.0 && spread < sigma) sigma = spread;
+    cache->bandwidth = sigma > 0.0 ? 0.9 * sigma * pow((double)cache->total, -0.2) : width;
+}
+
+bool QueryHistogram(HistogramCache* cache, double min, double max, int bins, std::vector<double>* counts)
+{
+    counts->assign(bins, 0.0);
+    if(cache->total == 0 || !(max > min) || bins <= 0) return false;
+    
+    // Only the part of the view with data matters
+    double lo = std::max(min, cache->dataMin);
+    double hi = std::min(max, cache->dataMax);
+    if(lo > hi) return false;
+    
+    double binWidth = (max - min) / bins;
+    double fineWidth = (cache->max - cache->min) / Histogram_FineBins;
+    bool inside = cache->min <= lo && hi <= cache->max;
+    bool rescan = !inside || fineWidth * Histogram_MinRefine > binWidth;
+    if(rescan)
+    {
+        // Some margin around the view so small pans don't go back to the rows
+        double width = hi - lo;
+        double margin = std::min(width * 0.5, std::max(0.0, binWidth / Histogram_MinRefine * Histogram_FineBins - width) * 0.5);
+        BuildFineBins(cache, std::max(lo - margin, cache->dataMin), std::min(hi + margin, cache->dataMax));
+    }
+    
+    double below = CumulativeCount(cache, min);
+    for(int b = 0; b < bins; ++b)
+    {
+        double above = CumulativeCount(cache, min + (b + 1) * binWidth);
+        (*counts)[b] = above - below;
+        below = above;
+    }
+    
+    return rescan;
+}
+
+bool QueryDensity(HistogramCache* cache, double min, double max, int bins, double bandwidth, std::vector<double>* density)
+{
+    density->assign(bins, 0.0);
+    if(cache->total == 0 || !(max > min) || bins <= 0) return false;
+    if(!(bandwidth > 0.0)) bandwidth = cache->bandwidth;
+    
+    // Binned estimate: counts on a grid a few times finer than the kernel
+    // (or the display bins when they're finer), convolved with the sampled
+    // kernel. The grid extends past the view by the reach of the kernel.
+    double binWidth = (max - min) / bins;
+    double step = std::max(binWidth, bandwidth / 8.0);
+    int radius = (int)ceil(4.0 * bandwidth / step);
+    int gridBins = (int)ceil((max - min) / step) + 2 * radius + 1;
+    double gridMin = min - radius * step;
+    
+    std::vector<double> grid;
+    bool rescan = QueryHistogram(cache, gridMin, gridMin + gridBins * step, gridBins, &grid);
+    
+    // Normalized so a kernel narrower than the grid gives back the histogram
+    std::vector<double> kernel(2 * radius + 1);
+    double kernelSum = 0.0;
+    for(int k = -radius; k <= radius; ++k)
+    {
+        double u = k * step / bandwidth;
+        kernel[k + radius] = exp(-0.5 * u * u);
+        kernelSum += kernel[k + radius];
+    }
+    double scale = 1.0 / (cache->total * step * kernelSum);
+    
+    // Only the middle of the grid is interpolated, the bins near its ends are missing some neighbours
+    std::vector<double> smooth(gridBins, 0.0);
+    for(int g = 0; g < gridBins; ++g)
+    {
+        int first = std::max(0, radius - g);
+        int last = std::min(2 * radius, gridBins - 1 - g + radius);
+        double sum = 0.0;
+        for(int k = first; k <= last; ++k)
+            sum += grid[g - radius + k] * kernel[k];
+        smooth[g] = sum * scale;
+    }
+    
+    // Linear interpolation between the centers of the grid bins
+    for(int b = 0; b < bins; ++b)
+    {
+        double t = (min + (b + 0.5) * binWidth - gridMin) / step - 0.5;
+        int g = std::min(std::max((int)floor(t), 0), gridBins - 2);
+        double fraction = std::min(std::max(t - g, 0.0), 1.0);
+        (*density)[b] = smooth[g] + fraction * (smooth[g + 1] - smooth[g]);
+    }
+    
+    return rescan;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// Histograms, 2D bins and kernel density estimates of data columns. Counting
+// is split over the job system, each task fills its own partial histogram
+// and they're summed at the end. Bin indices are computed for a block of
+// rows at a time in a loop the compiler vectorizes, then counted into a few
+// interleaved copies of the bins so repeated values don't serialize on the
+// same counter.
+//
+// Views that zoom and pan go through a HistogramCache: it keeps a fine
+// histogram around the last range that was asked for, and display bins are
+// interpolated from its prefix sums. The rows are only read again when the
+// view leaves that range or zooms in past its resolution.
+
+#define Histogram_FineBins 16384
+#define Histogram_MinRefine 8  // Fine bins per display bin, at least
+
+// Counts of the finite values in [min, max] (max included in the last bin)
+void ComputeHistogram(const double* values, int64_t count, double min, double max, int bins, std::vector<int64_t>* counts);
+// Row major, binsX * binsY counts of the rows where both values are in range
+void ComputeHistogram2D(const double* xs, const double* ys, int64_t count, double xMin, double xMax,
+                        double yMin, double yMax, int binsX, int binsY, std::vector<int64_t>* counts);
+
+struct HistogramCache
+{
+    const double* values;
+    int64_t count;
+    double dataMin;  // Of the finite values
+    double dataMax;
+    
+    double min;  // Range of the fine bins
+    double max;
+    std::vector<double> prefix;  // Histogram_FineBins + 1 cumulative counts
+    
+    // Of the whole column, from the first build
+    int64_t total;  // Finite values
+    double bandwidth;  // Silverman's rule of thumb, for the density
+    
+    int rescans;
+};
+
+// Builds the fine bins over the whole column, [min, max] being its range
+void InitHistogramCache(HistogramCache* cache, const double* values, int64_t count, double min, double max);
+// Counts of the display bins over [min, max], returns true if the rows had
+// to be read again
+bool QueryHistogram(HistogramCache* cache, double min, double max, int bins, std::vector<double>* counts);
+// Gaussian kernel density at the centers of the display bins, normalized
+// over the whole column. A bandwidth of 0 uses the cache's.
+bool QueryDensity(HistogramCache* cache, double min, double max, int bins, double bandwidth, std::vector<double>* density);
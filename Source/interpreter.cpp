@@ -0,0 +1,905 @@
+#include "interpreter.h"
+#include "interval.h"
+#include "ddouble.h"
+#include "jobs.h"
+#include "core.h"
+
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <assert.h>
+#include <algorithm>
+
+EvalInput EvalArray(const double* array)
+{
+    EvalInput input = {};
+    input.array = array;
+    return input;
+}
+
+EvalInput EvalRamp(double start, double step)
+{
+    EvalInput input = {};
+    input.start = start;
+    input.step = step;
+    return input;
+}
+
+EvalInput EvalConstant(double value)
+{
+    return EvalRamp(value, 0.0);
+}
+
+static thread_local std::vector<double> evalScratch;
+
+// Kernels run while the program calling them is in the middle of a batch,
+// each binding slot has its own registers (slots only grow with nesting)
+static thread_local std::vector<double> kernelScratch[Ast_MaxBindings];
+
+static const EvalInput noBindings[Ast_MaxBindings] = {};
+
+static void EvalChunk(const Program* program, const EvalInput vars[Var_Count], const EvalInput bound[Ast_MaxBindings],
+                      const double* params, int64_t offset, int n, double* regs);
+static void EvalBindings(const Program* program, const Instr* instr, const EvalInput vars[Var_Count],
+                         const EvalInput bound[Ast_MaxBindings], const double* params, int64_t offset, int n,
+                         const double* first, const double* last, double* dst);
+
+double EvalScalar(const Program* program, const double vars[Var_Count], const double* params, double* outputs)
+{
+    double stackRegs[64];
+    double* regs = stackRegs;
+    if(program->numRegs > ArrayCount(stackRegs))
+    {
+        evalScratch.resize(program->numRegs);
+        regs = evalScratch.data();
+    }
+    
+    for(const Instr& instr : program->code)
+    {
+        switch(instr.op)
+        {
+            case Op_Const: regs[instr.dst] = instr.value; break;
+            case Op_Var:   regs[instr.dst] = vars[instr.index]; break;
+            case Op_Param: regs[instr.dst] = params[instr.index]; break;
+            case Op_Integral:
+            case Op_Sum:
+            {
+                EvalInput inputs[Var_Count];
+                for(int i = 0; i < Var_Count; ++i)
+                    inputs[i] = EvalConstant(vars[i]);
+                EvalBindings(program, &instr, inputs, noBindings, params, 0, 1,
+                             &regs[instr.src[0]], &regs[instr.src[1]], &regs[instr.dst]);
+                break;
+            }
+            default:
+            {
+                regs[instr.dst] = ApplyOp(instr.op, regs[instr.src[0]], regs[instr.src[1]], regs[instr.src[2]]);
+                break;
+            }
+        }
+    }
+    
+    if(outputs)
+    {
+        for(uint32_t i = 0; i < program->numOutputs; ++i)
+            outputs[i] = regs[program->outputs[i]];
+    }
+    
+    return program->numOutputs > 0 ? regs[program->outputs[0]] : NAN;
+}
+
+// Inner loops of the batch interpreter, kept trivial so they get vectorized
+#define UnaryLoop(expr) \
+    for(int j = 0; j < n; ++j) { double a = srcA[j]; dst[j] = (expr); }
+#define BinaryLoop(expr) \
+    for(int j = 0; j < n; ++j) { double a = srcA[j]; double b = srcB[j]; dst[j] = (expr); }
+
+static void LoadInput(const EvalInput* input, int64_t offset, int n, double* __restrict dst)
+{
+    if(input->array)
+    {
+        memcpy(dst, input->array + offset, n * sizeof(double));
+    }
+    else
+    {
+        double start = input->start + offset * input->step;
+        double step = input->step;
+        for(int j = 0; j < n; ++j) dst[j] = start + j * step;
+    }
+}
+
+enum PlanStep : uint8_t
+{
+    Plan_Run,
+    Plan_Skip,
+    Plan_TakeThen,  // Selects whose condition holds over the whole batch, a copy
+    Plan_TakeElse,
+};
+
+static thread_local std::vector<Interval> planIntervals;
+static thread_local std::vector<uint32_t> planWriters;    // Per register, the last instruction writing it
+static thread_local std::vector<uint32_t> planProducers;  // Per instruction and source, the instruction computing it
+static thread_local std::vector<bool> planNeeded;
+
+// Bounds of an input over points [offset, offset + n), ramps allow for the
+// double-double ones being exact where the doubles round
+static Interval InputInterval(const EvalInput* input, int64_t offset, int n)
+{
+    if(input->array)
+    {
+        double lo = INFINITY, hi = -INFINITY;
+        bool nan = false;
+        for(int j = 0; j < n; ++j)
+        {
+            double value = input->array[offset + j];
+            nan |= isnan(value);
+            lo = fmin(lo, value);
+            hi = fmax(hi, value);
+        }
+        return IntervalRange(lo, hi, nan);
+    }
+    
+    double first = input->start + offset * input->step;
+    double last = first + (n - 1) * input->step;
+    double slack = 4.0 * DBL_EPSILON * (fabs(input->start) + fabs(offset * input->step) + fabs(n * input->step));
+    return IntervalRange(fmin(first, last) - slack, fmax(first, last) + slack, isnan(first) || isnan(last));
+}
+
+// Bounds every register over the batch, and turns the selects whose condition
+// is the same for all of its points into copies. The instructions only the
+// branches not taken need are then skipped. Null when no condition is decided,
+// which is the usual case for batches straddling the edge of a piece.
+static const uint8_t* PlanChunk(const Program* program, const EvalInput vars[Var_Count], const EvalInput bound[Ast_MaxBindings],
+                                const double* params, int64_t offset, int n, uint8_t* plan)
+{
+    size_t count = program->code.size();
+    planIntervals.resize(program->numRegs);
+    planWriters.resize(program->numRegs);
+    planProducers.resize(count * Ast_MaxChildren);
+    
+    bool decided = false;
+    for(size_t k = 0; k < count; ++k)
+    {
+        const Instr& instr = program->code[k];
+        for(int s = 0; s < opInfos[instr.op].arity; ++s)
+            planProducers[k * Ast_MaxChildren + s] = planWriters[instr.src[s]];
+        
+        Interval result;
+        switch(instr.op)
+        {
+            case Op_Const: result = IntervalPoint(instr.value); break;
+            case Op_Param: result = IntervalPoint(params[instr.index]); break;
+            case Op_Var:   result = InputInterval(&vars[instr.index], offset, n); break;
+            case Op_Bound: result = InputInterval(&bound[instr.index], offset, n); break;
+            default:
+            {
+                const Interval* regs = planIntervals.data();
+                result = IntervalOp(instr.op, regs[instr.src[0]], regs[instr.src[1]], regs[instr.src[2]]);
+                break;
+            }
+        }
+        
+        plan[k] = Plan_Run;
+        if(instr.op == Op_Select)
+        {
+            Interval condition = planIntervals[instr.src[0]];
+            if(IntervalAlwaysTrue(condition)) plan[k] = Plan_TakeThen;
+            else if(IntervalAlwaysFalse(condition)) plan[k] = Plan_TakeElse;
+            decided |= plan[k] != Plan_Run;
+        }
+        
+        planIntervals[instr.dst] = result;
+        planWriters[instr.dst] = (uint32_t)k;
+    }
+    if(!decided) return nullptr;
+    
+    // Backwards from the outputs, through the sources each step reads
+    planNeeded.assign(count, false);
+    for(uint32_t i = 0; i < program->numOutputs; ++i)
+        planNeeded[planWriters[program->outputs[i]]] = true;
+    
+    for(size_t k = count; k-- > 0;)
+    {
+        if(!planNeeded[k])
+        {
+            plan[k] = Plan_Skip;
+            continue;
+        }
+        
+        const uint32_t* producers = &planProducers[k * Ast_MaxChildren];
+        if(plan[k] == Plan_TakeThen) planNeeded[producers[1]] = true;
+        else if(plan[k] == Plan_TakeElse) planNeeded[producers[2]] = true;
+        else
+        {
+            for(int s = 0; s < opInfos[program->code[k].op].arity; ++s)
+                planNeeded[producers[s]] = true;
+        }
+    }
+    return plan;
+}
+
+static void EvalChunk(const Program* program, const EvalInput vars[Var_Count], const EvalInput bound[Ast_MaxBindings],
+                      const double* params, int64_t offset, int n, double* regs)
+{
+    // Kernels plan while the chunk calling them still uses its plan
+    size_t count = program->code.size();
+    uint8_t localPlan[Eval_PlanSize];
+    std::vector<uint8_t> largePlan;
+    const uint8_t* plan = nullptr;
+    if(program->conditional)
+    {
+        if(count > Eval_PlanSize) largePlan.resize(count);
+        plan = PlanChunk(program, vars, bound, params, offset, n, count > Eval_PlanSize ? largePlan.data() : localPlan);
+    }
+    
+    for(size_t k = 0; k < count; ++k)
+    {
+        const Instr& instr = program->code[k];
+        double* __restrict dst = regs + (size_t)instr.dst * Eval_BatchSize;
+        const double* __restrict srcA = regs + (size_t)instr.src[0] * Eval_BatchSize;
+        const double* __restrict srcB = regs + (size_t)instr.src[1] * Eval_BatchSize;
+        const double* __restrict srcC = regs + (size_t)instr.src[2] * Eval_BatchSize;
+        if(plan && plan[k] != Plan_Run)
+        {
+            if(plan[k] == Plan_TakeThen) memcpy(dst, srcB, n * sizeof(double));
+            else if(plan[k] == Plan_TakeElse) memcpy(dst, srcC, n * sizeof(double));
+            continue;
+        }
+        
+        switch(instr.op)
+        {
+            case Op_Const:
+            {
+                double value = instr.value;
+                for(int j = 0; j < n; ++j) dst[j] = value;
+                break;
+            }
+            case Op_Param:
+            {
+                double value = params[instr.index];
+                for(int j = 0; j < n; ++j) dst[j] = value;
+                break;
+            }
+            case Op_Var:   LoadInput(&vars[instr.index], offset, n, dst); break;
+            case Op_Bound: LoadInput(&bound[instr.index], offset, n, dst); break;
+            case Op_Neg:          UnaryLoop(-a); break;
+            case Op_Add:          BinaryLoop(a + b); break;
+            case Op_Sub:          BinaryLoop(a - b); break;
+            case Op_Mul:          BinaryLoop(a * b); break;
+            case Op_Div:          BinaryLoop(a / b); break;
+            case Op_Pow:          BinaryLoop(pow(a, b)); break;
+            case Op_Sqrt:         UnaryLoop(sqrt(a)); break;
+            case Op_Abs:          UnaryLoop(fabs(a)); break;
+            case Op_Exp:          UnaryLoop(exp(a)); break;
+            case Op_Ln:           UnaryLoop(log(a)); break;
+            case Op_Log10:        UnaryLoop(log10(a)); break;
+            case Op_Log2:         UnaryLoop(log2(a)); break;
+            case Op_Sin:          UnaryLoop(sin(a)); break;
+            case Op_Cos:          UnaryLoop(cos(a)); break;
+            case Op_Tan:          UnaryLoop(tan(a)); break;
+            case Op_Asin:         UnaryLoop(asin(a)); break;
+            case Op_Acos:         UnaryLoop(acos(a)); break;
+            case Op_Atan:         UnaryLoop(atan(a)); break;
+            case Op_Atan2:        BinaryLoop(atan2(a, b)); break;
+            case Op_Sinh:         UnaryLoop(sinh(a)); break;
+            case Op_Cosh:         UnaryLoop(cosh(a)); break;
+            case Op_Tanh:         UnaryLoop(tanh(a)); break;
+            case Op_Floor:        UnaryLoop(floor(a)); break;
+            case Op_Ceil:         UnaryLoop(ceil(a)); break;
+            case Op_Round:        UnaryLoop(floor(a + 0.5)); break;
+            case Op_Sign:         UnaryLoop(a > 0.0 ? 1.0 : (a < 0.0 ? -1.0 : a)); break;
+            case Op_Min:          BinaryLoop(a < b || a != a ? a : b); break;
+            case Op_Max:          BinaryLoop(a > b || a != a ? a : b); break;
+            case Op_Mod:          BinaryLoop(a - b * floor(a / b)); break;
+            case Op_Less:         BinaryLoop(a < b ? 1.0 : 0.0); break;
+            case Op_LessEqual:    BinaryLoop(a <= b ? 1.0 : 0.0); break;
+            case Op_Greater:      BinaryLoop(a > b ? 1.0 : 0.0); break;
+            case Op_GreaterEqual: BinaryLoop(a >= b ? 1.0 : 0.0); break;
+            case Op_Equal:        BinaryLoop(a == b ? 1.0 : 0.0); break;
+            case Op_And:          BinaryLoop(a != 0.0 && b != 0.0 ? 1.0 : 0.0); break;
+            case Op_Select:
+            {
+                // Both sides have been computed for the batch, so this is just a blend
+                for(int j = 0; j < n; ++j) dst[j] = srcA[j] != 0.0 ? srcB[j] : srcC[j];
+                break;
+            }
+            case Op_Integral:
+            case Op_Sum:
+            {
+                EvalBindings(program, &instr, vars, bound, params, offset, n, srcA, srcB, dst);
+                break;
+            }
+            default: assert(false); break;
+        }
+    }
+}
+
+#undef UnaryLoop
+#undef BinaryLoop
+
+// Where a kernel is evaluated: the variables and the enclosing bindings
+struct BindingPoint
+{
+    double vars[Var_Count];
+    double bound[Ast_MaxBindings];
+};
+
+// Neumaier's variant of Kahan summation, which also holds up when a term is larger than the sum
+struct KahanSum
+{
+    double sum;
+    double compensation;
+};
+
+static void KahanAdd(KahanSum* total, double value)
+{
+    double sum = total->sum + value;
+    if(fabs(total->sum) >= fabs(value)) total->compensation += (total->sum - sum) + value;
+    else total->compensation += (value - sum) + total->sum;
+    total->sum = sum;
+}
+
+// In place, the rounding error grows with log(n) instead of n
+static double PairwiseSum(double* values, int n)
+{
+    if(n == 0) return 0.0;
+    
+    while(n > 1)
+    {
+        int half = n / 2;
+        for(int i = 0; i < half; ++i)
+            values[i] = values[2 * i] + values[2 * i + 1];
+        if(n & 1) values[half] = values[n - 1];
+        n -= half;
+    }
+    
+    return values[0];
+}
+
+// Evaluates a kernel at n values of its variable, everything else is fixed by the point
+static void EvalKernel(const Program* kernel, const BindingPoint* point, const double* params,
+                       EvalInput values, int n, double* out)
+{
+    assert(n <= Eval_BatchSize);
+    
+    EvalInput vars[Var_Count];
+    EvalInput bound[Ast_MaxBindings];
+    for(int i = 0; i < Var_Count; ++i)
+        vars[i] = EvalConstant(point->vars[i]);
+    for(int i = 0; i < Ast_MaxBindings; ++i)
+        bound[i] = EvalConstant(point->bound[i]);
+    bound[kernel->binding] = values;
+    
+    std::vector<double>& regs = kernelScratch[kernel->binding];
+    regs.resize((size_t)kernel->numRegs * Eval_BatchSize);
+    EvalChunk(kernel, vars, bound, params, 0, n, regs.data());
+    memcpy(out, regs.data() + (size_t)kernel->outputs[0] * Eval_BatchSize, n * sizeof(double));
+}
+
+// Gauss-Kronrod G7-K15, nodes on [-1, 1] from the outside in, the last one is the center.
+// The Gauss nodes are the odd ones, and the center.
+static const double kronrodNodes[8] =
+{
+    0.991455371120812639206854697526329, 0.949107912342758524526189684047851,
+    0.864864423359769072789712788640926, 0.741531185599394439863864773280788,
+    0.586087235467691130294144845693013, 0.405845151377397166906606412076961,
+    0.207784955007898467600689403773245, 0.0,
+};
+
+static const double kronrodWeights[8] =
+{
+    0.022935322010529224963732008058970, 0.063092092629978553290700663189204,
+    0.104790010322250183839876322541518, 0.140653259715525918745189590510238,
+    0.169004726639267902826583426598550, 0.190350578064785409913256402421014,
+    0.204432940075298892414161999234649, 0.209482141084727828012999174891714,
+};
+
+static const double gaussWeights[4] =
+{
+    0.129484966168869693270611432679082, 0.279705391489276667901467771423780,
+    0.381830050505118944950369775488975, 0.417959183673469387755102040816327,
+};
+
+#define Quad_Nodes 15
+
+struct QuadInterval
+{
+    double a;
+    double b;
+    double value;
+    double error;
+    double absolute;  // Integral of |f|
+};
+
+static bool operator<(const QuadInterval& lhs, const QuadInterval& rhs)
+{
+    return lhs.error < rhs.error;
+}
+
+static thread_local std::vector<QuadInterval> quadScratch[Ast_MaxBindings];
+
+static void QuadNodes(const QuadInterval* interval, double* nodes)
+{
+    double center = 0.5 * (interval->a + interval->b);
+    double half = 0.5 * (interval->b - interval->a);
+    nodes[0] = center;
+    for(int k = 0; k < 7; ++k)
+    {
+        nodes[1 + 2 * k] = center - half * kronrodNodes[k];
+        nodes[2 + 2 * k] = center + half * kronrodNodes[k];
+    }
+}
+
+// Error estimate of QUADPACK's qk15: the difference of the two rules,
+// scaled down for smooth integrands and never below the rounding error
+static void QuadRule(QuadInterval* interval, const double* f)
+{
+    double half = 0.5 * (interval->b - interval->a);
+    double kronrod = kronrodWeights[7] * f[0];
+    double gauss = gaussWeights[3] * f[0];
+    double absolute = kronrodWeights[7] * fabs(f[0]);
+    for(int k = 0; k < 7; ++k)
+    {
+        double pair = f[1 + 2 * k] + f[2 + 2 * k];
+        kronrod += kronrodWeights[k] * pair;
+        absolute += kronrodWeights[k] * (fabs(f[1 + 2 * k]) + fabs(f[2 + 2 * k]));
+        if(k & 1) gauss += gaussWeights[k >> 1] * pair;
+    }
+    
+    double mean = 0.5 * kronrod;
+    double deviation = kronrodWeights[7] * fabs(f[0] - mean);
+    for(int k = 0; k < 7; ++k)
+        deviation += kronrodWeights[k] * (fabs(f[1 + 2 * k] - mean) + fabs(f[2 + 2 * k] - mean));
+    
+    double scale = fabs(half);
+    double error = fabs((kronrod - gauss) * half);
+    deviation *= scale;
+    absolute *= scale;
+    if(deviation != 0.0 && error != 0.0) error = deviation * fmin(1.0, pow(200.0 * error / deviation, 1.5));
+    if(absolute > DBL_MIN / (50.0 * DBL_EPSILON)) error = fmax(50.0 * DBL_EPSILON * absolute, error);
+    
+    interval->value = kronrod * half;
+    interval->error = error;
+    interval->absolute = absolute;
+}
+
+// Estimate given up on, when Eval_QuadMaxIntervals or the precision of the
+// bounds runs out: close enough to draw, or NaN (integrals through poles)
+static double Unconverged(double value, double error, bool* converged)
+{
+    *converged = false;
+    return error <= Eval_QuadLooseTolerance * fabs(value) ? value : NAN;
+}
+
+// Adaptive: the intervals with the largest errors are bisected, a batch of them at a time.
+// converged is false when the result isn't within Eval_QuadTolerance.
+static double Integrate(const Program* kernel, const BindingPoint* point, const double* params, double a, double b,
+                        bool* converged)
+{
+    *converged = true;
+    if(a == b) return 0.0;
+    if(!isfinite(a) || !isfinite(b)) return NAN;
+    
+    std::vector<QuadInterval>& intervals = quadScratch[kernel->binding];
+    intervals.clear();
+    
+    QuadInterval pending[2 * Eval_QuadSplit];
+    double nodes[2 * Eval_QuadSplit * Quad_Nodes];
+    double values[2 * Eval_QuadSplit * Quad_Nodes];
+    pending[0] = { a, b, 0.0, 0.0, 0.0 };
+    int numPending = 1;
+    
+    while(true)
+    {
+        for(int i = 0; i < numPending; ++i)
+            QuadNodes(&pending[i], nodes + i * Quad_Nodes);
+        EvalKernel(kernel, point, params, EvalArray(nodes), numPending * Quad_Nodes, values);
+        
+        for(int i = 0; i < numPending; ++i)
+        {
+            QuadRule(&pending[i], values + i * Quad_Nodes);
+            if(!isfinite(pending[i].value)) return NAN;
+            
+            intervals.push_back(pending[i]);
+            std::push_heap(intervals.begin(), intervals.end());
+        }
+        
+        KahanSum total = {};
+        double error = 0.0, absolute = 0.0;
+        for(const QuadInterval& interval : intervals)
+        {
+            KahanAdd(&total, interval.value);
+            error += interval.error;
+            absolute += interval.absolute;
+        }
+        
+        double value = total.sum + total.compensation;
+        double tolerance = fmax(Eval_QuadTolerance * fabs(value), 100.0 * DBL_EPSILON * absolute);
+        if(error <= tolerance) return value;
+        if(intervals.size() + 2 * Eval_QuadSplit > Eval_QuadMaxIntervals) return Unconverged(value, error, converged);
+        
+        // Intervals whose error doesn't matter aren't worth splitting
+        numPending = 0;
+        for(int i = 0; i < Eval_QuadSplit && !intervals.empty(); ++i)
+        {
+            const QuadInterval& worst = intervals.front();
+            double mid = 0.5 * (worst.a + worst.b);
+            if(i > 0 && worst.error < tolerance / Eval_QuadMaxIntervals) break;
+            if(mid == worst.a || mid == worst.b) break;
+            
+            pending[numPending++] = { worst.a, mid, 0.0, 0.0, 0.0 };
+            pending[numPending++] = { mid, worst.b, 0.0, 0.0, 0.0 };
+            std::pop_heap(intervals.begin(), intervals.end());
+            intervals.pop_back();
+        }
+        
+        // Out of precision
+        if(numPending == 0) return Unconverged(value, error, converged);
+    }
+}
+
+// Terms first to last, integers with first <= last
+static void SumTerms(const Program* kernel, const BindingPoint* point, const double* params,
+                     double first, double last, KahanSum* total)
+{
+    double values[Eval_BatchSize];
+    for(double n = first; n <= last; n += Eval_BatchSize)
+    {
+        int count = (int)fmin(last - n + 1.0, (double)Eval_BatchSize);
+        EvalKernel(kernel, point, params, EvalRamp(n, 1.0), count, values);
+        KahanAdd(total, PairwiseSum(values, count));
+    }
+}
+
+static void EvalBindings(const Program* program, const Instr* instr, const EvalInput vars[Var_Count],
+                         const EvalInput bound[Ast_MaxBindings], const double* params, int64_t offset, int n,
+                         const double* first, const double* last, double* dst)
+{
+    const Program* kernel = &program->kernels[instr->index];
+    BindingPoint point = {};
+    
+    // Result of the previous point, extended when it's shorter than starting over.
+    // Only converged results are, an unconverged error would carry over to the rest of the batch.
+    bool reuse = false;
+    double previousFirst = 0.0, previousLast = 0.0;
+    KahanSum previous = {};
+    
+    for(int j = 0; j < n; ++j)
+    {
+        int64_t i = offset + j;
+        for(int v = 0; v < Var_Count; ++v)
+            point.vars[v] = vars[v].array ? vars[v].array[i] : vars[v].start + i * vars[v].step;
+        for(uint32_t k = 0; k < kernel->binding; ++k)
+            point.bound[k] = bound[k].array ? bound[k].array[i] : bound[k].start + i * bound[k].step;
+        
+        KahanSum total = {};
+        bool converged = true;
+        if(instr->op == Op_Integral)
+        {
+            double a = first[j], b = last[j];
+            bool extend = reuse && a == previousFirst && fabs(b - previousLast) < fabs(b - a);
+            if(extend) total = previous;
+            KahanAdd(&total, Integrate(kernel, &point, params, extend ? previousLast : a, b, &converged));
+            previousFirst = a;
+            previousLast = b;
+        }
+        else
+        {
+            double a = ceil(first[j]), b = floor(last[j]);
+            bool extend = reuse && a == previousFirst && b >= previousLast && b - previousLast < b - a + 1.0;
+            double from = extend ? previousLast + 1.0 : a;
+            if(extend) total = previous;
+            
+            if(!isfinite(a) || !isfinite(b) || b - from + 1.0 > Eval_MaxSumTerms) total.sum = NAN;
+            else if(from <= b) SumTerms(kernel, &point, params, from, b, &total);
+            previousFirst = a;
+            previousLast = b;
+        }
+        
+        dst[j] = total.sum + total.compensation;
+        previous = total;
+        reuse = kernel->outerFree && converged && isfinite(dst[j]);
+    }
+}
+
+static void EvalBatchBound(const Program* program, const EvalInput vars[Var_Count], const EvalInput bound[Ast_MaxBindings],
+                           const double* params, int64_t count, double* const* outputs)
+{
+    evalScratch.resize((size_t)program->numRegs * Eval_BatchSize);
+    double* regs = evalScratch.data();
+    
+    for(int64_t offset = 0; offset < count; offset += Eval_BatchSize)
+    {
+        int n = (int)(count - offset < Eval_BatchSize ? count - offset : Eval_BatchSize);
+        EvalChunk(program, vars, bound, params, offset, n, regs);
+        
+        for(uint32_t i = 0; i < program->numOutputs; ++i)
+            memcpy(outputs[i] + offset, regs + (size_t)program->outputs[i] * Eval_BatchSize, n * sizeof(double));
+    }
+}
+
+void EvalBatch(const Program* program, const EvalInput vars[Var_Count], const double* params,
+               int64_t count, double* const* outputs)
+{
+    EvalBatchBound(program, vars, noBindings, params, count, outputs);
+}
+
+static EvalInput OffsetInput(const EvalInput* input, int64_t offset)
+{
+    EvalInput result = *input;
+    if(input->array) result.array += offset;
+    else result.start += offset * input->step;
+    return result;
+}
+
+void EvalBatchParallelBound(const Program* program, const EvalInput vars[Var_Count], const EvalInput bound[Ast_MaxBindings],
+                            const double* params, int64_t count, double* const* outputs, int maxThreads)
+{
+    const int64_t grainSize = program->kernels.empty() ? Eval_BatchSize * 64 : Eval_BatchSize;
+    ParallelFor(count, grainSize, [&](int64_t begin, int64_t end, int task)
+    {
+        EvalInput offsetVars[Var_Count];
+        for(int i = 0; i < Var_Count; ++i)
+            offsetVars[i] = OffsetInput(&vars[i], begin);
+        EvalInput offsetBound[Ast_MaxBindings];
+        for(int i = 0; i < Ast_MaxBindings; ++i)
+            offsetBound[i] = OffsetInput(&bound[i], begin);
+        
+        double* offsetOutputs[Program_MaxOutputs];
+        for(uint32_t i = 0; i < program->numOutputs; ++i)
+            offsetOutputs[i] = outputs[i] + begin;
+        
+        EvalBatchBound(program, offsetVars, offsetBound, params, end - begin, offsetOutputs);
+    }, maxThreads);
+}
+
+void EvalBatchParallel(const Program* program, const EvalInput vars[Var_Count], const double* params,
+                       int64_t count, double* const* outputs, int maxThreads)
+{
+    EvalBatchParallelBound(program, vars, noBindings, params, count, outputs, maxThreads);
+}
+
+static thread_local std::vector<double> broadcastParams;
+
+void EvalBroadcast(const Program* program, const EvalInput vars[Var_Count], const double* params, int numParams,
+                   int param, const double* list, int64_t rows, int64_t count, int64_t stride,
+                   double* const* outputs, int maxThreads)
+{
+    if(rows <= 0 || count <= 0) return;
+    
+    // Pieces of rows, as large as EvalBatchParallel's
+    const int64_t grainSize = program->kernels.empty() ? Eval_BatchSize * 64 : Eval_BatchSize;
+    int64_t pieces = (count + grainSize - 1) / grainSize;
+    ParallelFor(rows * pieces, 1, [&](int64_t begin, int64_t end, int task)
+    {
+        broadcastParams.assign(params, params + numParams);
+        for(int64_t item = begin; item < end; ++item)
+        {
+            int64_t row = item / pieces;
+            int64_t first = (item % pieces) * grainSize;
+            int64_t n = count - first < grainSize ? count - first : grainSize;
+            broadcastParams[param] = list[row];
+            
+            EvalInput offsetVars[Var_Count];
+            for(int i = 0; i < Var_Count; ++i)
+                offsetVars[i] = OffsetInput(&vars[i], first);
+            
+            double* offsetOutputs[Program_MaxOutputs];
+            for(uint32_t i = 0; i < program->numOutputs; ++i)
+                offsetOutputs[i] = outputs[i] + row * stride + first;
+            
+            EvalBatch(program, offsetVars, broadcastParams.data(), n, offsetOutputs);
+        }
+    }, maxThreads);
+}
+
+static thread_local std::vector<double> evalScratchDD;
+
+static void LoadInputDD(const EvalInput* input, const double* lo, int64_t offset, int n,
+                        double* __restrict dstHi, double* __restrict dstLo)
+{
+    if(input->array)
+    {
+        memcpy(dstHi, input->array + offset, n * sizeof(double));
+        if(lo) memcpy(dstLo, lo + offset, n * sizeof(double));
+        else memset(dstLo, 0, n * sizeof(double));
+    }
+    else
+    {
+        // Indices are exact in a double, the product and the sum are exact in double-double
+        double start = input->start, step = input->step;
+        for(int j = 0; j < n; ++j)
+        {
+            DoubleDouble x = DDAddDouble(TwoProd((double)(offset + j), step), start);
+            dstHi[j] = x.hi;
+            dstLo[j] = x.lo;
+        }
+    }
+}
+
+// Same as the double loops, with the double result standing in where double-double overflows
+#define UnaryLoopDD(expr, plain) \
+    for(int j = 0; j < n; ++j) \
+    { \
+        DoubleDouble a = { aHi[j], aLo[j] }; \
+        DoubleDouble r = DDOrDouble((expr), (plain)); \
+        dHi[j] = r.hi; dLo[j] = r.lo; \
+    }
+#define BinaryLoopDD(expr, plain) \
+    for(int j = 0; j < n; ++j) \
+    { \
+        DoubleDouble a = { aHi[j], aLo[j] }; \
+        DoubleDouble b = { bHi[j], bLo[j] }; \
+        DoubleDouble r = DDOrDouble((expr), (plain)); \
+        dHi[j] = r.hi; dLo[j] = r.lo; \
+    }
+#define CompareLoopDD(expr) \
+    for(int j = 0; j < n; ++j) \
+    { \
+        DoubleDouble a = { aHi[j], aLo[j] }; \
+        DoubleDouble b = { bHi[j], bLo[j] }; \
+        dHi[j] = (expr) ? 1.0 : 0.0; dLo[j] = 0.0; \
+    }
+
+// Registers are numRegs high parts, then numRegs low parts
+static void EvalChunkDD(const Program* program, const EvalInput vars[Var_Count], const double* const* varsLo,
+                        const double* params, int64_t offset, int n, double* regs)
+{
+    size_t lowOffset = (size_t)program->numRegs * Eval_BatchSize;
+    size_t count = program->code.size();
+    uint8_t localPlan[Eval_PlanSize];
+    std::vector<uint8_t> largePlan;
+    const uint8_t* plan = nullptr;
+    if(program->conditional)
+    {
+        if(count > Eval_PlanSize) largePlan.resize(count);
+        plan = PlanChunk(program, vars, noBindings, params, offset, n, count > Eval_PlanSize ? largePlan.data() : localPlan);
+    }
+    
+    for(size_t k = 0; k < count; ++k)
+    {
+        const Instr& instr = program->code[k];
+        double* __restrict dHi = regs + (size_t)instr.dst * Eval_BatchSize;
+        double* __restrict dLo = dHi + lowOffset;
+        const double* __restrict aHi = regs + (size_t)instr.src[0] * Eval_BatchSize;
+        const double* __restrict aLo = aHi + lowOffset;
+        const double* __restrict bHi = regs + (size_t)instr.src[1] * Eval_BatchSize;
+        const double* __restrict bLo = bHi + lowOffset;
+        const double* __restrict cHi = regs + (size_t)instr.src[2] * Eval_BatchSize;
+        const double* __restrict cLo = cHi + lowOffset;
+        if(plan && plan[k] != Plan_Run)
+        {
+            const double* source = plan[k] == Plan_TakeThen ? bHi : cHi;
+            if(plan[k] != Plan_Skip)
+            {
+                memcpy(dHi, source, n * sizeof(double));
+                memcpy(dLo, source + lowOffset, n * sizeof(double));
+            }
+            continue;
+        }
+        
+        switch(instr.op)
+        {
+            case Op_Const:
+            case Op_Param:
+            {
+                double value = instr.op == Op_Const ? instr.value : params[instr.index];
+                for(int j = 0; j < n; ++j) dHi[j] = value;
+                memset(dLo, 0, n * sizeof(double));
+                break;
+            }
+            case Op_Var:
+            {
+                LoadInputDD(&vars[instr.index], varsLo ? varsLo[instr.index] : nullptr, offset, n, dHi, dLo);
+                break;
+            }
+            case Op_Neg:          UnaryLoopDD(DDNeg(a), -a.hi); break;
+            case Op_Add:          BinaryLoopDD(DDAdd(a, b), a.hi + b.hi); break;
+            case Op_Sub:          BinaryLoopDD(DDSub(a, b), a.hi - b.hi); break;
+            case Op_Mul:          BinaryLoopDD(DDMul(a, b), a.hi * b.hi); break;
+            case Op_Div:          BinaryLoopDD(DDDiv(a, b), a.hi / b.hi); break;
+            case Op_Pow:          BinaryLoopDD(DDPow(a, b), pow(a.hi, b.hi)); break;
+            case Op_Sqrt:         UnaryLoopDD(DDSqrt(a), sqrt(a.hi)); break;
+            case Op_Abs:          UnaryLoopDD(DDAbs(a), fabs(a.hi)); break;
+            case Op_Exp:          UnaryLoopDD(DDExp(a), exp(a.hi)); break;
+            case Op_Ln:           UnaryLoopDD(DDLog(a), log(a.hi)); break;
+            case Op_Log10:        UnaryLoopDD(DDLog10(a), log10(a.hi)); break;
+            case Op_Log2:         UnaryLoopDD(DDLog2(a), log2(a.hi)); break;
+            case Op_Sin:          UnaryLoopDD(DDSin(a), sin(a.hi)); break;
+            case Op_Cos:          UnaryLoopDD(DDCos(a), cos(a.hi)); break;
+            case Op_Tan:          UnaryLoopDD(DDTan(a), tan(a.hi)); break;
+            case Op_Asin:         UnaryLoopDD(DDAsin(a), asin(a.hi)); break;
+            case Op_Acos:         UnaryLoopDD(DDAcos(a), acos(a.hi)); break;
+            case Op_Atan:         UnaryLoopDD(DDAtan(a), atan(a.hi)); break;
+            case Op_Atan2:        BinaryLoopDD(DDAtan2(a, b), atan2(a.hi, b.hi)); break;
+            case Op_Sinh:         UnaryLoopDD(DDSinh(a), sinh(a.hi)); break;
+            case Op_Cosh:         UnaryLoopDD(DDCosh(a), cosh(a.hi)); break;
+            case Op_Tanh:         UnaryLoopDD(DDTanh(a), tanh(a.hi)); break;
+            case Op_Floor:        UnaryLoopDD(DDFloor(a), floor(a.hi)); break;
+            case Op_Ceil:         UnaryLoopDD(DDCeil(a), ceil(a.hi)); break;
+            case Op_Round:        UnaryLoopDD(DDFloor(DDAddDouble(a, 0.5)), floor(a.hi + 0.5)); break;
+            case Op_Sign:         UnaryLoopDD((DoubleDouble{ a.hi > 0.0 ? 1.0 : (a.hi < 0.0 ? -1.0 : a.hi), 0.0 }), a.hi); break;
+            case Op_Min:          BinaryLoopDD(DDLess(a, b) || a.hi != a.hi ? a : b, a.hi < b.hi || a.hi != a.hi ? a.hi : b.hi); break;
+            case Op_Max:          BinaryLoopDD(DDLess(b, a) || a.hi != a.hi ? a : b, a.hi > b.hi || a.hi != a.hi ? a.hi : b.hi); break;
+            case Op_Mod:          BinaryLoopDD(DDSub(a, DDMul(b, DDFloor(DDDiv(a, b)))), a.hi - b.hi * floor(a.hi / b.hi)); break;
+            case Op_Less:         CompareLoopDD(DDLess(a, b)); break;
+            case Op_LessEqual:    CompareLoopDD(!DDLess(b, a) && a.hi == a.hi && b.hi == b.hi); break;
+            case Op_Greater:      CompareLoopDD(DDLess(b, a)); break;
+            case Op_GreaterEqual: CompareLoopDD(!DDLess(a, b) && a.hi == a.hi && b.hi == b.hi); break;
+            case Op_Equal:        CompareLoopDD(DDEqual(a, b)); break;
+            case Op_And:          CompareLoopDD(a.hi != 0.0 && b.hi != 0.0); break;
+            case Op_Select:
+            {
+                for(int j = 0; j < n; ++j)
+                {
+                    bool condition = aHi[j] != 0.0;
+                    dHi[j] = condition ? bHi[j] : cHi[j];
+                    dLo[j] = condition ? bLo[j] : cLo[j];
+                }
+                break;
+            }
+            case Op_Integral:
+            case Op_Sum:
+            {
+                // In double, over the high parts of the point
+                double inputs[Var_Count][Eval_BatchSize];
+                double lows[Eval_BatchSize];
+                EvalInput arrays[Var_Count];
+                for(int v = 0; v < Var_Count; ++v)
+                {
+                    LoadInputDD(&vars[v], varsLo ? varsLo[v] : nullptr, offset, n, inputs[v], lows);
+                    arrays[v] = EvalArray(inputs[v]);
+                }
+                
+                EvalBindings(program, &instr, arrays, noBindings, params, 0, n, aHi, bHi, dHi);
+                memset(dLo, 0, n * sizeof(double));
+                break;
+            }
+            default: assert(false); break;
+        }
+    }
+}
+
+#undef UnaryLoopDD
+#undef BinaryLoopDD
+#undef CompareLoopDD
+
+// Rows [begin, end), ramps stay exact because the offsets are absolute
+static void EvalRangeDD(const Program* program, const EvalInput vars[Var_Count], const double* const* varsLo,
+                        const double* params, int64_t begin, int64_t end, double* const* outputs, double* const* outputsLo)
+{
+    size_t lowOffset = (size_t)program->numRegs * Eval_BatchSize;
+    evalScratchDD.resize(2 * lowOffset);
+    double* regs = evalScratchDD.data();
+    
+    for(int64_t offset = begin; offset < end; offset += Eval_BatchSize)
+    {
+        int n = (int)(end - offset < Eval_BatchSize ? end - offset : Eval_BatchSize);
+        EvalChunkDD(program, vars, varsLo, params, offset, n, regs);
+        
+        for(uint32_t i = 0; i < program->numOutputs; ++i)
+        {
+            const double* hi = regs + (size_t)program->outputs[i] * Eval_BatchSize;
+            memcpy(outputs[i] + offset, hi, n * sizeof(double));
+            if(outputsLo) memcpy(outputsLo[i] + offset, hi + lowOffset, n * sizeof(double));
+        }
+    }
+}
+
+void EvalBatchDD(const Program* program, const EvalInput vars[Var_Count], const double* const* varsLo,
+                 const double* params, int64_t count, double* const* outputs, double* const* outputsLo)
+{
+    EvalRangeDD(program, vars, varsLo, params, 0, count, outputs, outputsLo);
+}
+
+void EvalBatchParallelDD(const Program* program, const EvalInput vars[Var_Count], const double* const* varsLo,
+                         const double* params, int64_t count, double* const* outputs,
+                         double* const* outputsLo, int maxThreads)
+{
+    // Each point costs a few times what it does in double
+    const int64_t grainSize = Eval_BatchSize * 4;
+    ParallelFor(count, grainSize, [&](int64_t begin, int64_t end, int task)
+    {
+        EvalRangeDD(program, vars, varsLo, params, begin, end, outputs, outputsLo);
+    }, maxThreads);
+}
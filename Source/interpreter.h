@@ -0,0 +1,88 @@
+#pragma once
+
+#include "compiler.h"
+
+// Program evaluation. The scalar path runs one point at a time, while the
+// batch path runs each instruction over Eval_BatchSize points before moving
+// on to the next one: the dispatch cost is paid once per batch and the inner
+// loops are simple enough for the compiler to vectorize.
+//
+// Piecewise definitions compile to selects, which blend both branches over
+// the batch. Before a batch of a program with selects, its instructions are
+// run once over intervals bounding the inputs (see interval.h): selects whose
+// condition holds, or fails, for the whole batch become copies, and what only
+// the other branch needs isn't computed at all. Batches far from the edges of
+// the pieces only pay for the piece they're in.
+//
+// Integrals and sums evaluate their kernel one point at a time, but over
+// a whole batch of values of their variable: Gauss-Kronrod 15 point rules
+// on up to Eval_QuadSplit intervals at once for integrals, consecutive
+// indices for sums, added pairwise and then with Neumaier's compensated
+// summation. When the kernel doesn't depend on the point and only the upper
+// bound moves (F(x) = integral(f, 0, x) sampled left to right), the previous
+// point's result is extended instead of starting over from the lower bound.
+// Results are only carried within a batch, so that batches stay independent
+// and can run in parallel.
+//
+// The double-double path (see ddouble.h) evaluates the same programs with
+// about 32 digits, for views zoomed in so far that the rounding of doubles
+// shows. Registers hold the high and low parts in separate arrays so the
+// loops vectorize the same way. Constants and parameters are the doubles the
+// compiler folded. Integrals and sums are still computed in double, from the
+// high parts of their inputs.
+
+#define Eval_BatchSize 256
+#define Eval_QuadTolerance 1e-12  // Relative
+#define Eval_QuadSplit 8          // Intervals bisected at once, 2 * 8 * 15 nodes fit in a batch
+#define Eval_QuadMaxIntervals 256
+#define Eval_QuadLooseTolerance 1e-6  // Relative, for integrals that run out of intervals, larger errors are NaN
+#define Eval_MaxSumTerms 1000000  // Larger sums are NaN rather than a frozen plot
+#define Eval_PlanSize 256         // Instructions planned on the stack, larger programs allocate
+
+// Value of a variable for each point: array[i] if there is an array,
+// otherwise start + i * step (step = 0 for constant values).
+struct EvalInput
+{
+    const double* array;
+    double start;
+    double step;
+};
+
+EvalInput EvalArray(const double* array);
+EvalInput EvalRamp(double start, double step);
+EvalInput EvalConstant(double value);
+
+// Returns the first output, all of them are written to outputs if it's not null
+double EvalScalar(const Program* program, const double vars[Var_Count], const double* params, double* outputs = nullptr);
+
+// outputs[i] receives count values for the i-th output of the program
+void EvalBatch(const Program* program, const EvalInput vars[Var_Count], const double* params,
+               int64_t count, double* const* outputs);
+
+// Same as EvalBatch, split over the job system (maxThreads = 0 uses all threads).
+// Programs with integrals or sums are split in single batches, they're expensive.
+void EvalBatchParallel(const Program* program, const EvalInput vars[Var_Count], const double* params,
+                       int64_t count, double* const* outputs, int maxThreads = 0);
+
+// Same again, with the values of Op_Bound leaves outside of integrals and
+// sums given by bound, for programs reading values computed elsewhere (see
+// subterms.h). Integrals and sums overwrite their own slots.
+void EvalBatchParallelBound(const Program* program, const EvalInput vars[Var_Count], const EvalInput bound[Ast_MaxBindings],
+                            const double* params, int64_t count, double* const* outputs, int maxThreads = 0);
+
+// Broadcast over a list (see Def_List): the program runs once per element,
+// with params[param] set to it, over the same count points. Row r of the i-th
+// output starts at outputs[i] + r * stride. Rows and batches are split over
+// the job system together, so a long list of short rows stays parallel.
+void EvalBroadcast(const Program* program, const EvalInput vars[Var_Count], const double* params, int numParams,
+                   int param, const double* list, int64_t rows, int64_t count, int64_t stride,
+                   double* const* outputs, int maxThreads = 0);
+
+// Double-double evaluation. Ramps are computed in double-double, the low parts
+// of array inputs are in varsLo when it isn't null. The outputs receive the
+// results rounded to double, and outputsLo the low parts when it isn't null.
+void EvalBatchDD(const Program* program, const EvalInput vars[Var_Count], const double* const* varsLo,
+                 const double* params, int64_t count, double* const* outputs, double* const* outputsLo = nullptr);
+void EvalBatchParallelDD(const Program* program, const EvalInput vars[Var_Count], const double* const* varsLo,
+                         const double* params, int64_t count, double* const* outputs,
+                         double* const* outputsLo = nullptr, int maxThreads = 0);
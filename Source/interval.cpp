@@ -0,0 +1,312 @@
+#include "interval.h"
+
+#include <math.h>
+#include <float.h>
+
+#define Interval_Pi 3.14159265358979323846
+#define Interval_FunctionUlps 4  // Elementary functions are within an ulp or two, with some margin
+
+static const Interval allNaN = { INFINITY, -INFINITY, true };
+
+static bool IsEmpty(Interval a)
+{
+    return a.lo > a.hi;
+}
+
+static Interval Everything(bool nan)
+{
+    return { -INFINITY, INFINITY, nan };
+}
+
+static double Down(double x, int ulps)
+{
+    for(int i = 0; i < ulps; ++i) x = nextafter(x, -INFINITY);
+    return x;
+}
+
+static double Up(double x, int ulps)
+{
+    for(int i = 0; i < ulps; ++i) x = nextafter(x, INFINITY);
+    return x;
+}
+
+static Interval Rounded(double lo, double hi, bool nan, int ulps)
+{
+    if(isnan(lo) || isnan(hi)) return Everything(true);
+    return { Down(lo, ulps), Up(hi, ulps), nan };
+}
+
+static Interval Hull(Interval a, Interval b)
+{
+    return { fmin(a.lo, b.lo), fmax(a.hi, b.hi), a.nan || b.nan };
+}
+
+static bool Contains(Interval a, double x)
+{
+    return a.lo <= x && x <= a.hi;
+}
+
+Interval IntervalPoint(double value)
+{
+    if(isnan(value)) return allNaN;
+    return { value, value, false };
+}
+
+Interval IntervalRange(double lo, double hi, bool nan)
+{
+    if(lo > hi) return allNaN;
+    return Rounded(lo, hi, nan, 2);
+}
+
+bool IntervalAlwaysTrue(Interval condition)
+{
+    return !Contains(condition, 0.0);
+}
+
+bool IntervalAlwaysFalse(Interval condition)
+{
+    return condition.lo == 0.0 && condition.hi == 0.0 && !condition.nan;
+}
+
+static Interval Boolean(bool alwaysTrue, bool alwaysFalse)
+{
+    if(alwaysTrue) return { 1.0, 1.0, false };
+    if(alwaysFalse) return { 0.0, 0.0, false };
+    return { 0.0, 1.0, false };
+}
+
+static Interval Add(Interval a, Interval b)
+{
+    if(IsEmpty(a) || IsEmpty(b)) return allNaN;
+    
+    // Infinities of opposite signs
+    bool nan = a.nan || b.nan || (a.lo == -INFINITY && b.hi == INFINITY) || (a.hi == INFINITY && b.lo == -INFINITY);
+    return Rounded(a.lo + b.lo, a.hi + b.hi, nan, 1);
+}
+
+static Interval Mul(Interval a, Interval b)
+{
+    if(IsEmpty(a) || IsEmpty(b)) return allNaN;
+    
+    // Zero times infinity
+    bool infinite = isinf(a.lo) || isinf(a.hi) || isinf(b.lo) || isinf(b.hi);
+    if(infinite && (Contains(a, 0.0) || Contains(b, 0.0))) return Everything(true);
+    
+    double p0 = a.lo * b.lo, p1 = a.lo * b.hi, p2 = a.hi * b.lo, p3 = a.hi * b.hi;
+    return Rounded(fmin(fmin(p0, p1), fmin(p2, p3)), fmax(fmax(p0, p1), fmax(p2, p3)), a.nan || b.nan, 1);
+}
+
+static Interval Div(Interval a, Interval b)
+{
+    if(IsEmpty(a) || IsEmpty(b)) return allNaN;
+    if(Contains(b, 0.0)) return Everything(true);
+    if((isinf(a.lo) || isinf(a.hi)) && (isinf(b.lo) || isinf(b.hi))) return Everything(true);
+    
+    double q0 = a.lo / b.lo, q1 = a.lo / b.hi, q2 = a.hi / b.lo, q3 = a.hi / b.hi;
+    return Rounded(fmin(fmin(q0, q1), fmin(q2, q3)), fmax(fmax(q0, q1), fmax(q2, q3)), a.nan || b.nan, 1);
+}
+
+static Interval Pow(Interval a, Interval b)
+{
+    if(IsEmpty(b)) return allNaN;
+    
+    // pow(x, 0) is 1 even for NaN
+    if(b.lo == b.hi && !b.nan && b.lo == 0.0) return { 1.0, 1.0, false };
+    if(IsEmpty(a)) return allNaN;
+    
+    if(b.lo == b.hi && !b.nan && b.lo == floor(b.lo) && fabs(b.lo) < 1e15)
+    {
+        double n = b.lo;
+        bool even = fmod(n, 2.0) == 0.0;
+        if(n < 0.0 && Contains(a, 0.0)) return Everything(true);
+        
+        double pLo = pow(a.lo, n), pHi = pow(a.hi, n);
+        if(even && Contains(a, 0.0)) return Rounded(0.0, fmax(pLo, pHi), a.nan, Interval_FunctionUlps);
+        return Rounded(fmin(pLo, pHi), fmax(pLo, pHi), a.nan, Interval_FunctionUlps);
+    }
+    
+    // Monotonic in both arguments on a positive base
+    if(a.lo > 0.0)
+    {
+        double p0 = pow(a.lo, b.lo), p1 = pow(a.lo, b.hi), p2 = pow(a.hi, b.lo), p3 = pow(a.hi, b.hi);
+        return Rounded(fmin(fmin(p0, p1), fmin(p2, p3)), fmax(fmax(p0, p1), fmax(p2, p3)), a.nan || b.nan, Interval_FunctionUlps);
+    }
+    
+    return Everything(true);
+}
+
+// Functions increasing over their domain [domainLo, domainHi], NaN outside of it
+static Interval Increasing(double (*f)(double), Interval a, double domainLo, double domainHi)
+{
+    if(IsEmpty(a) || a.hi < domainLo || a.lo > domainHi) return allNaN;
+    
+    bool nan = a.nan || a.lo < domainLo || a.hi > domainHi;
+    return Rounded(f(fmax(a.lo, domainLo)), f(fmin(a.hi, domainHi)), nan, Interval_FunctionUlps);
+}
+
+// Sine, or cosine which is the sine shifted by phase, from its values at the ends and the peaks in between
+static Interval Periodic(double (*f)(double), Interval a, double phase)
+{
+    if(IsEmpty(a)) return allNaN;
+    if(isinf(a.lo) || isinf(a.hi)) return { -1.0, 1.0, true };
+    if(a.hi - a.lo >= 2.0 * Interval_Pi) return { -1.0, 1.0, a.nan };
+    
+    double lo = f(a.lo), hi = f(a.hi);
+    double result[2] = { fmin(lo, hi), fmax(lo, hi) };
+    
+    // Peaks at pi/2 + 2 pi k and troughs at -pi/2 + 2 pi k, looked for a little past the ends
+    double margin = 1e-9 * (1.0 + fmax(fabs(a.lo), fabs(a.hi)));
+    for(int side = 0; side < 2; ++side)
+    {
+        double offset = side == 0 ? Interval_Pi / 2.0 : -Interval_Pi / 2.0;
+        double first = ceil((a.lo + phase - margin - offset) / (2.0 * Interval_Pi));
+        double last = floor((a.hi + phase + margin - offset) / (2.0 * Interval_Pi));
+        if(first <= last)
+        {
+            if(side == 0) result[1] = 1.0;
+            else result[0] = -1.0;
+        }
+    }
+    
+    Interval out = Rounded(result[0], result[1], a.nan, Interval_FunctionUlps);
+    out.lo = fmax(out.lo, -1.0);
+    out.hi = fmin(out.hi, 1.0);
+    return out;
+}
+
+static Interval Tan(Interval a)
+{
+    if(IsEmpty(a)) return allNaN;
+    if(isinf(a.lo) || isinf(a.hi) || a.hi - a.lo >= Interval_Pi) return Everything(true);
+    
+    // No pole between the ends, with some margin
+    double margin = 1e-9 * (1.0 + fmax(fabs(a.lo), fabs(a.hi)));
+    double first = ceil((a.lo - margin - Interval_Pi / 2.0) / Interval_Pi);
+    double last = floor((a.hi + margin - Interval_Pi / 2.0) / Interval_Pi);
+    if(first <= last) return Everything(a.nan);
+    
+    return Rounded(tan(a.lo), tan(a.hi), a.nan, Interval_FunctionUlps);
+}
+
+// Exact functions which only step: floor, ceil and round. Double-double values
+// may sit on the other side of a step than their high part, so the ends move out first.
+static Interval Steps(double (*f)(double), Interval a, double shift)
+{
+    if(IsEmpty(a)) return allNaN;
+    return { f(Down(a.lo, 1) + shift), f(Up(a.hi, 1) + shift), a.nan };
+}
+
+static Interval Abs(Interval a)
+{
+    if(IsEmpty(a)) return allNaN;
+    if(a.lo >= 0.0) return a;
+    if(a.hi <= 0.0) return { -a.hi, -a.lo, a.nan };
+    return { 0.0, fmax(-a.lo, a.hi), a.nan };
+}
+
+static Interval Cosh(Interval a)
+{
+    if(IsEmpty(a)) return allNaN;
+    
+    double lo = cosh(a.lo), hi = cosh(a.hi);
+    if(Contains(a, 0.0)) return Rounded(1.0, fmax(lo, hi), a.nan, Interval_FunctionUlps);
+    return Rounded(fmin(lo, hi), fmax(lo, hi), a.nan, Interval_FunctionUlps);
+}
+
+// a - b floor(a / b), within b of zero up to the rounding of a
+static Interval Mod(Interval a, Interval b)
+{
+    if(IsEmpty(a) || IsEmpty(b)) return allNaN;
+    if(isinf(a.lo) || isinf(a.hi) || isinf(b.lo) || isinf(b.hi) || Contains(b, 0.0)) return Everything(true);
+    
+    double slack = 4.0 * DBL_EPSILON * fmax(fabs(a.lo), fabs(a.hi));
+    bool nan = a.nan || b.nan;
+    if(b.lo > 0.0) return Rounded(-slack, b.hi + slack, nan, 1);
+    return Rounded(b.lo - slack, slack, nan, 1);
+}
+
+// a < b, or a <= b when orEqual
+static Interval Less(Interval a, Interval b, bool orEqual)
+{
+    if(IsEmpty(a) || IsEmpty(b)) return Boolean(false, true);
+    
+    bool certain = !a.nan && !b.nan && (orEqual ? a.hi <= b.lo : a.hi < b.lo);
+    bool never = orEqual ? a.lo > b.hi : a.lo >= b.hi;
+    return Boolean(certain, never);
+}
+
+// NaN on either side gives NaN, see ApplyOp
+static Interval MinMax(Interval a, Interval b, bool max)
+{
+    if(a.nan || b.nan || IsEmpty(a) || IsEmpty(b)) return Hull(a, b);
+    if(max) return { fmax(a.lo, b.lo), fmax(a.hi, b.hi), false };
+    return { fmin(a.lo, b.lo), fmin(a.hi, b.hi), false };
+}
+
+Interval IntervalOp(OpCode op, Interval a, Interval b, Interval c)
+{
+    switch(op)
+    {
+        case Op_Neg:          return IsEmpty(a) ? allNaN : Interval{ -a.hi, -a.lo, a.nan };
+        case Op_Add:          return Add(a, b);
+        case Op_Sub:          return Add(a, IntervalOp(Op_Neg, b, b, b));
+        case Op_Mul:          return Mul(a, b);
+        case Op_Div:          return Div(a, b);
+        case Op_Pow:          return Pow(a, b);
+        case Op_Sqrt:         return Increasing(sqrt, a, 0.0, INFINITY);
+        case Op_Abs:          return Abs(a);
+        case Op_Exp:          return Increasing(exp, a, -INFINITY, INFINITY);
+        case Op_Ln:           return Increasing(log, a, 0.0, INFINITY);
+        case Op_Log10:        return Increasing(log10, a, 0.0, INFINITY);
+        case Op_Log2:         return Increasing(log2, a, 0.0, INFINITY);
+        case Op_Sin:          return Periodic(sin, a, 0.0);
+        case Op_Cos:          return Periodic(cos, a, Interval_Pi / 2.0);
+        case Op_Tan:          return Tan(a);
+        case Op_Asin:         return Increasing(asin, a, -1.0, 1.0);
+        case Op_Acos:
+        {
+            // Decreasing, the ends swap
+            Interval result = Increasing(asin, a, -1.0, 1.0);
+            if(IsEmpty(result)) return result;
+            return Rounded(acos(fmin(a.hi, 1.0)), acos(fmax(a.lo, -1.0)), result.nan, Interval_FunctionUlps);
+        }
+        case Op_Atan:         return Increasing(atan, a, -INFINITY, INFINITY);
+        case Op_Atan2:        return Rounded(-Interval_Pi, Interval_Pi, a.nan || b.nan, Interval_FunctionUlps);
+        case Op_Sinh:         return Increasing(sinh, a, -INFINITY, INFINITY);
+        case Op_Cosh:         return Cosh(a);
+        case Op_Tanh:         return Increasing(tanh, a, -INFINITY, INFINITY);
+        case Op_Floor:        return Steps(floor, a, 0.0);
+        case Op_Ceil:         return Steps(ceil, a, 0.0);
+        case Op_Round:        return Steps(floor, a, 0.5);
+        case Op_Sign:
+        {
+            if(IsEmpty(a)) return allNaN;
+            return { a.lo > 0.0 ? 1.0 : (a.lo < 0.0 ? -1.0 : 0.0), a.hi > 0.0 ? 1.0 : (a.hi < 0.0 ? -1.0 : 0.0), a.nan };
+        }
+        case Op_Min:          return MinMax(a, b, false);
+        case Op_Max:          return MinMax(a, b, true);
+        case Op_Mod:          return Mod(a, b);
+        case Op_Less:         return Less(a, b, false);
+        case Op_LessEqual:    return Less(a, b, true);
+        case Op_Greater:      return Less(b, a, false);
+        case Op_GreaterEqual: return Less(b, a, true);
+        case Op_Equal:
+        {
+            if(IsEmpty(a) || IsEmpty(b)) return Boolean(false, true);
+            bool certain = !a.nan && !b.nan && a.lo == a.hi && b.lo == b.hi && a.lo == b.lo;
+            return Boolean(certain, a.hi < b.lo || a.lo > b.hi);
+        }
+        case Op_And:
+        {
+            bool certain = IntervalAlwaysTrue(a) && IntervalAlwaysTrue(b);
+            return Boolean(certain, IntervalAlwaysFalse(a) || IntervalAlwaysFalse(b));
+        }
+        case Op_Select:
+        {
+            if(IntervalAlwaysTrue(a)) return b;
+            if(IntervalAlwaysFalse(a)) return c;
+            return Hull(b, c);
+        }
+        default:              return Everything(true);
+    }
+}
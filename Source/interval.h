@@ -0,0 +1,30 @@
+#pragma once
+
+#include "parser.h"
+
+// Interval arithmetic over the operations of programs, to bound what an
+// expression can do over a whole batch of points without evaluating them.
+// Every value the interpreter computes from inputs inside the intervals is
+// inside the result, both in double and in double-double: bounds are rounded
+// outwards by an ulp after operations which round, and by a few more after
+// the elementary functions, which aren't correctly rounded. NaN is tracked
+// separately, since comparisons with it are false and selects treat it as
+// true.
+
+struct Interval
+{
+    double lo;  // lo > hi when every value is NaN
+    double hi;
+    bool nan;   // Some values may be NaN
+};
+
+Interval IntervalPoint(double value);
+// Bounds of values that were themselves rounded, like ramps of inputs
+Interval IntervalRange(double lo, double hi, bool nan);
+
+// Semantics of ApplyOp over intervals. Integrals and sums aren't bounded.
+Interval IntervalOp(OpCode op, Interval a, Interval b, Interval c);
+
+// Conditions which hold, or fail, for every value of the interval
+bool IntervalAlwaysTrue(Interval condition);
+bool IntervalAlwaysFalse(Interval condition);
@@ -0,0 +1,224 @@
+#include "jobs.h"
+
+#include <assert.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <string>
+#include <stdio.h>
+
+struct Job
+{
+    std::function<void()> func;
+    JobCounter* counter;
+    bool background;
+};
+
+struct JobSystem
+{
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    std::deque<Job> queue;
+    std::deque<Job> background;  // Taken by the workers when queue is empty, never by waiting threads
+    std::vector<std::thread> workers;
+    bool quit;
+    
+    JobProfileHooks profile;
+    std::deque<std::string> workerNames;  // Never cleared, the profiler keeps pointers to them
+};
+
+static JobSystem jobSystem;
+
+static void ExecuteJob(Job* job)
+{
+    if(jobSystem.profile.beginZone) jobSystem.profile.beginZone(job->background ? "Background job" : "Job");
+    job->func();
+    if(jobSystem.profile.endZone) jobSystem.profile.endZone();
+    if(job->counter) job->counter->pending.fetch_sub(1);
+}
+
+// The next job for a worker, under the lock
+static bool PopJob(Job* out)
+{
+    std::deque<Job>* queue = !jobSystem.queue.empty() ? &jobSystem.queue : &jobSystem.background;
+    if(queue->empty()) return false;
+    
+    *out = std::move(queue->front());
+    queue->pop_front();
+    return true;
+}
+
+// A thread waiting on counter only runs the foreground jobs of that counter:
+// helping with anything else would run background work, or another thread's,
+// in the middle of its own (on the main thread, in the middle of the frame)
+static bool TryRunQueuedJob(const JobCounter* counter)
+{
+    Job job;
+    {
+        std::lock_guard<std::mutex> lock(jobSystem.mutex);
+        auto found = jobSystem.queue.begin();
+        while(found != jobSystem.queue.end() && found->counter != counter) ++found;
+        if(found == jobSystem.queue.end()) return false;
+        
+        job = std::move(*found);
+        jobSystem.queue.erase(found);
+    }
+    
+    ExecuteJob(&job);
+    return true;
+}
+
+static void WorkerLoop(const char* name)
+{
+    if(jobSystem.profile.setThreadName) jobSystem.profile.setThreadName(name);
+    
+    while(true)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(jobSystem.mutex);
+            jobSystem.wakeUp.wait(lock, [] { return jobSystem.quit || !jobSystem.queue.empty() || !jobSystem.background.empty(); });
+            if(jobSystem.quit) return;
+            
+            PopJob(&job);
+        }
+        
+        ExecuteJob(&job);
+    }
+}
+
+void SetJobProfileHooks(const JobProfileHooks* hooks)
+{
+    jobSystem.profile = *hooks;
+}
+
+void InitJobSystem(int numWorkers)
+{
+    assert(jobSystem.workers.empty());
+    
+    if(numWorkers < 0)
+    {
+        int hardwareThreads = (int)std::thread::hardware_concurrency();
+        numWorkers = hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+    }
+    
+    jobSystem.quit = false;
+    while((int)jobSystem.workerNames.size() < numWorkers)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "Worker %d", (int)jobSystem.workerNames.size() + 1);
+        jobSystem.workerNames.push_back(name);
+    }
+    for(int i = 0; i < numWorkers; ++i)
+        jobSystem.workers.emplace_back(WorkerLoop, jobSystem.workerNames[i].c_str());
+}
+
+void ShutdownJobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(jobSystem.mutex);
+        jobSystem.quit = true;
+    }
+    jobSystem.wakeUp.notify_all();
+    
+    for(std::thread& worker : jobSystem.workers)
+        worker.join();
+    
+    jobSystem.workers.clear();
+    
+    // What's left runs here, so the counters of the jobs still reach zero and
+    // whatever waits on them later doesn't hang. Jobs queued from these run inline.
+    Job job;
+    while(PopJob(&job))
+        ExecuteJob(&job);
+}
+
+int GetNumJobThreads()
+{
+    return (int)jobSystem.workers.size() + 1;
+}
+
+static void QueueJob(std::function<void()> job, JobCounter* counter, bool background)
+{
+    if(counter) counter->pending.fetch_add(1);
+    
+    if(jobSystem.workers.empty())
+    {
+        Job inlineJob = { std::move(job), counter, background };
+        ExecuteJob(&inlineJob);
+        return;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(jobSystem.mutex);
+        (background ? jobSystem.background : jobSystem.queue).push_back({ std::move(job), counter, background });
+    }
+    jobSystem.wakeUp.notify_one();
+}
+
+void RunJob(std::function<void()> job, JobCounter* counter)
+{
+    QueueJob(std::move(job), counter, false);
+}
+
+void RunBackgroundJob(std::function<void()> job, JobCounter* counter)
+{
+    QueueJob(std::move(job), counter, true);
+}
+
+void WaitForJobs(JobCounter* counter)
+{
+    while(counter->pending.load() > 0)
+    {
+        if(!TryRunQueuedJob(counter))
+            std::this_thread::yield();
+    }
+}
+
+bool JobsDone(const JobCounter* counter)
+{
+    return counter->pending.load() == 0;
+}
+
+void ParallelFor(int64_t count, int64_t grainSize, const ParallelForFunc& func, int maxThreads)
+{
+    if(count <= 0) return;
+    if(grainSize < 1) grainSize = 1;
+    
+    int64_t numChunks = (count + grainSize - 1) / grainSize;
+    int numTasks = GetNumJobThreads();
+    if(maxThreads > 0 && maxThreads < numTasks) numTasks = maxThreads;
+    if(numChunks < numTasks) numTasks = (int)numChunks;
+    
+    if(numTasks <= 1)
+    {
+        func(0, count, 0);
+        return;
+    }
+    
+    // Chunks are handed out dynamically, since the cost per item is often uneven
+    std::atomic<int64_t> nextChunk{0};
+    auto task = [&](int taskIndex)
+    {
+        if(jobSystem.profile.beginZone) jobSystem.profile.beginZone("Parallel for");
+        while(true)
+        {
+            int64_t chunk = nextChunk.fetch_add(1);
+            if(chunk >= numChunks) break;
+            
+            int64_t begin = chunk * grainSize;
+            int64_t end = begin + grainSize < count ? begin + grainSize : count;
+            func(begin, end, taskIndex);
+        }
+        if(jobSystem.profile.endZone) jobSystem.profile.endZone();
+    };
+    
+    JobCounter counter;
+    for(int i = 1; i < numTasks; ++i)
+        RunJob([&task, i] { task(i); }, &counter);
+    
+    task(0);
+    WaitForJobs(&counter);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+
+// Thread pool with a shared queue, and a second one for background work
+// (tiles, animation frames, ODE solutions...) that the workers only take
+// when the first is empty, so the frame's parallel loops don't wait behind
+// it. Threads waiting on a counter run the queued jobs of that counter in
+// the meantime, so jobs can safely wait on other jobs, and waiting never
+// runs someone else's work. If the job system hasn't been initialized
+// everything runs inline, and jobs still queued at shutdown run on the
+// thread shutting it down.
+
+struct JobCounter
+{
+    std::atomic<int> pending{0};
+};
+
+// Zones around the jobs and names for the worker threads, for the profiler
+// (see profiler.h). The job system doesn't depend on it, so the headless
+// builds leave these unset. Set before InitJobSystem to name the workers.
+struct JobProfileHooks
+{
+    void (*beginZone)(const char* name);
+    void (*endZone)();
+    void (*setThreadName)(const char* name);
+};
+
+void SetJobProfileHooks(const JobProfileHooks* hooks);
+// numWorkers = -1 uses one worker per hardware thread, minus the calling thread
+void InitJobSystem(int numWorkers = -1);
+void ShutdownJobSystem();
+// Number of threads which can run jobs at the same time, including the calling one
+int GetNumJobThreads();
+
+void RunJob(std::function<void()> job, JobCounter* counter = nullptr);
+// Work that runs across frames, taken by the workers when there's nothing else
+void RunBackgroundJob(std::function<void()> job, JobCounter* counter = nullptr);
+void WaitForJobs(JobCounter* counter);
+bool JobsDone(const JobCounter* counter);
+
+// Calls func on consecutive ranges of at least grainSize items. The calling thread
+// participates, and task is in [0, GetNumJobThreads()), unique among concurrently
+// running ranges of the same call (for per-thread partial results).
+typedef std::function<void(int64_t begin, int64_t end, int task)> ParallelForFunc;
+void ParallelFor(int64_t count, int64_t grainSize, const ParallelForFunc& func, int maxThreads = 0);
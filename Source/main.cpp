@@ -1,7 +1,12 @@
 
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include <iostream>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <math.h>
 
 #include <windows.h>
 
@@ -16,6 +21,26 @@
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_wgpu.h"
 
+#include "core.h"
+#include "profiler.h"
+#include "batch.h"
+#include "jobs.h"
+#include "datatable.h"
+#include "plot.h"
+#include "scatter.h"
+#include "streaming.h"
+#include "shmfeed.h"
+#include "fit.h"
+#include "histogram.h"
+#include "curves.h"
+#include "analysis.h"
+#include "animation.h"
+#include "session.h"
+#include "diskcache.h"
+#include "fields.h"
+#include "curvelines.h"
+#include "domain.h"
+
 struct WGPUState
 {
     WGPUInstance instance;
@@ -31,21 +56,43 @@ struct WGPUState
     WGPURenderPassEncoder pass;
     WGPUCommandEncoder encoder;
     WGPUCommandBuffer cmdBuffer;
+    
+    GPUProfiler gpuProfiler;
+    ScatterRenderer scatter;
+    FieldRenderer fields;
+    CurveRenderer curves;
+    DomainRenderer domain;
 };
 
 // Returns the DPI scale
 float HandleDPI();
-WGPUState InitWGPU(GLFWwindow* window);
+WGPUState InitWGPU(GLFWwindow* window, DiskCache* cache);
 void CleanupWGPU(WGPUState* state);
 void InitDearImgui(GLFWwindow* window, const WGPUState state);
-void RenderDearImgui(WGPUState* state);
+void RenderFrame(WGPUState* state, const Plot* plot);
 void CleanupDearImgui();
 void WGPUMessageCallback(WGPUErrorType type, char const* message, void* userDataPtr);
 void FrameCleanup(WGPUState* state);
 void Resize(WGPUState* state, int width, int height);
+// Data sources that keep growing, plotted through live scatter series
+struct LiveSources
+{
+    std::vector<DataStream*> streams;
+    std::vector<ShmFeed*> feeds;
+};
+
+void ShowDataWindow(bool* open, std::vector<DataTable*>* tables, LiveSources* live, Plot* plot, ScatterRenderer* scatter);
+void ShowExpressionsWindow(bool* open, CurveList* curves, Analyzer* analyzer, Animator* animator, FieldSolver* solver,
+                           DomainRenderer* domain);
+void UpdateLiveSources(LiveSources* live, Plot* plot, ScatterRenderer* scatter);
+void ShowSessionWindow(bool* open, Session* session, const DiskCache* cache);
 
-int main()
+int main(int argc, char** argv)
 {
+    // Command line batch evaluation, skips window and GPU initialization entirely
+    if(argc > 1 && strcmp(argv[1], "--batch") == 0)
+        return RunBatchMode(argc - 2, argv + 2);
+    
     // Glfw initialization
     bool ok = glfwInit();
     assert(ok);
@@ -58,7 +105,12 @@ int main()
     GLFWwindow* window = glfwCreateWindow(1200, 800, "Plotter", nullptr, nullptr);
     assert(window);
     
-    WGPUState wgpu = InitWGPU(window);
+    // Shaders and pipelines compiled in earlier runs, and the tiles rendered on the CPU
+    DiskCache diskCache;
+    OpenDiskCache(&diskCache, nullptr);
+    
+    WGPUState wgpu = InitWGPU(window, &diskCache);
+    wgpu.domain.diskCache = diskCache.enabled ? &diskCache : nullptr;
     
 #ifdef DEBUG
     WGPUAdapterProperties properties = WGPU_ADAPTER_PROPERTIES_INIT;
@@ -85,11 +137,36 @@ int main()
     InitDearImgui(window, wgpu);
     
     bool showDemoWindow = true;
+    bool showProfiler = false;
+    bool showData = true;
+    bool showExpressions = true;
+    bool showSession = true;
+    std::vector<DataTable*> dataTables;
+    LiveSources live;
+    CurveList curves;
+    Analyzer analyzer;
+    Animator animator;
+    FieldSolver solver;
+    AddCurve(&curves, "y = sin(x)");
+    
+    Plot plot;
+    InitPlot(&plot, wgpu.swapchainWidth, wgpu.swapchainHeight);
+    Session session = { &curves, &dataTables, &plot.view, &animator, &solver.method };
+    
+    ProfilerSetThreadName("Main");
+    JobProfileHooks profileHooks = { ProfilerBeginZone, ProfilerEndZone, ProfilerSetThreadName };
+    SetJobProfileHooks(&profileHooks);
+    InitJobSystem();
     
     // Main loop
     while(!glfwWindowShouldClose(window))
     {
-        glfwPollEvents();
+        ProfilerBeginFrame();
+        
+        {
+            ProfileScope("Poll events");
+            glfwPollEvents();
+        }
         
         // React to changes in screen size
         int width, height;
@@ -101,25 +178,88 @@ int main()
             ImGui_ImplWGPU_CreateDeviceObjects();
         }
         
-        // Signal the start of frame to imgui
-        ImGui_ImplWGPU_NewFrame();
-        ImGui_ImplGlfw_NewFrame();
-        ImGui::NewFrame();
+        {
+            ProfileScope("ImGui build");
+            
+            // Signal the start of frame to imgui
+            ImGui_ImplWGPU_NewFrame();
+            ImGui_ImplGlfw_NewFrame();
+            ImGui::NewFrame();
+            
+            if(ImGui::IsKeyPressed(ImGuiKey_F3, false))
+                showProfiler = !showProfiler;
+            
+            if(showDemoWindow)
+                ImGui::ShowDemoWindow(&showDemoWindow);
+            if(showProfiler)
+                ShowProfilerWindow(&showProfiler);
+            if(showData)
+                ShowDataWindow(&showData, &dataTables, &live, &plot, &wgpu.scatter);
+            if(showExpressions)
+                ShowExpressionsWindow(&showExpressions, &curves, &analyzer, &animator, &solver, &wgpu.domain);
+            if(showSession)
+                ShowSessionWindow(&showSession, &session, &diskCache);
+            
+            UpdatePlotView(&plot.view, wgpu.swapchainWidth, wgpu.swapchainHeight);
+            DrawPlotGrid(&plot.view);
+        }
+        
+        {
+            ProfileScope("Curves");
+            UpdateAnimation(&animator, &curves, &plot.view, ImGui::GetIO().DeltaTime);
+            SampleCurves(&curves, &plot.view);
+            HandleAnalysisClick(&analyzer, &curves, &plot.view);
+            HandleFieldClick(&curves, &plot.view);
+            UpdateAnalysis(&analyzer, &curves, &plot.view);
+            UpdateFieldSolutions(&solver, &curves, &plot.view);
+            UpdateFieldArrows(&wgpu.fields, &curves, &plot.view);
+            DrawFieldSolutions(&solver, &curves, &plot.view);
+            UpdateCurveLines(&wgpu.curves, &curves, &plot.view);
+            UpdateDomainTiles(&wgpu.domain, &curves, &plot.view);
+            DrawAnalysis(&analyzer, &curves, &plot.view);
+        }
         
-        if(showDemoWindow)
-            ImGui::ShowDemoWindow(&showDemoWindow);
+        {
+            ProfileScope("Live sources");
+            UpdateLiveSources(&live, &plot, &wgpu.scatter);
+        }
         
-        RenderDearImgui(&wgpu);
+        RenderFrame(&wgpu, &plot);
         
         // This is necessary to display validation errors
+        // (and to receive the GPU timestamps)
         wgpuDeviceTick(wgpu.device);
         
         // Swap buffers
-        wgpuSurfacePresent(wgpu.surface);
+        {
+            ProfileScope("Present");
+            wgpuSurfacePresent(wgpu.surface);
+        }
         
         FrameCleanup(&wgpu);
+        ProfilerEndFrame();
+    }
+    
+    for(ScatterSeries* series : plot.scatter)
+        DestroyScatterSeries(series);
+    
+    for(DataStream* stream : live.streams)
+        CloseDataStream(stream);
+    for(ShmFeed* feed : live.feeds)
+        CloseShmFeed(feed);
+    
+    for(DataTable* table : dataTables)
+    {
+        FreeDataTable(table);
+        delete table;
     }
     
+    ShutdownAnalyzer(&analyzer);
+    ShutdownAnimator(&animator);
+    ShutdownFieldSolver(&solver);
+    StopDomainJobs(&wgpu.domain);
+    FreeCurves(&curves);
+    ShutdownJobSystem();
     CleanupWGPU(&wgpu);
     CleanupDearImgui();
     glfwDestroyWindow(window);
@@ -150,7 +290,7 @@ float HandleDPI()
     return scale;
 }
 
-WGPUState InitWGPU(GLFWwindow* window)
+WGPUState InitWGPU(GLFWwindow* window, DiskCache* cache)
 {
     WGPUState state = {0};
     
@@ -191,11 +331,41 @@ WGPUState InitWGPU(GLFWwindow* window)
     }
     
     // Device
+    bool hasTimestamps = wgpuAdapterHasFeature(state.adapter, WGPUFeatureName_TimestampQuery);
     {
+        // Timestamp queries are only used by the profiler, so they're optional
+        WGPUFeatureName requiredFeatures[] = { WGPUFeatureName_TimestampQuery };
+        
+        // Dawn stores what it compiles shaders and pipelines into through these,
+        // and looks there first when it compiles them again
+        WGPUDawnCacheDeviceDescriptor cacheDesc = WGPU_DAWN_CACHE_DEVICE_DESCRIPTOR_INIT;
+        cacheDesc.chain.sType = WGPUSType_DawnCacheDeviceDescriptor;
+        cacheDesc.isolationKey = "Plotter";
+        cacheDesc.functionUserdata = cache;
+        cacheDesc.loadDataFunction = [](const void* key, size_t keySize, void* value, size_t valueSize, void* userdata) -> size_t
+        {
+            // Asked for the size first, with no buffer: the header has it, the data is checked by the read
+            if(!value)
+            {
+                size_t size = 0;
+                return SizeOfDiskCache((DiskCache*)userdata, key, keySize, &size) ? size : 0;
+            }
+            
+            std::vector<uint8_t> data;
+            if(!ReadDiskCache((DiskCache*)userdata, key, keySize, &data)) return 0;
+            if(valueSize >= data.size()) memcpy(value, data.data(), data.size());
+            return data.size();
+        };
+        cacheDesc.storeDataFunction = [](const void* key, size_t keySize, const void* value, size_t valueSize, void* userdata)
+        {
+            WriteDiskCache((DiskCache*)userdata, key, keySize, value, valueSize);
+        };
+        
         WGPUDeviceDescriptor deviceDesc = WGPU_DEVICE_DESCRIPTOR_INIT;
-        deviceDesc.nextInChain = nullptr;
+        deviceDesc.nextInChain = cache->enabled ? &cacheDesc.chain : nullptr;
         deviceDesc.label = "Device";
-        deviceDesc.requiredFeatureCount = 0;
+        deviceDesc.requiredFeatureCount = hasTimestamps ? ArrayCount(requiredFeatures) : 0;
+        deviceDesc.requiredFeatures = hasTimestamps ? requiredFeatures : nullptr;
         deviceDesc.requiredLimits = nullptr;
         deviceDesc.defaultQueue.nextInChain = nullptr;
         deviceDesc.defaultQueue.label = "Default queue";
@@ -229,6 +399,16 @@ WGPUState InitWGPU(GLFWwindow* window)
     // Error callback
     wgpuDeviceSetUncapturedErrorCallback(state.device, WGPUMessageCallback, nullptr);
     
+    // Profiling
+    InitGPUProfiler(&state.gpuProfiler, state.device, hasTimestamps);
+    
+    // Plot rendering
+    WGPUTextureFormat format = wgpuSurfaceGetPreferredFormat(state.surface, state.adapter);
+    InitScatterRenderer(&state.scatter, state.device, format);
+    InitFieldRenderer(&state.fields, state.device, format);
+    InitCurveRenderer(&state.curves, state.device, format);
+    InitDomainRenderer(&state.domain, state.device, format);
+    
     // Swapchain
     int width, height;
     glfwGetFramebufferSize(window, &width, &height);
@@ -238,6 +418,12 @@ WGPUState InitWGPU(GLFWwindow* window)
 
 void CleanupWGPU(WGPUState* state)
 {
+    CleanupGPUProfiler(&state->gpuProfiler);
+    CleanupScatterRenderer(&state->scatter);
+    CleanupFieldRenderer(&state->fields);
+    CleanupCurveRenderer(&state->curves);
+    CleanupDomainRenderer(&state->domain);
+    
     wgpuQueueRelease(state->queue);
 	wgpuDeviceRelease(state->device);
 	wgpuAdapterRelease(state->adapter);
@@ -280,10 +466,13 @@ void InitDearImgui(GLFWwindow* window, const WGPUState state)
     ImGui_ImplWGPU_Init(&initInfo);
 }
 
-void RenderDearImgui(WGPUState* state)
+void RenderFrame(WGPUState* state, const Plot* plot)
 {
     // Generate the rendering data
-    ImGui::Render();
+    {
+        ProfileScope("ImGui render");
+        ImGui::Render();
+    }
     
     // Prepare frame
     wgpuSurfaceGetCurrentTexture(state->surface, &state->frame);
@@ -299,13 +488,15 @@ void RenderDearImgui(WGPUState* state)
         case WGPUSurfaceGetCurrentTextureStatus_Force32: break;
     }
     
+    ProfilerBeginZone("Encode");
+    
     state->frameView = wgpuTextureCreateView(state->frame.texture, nullptr);
     
     WGPURenderPassColorAttachment colorAttachments = WGPU_RENDER_PASS_COLOR_ATTACHMENT_INIT;
     colorAttachments.depthSlice = WGPU_DEPTH_SLICE_UNDEFINED;
     colorAttachments.loadOp = WGPULoadOp_Clear;
     colorAttachments.storeOp = WGPUStoreOp_Store;
-    colorAttachments.clearValue = { 0.5, 0.5, 0.5, 1 };
+    colorAttachments.clearValue = { 0.08, 0.08, 0.1, 1 };
     colorAttachments.view = state->frameView;
     
     WGPURenderPassDescriptor renderPassDesc = WGPU_RENDER_PASS_DESCRIPTOR_INIT;
@@ -313,17 +504,37 @@ void RenderDearImgui(WGPUState* state)
     renderPassDesc.colorAttachments = &colorAttachments;
     renderPassDesc.depthStencilAttachment = nullptr;
     
+    WGPURenderPassTimestampWrites timestampWrites;
+    GPUProfilerBeginPass(&state->gpuProfiler, &renderPassDesc, &timestampWrites);
+    
     WGPUCommandEncoderDescriptor encDesc = WGPU_COMMAND_ENCODER_DESCRIPTOR_INIT;
     state->encoder = wgpuDeviceCreateCommandEncoder(state->device, &encDesc);
     
-    // Perform actual rendering
+    // Offscreen passes have to be encoded before the frame's one
+    PrepareDomainTiles(&state->domain, state->encoder);
+    PrepareScatter(&state->scatter, state->encoder, plot);
+    
+    // Perform actual rendering, the plot goes below everything else
     state->pass = wgpuCommandEncoderBeginRenderPass(state->encoder, &renderPassDesc);
+    DrawDomainTiles(&state->domain, state->pass);
+    DrawScatter(&state->scatter, state->pass, plot);
+    DrawFieldArrows(&state->fields, state->pass);
+    DrawCurveLines(&state->curves, state->pass);
     ImGui_ImplWGPU_RenderDrawData(ImGui::GetDrawData(), state->pass);
     wgpuRenderPassEncoderEnd(state->pass);
+    GPUProfilerResolve(&state->gpuProfiler, state->encoder);
     
     WGPUCommandBufferDescriptor cmdBufferDesc = WGPU_COMMAND_BUFFER_DESCRIPTOR_INIT;
     state->cmdBuffer = wgpuCommandEncoderFinish(state->encoder, &cmdBufferDesc);
-    wgpuQueueSubmit(state->queue, 1, &state->cmdBuffer);
+    
+    ProfilerEndZone();
+    
+    {
+        ProfileScope("Submit");
+        wgpuQueueSubmit(state->queue, 1, &state->cmdBuffer);
+    }
+    
+    GPUProfilerAfterSubmit(&state->gpuProfiler);
 }
 
 void Resize(WGPUState* state, int width, int height)
@@ -360,3 +571,899 @@ void CleanupDearImgui()
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
 }
+
+static bool EndsWith(const char* str, const char* suffix)
+{
+    size_t length = strlen(str);
+    size_t suffixLength = strlen(suffix);
+    return length >= suffixLength && strcmp(str + length - suffixLength, suffix) == 0;
+}
+
+// Zooms the x range of the last item around the mouse with the wheel, pans
+// it by dragging. Returns true if the range changed.
+static bool ZoomAndPan(ImVec2 pos, ImVec2 size, double* viewMin, double* viewMax)
+{
+    double viewWidth = *viewMax - *viewMin;
+    ImGuiIO& io = ImGui::GetIO();
+    bool changed = false;
+    if(ImGui::IsItemHovered() && io.MouseWheel != 0.0f)
+    {
+        double anchor = *viewMin + (io.MousePos.x - pos.x) / size.x * viewWidth;
+        double zoom = pow(0.8, io.MouseWheel);
+        *viewMin = anchor - (anchor - *viewMin) * zoom;
+        *viewMax = anchor + (*viewMax - anchor) * zoom;
+        changed = true;
+    }
+    if(ImGui::IsItemActive() && io.MouseDelta.x != 0.0f)
+    {
+        double delta = io.MouseDelta.x / size.x * viewWidth;
+        *viewMin -= delta;
+        *viewMax -= delta;
+        changed = true;
+    }
+    
+    return changed;
+}
+
+struct PreviewState
+{
+    bool ready = false;  // The columns are picked the first time the table is shown
+    int xColumn = 0;     // 0 is the row index
+    int yColumn = 0;
+    double viewMin = 0;
+    double viewMax = 1;
+};
+
+struct ScatterControlsState
+{
+    bool ready = false;
+    int xColumn = 0;
+    int yColumn = 0;
+};
+
+struct FitControlsState
+{
+    char regression[256] = "";
+    ParamTable params;  // Fitted values, the starting point of the next fit
+    FitResult result = {};
+    char error[256] = "";
+    bool fitted = false;
+};
+
+struct HistogramState
+{
+    bool ready = false;
+    int mode = 0;
+    int xColumn = 0;
+    int yColumn = 0;
+    int bins = 100;
+    double viewMin = 0;
+    double viewMax = 1;
+    HistogramCache cache = {};
+    
+    // Of the last query, redone when stale
+    bool stale = true;
+    std::vector<double> heights;
+    std::vector<int64_t> cells;
+    int binsY = 0;
+    double ms = 0.0;
+    bool rescan = false;
+};
+
+// What the panels of one table show, by the table's id (see ShowDataWindow)
+struct TableView
+{
+    PreviewState preview;
+    HistogramState histogram;
+    ScatterControlsState scatter;
+    FitControlsState fit;
+};
+
+// Line plot of one column against another (or against the row index),
+// drawn from the min/max pyramid so the cost doesn't depend on the row count
+static void ShowDataPreview(DataTable* table, PreviewState* state)
+{
+    static std::vector<double> pointsX, pointsY;
+    
+    int columnCount = (int)table->columns.size();
+    if(columnCount == 0) return;
+    
+    std::vector<const char*> names(columnCount + 1);
+    names[0] = "(row)";
+    for(int i = 0; i < columnCount; ++i)
+        names[i + 1] = table->columns[i].name;
+    
+    bool reset = !state->ready;
+    if(reset)
+    {
+        state->ready = true;
+        state->xColumn = 0;
+        state->yColumn = columnCount > 1 ? 1 : 0;
+    }
+    state->xColumn = std::clamp(state->xColumn, 0, columnCount);
+    state->yColumn = std::clamp(state->yColumn, 0, columnCount - 1);
+    
+    ImGui::SetNextItemWidth(150.0f);
+    reset |= ImGui::Combo("x", &state->xColumn, names.data(), columnCount + 1);
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(150.0f);
+    ImGui::Combo("y", &state->yColumn, names.data() + 1, columnCount);
+    
+    // Only sorted columns work as x, which is checked when they're picked
+    const double* xs = state->xColumn > 0 ? table->columns[state->xColumn - 1].values : nullptr;
+    if(reset && xs && !std::is_sorted(xs, xs + table->rowCount))
+    {
+        state->xColumn = 0;
+        xs = nullptr;
+    }
+    
+    double& viewMin = state->viewMin;
+    double& viewMax = state->viewMax;
+    if(reset)
+    {
+        viewMin = xs ? table->columns[state->xColumn - 1].min : 0.0;
+        viewMax = xs ? table->columns[state->xColumn - 1].max : (double)table->rowCount;
+        if(!(viewMax > viewMin)) viewMax = viewMin + 1;
+    }
+    
+    ImVec2 pos = ImGui::GetCursorScreenPos();
+    ImVec2 size(ImGui::GetContentRegionAvail().x, 200.0f);
+    if(size.x < 16.0f) return;
+    ImGui::InvisibleButton("preview", size);
+    ZoomAndPan(pos, size, &viewMin, &viewMax);
+    
+    int pixels = (int)size.x;
+    const DataColumn* column = &table->columns[state->yColumn];
+    DownsampleSeries(GetDataPyramid(table, state->yColumn), xs, column->values, table->rowCount,
+                     viewMin, viewMax, pixels, Downsample_MinMax, &pointsX, &pointsY);
+    
+    double yMin = INFINITY, yMax = -INFINITY;
+    for(double y : pointsY)
+    {
+        if(y < yMin) yMin = y;
+        if(y > yMax) yMax = y;
+    }
+    if(!(yMax > yMin))
+    {
+        yMin -= 0.5;
+        yMax += 0.5;
+    }
+    
+    ImDrawList* drawList = ImGui::GetWindowDrawList();
+    ImVec2 end = pos + size;
+    drawList->AddRectFilled(pos, end, IM_COL32(20, 20, 24, 255));
+    drawList->PushClipRect(pos, end, true);
+    
+    ImU32 color = IM_COL32(90, 170, 255, 255);
+    for(size_t i = 1; i < pointsX.size(); ++i)
+    {
+        if(isnan(pointsY[i - 1]) || isnan(pointsY[i])) continue;
+        
+        ImVec2 a(pos.x + (float)((pointsX[i - 1] - viewMin) / (viewMax - viewMin)) * size.x,
+                 end.y - (float)((pointsY[i - 1] - yMin) / (yMax - yMin)) * size.y);
+        ImVec2 b(pos.x + (float)((pointsX[i] - viewMin) / (viewMax - viewMin)) * size.x,
+                 end.y - (float)((pointsY[i] - yMin) / (yMax - yMin)) * size.y);
+        drawList->AddLine(a, b, color);
+    }
+    
+    drawList->PopClipRect();
+    ImGui::Text("%d of %lld points drawn", (int)pointsX.size(), (long long)table->rowCount);
+}
+
+// Histogram or kernel density of a column, or 2D bins of two columns over
+// the range of the first one. Recomputed only when the view changes: the 1D
+// views are rebinned from the cache (see histogram.h), 2D bins go through
+// all the rows.
+static void ShowHistogram(const DataTable* table, HistogramState* state)
+{
+    static const char* modeNames[] = { "Histogram", "Density", "2D bins" };
+    
+    int columnCount = (int)table->columns.size();
+    if(columnCount == 0) return;
+    
+    std::vector<const char*> names(columnCount);
+    for(int i = 0; i < columnCount; ++i)
+        names[i] = table->columns[i].name;
+    
+    bool newColumn = !state->ready;
+    if(newColumn)
+    {
+        state->ready = true;
+        state->xColumn = 0;
+        state->yColumn = columnCount > 1 ? 1 : 0;
+    }
+    state->xColumn = std::clamp(state->xColumn, 0, columnCount - 1);
+    state->yColumn = std::clamp(state->yColumn, 0, columnCount - 1);
+    
+    int& mode = state->mode;
+    int& bins = state->bins;
+    double& viewMin = state->viewMin;
+    double& viewMax = state->viewMax;
+    HistogramCache& cache = state->cache;
+    std::vector<double>& heights = state->heights;
+    std::vector<int64_t>& cells = state->cells;
+    int& binsY = state->binsY;
+    
+    ImGui::SetNextItemWidth(110.0f);
+    bool changed = ImGui::Combo("##mode", &mode, modeNames, (int)ArrayCount(modeNames));
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(150.0f);
+    newColumn |= ImGui::Combo("Column", &state->xColumn, names.data(), columnCount);
+    if(mode == 2)
+    {
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(150.0f);
+        changed |= ImGui::Combo("against", &state->yColumn, names.data(), columnCount);
+    }
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(120.0f);
+    changed |= ImGui::SliderInt("Bins", &bins, 8, 512);
+    
+    const DataColumn* x = &table->columns[state->xColumn];
+    if(newColumn)
+    {
+        InitHistogramCache(&cache, x->values, table->rowCount, x->min, x->max);
+        viewMin = cache.dataMin;
+        viewMax = cache.dataMax;
+        if(!(viewMax > viewMin))
+        {
+            viewMin -= 0.5;
+            viewMax += 0.5;
+        }
+        changed = true;
+    }
+    
+    ImVec2 pos = ImGui::GetCursorScreenPos();
+    ImVec2 size(ImGui::GetContentRegionAvail().x, 200.0f);
+    if(size.x < 16.0f) return;
+    ImGui::InvisibleButton("histogram", size);
+    changed |= ZoomAndPan(pos, size, &viewMin, &viewMax);
+    
+    // Changes made while the panel was too narrow to draw are still pending
+    state->stale |= changed;
+    if(state->stale)
+    {
+        uint64_t start = GetTimeNs();
+        if(mode == 0)
+        {
+            state->rescan = QueryHistogram(&cache, viewMin, viewMax, bins, &heights);
+        }
+        else if(mode == 1)
+        {
+            state->rescan = QueryDensity(&cache, viewMin, viewMax, bins, 0.0, &heights);
+        }
+        else
+        {
+            const DataColumn* y = &table->columns[state->yColumn];
+            binsY = std::max(1, (int)(bins * size.y / size.x));
+            double yMin = isfinite(y->min) ? y->min : 0.0;
+            double yMax = y->max > yMin ? y->max : yMin + 1.0;
+            ComputeHistogram2D(x->values, y->values, table->rowCount, viewMin, viewMax, yMin, yMax, bins, binsY, &cells);
+            state->rescan = true;
+        }
+        state->ms = (GetTimeNs() - start) / 1e6;
+        state->stale = false;
+    }
+    
+    ImDrawList* drawList = ImGui::GetWindowDrawList();
+    ImVec2 end = pos + size;
+    drawList->AddRectFilled(pos, end, IM_COL32(20, 20, 24, 255));
+    drawList->PushClipRect(pos, end, true);
+    
+    float binWidth = size.x / bins;
+    if(mode == 2)
+    {
+        // Log scale, so sparse cells still show up next to dense ones
+        int64_t maxCount = 1;
+        for(int64_t count : cells)
+            maxCount = std::max(maxCount, count);
+        
+        float binHeight = size.y / binsY;
+        for(int j = 0; j < binsY; ++j)
+        {
+            for(int i = 0; i < bins; ++i)
+            {
+                int64_t count = cells[(size_t)j * bins + i];
+                if(count == 0) continue;
+                
+                float level = 0.15f + 0.85f * (float)(log1p((double)count) / log1p((double)maxCount));
+                ImVec2 a(pos.x + i * binWidth, end.y - (j + 1) * binHeight);
+                drawList->AddRectFilled(a, a + ImVec2(binWidth, binHeight), IM_COL32(90, 170, 255, (int)(255 * level)));
+            }
+        }
+    }
+    else
+    {
+        double maxHeight = 0.0;
+        for(double height : heights)
+            maxHeight = std::max(maxHeight, height);
+        if(maxHeight <= 0.0) maxHeight = 1.0;
+        
+        ImU32 color = IM_COL32(90, 170, 255, 255);
+        for(int i = 0; i < bins; ++i)
+        {
+            float top = end.y - (float)(heights[i] / maxHeight) * (size.y - 4.0f);
+            if(mode == 0)
+                drawList->AddRectFilled(ImVec2(pos.x + i * binWidth, top), ImVec2(pos.x + (i + 1) * binWidth - 1.0f, end.y), color);
+            else if(i > 0)
+                drawList->AddLine(ImVec2(pos.x + (i - 0.5f) * binWidth, end.y - (float)(heights[i - 1] / maxHeight) * (size.y - 4.0f)),
+                                  ImVec2(pos.x + (i + 0.5f) * binWidth, top), color);
+        }
+    }
+    
+    drawList->PopClipRect();
+    ImGui::Text("[%g, %g], %s in %.2f ms%s", viewMin, viewMax, modeNames[mode], state->ms,
+                state->rescan ? ", read the rows" : ", from the cached bins");
+    if(mode == 1)
+    {
+        ImGui::SameLine();
+        ImGui::Text("bandwidth %g", cache.bandwidth);
+    }
+}
+
+// Uploads two columns of the table as a scatter series of the main plot
+static void ShowScatterControls(const DataTable* table, ScatterControlsState* state, Plot* plot, ScatterRenderer* scatter)
+{
+    int columnCount = (int)table->columns.size();
+    if(columnCount == 0) return;
+    
+    if(!state->ready)
+    {
+        state->ready = true;
+        state->xColumn = 0;
+        state->yColumn = columnCount > 1 ? 1 : 0;
+    }
+    state->xColumn = std::clamp(state->xColumn, 0, columnCount - 1);
+    state->yColumn = std::clamp(state->yColumn, 0, columnCount - 1);
+    
+    std::vector<const char*> names(columnCount);
+    for(int i = 0; i < columnCount; ++i)
+        names[i] = table->columns[i].name;
+    
+    ImGui::SetNextItemWidth(150.0f);
+    ImGui::Combo("Scatter x", &state->xColumn, names.data(), columnCount);
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(150.0f);
+    ImGui::Combo("Scatter y", &state->yColumn, names.data(), columnCount);
+    ImGui::SameLine();
+    if(ImGui::Button("Plot"))
+    {
+        const DataColumn* x = &table->columns[state->xColumn];
+        const DataColumn* y = &table->columns[state->yColumn];
+        char name[128];
+        snprintf(name, sizeof(name), "%s, %s", x->name, y->name);
+        plot->scatter.push_back(CreateScatterSeries(scatter, name, x->valuesF32, y->valuesF32, table->rowCount));
+    }
+}
+
+// Least squares fit of a regression on the columns of the table
+static void ShowFitControls(const DataTable* table, FitControlsState* state)
+{
+    ImGui::SetNextItemWidth(-80.0f);
+    bool submit = ImGui::InputTextWithHint("##regression", "y1 ~ a x1^2 + b", state->regression, sizeof(state->regression),
+                                           ImGuiInputTextFlags_EnterReturnsTrue);
+    ImGui::SameLine();
+    if((ImGui::Button("Fit") || submit) && state->regression[0])
+    {
+        ProfileScope("Fit regression");
+        state->fitted = FitRegression(state->regression, table, &state->params, &state->result, state->error, sizeof(state->error));
+    }
+    
+    if(!state->fitted)
+    {
+        if(state->error[0]) ImGui::TextWrapped("%s", state->error);
+        return;
+    }
+    
+    const FitResult& result = state->result;
+    const ParamTable& params = state->params;
+    
+    ImGui::Text("%s, %d iteration%s over %lld rows in %.1f ms%s", result.linear ? "Linear (QR)" : "Levenberg-Marquardt",
+                result.iterations, result.iterations == 1 ? "" : "s", (long long)result.rows, result.seconds * 1e3,
+                result.converged ? "" : ", not converged");
+    ImGui::Text("R^2 = %.6f, residual sum of squares %g", result.rSquared, result.rss);
+    for(uint32_t i = 0; i < result.numParams; ++i)
+    {
+        int param = result.params[i];
+        ImGui::Text("%-8s = %.10g", params.names[param].c_str(), params.values[param]);
+    }
+}
+
+// Series reading from a source have to go before it's closed or detached
+static void RemoveLiveSeries(Plot* plot, const void* source)
+{
+    for(size_t s = 0; s < plot->scatter.size();)
+    {
+        if(plot->scatter[s]->liveSource != source)
+        {
+            ++s;
+            continue;
+        }
+        
+        DestroyScatterSeries(plot->scatter[s]);
+        plot->scatter.erase(plot->scatter.begin() + s);
+    }
+}
+
+void UpdateLiveSources(LiveSources* live, Plot* plot, ScatterRenderer* scatter)
+{
+    for(DataStream* stream : live->streams)
+        UpdateDataStream(stream);
+    
+    for(ShmFeed* feed : live->feeds)
+    {
+        if(UpdateShmFeed(feed) < 0)
+            RemoveLiveSeries(plot, feed);
+    }
+    
+    for(ScatterSeries* series : plot->scatter)
+    {
+        if(series->liveSource)
+            UploadLiveScatter(scatter, series);
+    }
+}
+
+// Channels or columns of a live source picked for x and y
+struct LiveAxes
+{
+    int index[2] = { 0, 1 };
+};
+
+static void ShowStreams(std::vector<DataStream*>* streams, Plot* plot, ScatterRenderer* scatter)
+{
+    // By stream, dropped when it's closed, so a new one at the same address starts over
+    static std::unordered_map<const DataStream*, LiveAxes> axes;
+    static char source[256] = "";
+    static int windowRows = 1000000;
+    static char error[256] = "";
+    static const char* statusNames[] = { "Waiting", "Connected", "Closed", "Error" };
+    
+    ImGui::SetNextItemWidth(-160.0f);
+    ImGui::InputText("##source", source, sizeof(source));
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(90.0f);
+    ImGui::InputInt("##window", &windowRows, 0, 0);
+    ImGui::SameLine();
+    if(ImGui::Button("Stream") && source[0])
+    {
+        windowRows = std::max(windowRows, 1);
+        error[0] = '\0';
+        DataStream* stream = OpenDataStream(source, windowRows, error, sizeof(error));
+        if(stream) streams->push_back(stream);
+    }
+    
+    if(error[0]) ImGui::TextWrapped("%s", error);
+    
+    for(size_t i = 0; i < streams->size(); ++i)
+    {
+        DataStream* stream = (*streams)[i];
+        ImGui::PushID(stream);
+        
+        int status = stream->status.load();
+        ImGui::Text("%s: %s, %.2fM rows/s, %lld rows, %llu ring stalls", stream->source, statusNames[status],
+                    stream->rowsPerSecond / 1e6, (long long)stream->window.total, (unsigned long long)stream->stalls.load());
+        if(status == Stream_Error) ImGui::TextWrapped("%s", stream->error);
+        
+        int* channels = axes[stream].index;
+        uint32_t channelCount = stream->window.channels;
+        if(channelCount > 0)
+        {
+            const char* names[Stream_MaxChannels];
+            for(uint32_t c = 0; c < channelCount; ++c)
+                names[c] = stream->names[c];
+            
+            for(int axis = 0; axis < 2; ++axis)
+            {
+                channels[axis] = std::clamp(channels[axis], 0, (int)channelCount - 1);
+                ImGui::SetNextItemWidth(120.0f);
+                ImGui::Combo(axis == 0 ? "x##channel" : "y##channel", &channels[axis], names, channelCount);
+                ImGui::SameLine();
+            }
+            
+            if(ImGui::Button("Plot"))
+            {
+                char name[128];
+                snprintf(name, sizeof(name), "%s: %s, %s", stream->source, names[channels[0]], names[channels[1]]);
+                ScatterSeries* series = CreateScatterSeries(scatter, name, nullptr, nullptr, stream->window.capacity);
+                series->liveSource = stream;
+                series->liveX = stream->window.valuesF32.data() + channels[0] * stream->window.capacity;
+                series->liveY = stream->window.valuesF32.data() + channels[1] * stream->window.capacity;
+                series->liveCapacity = stream->window.capacity;
+                series->liveTotal = &stream->window.total;
+                plot->scatter.push_back(series);
+            }
+            ImGui::SameLine();
+        }
+        
+        if(ImGui::Button("Close"))
+        {
+            RemoveLiveSeries(plot, stream);
+            axes.erase(stream);
+            CloseDataStream(stream);
+            streams->erase(streams->begin() + i);
+            ImGui::PopID();
+            break;
+        }
+        
+        ImGui::PopID();
+    }
+}
+
+// Shared memory segments from producers on the same machine, see plotter_shm.h
+static void ShowShmFeeds(std::vector<ShmFeed*>* feeds, Plot* plot, ScatterRenderer* scatter)
+{
+    // By feed, like the channels of streams
+    static std::unordered_map<const ShmFeed*, LiveAxes> axes;
+    static char name[128] = "";
+    static char error[256] = "";
+    static const char* statusNames[] = { "Attached", "Waiting", "Error" };
+    
+    ImGui::SetNextItemWidth(-160.0f);
+    ImGui::InputText("##shm", name, sizeof(name));
+    ImGui::SameLine();
+    if(ImGui::Button("Attach") && name[0])
+    {
+        error[0] = '\0';
+        ShmFeed* feed = OpenShmFeed(name, error, sizeof(error));
+        if(feed) feeds->push_back(feed);
+    }
+    
+    if(error[0]) ImGui::TextWrapped("%s", error);
+    
+    for(size_t i = 0; i < feeds->size(); ++i)
+    {
+        ShmFeed* feed = (*feeds)[i];
+        ImGui::PushID(feed);
+        
+        ImGui::Text("%s: %s, %.2fM rows/s, %lld rows", feed->name, statusNames[feed->status],
+                    feed->rowsPerSecond / 1e6, (long long)feed->total);
+        if(feed->status == ShmFeed_Error) ImGui::TextWrapped("%s", feed->error);
+        
+        int* columns = axes[feed].index;
+        if(feed->status == ShmFeed_Attached)
+        {
+            const char* names[PlotterShm_MaxColumns];
+            for(uint32_t c = 0; c < feed->columnCount; ++c)
+                names[c] = feed->names[c];
+            
+            for(int axis = 0; axis < 2; ++axis)
+            {
+                columns[axis] = std::clamp(columns[axis], 0, (int)feed->columnCount - 1);
+                ImGui::SetNextItemWidth(120.0f);
+                ImGui::Combo(axis == 0 ? "x##column" : "y##column", &columns[axis], names, feed->columnCount);
+                ImGui::SameLine();
+            }
+            
+            // The series reads the float columns right from the mapping
+            if(ImGui::Button("Plot"))
+            {
+                char seriesName[128];
+                snprintf(seriesName, sizeof(seriesName), "%s: %s, %s", feed->name, names[columns[0]], names[columns[1]]);
+                ScatterSeries* series = CreateScatterSeries(scatter, seriesName, nullptr, nullptr, feed->capacity);
+                series->liveSource = feed;
+                series->liveX = ShmFeedColumn(feed, columns[0]);
+                series->liveY = ShmFeedColumn(feed, columns[1]);
+                series->liveCapacity = feed->capacity;
+                series->liveTotal = &feed->total;
+                plot->scatter.push_back(series);
+            }
+            ImGui::SameLine();
+        }
+        
+        if(ImGui::Button("Detach"))
+        {
+            RemoveLiveSeries(plot, feed);
+            axes.erase(feed);
+            CloseShmFeed(feed);
+            feeds->erase(feeds->begin() + i);
+            ImGui::PopID();
+            break;
+        }
+        
+        ImGui::PopID();
+    }
+}
+
+void ShowDataWindow(bool* open, std::vector<DataTable*>* tables, LiveSources* live, Plot* plot, ScatterRenderer* scatter)
+{
+    if(!ImGui::Begin("Data", open))
+    {
+        ImGui::End();
+        return;
+    }
+    
+    static char path[512] = "";
+    static char status[256] = "";
+    
+    // Native files are recognized by extension, everything else is parsed as CSV
+    ImGui::SetNextItemWidth(-80.0f);
+    bool submit = ImGui::InputText("##path", path, sizeof(path), ImGuiInputTextFlags_EnterReturnsTrue);
+    ImGui::SameLine();
+    if((ImGui::Button("Open") || submit) && path[0])
+    {
+        DataTable* table = new DataTable();
+        uint64_t start = GetTimeNs();
+        bool native = EndsWith(path, Data_FileExtension);
+        bool ok = native ? LoadDataTable(path, table, status, sizeof(status)) :
+                           ImportCSV(path, table, status, sizeof(status));
+        double ms = (GetTimeNs() - start) / 1e6;
+        
+        if(ok)
+        {
+            snprintf(status, sizeof(status), "Loaded %lld rows in %.1f ms", (long long)table->rowCount, ms);
+            tables->push_back(table);
+        }
+        else
+        {
+            delete table;
+        }
+    }
+    
+    if(status[0]) ImGui::TextWrapped("%s", status);
+    
+    // Ids aren't reused, so a table opened (or a session loaded) in place of
+    // another starts with its own view. Those of closed tables are dropped.
+    static std::unordered_map<uint32_t, TableView> views;
+    std::erase_if(views, [&](const auto& entry)
+    {
+        return std::none_of(tables->begin(), tables->end(), [&](const DataTable* table) { return table->id == entry.first; });
+    });
+    
+    for(size_t i = 0; i < tables->size(); ++i)
+    {
+        DataTable* table = (*tables)[i];
+        TableView* view = &views[table->id];
+        ImGui::PushID((int)i);
+        
+        char header[128];
+        snprintf(header, sizeof(header), "Table %d: %lld rows, %d columns%s###table", (int)i + 1,
+                 (long long)table->rowCount, (int)table->columns.size(), table->isMapped ? " (mapped)" : "");
+        if(ImGui::CollapsingHeader(header))
+        {
+            for(const DataColumn& column : table->columns)
+                ImGui::Text("%-16s [%g, %g]", column.name, column.min, column.max);
+            
+            ShowDataPreview(table, &view->preview);
+            ShowHistogram(table, &view->histogram);
+            ShowScatterControls(table, &view->scatter, plot, scatter);
+            ShowFitControls(table, &view->fit);
+            
+            // Next to the file it was read from, the path typed above may be another table's by now
+            if(!table->isMapped && table->source[0] && ImGui::Button("Save"))
+            {
+                char savePath[Data_MaxPath + 8];
+                bool native = EndsWith(table->source, Data_FileExtension);
+                snprintf(savePath, sizeof(savePath), "%s%s", table->source, native ? "" : Data_FileExtension);
+                if(SaveDataTable(savePath, table))
+                    snprintf(status, sizeof(status), "Saved '%s'", savePath);
+                else
+                    snprintf(status, sizeof(status), "Could not write '%s'", savePath);
+            }
+            ImGui::SameLine();
+            if(ImGui::Button("Close"))
+            {
+                FreeDataTable(table);
+                delete table;
+                tables->erase(tables->begin() + i);
+                ImGui::PopID();
+                break;
+            }
+        }
+        
+        ImGui::PopID();
+    }
+    
+    ImGui::Separator();
+    ShowStreams(&live->streams, plot, scatter);
+    ShowShmFeeds(&live->feeds, plot, scatter);
+    
+    if(!plot->scatter.empty())
+    {
+        ImGui::Separator();
+        for(size_t i = 0; i < plot->scatter.size();)
+        {
+            if(ShowScatterSettings(plot->scatter[i]))
+            {
+                ++i;
+                continue;
+            }
+            
+            DestroyScatterSeries(plot->scatter[i]);
+            plot->scatter.erase(plot->scatter.begin() + i);
+        }
+    }
+    
+    ImGui::End();
+}
+
+// One line per expression, edited live, then a slider per parameter
+void ShowExpressionsWindow(bool* open, CurveList* curves, Analyzer* analyzer, Animator* animator, FieldSolver* solver,
+                           DomainRenderer* domain)
+{
+    if(!ImGui::Begin("Expressions", open))
+    {
+        ImGui::End();
+        return;
+    }
+    
+    for(size_t i = 0; i < curves->curves.size(); ++i)
+    {
+        Curve* curve = curves->curves[i];
+        ImGui::PushID((int)curve->id);
+        
+        ImGui::Checkbox("##visible", &curve->visible);
+        ImGui::SameLine();
+        ImGui::ColorEdit4("##color", curve->color, ImGuiColorEditFlags_NoInputs);
+        ImGui::SameLine();
+        
+        char text[Curve_MaxText];
+        memcpy(text, curve->text, sizeof(text));
+        ImGui::SetNextItemWidth(-30.0f);
+        if(ImGui::InputText("##text", text, sizeof(text)))
+            SetCurveText(curves, curve, text);
+        ImGui::SameLine();
+        if(ImGui::Button("x"))
+        {
+            RemoveCurve(curves, curve);
+            ImGui::PopID();
+            break;
+        }
+        
+        if(curve->error[0])
+            ImGui::TextColored(ImVec4(1.0f, 0.5f, 0.4f, 1.0f), "%s", curve->error);
+        if(curve->doubleDouble && curve->visible)
+            ImGui::TextDisabled("Zoomed past double precision, evaluated in double-double");
+        if(analyzer->selected == curve->id)
+            ImGui::Text("%d points of interest in view%s", (int)analyzer->visible.size(), analyzer->pendingTiles > 0 ? ", analyzing..." : "");
+        if((curve->def.kind == Def_SlopeField || curve->def.kind == Def_VectorField) && !curve->starts.empty())
+        {
+            ImGui::Text("%d solutions", (int)(curve->starts.size() / 2));
+            ImGui::SameLine();
+            if(ImGui::Button("Clear"))
+                curve->starts.clear();
+        }
+        if(domain->curve == curve->id)
+        {
+            ImGui::Checkbox("Compute on the GPU", &domain->useGpu);
+            ImGui::SameLine();
+            if(domain->onGpu) ImGui::TextDisabled("on the GPU");
+            else if(domain->pendingTiles > 0) ImGui::TextDisabled("on the CPU, %d tiles left", domain->pendingTiles);
+            else ImGui::TextDisabled("on the CPU");
+            if(curve->def.kind == Def_Iteration)
+                ImGui::SliderInt("Iterations", &domain->maxIterations, 50, 20000, "%d", ImGuiSliderFlags_Logarithmic);
+        }
+        
+        ImGui::PopID();
+    }
+    
+    if(ImGui::Button("Add"))
+        AddCurve(curves, "");
+    ImGui::SameLine();
+    ImGui::TextDisabled("Click a curve to show its zeros, extrema and intersections");
+    ImGui::TextDisabled("Click next to a slope field (y' = ...) or vector field ((x', y') = (..., ...)) to add a solution");
+    ImGui::TextDisabled("Complex functions (f(z) = ...) are drawn with domain coloring");
+    ImGui::TextDisabled("Iterated maps (z -> z^2 + c) are drawn by how fast the points escape");
+    ImGui::TextDisabled("Lists (a = [1...10]) draw the curves using them once per element");
+    
+    int method = solver->method;
+    if(ImGui::Combo("ODE solver", &method, odeMethodNames, Ode_MethodCount))
+        solver->method = (OdeMethod)method;
+    
+    ParamTable* params = &curves->params;
+    if(!params->names.empty()) ImGui::Separator();
+    for(size_t i = 0; i < params->names.size(); ++i)
+    {
+        if(!params->lists[i].empty())
+        {
+            ImGui::Text("%s: list of %d", params->names[i].c_str(), (int)params->lists[i].size());
+            continue;
+        }
+        if((int)i == animator->param)
+        {
+            ImGui::Text("%s = %.6g, animated", params->names[i].c_str(), params->values[i]);
+            continue;
+        }
+        
+        float value = (float)params->values[i];
+        if(ImGui::SliderFloat(params->names[i].c_str(), &value, -10.0f, 10.0f))
+            params->values[i] = value;
+    }
+    
+    if(!params->names.empty())
+    {
+        // Frames ahead of playback are sampled in the background, see animation.h
+        const char* preview = animator->param >= 0 ? params->names[animator->param].c_str() : "None";
+        if(ImGui::BeginCombo("Animate", preview))
+        {
+            if(ImGui::Selectable("None", animator->param < 0)) animator->param = -1;
+            for(size_t i = 0; i < params->names.size(); ++i)
+            {
+                if(!params->lists[i].empty()) continue;
+                if(ImGui::Selectable(params->names[i].c_str(), (int)i == animator->param))
+                {
+                    animator->param = (int)i;
+                    animator->frame = 0;
+                    animator->time = 0.0;
+                }
+            }
+            ImGui::EndCombo();
+        }
+    }
+    if(animator->param >= 0)
+    {
+        float range[2] = { (float)animator->min, (float)animator->max };
+        if(ImGui::DragFloat2("Range", range, 0.05f))
+        {
+            animator->min = range[0];
+            animator->max = range[1];
+        }
+        float seconds = (float)animator->seconds;
+        if(ImGui::SliderFloat("Seconds", &seconds, 1.0f, 60.0f, "%.1f"))
+            animator->seconds = seconds;
+        
+        if(ImGui::Button(animator->playing ? "Pause" : "Play"))
+            animator->playing = !animator->playing;
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(-80.0f);
+        ImGui::SliderInt("Frame", &animator->frame, 0, GetAnimationFrames(animator) - 1);
+        ImGui::TextDisabled("%d frames ready ahead", animator->bakedAhead);
+    }
+    
+    ImGui::End();
+}
+
+// Sessions are binary by extension (see session.h), anything else is text
+void ShowSessionWindow(bool* open, Session* session, const DiskCache* cache)
+{
+    if(!ImGui::Begin("Session", open))
+    {
+        ImGui::End();
+        return;
+    }
+    
+    static char path[512] = "";
+    static char status[256] = "";
+    
+    ImGui::SetNextItemWidth(-120.0f);
+    bool submit = ImGui::InputText("##path", path, sizeof(path), ImGuiInputTextFlags_EnterReturnsTrue);
+    bool binary = EndsWith(path, Session_FileExtension);
+    ImGui::SameLine();
+    if((ImGui::Button("Open") || submit) && path[0])
+    {
+        uint64_t start = GetTimeNs();
+        bool ok = binary ? LoadSession(path, session, status, sizeof(status)) :
+                           LoadSessionText(path, session, status, sizeof(status));
+        double ms = (GetTimeNs() - start) / 1e6;
+        if(ok) snprintf(status, sizeof(status), "Opened %d curves in %.1f ms", (int)session->curves->curves.size(), ms);
+    }
+    ImGui::SameLine();
+    if(ImGui::Button("Save") && path[0])
+    {
+        bool ok = binary ? SaveSession(path, session, status, sizeof(status)) :
+                           SaveSessionText(path, session, status, sizeof(status));
+        if(ok) snprintf(status, sizeof(status), "Saved '%s'", path);
+    }
+    
+    if(status[0]) ImGui::TextWrapped("%s", status);
+    ImGui::TextDisabled("%s files keep the samples, other files are text", Session_FileExtension);
+    
+    int pending = 0;
+    for(const Curve* curve : session->curves->curves)
+        pending += curve->pending ? 1 : 0;
+    if(pending > 0) ImGui::TextDisabled("%d hidden curves not compiled yet", pending);
+    
+    // Pipelines and CPU tiles from earlier runs, see diskcache.h
+    ImGui::Separator();
+    if(cache->enabled)
+    {
+        ImGui::TextDisabled("Disk cache: %llu hits, %llu misses, %llu written", (unsigned long long)cache->hits,
+                            (unsigned long long)cache->misses, (unsigned long long)cache->writes);
+        ImGui::TextDisabled("%s", cache->directory);
+    }
+    else
+    {
+        ImGui::TextDisabled("No disk cache, the cache directory couldn't be created");
+    }
+    
+    ImGui::End();
+}
@@ -0,0 +1,324 @@
+#include "ode.h"
+#include "interpreter.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+const char* odeMethodNames[Ode_MethodCount] = { "RK4", "Dormand-Prince" };
+
+#define Ode_Stages 7
+#define Ode_MinStep 1e-12  // Fraction of maxStep, below that a lane has stalled
+
+// Dormand-Prince 5(4). The last row is the 5th order solution, where the
+// derivative is the first stage of the next step (first same as last).
+static const double dpA[Ode_Stages][Ode_Stages - 1] =
+{
+    { 0 },
+    { 1.0 / 5.0 },
+    { 3.0 / 40.0, 9.0 / 40.0 },
+    { 44.0 / 45.0, -56.0 / 15.0, 32.0 / 9.0 },
+    { 19372.0 / 6561.0, -25360.0 / 2187.0, 64448.0 / 6561.0, -212.0 / 729.0 },
+    { 9017.0 / 3168.0, -355.0 / 33.0, 46732.0 / 5247.0, 49.0 / 176.0, -5103.0 / 18656.0 },
+    { 35.0 / 384.0, 0.0, 500.0 / 1113.0, 125.0 / 192.0, -2187.0 / 6784.0, 11.0 / 84.0 },
+};
+
+// Difference between the 5th and the embedded 4th order solutions
+static const double dpE[Ode_Stages] =
+{
+    71.0 / 57600.0, 0.0, -71.0 / 16695.0, 71.0 / 1920.0, -17253.0 / 339200.0, 22.0 / 525.0, -1.0 / 40.0,
+};
+
+// Structure of arrays, lanes are removed by moving the last one in their place
+struct OdeLanes
+{
+    int count;
+    std::vector<double> x, y, h;
+    std::vector<double> kx[Ode_Stages], ky[Ode_Stages];
+    std::vector<double> stageX, stageY;
+    std::vector<int> path;
+    std::vector<int> steps;
+};
+
+struct OdeSolver
+{
+    const Program* program;
+    const double* params;
+    const OdeOptions* options;
+    OdeLanes lanes;
+    std::vector<std::vector<double>> pathX, pathY;
+    double fixedStep;  // RK4
+    OdeStats stats;
+};
+
+// Derivatives at the stage points of every lane
+static void EvalStage(OdeSolver* solver, int stage)
+{
+    OdeLanes* lanes = &solver->lanes;
+    EvalInput vars[Var_Count] = { EvalArray(lanes->stageX.data()), EvalArray(lanes->stageY.data()), EvalConstant(0.0) };
+    double* outputs[2] = { lanes->kx[stage].data(), lanes->ky[stage].data() };
+    EvalBatch(solver->program, vars, solver->params, lanes->count, outputs);
+    solver->stats.evaluations += lanes->count;
+}
+
+// Stage point of each lane: x + h * sum(a[j] * k[j])
+static void StagePoints(OdeLanes* lanes, const double* a, int numTerms)
+{
+    int n = lanes->count;
+    for(int i = 0; i < n; ++i)
+    {
+        lanes->stageX[i] = 0.0;
+        lanes->stageY[i] = 0.0;
+    }
+    
+    for(int j = 0; j < numTerms; ++j)
+    {
+        if(a[j] == 0.0) continue;
+        
+        double weight = a[j];
+        const double* kx = lanes->kx[j].data();
+        const double* ky = lanes->ky[j].data();
+        for(int i = 0; i < n; ++i)
+        {
+            lanes->stageX[i] += weight * kx[i];
+            lanes->stageY[i] += weight * ky[i];
+        }
+    }
+    
+    for(int i = 0; i < n; ++i)
+    {
+        lanes->stageX[i] = lanes->x[i] + lanes->h[i] * lanes->stageX[i];
+        lanes->stageY[i] = lanes->y[i] + lanes->h[i] * lanes->stageY[i];
+    }
+}
+
+static void RemoveLane(OdeLanes* lanes, int i)
+{
+    int last = --lanes->count;
+    lanes->x[i] = lanes->x[last];
+    lanes->y[i] = lanes->y[last];
+    lanes->h[i] = lanes->h[last];
+    for(int s = 0; s < Ode_Stages; ++s)
+    {
+        lanes->kx[s][i] = lanes->kx[s][last];
+        lanes->ky[s][i] = lanes->ky[s][last];
+    }
+    lanes->path[i] = lanes->path[last];
+    lanes->steps[i] = lanes->steps[last];
+}
+
+// Distances are measured relative to the box, so that x and y count alike
+// whatever the units of the axes
+static double Speed(const OdeOptions* options, double kx, double ky)
+{
+    return hypot(kx / (options->box[1] - options->box[0]), ky / (options->box[3] - options->box[2]));
+}
+
+static bool InBox(const OdeOptions* options, double x, double y)
+{
+    return x >= options->box[0] && x <= options->box[1] && y >= options->box[2] && y <= options->box[3];
+}
+
+// Steps never cover more than maxStep, the sign of h is the direction of the lane
+static void LimitSteps(OdeSolver* solver)
+{
+    OdeLanes* lanes = &solver->lanes;
+    for(int i = 0; i < lanes->count; ++i)
+    {
+        double speed = Speed(solver->options, lanes->kx[0][i], lanes->ky[0][i]);
+        double limit = solver->options->maxStep / speed;
+        lanes->h[i] = copysign(fmin(fabs(lanes->h[i]), limit), lanes->h[i]);
+    }
+}
+
+// Ends the lanes that are done after a step, the others get the new point
+static void FinishStep(OdeSolver* solver, const uint8_t* accepted, const double* newX, const double* newY)
+{
+    OdeLanes* lanes = &solver->lanes;
+    const OdeOptions* options = solver->options;
+    for(int i = lanes->count - 1; i >= 0; --i)
+    {
+        bool done = !isfinite(newX[i]) || !isfinite(newY[i]) || !(fabs(lanes->h[i]) * Speed(options, lanes->kx[0][i], lanes->ky[0][i]) >= Ode_MinStep * options->maxStep);
+        if(!done && accepted[i])
+        {
+            lanes->x[i] = newX[i];
+            lanes->y[i] = newY[i];
+            solver->pathX[lanes->path[i]].push_back(newX[i]);
+            solver->pathY[lanes->path[i]].push_back(newY[i]);
+            done = !InBox(options, newX[i], newY[i]) || ++lanes->steps[i] >= options->maxSteps;
+        }
+        
+        if(done) RemoveLane(lanes, i);
+    }
+}
+
+static void StepRK4(OdeSolver* solver, double* newX, double* newY, uint8_t* accepted)
+{
+    static const double half[1] = { 0.5 };
+    static const double secondHalf[2] = { 0.0, 0.5 };
+    static const double full[3] = { 0.0, 0.0, 1.0 };
+    
+    OdeLanes* lanes = &solver->lanes;
+    for(int i = 0; i < lanes->count; ++i)
+        lanes->h[i] = copysign(solver->fixedStep, lanes->h[i]);
+    
+    StagePoints(lanes, half, 1);
+    EvalStage(solver, 1);
+    StagePoints(lanes, secondHalf, 2);
+    EvalStage(solver, 2);
+    StagePoints(lanes, full, 3);
+    EvalStage(solver, 3);
+    
+    static const double weights[4] = { 1.0 / 6.0, 1.0 / 3.0, 1.0 / 3.0, 1.0 / 6.0 };
+    StagePoints(lanes, weights, 4);
+    
+    int n = lanes->count;
+    for(int i = 0; i < n; ++i)
+    {
+        newX[i] = lanes->stageX[i];
+        newY[i] = lanes->stageY[i];
+        accepted[i] = 1;
+    }
+    solver->stats.steps += n;
+}
+
+static void StepDormandPrince(OdeSolver* solver, double* newX, double* newY, uint8_t* accepted)
+{
+    OdeLanes* lanes = &solver->lanes;
+    const OdeOptions* options = solver->options;
+    LimitSteps(solver);
+    for(int s = 1; s < Ode_Stages; ++s)
+    {
+        StagePoints(lanes, dpA[s], s);
+        EvalStage(solver, s);
+    }
+    
+    // The last stage was evaluated at the 5th order solution
+    double scaleX = 1.0 / (options->tolerance * (options->box[1] - options->box[0]));
+    double scaleY = 1.0 / (options->tolerance * (options->box[3] - options->box[2]));
+    int n = lanes->count;
+    for(int i = 0; i < n; ++i)
+    {
+        double errorX = 0.0, errorY = 0.0;
+        for(int s = 0; s < Ode_Stages; ++s)
+        {
+            errorX += dpE[s] * lanes->kx[s][i];
+            errorY += dpE[s] * lanes->ky[s][i];
+        }
+        
+        double error = fmax(fabs(lanes->h[i] * errorX) * scaleX, fabs(lanes->h[i] * errorY) * scaleY);
+        bool ok = error <= 1.0;
+        accepted[i] = ok;
+        newX[i] = ok || !isfinite(error) ? lanes->stageX[i] : lanes->x[i];
+        newY[i] = ok || !isfinite(error) ? lanes->stageY[i] : lanes->y[i];
+        
+        // The usual controller, growing at most 5 times per step and not at all after a rejection
+        double factor = error > 0.0 ? 0.9 * pow(error, -0.2) : 5.0;
+        lanes->h[i] *= fmin(fmax(factor, 0.2), ok ? 5.0 : 1.0);
+        
+        if(ok)
+        {
+            lanes->kx[0][i] = lanes->kx[Ode_Stages - 1][i];
+            lanes->ky[0][i] = lanes->ky[Ode_Stages - 1][i];
+            ++solver->stats.steps;
+        }
+        else
+        {
+            ++solver->stats.rejected;
+        }
+    }
+}
+
+void SolveOde(const Program* program, const double* params, const double* starts, int count,
+              const OdeOptions* options, std::vector<double>* xs, std::vector<double>* ys, OdeStats* stats)
+{
+    OdeSolver solver = {};
+    solver.program = program;
+    solver.params = params;
+    solver.options = options;
+    
+    // Lane 2i goes forwards from start i, lane 2i + 1 backwards
+    OdeLanes* lanes = &solver.lanes;
+    int numLanes = 2 * count;
+    lanes->count = numLanes;
+    lanes->x.resize(numLanes);
+    lanes->y.resize(numLanes);
+    lanes->h.resize(numLanes);
+    for(int s = 0; s < Ode_Stages; ++s)
+    {
+        lanes->kx[s].resize(numLanes);
+        lanes->ky[s].resize(numLanes);
+    }
+    lanes->stageX.resize(numLanes);
+    lanes->stageY.resize(numLanes);
+    lanes->path.resize(numLanes);
+    lanes->steps.assign(numLanes, 0);
+    solver.pathX.resize(numLanes);
+    solver.pathY.resize(numLanes);
+    
+    for(int i = 0; i < numLanes; ++i)
+    {
+        double x = starts[(i / 2) * 2], y = starts[(i / 2) * 2 + 1];
+        lanes->x[i] = lanes->stageX[i] = x;
+        lanes->y[i] = lanes->stageY[i] = y;
+        lanes->h[i] = i & 1 ? -HUGE_VAL : HUGE_VAL;
+        lanes->path[i] = i;
+        solver.pathX[i].push_back(x);
+        solver.pathY[i].push_back(y);
+    }
+    EvalStage(&solver, 0);
+    
+    // Lanes which can't move at all end right away
+    for(int i = lanes->count - 1; i >= 0; --i)
+    {
+        double speed = Speed(options, lanes->kx[0][i], lanes->ky[0][i]);
+        if(!InBox(options, lanes->x[i], lanes->y[i]) || !(speed > 0.0) || !isfinite(speed))
+            RemoveLane(lanes, i);
+    }
+    
+    // A fixed step in s, the one covering maxStep at the median speed. Limiting
+    // the distance of every step instead would make huge steps in s where the
+    // solutions are slow, which RK4 doesn't survive (small orbits, equilibria).
+    if(options->method == Ode_RK4 && lanes->count > 0)
+    {
+        std::vector<double> speeds(lanes->count);
+        for(int i = 0; i < lanes->count; ++i)
+            speeds[i] = Speed(options, lanes->kx[0][i], lanes->ky[0][i]);
+        std::nth_element(speeds.begin(), speeds.begin() + speeds.size() / 2, speeds.end());
+        solver.fixedStep = options->maxStep / speeds[speeds.size() / 2];
+    }
+    
+    std::vector<double> newX(numLanes), newY(numLanes);
+    std::vector<uint8_t> accepted(numLanes);
+    while(lanes->count > 0)
+    {
+        if(options->method == Ode_RK4) StepRK4(&solver, newX.data(), newY.data(), accepted.data());
+        else StepDormandPrince(&solver, newX.data(), newY.data(), accepted.data());
+        FinishStep(&solver, accepted.data(), newX.data(), newY.data());
+        
+        // RK4 needs the derivative at the new points, Dormand-Prince already has it
+        if(options->method == Ode_RK4 && lanes->count > 0)
+        {
+            for(int i = 0; i < lanes->count; ++i)
+            {
+                lanes->stageX[i] = lanes->x[i];
+                lanes->stageY[i] = lanes->y[i];
+            }
+            EvalStage(&solver, 0);
+        }
+    }
+    
+    for(int i = 0; i < count; ++i)
+    {
+        const std::vector<double>& backX = solver.pathX[2 * i + 1];
+        const std::vector<double>& backY = solver.pathY[2 * i + 1];
+        xs->insert(xs->end(), backX.rbegin(), backX.rend());
+        ys->insert(ys->end(), backY.rbegin(), backY.rend());
+        xs->insert(xs->end(), solver.pathX[2 * i].begin() + 1, solver.pathX[2 * i].end());
+        ys->insert(ys->end(), solver.pathY[2 * i].begin() + 1, solver.pathY[2 * i].end());
+        xs->push_back(NAN);
+        ys->push_back(NAN);
+    }
+    
+    if(stats) *stats = solver.stats;
+}
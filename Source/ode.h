@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "compiler.h"
+
+// Solutions of differential equations, many at once. The program gives
+// dx/ds and dy/ds at (x, y) (see Def_SlopeField and Def_VectorField). Every
+// start point is integrated forwards and backwards in s, each direction is a
+// lane: a stage of a step is one batch evaluation over all the lanes still
+// running, and the updates are plain loops over the lanes. Lanes stop when
+// they leave the box, stall, or run out of steps.
+//
+// RK4 takes the same step in s everywhere, sized to cover maxStep at the
+// median speed of the start points. Dormand-Prince (RK45) adapts the step of
+// each lane to the error estimate, with maxStep as an upper bound on the
+// distance so that the polylines stay smooth.
+
+enum OdeMethod
+{
+    Ode_RK4 = 0,
+    Ode_DormandPrince,
+    Ode_MethodCount
+};
+
+extern const char* odeMethodNames[Ode_MethodCount];
+
+struct OdeOptions
+{
+    OdeMethod method;
+    double box[4];     // xMin, xMax, yMin, yMax
+    double maxStep;    // Longest distance covered by one step, as a fraction of the box
+    double tolerance;  // Dormand-Prince, error per step relative to the size of the box
+    int maxSteps;      // Per lane
+};
+
+struct OdeStats
+{
+    int64_t steps;     // Accepted, over all lanes
+    int64_t rejected;
+    int64_t evaluations;  // Points the program was evaluated at
+};
+
+// starts holds count (x, y) pairs. The solutions are appended to xs and ys as
+// polylines from their backward end to their forward end, each followed by NaN.
+void SolveOde(const Program* program, const double* params, const double* starts, int count,
+              const OdeOptions* options, std::vector<double>* xs, std::vector<double>* ys, OdeStats* stats = nullptr);
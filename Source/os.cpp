@@ -0,0 +1,516 @@
+#include "os.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <dirent.h>
+#endif
+
+static void SetSharedMemoryName(const char* name, SharedMemory* out)
+{
+    snprintf(out->name, sizeof(out->name), name[0] == '/' ? "%s" : "/%s", name);
+}
+
+#ifdef _WIN32
+
+static bool MapFile(const char* path, uint64_t size, bool write, MappedFile* out)
+{
+    memset(out, 0, sizeof(MappedFile));
+    
+    DWORD access = write ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ;
+    DWORD creation = write ? CREATE_ALWAYS : OPEN_EXISTING;
+    HANDLE file = CreateFileA(path, access, FILE_SHARE_READ, nullptr, creation, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(file == INVALID_HANDLE_VALUE) return false;
+    
+    if(!write)
+    {
+        LARGE_INTEGER fileSize;
+        if(!GetFileSizeEx(file, &fileSize))
+        {
+            CloseHandle(file);
+            return false;
+        }
+        size = (uint64_t)fileSize.QuadPart;
+    }
+    
+    out->fileHandle = file;
+    out->size = size;
+    out->writable = write;
+    
+    // Empty files can't be mapped, but they're still valid files
+    if(size == 0) return true;
+    
+    DWORD protect = write ? PAGE_READWRITE : PAGE_READONLY;
+    HANDLE mapping = CreateFileMappingA(file, nullptr, protect, (DWORD)(size >> 32), (DWORD)size, nullptr);
+    if(!mapping)
+    {
+        CloseHandle(file);
+        return false;
+    }
+    
+    void* data = MapViewOfFile(mapping, write ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0);
+    if(!data)
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    
+    out->mappingHandle = mapping;
+    out->data = data;
+    return true;
+}
+
+void UnmapFile(MappedFile* file)
+{
+    if(file->data) UnmapViewOfFile(file->data);
+    if(file->mappingHandle) CloseHandle((HANDLE)file->mappingHandle);
+    if(file->fileHandle) CloseHandle((HANDLE)file->fileHandle);
+    memset(file, 0, sizeof(MappedFile));
+}
+
+bool CreateSharedMemory(const char* name, uint64_t size, SharedMemory* out)
+{
+    memset(out, 0, sizeof(SharedMemory));
+    SetSharedMemoryName(name, out);
+    
+    // Backed by the paging file, the name lives in the session namespace
+    HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)size, out->name + 1);
+    if(!mapping) return false;
+    
+    void* data = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, 0);
+    if(!data)
+    {
+        CloseHandle(mapping);
+        return false;
+    }
+    
+    out->mappingHandle = mapping;
+    out->data = data;
+    out->size = size;
+    out->owner = true;
+    return true;
+}
+
+bool OpenSharedMemory(const char* name, SharedMemory* out)
+{
+    memset(out, 0, sizeof(SharedMemory));
+    SetSharedMemoryName(name, out);
+    
+    HANDLE mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, out->name + 1);
+    if(!mapping) return false;
+    
+    void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if(!data)
+    {
+        CloseHandle(mapping);
+        return false;
+    }
+    
+    // Views are rounded up to pages, the mapping itself doesn't report a size
+    MEMORY_BASIC_INFORMATION info;
+    VirtualQuery(data, &info, sizeof(info));
+    
+    out->mappingHandle = mapping;
+    out->data = data;
+    out->size = info.RegionSize;
+    return true;
+}
+
+void CloseSharedMemory(SharedMemory* memory)
+{
+    // The mapping goes away with its last handle
+    if(memory->data) UnmapViewOfFile(memory->data);
+    if(memory->mappingHandle) CloseHandle((HANDLE)memory->mappingHandle);
+    memset(memory, 0, sizeof(SharedMemory));
+}
+
+void SetStdoutBinary()
+{
+    fflush(stdout);
+    _setmode(_fileno(stdout), _O_BINARY);
+}
+
+bool OpenStreamFile(const char* path, OSStream* out)
+{
+    memset(out, 0, sizeof(OSStream));
+    
+    HANDLE handle;
+    if(strcmp(path, "-") == 0)
+        handle = GetStdHandle(STD_INPUT_HANDLE);
+    else
+        handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(handle == INVALID_HANDLE_VALUE || handle == nullptr) return false;
+    
+    out->handle = handle;
+    out->isPipe = GetFileType(handle) == FILE_TYPE_PIPE;
+    return true;
+}
+
+bool ListenUnixSocket(const char* path, OSStream* out)
+{
+    memset(out, 0, sizeof(OSStream));
+    return false;
+}
+
+int64_t ReadStream(OSStream* stream, void* buffer, int64_t size, int timeoutMs)
+{
+    // Pipes are polled, so the reads never block for longer than the timeout
+    DWORD available = (DWORD)size;
+    if(stream->isPipe)
+    {
+        if(!PeekNamedPipe((HANDLE)stream->handle, nullptr, 0, nullptr, &available, nullptr)) return -1;
+        if(available == 0)
+        {
+            if(timeoutMs > 0) Sleep(1);
+            return 0;
+        }
+        if(available > (DWORD)size) available = (DWORD)size;
+    }
+    
+    DWORD read = 0;
+    if(!ReadFile((HANDLE)stream->handle, buffer, available, &read, nullptr)) return -1;
+    return read == 0 ? -1 : (int64_t)read;
+}
+
+void CloseStream(OSStream* stream)
+{
+    if(stream->handle && stream->handle != GetStdHandle(STD_INPUT_HANDLE)) CloseHandle((HANDLE)stream->handle);
+    memset(stream, 0, sizeof(OSStream));
+}
+
+bool GetCacheDirectory(char* out, int size)
+{
+    const char* local = getenv("LOCALAPPDATA");
+    if(!local || !local[0]) return false;
+    
+    snprintf(out, size, "%s", local);
+    return true;
+}
+
+bool MakeDirectory(const char* path)
+{
+    return CreateDirectoryA(path, nullptr) || GetLastError() == ERROR_ALREADY_EXISTS;
+}
+
+bool ListDirectory(const char* path, std::vector<DirectoryEntry>* out)
+{
+    out->clear();
+    
+    char pattern[1024];
+    snprintf(pattern, sizeof(pattern), "%s\\*", path);
+    WIN32_FIND_DATAA found;
+    HANDLE find = FindFirstFileA(pattern, &found);
+    if(find == INVALID_HANDLE_VALUE) return false;
+    
+    do
+    {
+        if(found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) continue;
+        
+        DirectoryEntry entry = {};
+        snprintf(entry.name, sizeof(entry.name), "%s", found.cFileName);
+        entry.size = ((uint64_t)found.nFileSizeHigh << 32) | found.nFileSizeLow;
+        uint64_t written = ((uint64_t)found.ftLastWriteTime.dwHighDateTime << 32) | found.ftLastWriteTime.dwLowDateTime;
+        entry.modified = written / 10000000;  // From 100 ns intervals
+        out->push_back(entry);
+    }
+    while(FindNextFileA(find, &found));
+    
+    FindClose(find);
+    return true;
+}
+
+bool ReplaceFileWith(const char* to, const char* from)
+{
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+#else
+
+static bool MapFile(const char* path, uint64_t size, bool write, MappedFile* out)
+{
+    memset(out, 0, sizeof(MappedFile));
+    out->fd = -1;
+    
+    int fd = write ? open(path, O_RDWR | O_CREAT | O_TRUNC, 0644) : open(path, O_RDONLY);
+    if(fd == -1) return false;
+    
+    if(write)
+    {
+        if(ftruncate(fd, (off_t)size) != 0)
+        {
+            close(fd);
+            return false;
+        }
+    }
+    else
+    {
+        struct stat info;
+        if(fstat(fd, &info) != 0)
+        {
+            close(fd);
+            return false;
+        }
+        size = (uint64_t)info.st_size;
+    }
+    
+    out->fd = fd;
+    out->size = size;
+    out->writable = write;
+    
+    // Empty files can't be mapped, but they're still valid files
+    if(size == 0) return true;
+    
+    int protect = write ? PROT_READ | PROT_WRITE : PROT_READ;
+    void* data = mmap(nullptr, size, protect, MAP_SHARED, fd, 0);
+    if(data == MAP_FAILED)
+    {
+        close(fd);
+        out->fd = -1;
+        return false;
+    }
+    
+    out->data = data;
+    return true;
+}
+
+void UnmapFile(MappedFile* file)
+{
+    if(file->data) munmap(file->data, file->size);
+    if(file->fd != -1) close(file->fd);
+    memset(file, 0, sizeof(MappedFile));
+    file->fd = -1;
+}
+
+bool CreateSharedMemory(const char* name, uint64_t size, SharedMemory* out)
+{
+    memset(out, 0, sizeof(SharedMemory));
+    out->fd = -1;
+    SetSharedMemoryName(name, out);
+    
+    // A leftover segment could be bigger, start from a new one
+    shm_unlink(out->name);
+    int fd = shm_open(out->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if(fd == -1) return false;
+    
+    void* data = ftruncate(fd, (off_t)size) == 0 ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    if(data == MAP_FAILED)
+    {
+        close(fd);
+        shm_unlink(out->name);
+        return false;
+    }
+    
+    out->fd = fd;
+    out->data = data;
+    out->size = size;
+    out->owner = true;
+    return true;
+}
+
+bool OpenSharedMemory(const char* name, SharedMemory* out)
+{
+    memset(out, 0, sizeof(SharedMemory));
+    out->fd = -1;
+    SetSharedMemoryName(name, out);
+    
+    int fd = shm_open(out->name, O_RDONLY, 0);
+    if(fd == -1) return false;
+    
+    struct stat info;
+    if(fstat(fd, &info) != 0 || info.st_size <= 0)
+    {
+        close(fd);
+        return false;
+    }
+    
+    void* data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if(data == MAP_FAILED)
+    {
+        close(fd);
+        return false;
+    }
+    
+    out->fd = fd;
+    out->data = data;
+    out->size = (uint64_t)info.st_size;
+    return true;
+}
+
+void CloseSharedMemory(SharedMemory* memory)
+{
+    if(memory->data) munmap(memory->data, memory->size);
+    if(memory->fd != -1) close(memory->fd);
+    if(memory->owner) shm_unlink(memory->name);
+    memset(memory, 0, sizeof(SharedMemory));
+    memory->fd = -1;
+}
+
+void SetStdoutBinary()
+{
+    // Nothing to do, there's no text mode
+}
+
+bool OpenStreamFile(const char* path, OSStream* out)
+{
+    memset(out, 0, sizeof(OSStream));
+    out->fd = -1;
+    out->listenFd = -1;
+    
+    // Non blocking, otherwise opening a FIFO waits for a writer
+    int fd = strcmp(path, "-") == 0 ? dup(STDIN_FILENO) : open(path, O_RDONLY | O_NONBLOCK);
+    if(fd == -1) return false;
+    
+    struct stat info;
+    out->fd = fd;
+    out->waitForWriter = fstat(fd, &info) == 0 && S_ISFIFO(info.st_mode);
+    return true;
+}
+
+bool ListenUnixSocket(const char* path, OSStream* out)
+{
+    memset(out, 0, sizeof(OSStream));
+    out->fd = -1;
+    out->listenFd = -1;
+    
+    struct sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if(strlen(path) >= sizeof(address.sun_path)) return false;
+    strcpy(address.sun_path, path);
+    
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd == -1) return false;
+    
+    // Leftover from a previous run
+    unlink(path);
+    
+    if(bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(fd, 1) != 0)
+    {
+        close(fd);
+        return false;
+    }
+    
+    out->listenFd = fd;
+    return true;
+}
+
+int64_t ReadStream(OSStream* stream, void* buffer, int64_t size, int timeoutMs)
+{
+    if(stream->fd == -1)
+    {
+        if(stream->listenFd == -1) return -1;
+        
+        struct pollfd listenPoll = { stream->listenFd, POLLIN, 0 };
+        if(poll(&listenPoll, 1, timeoutMs) <= 0) return 0;
+        
+        stream->fd = accept(stream->listenFd, nullptr, nullptr);
+        if(stream->fd == -1) return 0;
+    }
+    
+    struct pollfd readPoll = { stream->fd, POLLIN, 0 };
+    int ready = poll(&readPoll, 1, timeoutMs);
+    if(ready < 0) return errno == EINTR ? 0 : -1;
+    if(ready == 0) return 0;
+    
+    ssize_t bytes = read(stream->fd, buffer, (size_t)size);
+    if(bytes > 0)
+    {
+        stream->waitForWriter = false;
+        return bytes;
+    }
+    if(bytes < 0 && (errno == EAGAIN || errno == EINTR)) return 0;
+    
+    // Nobody has opened the FIFO for writing yet, poll keeps reporting a hang up
+    if(bytes == 0 && stream->waitForWriter)
+    {
+        usleep(timeoutMs * 1000);
+        return 0;
+    }
+    
+    return -1;
+}
+
+void CloseStream(OSStream* stream)
+{
+    if(stream->fd != -1) close(stream->fd);
+    if(stream->listenFd != -1) close(stream->listenFd);
+    memset(stream, 0, sizeof(OSStream));
+    stream->fd = -1;
+    stream->listenFd = -1;
+}
+
+bool GetCacheDirectory(char* out, int size)
+{
+    const char* home = getenv("HOME");
+#ifdef __APPLE__
+    if(!home || !home[0]) return false;
+    snprintf(out, size, "%s/Library/Caches", home);
+#else
+    const char* xdg = getenv("XDG_CACHE_HOME");
+    if(xdg && xdg[0]) snprintf(out, size, "%s", xdg);
+    else if(home && home[0]) snprintf(out, size, "%s/.cache", home);
+    else return false;
+#endif
+    return true;
+}
+
+bool MakeDirectory(const char* path)
+{
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+
+bool ListDirectory(const char* path, std::vector<DirectoryEntry>* out)
+{
+    out->clear();
+    
+    DIR* dir = opendir(path);
+    if(!dir) return false;
+    
+    while(struct dirent* found = readdir(dir))
+    {
+        char filePath[1024];
+        snprintf(filePath, sizeof(filePath), "%s/%s", path, found->d_name);
+        struct stat info;
+        if(stat(filePath, &info) != 0 || !S_ISREG(info.st_mode)) continue;
+        
+        DirectoryEntry entry = {};
+        snprintf(entry.name, sizeof(entry.name), "%s", found->d_name);
+        entry.size = (uint64_t)info.st_size;
+        entry.modified = (uint64_t)info.st_mtime;
+        out->push_back(entry);
+    }
+    
+    closedir(dir);
+    return true;
+}
+
+bool ReplaceFileWith(const char* to, const char* from)
+{
+    return rename(from, to) == 0;
+}
+
+#endif
+
+bool MapFileRead(const char* path, MappedFile* out)
+{
+    return MapFile(path, 0, false, out);
+}
+
+bool MapFileWrite(const char* path, uint64_t size, MappedFile* out)
+{
+    return MapFile(path, size, true, out);
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// Platform specific functionality
+
+struct MappedFile
+{
+    void* data;
+    uint64_t size;
+    bool writable;
+    
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#else
+    int fd;
+#endif
+};
+
+// Maps an existing file for reading
+bool MapFileRead(const char* path, MappedFile* out);
+// Creates (or truncates) a file of the given size and maps it for writing
+bool MapFileWrite(const char* path, uint64_t size, MappedFile* out);
+void UnmapFile(MappedFile* file);
+
+// Named shared memory, shm_open on POSIX systems and named file mappings on
+// windows. Names are "/name" style, the slash is added when missing.
+struct SharedMemory
+{
+    void* data;
+    uint64_t size;
+    bool owner;  // Created it, so it's removed on close
+    char name[128];
+    
+#ifdef _WIN32
+    void* mappingHandle;
+#else
+    int fd;
+#endif
+};
+
+// Creates (or replaces) a segment of the given size and maps it for writing
+bool CreateSharedMemory(const char* name, uint64_t size, SharedMemory* out);
+// Maps an existing segment for reading
+bool OpenSharedMemory(const char* name, SharedMemory* out);
+void CloseSharedMemory(SharedMemory* memory);
+
+// Stdout is opened in text mode on windows, which mangles binary output
+void SetStdoutBinary();
+
+// Byte streams from other processes, read with a timeout so reader threads
+// can notice when they should stop
+struct OSStream
+{
+#ifdef _WIN32
+    void* handle;
+    bool isPipe;
+#else
+    int fd;
+    int listenFd;
+    bool waitForWriter;  // FIFOs report end of file until a writer shows up
+#endif
+};
+
+// FIFOs, named pipes (\\.\pipe\name on windows), regular files or "-" for stdin
+bool OpenStreamFile(const char* path, OSStream* out);
+// Not supported on windows. The first connection is accepted by ReadStream.
+bool ListenUnixSocket(const char* path, OSStream* out);
+// Returns the number of bytes read, 0 if nothing arrived within the timeout
+// and -1 once the stream is closed
+int64_t ReadStream(OSStream* stream, void* buffer, int64_t size, int timeoutMs);
+void CloseStream(OSStream* stream);
+
+// Files and directories, for the disk cache (see diskcache.h)
+struct DirectoryEntry
+{
+    char name[256];
+    uint64_t size;
+    uint64_t modified;  // Seconds, only for comparing with each other
+};
+
+// Where the user's caches go: %LOCALAPPDATA% on windows, ~/Library/Caches on
+// macOS, $XDG_CACHE_HOME or ~/.cache elsewhere
+bool GetCacheDirectory(char* out, int size);
+// Succeeds when it already exists, parents aren't created
+bool MakeDirectory(const char* path);
+// The regular files in the directory, not its subdirectories
+bool ListDirectory(const char* path, std::vector<DirectoryEntry>* out);
+// Renames from over to, readers see either file whole
+bool ReplaceFileWith(const char* to, const char* from);
@@ -0,0 +1,1647 @@
+#include "parser.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <assert.h>
+
+const OpInfo opInfos[Op_Count] =
+{
+    { "const", 0 },
+    { "var",   0 },
+    { "param", 0 },
+    { "bound", 0 },
+    
+    { "neg", 1 },
+    { "+",   2 },
+    { "-",   2 },
+    { "*",   2 },
+    { "/",   2 },
+    { "^",   2 },
+    
+    // Names of the functions as they're written in expressions
+    { "sqrt",  1 },
+    { "abs",   1 },
+    { "exp",   1 },
+    { "ln",    1 },
+    { "log",   1 },
+    { "log2",  1 },
+    { "sin",   1 },
+    { "cos",   1 },
+    { "tan",   1 },
+    { "asin",  1 },
+    { "acos",  1 },
+    { "atan",  1 },
+    { "atan2", 2 },
+    { "sinh",  1 },
+    { "cosh",  1 },
+    { "tanh",  1 },
+    { "floor", 1 },
+    { "ceil",  1 },
+    { "round", 1 },
+    { "sign",  1 },
+    { "min",   2 },
+    { "max",   2 },
+    { "mod",   2 },
+    
+    { "<",      2 },
+    { "<=",     2 },
+    { ">",      2 },
+    { ">=",     2 },
+    { "==",     2 },
+    { "and",    2 },
+    { "select", 3 },
+    
+    { "integral", 2 },
+    { "sum",      2 },
+};
+
+const char* varNames[Var_Count] = { "x", "y", "t" };
+
+AstRef AstConst(Ast* ast, double value)
+{
+    AstNode node = {};
+    node.op = Op_Const;
+    node.value = value;
+    ast->nodes.push_back(node);
+    return (AstRef)(ast->nodes.size() - 1);
+}
+
+AstRef AstLeaf(Ast* ast, OpCode op, uint32_t index)
+{
+    assert(op == Op_Var || op == Op_Param || op == Op_Bound);
+    
+    AstNode node = {};
+    node.op = op;
+    node.index = index;
+    ast->nodes.push_back(node);
+    return (AstRef)(ast->nodes.size() - 1);
+}
+
+AstRef AstOp(Ast* ast, OpCode op, AstRef a, AstRef b, AstRef c)
+{
+    AstNode node = {};
+    node.op = op;
+    node.childCount = (uint8_t)opInfos[op].arity;
+    node.children[0] = a;
+    node.children[1] = b;
+    node.children[2] = c;
+    assert(node.childCount == 0 || a != Ast_Null);
+    assert(node.childCount <= 1 || b != Ast_Null);
+    assert(node.childCount <= 2 || c != Ast_Null);
+    ast->nodes.push_back(node);
+    return (AstRef)(ast->nodes.size() - 1);
+}
+
+AstRef AstBinding(Ast* ast, OpCode op, AstRef first, AstRef last, AstRef body, uint32_t slot)
+{
+    assert(op == Op_Integral || op == Op_Sum);
+    assert(slot < Ast_MaxBindings);
+    
+    // The body is a child too, so that walking the tree sees what it depends on
+    AstRef result = AstOp(ast, op, first, last);
+    AstNode* node = &ast->nodes[result];
+    node->childCount = 3;
+    node->children[2] = body;
+    node->index = slot;
+    return result;
+}
+
+bool AstDependsOn(const Ast* ast, AstRef ref, OpCode leafOp, uint32_t index)
+{
+    const AstNode* node = &ast->nodes[ref];
+    if(node->op == leafOp) return node->index == index;
+    
+    for(int i = 0; i < node->childCount; ++i)
+    {
+        if(AstDependsOn(ast, node->children[i], leafOp, index))
+            return true;
+    }
+    
+    return false;
+}
+
+// Copy of the tree with the variable bound in the given slot replaced by value
+static AstRef AstSubstitute(Ast* ast, AstRef ref, uint32_t slot, AstRef value)
+{
+    AstNode node = ast->nodes[ref];
+    if(node.op == Op_Bound) return node.index == slot ? value : ref;
+    
+    bool changed = false;
+    for(int i = 0; i < node.childCount; ++i)
+    {
+        AstRef child = AstSubstitute(ast, node.children[i], slot, value);
+        changed |= child != node.children[i];
+        node.children[i] = child;
+    }
+    
+    if(!changed) return ref;
+    ast->nodes.push_back(node);
+    return (AstRef)(ast->nodes.size() - 1);
+}
+
+// Zero derivatives are Ast_Null, these keep them from spreading into the tree
+static AstRef DerivAdd(Ast* ast, AstRef a, AstRef b)
+{
+    if(a == Ast_Null) return b;
+    if(b == Ast_Null) return a;
+    return AstOp(ast, Op_Add, a, b);
+}
+
+static AstRef DerivSub(Ast* ast, AstRef a, AstRef b)
+{
+    if(b == Ast_Null) return a;
+    if(a == Ast_Null) return AstOp(ast, Op_Neg, b);
+    return AstOp(ast, Op_Sub, a, b);
+}
+
+static AstRef DerivMul(Ast* ast, AstRef a, AstRef b)
+{
+    if(a == Ast_Null || b == Ast_Null) return Ast_Null;
+    return AstOp(ast, Op_Mul, a, b);
+}
+
+static AstRef DerivDiv(Ast* ast, AstRef a, AstRef b)
+{
+    if(a == Ast_Null) return Ast_Null;
+    return AstOp(ast, Op_Div, a, b);
+}
+
+AstRef AstDerivative(Ast* ast, AstRef ref, OpCode leafOp, uint32_t index)
+{
+    // Copied, nodes move when the tree grows
+    AstNode node = ast->nodes[ref];
+    if(node.op == Op_Const || node.op == Op_Var || node.op == Op_Param || node.op == Op_Bound)
+        return node.op == leafOp && node.index == index ? AstConst(ast, 1.0) : Ast_Null;
+    
+    AstRef a = node.children[0];
+    AstRef b = node.children[1];
+    AstRef c = node.children[2];
+    AstRef da = node.childCount > 0 ? AstDerivative(ast, a, leafOp, index) : Ast_Null;
+    AstRef db = node.childCount > 1 ? AstDerivative(ast, b, leafOp, index) : Ast_Null;
+    
+    switch(node.op)
+    {
+        case Op_Neg: return da == Ast_Null ? Ast_Null : AstOp(ast, Op_Neg, da);
+        case Op_Add: return DerivAdd(ast, da, db);
+        case Op_Sub: return DerivSub(ast, da, db);
+        case Op_Mul: return DerivAdd(ast, DerivMul(ast, da, b), DerivMul(ast, a, db));
+        case Op_Div:
+        {
+            // a'/b - a b'/b^2
+            AstRef quotient = DerivDiv(ast, DerivMul(ast, ref, db), b);
+            return DerivSub(ast, DerivDiv(ast, da, b), quotient);
+        }
+        case Op_Pow:
+        {
+            // Constant exponents are the common case: b a^(b-1) a'
+            if(db == Ast_Null)
+            {
+                AstRef power = AstOp(ast, Op_Pow, a, AstOp(ast, Op_Sub, b, AstConst(ast, 1.0)));
+                return DerivMul(ast, AstOp(ast, Op_Mul, b, power), da);
+            }
+            
+            // a^b (b' ln(a) + b a'/a)
+            AstRef inner = DerivAdd(ast, DerivMul(ast, db, AstOp(ast, Op_Ln, a)), DerivDiv(ast, DerivMul(ast, b, da), a));
+            return DerivMul(ast, ref, inner);
+        }
+        case Op_Sqrt:  return DerivDiv(ast, da, AstOp(ast, Op_Mul, AstConst(ast, 2.0), ref));
+        case Op_Abs:   return DerivMul(ast, AstOp(ast, Op_Sign, a), da);
+        case Op_Exp:   return DerivMul(ast, ref, da);
+        case Op_Ln:    return DerivDiv(ast, da, a);
+        case Op_Log10: return DerivDiv(ast, da, AstOp(ast, Op_Mul, a, AstConst(ast, 2.30258509299404568402)));
+        case Op_Log2:  return DerivDiv(ast, da, AstOp(ast, Op_Mul, a, AstConst(ast, 0.69314718055994530942)));
+        case Op_Sin:   return DerivMul(ast, AstOp(ast, Op_Cos, a), da);
+        case Op_Cos:   return DerivMul(ast, AstOp(ast, Op_Neg, AstOp(ast, Op_Sin, a)), da);
+        case Op_Tan:   return DerivMul(ast, AstOp(ast, Op_Add, AstConst(ast, 1.0), AstOp(ast, Op_Mul, ref, ref)), da);
+        case Op_Asin:
+        case Op_Acos:
+        {
+            AstRef root = AstOp(ast, Op_Sqrt, AstOp(ast, Op_Sub, AstConst(ast, 1.0), AstOp(ast, Op_Mul, a, a)));
+            AstRef result = DerivDiv(ast, da, root);
+            return node.op == Op_Acos && result != Ast_Null ? AstOp(ast, Op_Neg, result) : result;
+        }
+        case Op_Atan:  return DerivDiv(ast, da, AstOp(ast, Op_Add, AstConst(ast, 1.0), AstOp(ast, Op_Mul, a, a)));
+        case Op_Atan2:
+        {
+            // atan2(a, b): (b a' - a b') / (a^2 + b^2)
+            AstRef numerator = DerivSub(ast, DerivMul(ast, b, da), DerivMul(ast, a, db));
+            return DerivDiv(ast, numerator, AstOp(ast, Op_Add, AstOp(ast, Op_Mul, a, a), AstOp(ast, Op_Mul, b, b)));
+        }
+        case Op_Sinh:  return DerivMul(ast, AstOp(ast, Op_Cosh, a), da);
+        case Op_Cosh:  return DerivMul(ast, AstOp(ast, Op_Sinh, a), da);
+        case Op_Tanh:  return DerivMul(ast, AstOp(ast, Op_Sub, AstConst(ast, 1.0), AstOp(ast, Op_Mul, ref, ref)), da);
+        case Op_Min:
+        case Op_Max:
+        {
+            if(da == Ast_Null && db == Ast_Null) return Ast_Null;
+            AstRef pickA = AstOp(ast, node.op == Op_Min ? Op_Less : Op_Greater, a, b);
+            return AstOp(ast, Op_Select, pickA, da != Ast_Null ? da : AstConst(ast, 0.0), db != Ast_Null ? db : AstConst(ast, 0.0));
+        }
+        case Op_Mod:   return DerivSub(ast, da, DerivMul(ast, db, AstOp(ast, Op_Floor, AstOp(ast, Op_Div, a, b))));
+        case Op_Select:
+        {
+            AstRef dc = AstDerivative(ast, c, leafOp, index);
+            if(db == Ast_Null && dc == Ast_Null) return Ast_Null;
+            return AstOp(ast, Op_Select, a, db != Ast_Null ? db : AstConst(ast, 0.0), dc != Ast_Null ? dc : AstConst(ast, 0.0));
+        }
+        case Op_Integral:
+        {
+            // Leibniz rule: f(b) b' - f(a) a' plus the integral of the derivative of f
+            AstRef dc = AstDerivative(ast, c, leafOp, index);
+            AstRef result = dc != Ast_Null ? AstBinding(ast, Op_Integral, a, b, dc, node.index) : Ast_Null;
+            if(db != Ast_Null) result = DerivAdd(ast, result, DerivMul(ast, AstSubstitute(ast, c, node.index, b), db));
+            if(da != Ast_Null) result = DerivSub(ast, result, DerivMul(ast, AstSubstitute(ast, c, node.index, a), da));
+            return result;
+        }
+        case Op_Sum:
+        {
+            // The bounds only move in steps
+            AstRef dc = AstDerivative(ast, c, leafOp, index);
+            return dc != Ast_Null ? AstBinding(ast, Op_Sum, a, b, dc, node.index) : Ast_Null;
+        }
+        
+        // Piecewise constant, the derivative is zero almost everywhere
+        default: return Ast_Null;
+    }
+}
+
+// Complex values as their real and imaginary parts. Ast_Null is zero like
+// for derivatives, so the parts of an expression that are real stay real
+// operations instead of being carried along with a zero imaginary part.
+struct ComplexNode
+{
+    AstRef re;
+    AstRef im;
+};
+
+struct ComplexLowering
+{
+    Ast* ast;
+    std::vector<ComplexNode> lowered;  // Of the nodes of the parsed tree
+    std::vector<bool> done;
+    const char* error;  // Name of the first function which needed real arguments
+};
+
+static AstRef OrZero(Ast* ast, AstRef ref)
+{
+    return ref != Ast_Null ? ref : AstConst(ast, 0.0);
+}
+
+static ComplexNode ComplexMul(Ast* ast, ComplexNode a, ComplexNode b)
+{
+    return { DerivSub(ast, DerivMul(ast, a.re, b.re), DerivMul(ast, a.im, b.im)),
+             DerivAdd(ast, DerivMul(ast, a.re, b.im), DerivMul(ast, a.im, b.re)) };
+}
+
+// (a + bi) / (c + di) = ((ac + bd) + (bc - ad) i) / (c^2 + d^2)
+static ComplexNode ComplexDiv(Ast* ast, ComplexNode a, ComplexNode b)
+{
+    if(b.im == Ast_Null)
+    {
+        AstRef divisor = OrZero(ast, b.re);
+        return { DerivDiv(ast, a.re, divisor), DerivDiv(ast, a.im, divisor) };
+    }
+    
+    AstRef norm = DerivAdd(ast, DerivMul(ast, b.re, b.re), AstOp(ast, Op_Mul, b.im, b.im));
+    AstRef re = DerivAdd(ast, DerivMul(ast, a.re, b.re), DerivMul(ast, a.im, b.im));
+    AstRef im = DerivSub(ast, DerivMul(ast, a.im, b.re), DerivMul(ast, a.re, b.im));
+    return { DerivDiv(ast, re, norm), DerivDiv(ast, im, norm) };
+}
+
+static AstRef ComplexAbs(Ast* ast, ComplexNode a)
+{
+    if(a.im == Ast_Null) return AstOp(ast, Op_Abs, OrZero(ast, a.re));
+    if(a.re == Ast_Null) return AstOp(ast, Op_Abs, a.im);
+    return AstOp(ast, Op_Sqrt, AstOp(ast, Op_Add, AstOp(ast, Op_Mul, a.re, a.re), AstOp(ast, Op_Mul, a.im, a.im)));
+}
+
+static ComplexNode ComplexExp(Ast* ast, ComplexNode a)
+{
+    AstRef scale = a.re != Ast_Null ? AstOp(ast, Op_Exp, a.re) : Ast_Null;
+    if(a.im == Ast_Null) return { scale != Ast_Null ? scale : AstConst(ast, 1.0), Ast_Null };
+    
+    AstRef cosine = AstOp(ast, Op_Cos, a.im), sine = AstOp(ast, Op_Sin, a.im);
+    if(scale == Ast_Null) return { cosine, sine };
+    return { AstOp(ast, Op_Mul, scale, cosine), AstOp(ast, Op_Mul, scale, sine) };
+}
+
+// Principal branch, the cut is along the negative reals
+static ComplexNode ComplexLn(Ast* ast, ComplexNode a)
+{
+    const AstNode* re = a.re != Ast_Null ? &ast->nodes[a.re] : nullptr;
+    if(a.im == Ast_Null && re && re->op == Op_Const && re->value > 0.0) return { AstOp(ast, Op_Ln, a.re), Ast_Null };
+    
+    AstRef angle = AstOp(ast, Op_Atan2, OrZero(ast, a.im), OrZero(ast, a.re));
+    return { AstOp(ast, Op_Ln, ComplexAbs(ast, a)), angle };
+}
+
+// Principal root. The larger part is the root of half the modulus plus the
+// magnitude of the real part, the other one is divided out of it so nothing cancels.
+static ComplexNode ComplexSqrt(Ast* ast, ComplexNode a)
+{
+    AstRef re = OrZero(ast, a.re);
+    AstRef half = AstConst(ast, 0.5);
+    if(a.im == Ast_Null)
+    {
+        AstRef modulus = AstOp(ast, Op_Abs, re);
+        return { AstOp(ast, Op_Sqrt, AstOp(ast, Op_Mul, AstOp(ast, Op_Add, modulus, re), half)),
+                 AstOp(ast, Op_Sqrt, AstOp(ast, Op_Mul, AstOp(ast, Op_Sub, modulus, re), half)) };
+    }
+    
+    AstRef large = AstOp(ast, Op_Sqrt, AstOp(ast, Op_Mul, AstOp(ast, Op_Add, ComplexAbs(ast, a), AstOp(ast, Op_Abs, re)), half));
+    AstRef small = AstOp(ast, Op_Div, a.im, AstOp(ast, Op_Mul, large, AstConst(ast, 2.0)));
+    AstRef positive = AstOp(ast, Op_GreaterEqual, re, AstConst(ast, 0.0));
+    AstRef signedLarge = AstOp(ast, Op_Select, AstOp(ast, Op_Less, a.im, AstConst(ast, 0.0)), AstOp(ast, Op_Neg, large), large);
+    return { AstOp(ast, Op_Select, positive, large, AstOp(ast, Op_Abs, small)),
+             AstOp(ast, Op_Select, positive, small, signedLarge) };
+}
+
+static ComplexNode ComplexAddReal(Ast* ast, ComplexNode a, double value)
+{
+    return { DerivAdd(ast, a.re, AstConst(ast, value)), a.im };
+}
+
+static ComplexNode ComplexScale(Ast* ast, ComplexNode a, double value)
+{
+    AstRef factor = AstConst(ast, value);
+    return { DerivMul(ast, a.re, factor), DerivMul(ast, a.im, factor) };
+}
+
+// i a
+static ComplexNode ComplexRotate(Ast* ast, ComplexNode a)
+{
+    return { a.im != Ast_Null ? AstOp(ast, Op_Neg, a.im) : Ast_Null, a.re };
+}
+
+// asin z = -i ln(iz + sqrt(1 - z^2))
+static ComplexNode ComplexAsin(Ast* ast, ComplexNode a)
+{
+    ComplexNode square = ComplexMul(ast, a, a);
+    ComplexNode root = ComplexSqrt(ast, ComplexAddReal(ast, ComplexScale(ast, square, -1.0), 1.0));
+    ComplexNode rotated = ComplexRotate(ast, a);
+    ComplexNode log = ComplexLn(ast, { DerivAdd(ast, rotated.re, root.re), DerivAdd(ast, rotated.im, root.im) });
+    return { log.im, log.re != Ast_Null ? AstOp(ast, Op_Neg, log.re) : Ast_Null };
+}
+
+// atan z = i/2 (ln(1 - iz) - ln(1 + iz))
+static ComplexNode ComplexAtan(Ast* ast, ComplexNode a)
+{
+    ComplexNode rotated = ComplexRotate(ast, a);
+    ComplexNode minus = ComplexLn(ast, ComplexAddReal(ast, ComplexScale(ast, rotated, -1.0), 1.0));
+    ComplexNode plus = ComplexLn(ast, ComplexAddReal(ast, rotated, 1.0));
+    ComplexNode difference = { DerivSub(ast, minus.re, plus.re), DerivSub(ast, minus.im, plus.im) };
+    return ComplexScale(ast, ComplexRotate(ast, difference), 0.5);
+}
+
+// tan(a + bi) = (sin 2a + i sinh 2b) / (cos 2a + cosh 2b), and tanh the same way
+static ComplexNode ComplexTan(Ast* ast, ComplexNode a, bool hyperbolic)
+{
+    AstRef two = AstConst(ast, 2.0);
+    AstRef re = AstOp(ast, Op_Mul, OrZero(ast, a.re), two);
+    AstRef im = AstOp(ast, Op_Mul, a.im, two);
+    OpCode circular[2] = { Op_Sin, Op_Cos }, other[2] = { Op_Sinh, Op_Cosh };
+    const OpCode* ofRe = hyperbolic ? other : circular;
+    const OpCode* ofIm = hyperbolic ? circular : other;
+    AstRef divisor = AstOp(ast, Op_Add, AstOp(ast, ofRe[1], re), AstOp(ast, ofIm[1], im));
+    return { AstOp(ast, Op_Div, AstOp(ast, ofRe[0], re), divisor), AstOp(ast, Op_Div, AstOp(ast, ofIm[0], im), divisor) };
+}
+
+static ComplexNode LowerComplex(ComplexLowering* l, AstRef ref)
+{
+    if(l->done[ref]) return l->lowered[ref];
+    
+    // Copied, nodes move when the tree grows
+    Ast* ast = l->ast;
+    AstNode node = ast->nodes[ref];
+    bool binding = node.op == Op_Integral || node.op == Op_Sum;
+    int operands = binding ? 2 : node.childCount;
+    
+    ComplexNode args[Ast_MaxChildren] = { { Ast_Null, Ast_Null }, { Ast_Null, Ast_Null }, { Ast_Null, Ast_Null } };
+    bool real = true;
+    for(int i = 0; i < operands; ++i)
+    {
+        args[i] = LowerComplex(l, node.children[i]);
+        real &= args[i].im == Ast_Null;
+    }
+    
+    ComplexNode a = args[0], b = args[1];
+    ComplexNode result = { Ast_Null, Ast_Null };
+    switch(node.op)
+    {
+        case Op_Const: result.re = node.value != 0.0 ? ref : Ast_Null; break;
+        case Op_Param:
+        case Op_Bound: result.re = ref; break;
+        case Op_Var:
+        {
+            if(node.index == Var_Z) result = { AstLeaf(ast, Op_Var, Var_X), AstLeaf(ast, Op_Var, Var_Y) };
+            else result.im = AstConst(ast, 1.0);
+            break;
+        }
+        case Op_Neg:
+        {
+            result.re = a.re != Ast_Null ? AstOp(ast, Op_Neg, a.re) : Ast_Null;
+            result.im = a.im != Ast_Null ? AstOp(ast, Op_Neg, a.im) : Ast_Null;
+            break;
+        }
+        case Op_Add: result = { DerivAdd(ast, a.re, b.re), DerivAdd(ast, a.im, b.im) }; break;
+        case Op_Sub: result = { DerivSub(ast, a.re, b.re), DerivSub(ast, a.im, b.im) }; break;
+        case Op_Mul: result = ComplexMul(ast, a, b); break;
+        case Op_Div: result = ComplexDiv(ast, a, b); break;
+        case Op_Pow:
+        {
+            // Small integer exponents by squaring, like the compiler does for reals. The
+            // exponent is read before any node is added, the nodes move when the tree grows.
+            bool constant = ast->nodes[node.children[1]].op == Op_Const;
+            double exponent = ast->nodes[node.children[1]].value;
+            if(constant && exponent == floor(exponent) && fabs(exponent) <= 16.0)
+            {
+                if(real)
+                {
+                    result.re = AstOp(ast, Op_Pow, OrZero(ast, a.re), node.children[1]);
+                    break;
+                }
+                
+                int n = (int)fabs(exponent);
+                ComplexNode power = { AstConst(ast, 1.0), Ast_Null }, square = a;
+                bool one = true;
+                while(n > 0)
+                {
+                    if(n & 1)
+                    {
+                        power = one ? square : ComplexMul(ast, power, square);
+                        one = false;
+                    }
+                    
+                    n >>= 1;
+                    if(n > 0) square = ComplexMul(ast, square, square);
+                }
+                result = exponent < 0.0 ? ComplexDiv(ast, { AstConst(ast, 1.0), Ast_Null }, power) : power;
+                break;
+            }
+            
+            result = ComplexExp(ast, ComplexMul(ast, b, ComplexLn(ast, a)));
+            break;
+        }
+        case Op_Sqrt:  result = ComplexSqrt(ast, a); break;
+        case Op_Abs:   result.re = ComplexAbs(ast, a); break;
+        case Op_Exp:   result = ComplexExp(ast, a); break;
+        case Op_Ln:    result = ComplexLn(ast, a); break;
+        case Op_Log10: result = ComplexScale(ast, ComplexLn(ast, a), 0.43429448190325182765); break;
+        case Op_Log2:  result = ComplexScale(ast, ComplexLn(ast, a), 1.44269504088896340736); break;
+        case Op_Sin:
+        case Op_Cos:
+        case Op_Sinh:
+        case Op_Cosh:
+        {
+            bool sine = node.op == Op_Sin || node.op == Op_Sinh;
+            if(real)
+            {
+                result.re = AstOp(ast, node.op, OrZero(ast, a.re));
+                break;
+            }
+            
+            // sin(a + bi) = sin a cosh b + i cos a sinh b, cos(a + bi) = cos a cosh b - i sin a sinh b,
+            // and the hyperbolic ones with the roles of the parts swapped
+            bool hyperbolic = node.op == Op_Sinh || node.op == Op_Cosh;
+            AstRef re = OrZero(ast, a.re);
+            AstRef evenRe = AstOp(ast, hyperbolic ? Op_Cosh : Op_Cos, re);
+            AstRef oddRe = AstOp(ast, hyperbolic ? Op_Sinh : Op_Sin, re);
+            AstRef evenIm = AstOp(ast, hyperbolic ? Op_Cos : Op_Cosh, a.im);
+            AstRef oddIm = AstOp(ast, hyperbolic ? Op_Sin : Op_Sinh, a.im);
+            if(sine) result = { AstOp(ast, Op_Mul, oddRe, evenIm), AstOp(ast, Op_Mul, evenRe, oddIm) };
+            else result = { AstOp(ast, Op_Mul, evenRe, evenIm), AstOp(ast, Op_Mul, oddRe, oddIm) };
+            if(!sine && !hyperbolic) result.im = AstOp(ast, Op_Neg, result.im);
+            break;
+        }
+        case Op_Tan:
+        case Op_Tanh:
+        {
+            if(real) result.re = AstOp(ast, node.op, OrZero(ast, a.re));
+            else result = ComplexTan(ast, a, node.op == Op_Tanh);
+            break;
+        }
+        case Op_Asin: result = ComplexAsin(ast, a); break;
+        case Op_Acos:
+        {
+            ComplexNode asin = ComplexAsin(ast, a);
+            result = { DerivSub(ast, AstConst(ast, 1.57079632679489661923), asin.re), asin.im != Ast_Null ? AstOp(ast, Op_Neg, asin.im) : Ast_Null };
+            break;
+        }
+        case Op_Atan:
+        {
+            if(real) result.re = AstOp(ast, Op_Atan, OrZero(ast, a.re));
+            else result = ComplexAtan(ast, a);
+            break;
+        }
+        case Op_Select:
+        {
+            ComplexNode c = args[2];
+            if(a.im != Ast_Null && !l->error) l->error = opInfos[node.op].name;
+            AstRef condition = OrZero(ast, a.re);
+            if(b.re != Ast_Null || c.re != Ast_Null) result.re = AstOp(ast, Op_Select, condition, OrZero(ast, b.re), OrZero(ast, c.re));
+            if(b.im != Ast_Null || c.im != Ast_Null) result.im = AstOp(ast, Op_Select, condition, OrZero(ast, b.im), OrZero(ast, c.im));
+            break;
+        }
+        case Op_Integral:
+        case Op_Sum:
+        {
+            // Real bounds, and one binding per part of the body
+            if(!real && !l->error) l->error = opInfos[node.op].name;
+            ComplexNode body = LowerComplex(l, node.children[2]);
+            AstRef first = OrZero(ast, a.re), last = OrZero(ast, b.re);
+            if(body.re != Ast_Null) result.re = AstBinding(ast, node.op, first, last, body.re, node.index);
+            if(body.im != Ast_Null) result.im = AstBinding(ast, node.op, first, last, body.im, node.index);
+            break;
+        }
+        default:
+        {
+            // Comparisons, rounding and the like only make sense on reals
+            if(!real && !l->error) l->error = opInfos[node.op].name;
+            result.re = AstOp(ast, node.op, OrZero(ast, a.re), operands > 1 ? OrZero(ast, b.re) : Ast_Null,
+                              operands > 2 ? OrZero(ast, args[2].re) : Ast_Null);
+            break;
+        }
+    }
+    
+    l->lowered[ref] = result;
+    l->done[ref] = true;
+    return result;
+}
+
+// Iterated maps as a polynomial in z plus a multiple of c. Subtrees which
+// depend on neither are lowered as complex constants.
+struct ComplexPolynomial
+{
+    std::vector<ComplexNode> terms;  // Coefficients of z^0, z^1, ...
+    ComplexNode factor;              // Of c
+    bool valid;
+};
+
+static ComplexPolynomial PolynomialMul(Ast* ast, const ComplexPolynomial* a, const ComplexPolynomial* b)
+{
+    ComplexPolynomial result = { {}, { Ast_Null, Ast_Null }, a->valid && b->valid };
+    if(!result.valid) return result;
+    
+    // c only appears once, times constants
+    bool aFactor = a->factor.re != Ast_Null || a->factor.im != Ast_Null;
+    bool bFactor = b->factor.re != Ast_Null || b->factor.im != Ast_Null;
+    if((aFactor && (bFactor || b->terms.size() > 1)) || (bFactor && a->terms.size() > 1))
+    {
+        result.valid = false;
+        return result;
+    }
+    
+    if(!a->terms.empty() && !b->terms.empty()) result.terms.assign(a->terms.size() + b->terms.size() - 1, { Ast_Null, Ast_Null });
+    for(size_t i = 0; i < a->terms.size(); ++i)
+    {
+        for(size_t j = 0; j < b->terms.size(); ++j)
+        {
+            ComplexNode product = ComplexMul(ast, a->terms[i], b->terms[j]);
+            ComplexNode* term = &result.terms[i + j];
+            *term = { DerivAdd(ast, term->re, product.re), DerivAdd(ast, term->im, product.im) };
+        }
+    }
+    
+    if(aFactor && !b->terms.empty()) result.factor = ComplexMul(ast, a->factor, b->terms[0]);
+    if(bFactor && !a->terms.empty()) result.factor = ComplexMul(ast, b->factor, a->terms[0]);
+    return result;
+}
+
+static ComplexPolynomial ExpandPolynomial(ComplexLowering* l, AstRef ref)
+{
+    Ast* ast = l->ast;
+    ComplexPolynomial result = { {}, { Ast_Null, Ast_Null }, true };
+    if(!AstDependsOn(ast, ref, Op_Var, Var_Z) && !AstDependsOn(ast, ref, Op_Var, Var_C))
+    {
+        result.terms.push_back(LowerComplex(l, ref));
+        return result;
+    }
+    
+    AstNode node = ast->nodes[ref];
+    switch(node.op)
+    {
+        case Op_Var:
+        {
+            if(node.index == Var_Z) result.terms = { { Ast_Null, Ast_Null }, { AstConst(ast, 1.0), Ast_Null } };
+            else result.factor.re = AstConst(ast, 1.0);
+            break;
+        }
+        case Op_Neg:
+        case Op_Add:
+        case Op_Sub:
+        {
+            // -b is 0 - b
+            ComplexPolynomial a = result, b = result;
+            if(node.op == Op_Neg)
+            {
+                b = ExpandPolynomial(l, node.children[0]);
+            }
+            else
+            {
+                a = ExpandPolynomial(l, node.children[0]);
+                b = ExpandPolynomial(l, node.children[1]);
+            }
+            
+            bool add = node.op == Op_Add;
+            result.valid = a.valid && b.valid;
+            result.terms.assign(a.terms.size() > b.terms.size() ? a.terms.size() : b.terms.size(), { Ast_Null, Ast_Null });
+            for(size_t i = 0; i < result.terms.size(); ++i)
+            {
+                ComplexNode x = i < a.terms.size() ? a.terms[i] : ComplexNode{ Ast_Null, Ast_Null };
+                ComplexNode y = i < b.terms.size() ? b.terms[i] : ComplexNode{ Ast_Null, Ast_Null };
+                result.terms[i] = add ? ComplexNode{ DerivAdd(ast, x.re, y.re), DerivAdd(ast, x.im, y.im) } :
+                                        ComplexNode{ DerivSub(ast, x.re, y.re), DerivSub(ast, x.im, y.im) };
+            }
+            
+            if(add) result.factor = { DerivAdd(ast, a.factor.re, b.factor.re), DerivAdd(ast, a.factor.im, b.factor.im) };
+            else result.factor = { DerivSub(ast, a.factor.re, b.factor.re), DerivSub(ast, a.factor.im, b.factor.im) };
+            break;
+        }
+        case Op_Mul:
+        {
+            ComplexPolynomial a = ExpandPolynomial(l, node.children[0]);
+            ComplexPolynomial b = ExpandPolynomial(l, node.children[1]);
+            result = PolynomialMul(ast, &a, &b);
+            break;
+        }
+        case Op_Div:
+        {
+            // By constants only
+            ComplexPolynomial a = ExpandPolynomial(l, node.children[0]);
+            if(AstDependsOn(ast, node.children[1], Op_Var, Var_Z) || AstDependsOn(ast, node.children[1], Op_Var, Var_C))
+            {
+                result.valid = false;
+                break;
+            }
+            
+            ComplexNode divisor = LowerComplex(l, node.children[1]);
+            result = a;
+            for(ComplexNode& term : result.terms)
+                if(term.re != Ast_Null || term.im != Ast_Null) term = ComplexDiv(ast, term, divisor);
+            if(result.factor.re != Ast_Null || result.factor.im != Ast_Null) result.factor = ComplexDiv(ast, result.factor, divisor);
+            break;
+        }
+        case Op_Pow:
+        {
+            // Natural exponents, by squaring. Large ones are left for the degree check of ParseIteration.
+            // Copied, the expansion adds nodes.
+            AstNode exponent = ast->nodes[node.children[1]];
+            if(exponent.op != Op_Const || exponent.value != floor(exponent.value) || exponent.value < 0.0 ||
+               exponent.value > 64.0)
+            {
+                result.valid = false;
+                break;
+            }
+            
+            ComplexPolynomial square = ExpandPolynomial(l, node.children[0]);
+            result.terms = { { AstConst(ast, 1.0), Ast_Null } };
+            for(int n = (int)exponent.value; n > 0 && result.valid; n >>= 1)
+            {
+                if(n & 1) result = PolynomialMul(ast, &result, &square);
+                if(n > 1) square = PolynomialMul(ast, &square, &square);
+            }
+            break;
+        }
+        default:
+        {
+            result.valid = false;
+            break;
+        }
+    }
+    
+    return result;
+}
+
+int FindParam(const ParamTable* table, const char* name, int length)
+{
+    for(size_t i = 0; i < table->names.size(); ++i)
+    {
+        const std::string& other = table->names[i];
+        if((int)other.size() == length && memcmp(other.data(), name, length) == 0)
+            return (int)i;
+    }
+    
+    return -1;
+}
+
+int FindOrAddParam(ParamTable* table, const char* name, int length)
+{
+    int found = FindParam(table, name, length);
+    if(found != -1) return found;
+    
+    table->names.push_back(std::string(name, length));
+    table->values.push_back(0.0);
+    table->lists.emplace_back();
+    return (int)table->names.size() - 1;
+}
+
+enum TokenType
+{
+    Tok_EOF = 0,
+    Tok_Invalid,
+    Tok_Number,
+    Tok_Ident,
+    Tok_Plus,
+    Tok_Minus,
+    Tok_Star,
+    Tok_Slash,
+    Tok_Caret,
+    Tok_LParen,
+    Tok_RParen,
+    Tok_LBrace,
+    Tok_RBrace,
+    Tok_Comma,
+    Tok_Colon,
+    Tok_Less,
+    Tok_LessEqual,
+    Tok_Greater,
+    Tok_GreaterEqual,
+    Tok_Equal,
+    Tok_Tilde,
+    Tok_Prime,
+    Tok_Arrow,
+    Tok_LBracket,
+    Tok_RBracket,
+    Tok_Ellipsis,
+};
+
+struct Token
+{
+    TokenType type;
+    int start;
+    int length;
+    double value;
+};
+
+struct Parser
+{
+    const char* text;
+    int pos;
+    Token token;
+    
+    Ast* ast;
+    ParamTable* params;
+    int piecewiseDepth;  // '=' means equality inside of piecewise conditions
+    bool complex;        // z and i are the variable and the imaginary unit, see ParseComplex
+    bool iteration;      // And c the point, see ParseIteration
+    
+    // Variables of the integrals and sums being parsed, the slot is the position
+    Token bindings[Ast_MaxBindings];
+    int numBindings;
+    
+    bool failed;
+    char error[128];
+    int errorPos;
+};
+
+static bool IsIdentChar(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+static bool IsDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static void NextToken(Parser* p)
+{
+    const char* s = p->text;
+    while(s[p->pos] == ' ' || s[p->pos] == '\t' || s[p->pos] == '\n' || s[p->pos] == '\r')
+        ++p->pos;
+    
+    Token token = {};
+    token.start = p->pos;
+    char c = s[p->pos];
+    
+    if(c == '\0')
+    {
+        token.type = Tok_EOF;
+    }
+    else if(IsDigit(c) || (c == '.' && IsDigit(s[p->pos + 1])))
+    {
+        // Scanned by hand, strtod would accept things like "0x1" and "inf"
+        int end = p->pos;
+        while(IsDigit(s[end])) ++end;
+        if(s[end] == '.' && s[end + 1] != '.')  // Not 1...10
+        {
+            ++end;
+            while(IsDigit(s[end])) ++end;
+        }
+        
+        if(s[end] == 'e' || s[end] == 'E')
+        {
+            int exp = end + 1;
+            if(s[exp] == '+' || s[exp] == '-') ++exp;
+            if(IsDigit(s[exp]))
+            {
+                end = exp;
+                while(IsDigit(s[end])) ++end;
+            }
+        }
+        
+        char buffer[64];
+        int length = end - p->pos;
+        if(length > (int)sizeof(buffer) - 1) length = sizeof(buffer) - 1;
+        memcpy(buffer, s + p->pos, length);
+        buffer[length] = '\0';
+        
+        token.type = Tok_Number;
+        token.value = strtod(buffer, nullptr);
+        p->pos = end;
+    }
+    else if(IsIdentChar(c))
+    {
+        token.type = Tok_Ident;
+        while(IsIdentChar(s[p->pos])) ++p->pos;
+    }
+    else
+    {
+        ++p->pos;
+        switch(c)
+        {
+            case '+': token.type = Tok_Plus;   break;
+            case '-':
+            {
+                token.type = Tok_Minus;
+                if(s[p->pos] == '>') { token.type = Tok_Arrow; ++p->pos; }
+                break;
+            }
+            case '*': token.type = Tok_Star;   break;
+            case '/': token.type = Tok_Slash;  break;
+            case '^': token.type = Tok_Caret;  break;
+            case '(': token.type = Tok_LParen; break;
+            case ')': token.type = Tok_RParen; break;
+            case '{': token.type = Tok_LBrace; break;
+            case '}': token.type = Tok_RBrace; break;
+            case '[': token.type = Tok_LBracket; break;
+            case ']': token.type = Tok_RBracket; break;
+            case ',': token.type = Tok_Comma;  break;
+            case ':': token.type = Tok_Colon;  break;
+            case '=': token.type = Tok_Equal;  break;
+            case '~': token.type = Tok_Tilde;  break;
+            case '\'': token.type = Tok_Prime; break;
+            case '<':
+            {
+                token.type = Tok_Less;
+                if(s[p->pos] == '=') { token.type = Tok_LessEqual; ++p->pos; }
+                break;
+            }
+            case '>':
+            {
+                token.type = Tok_Greater;
+                if(s[p->pos] == '=') { token.type = Tok_GreaterEqual; ++p->pos; }
+                break;
+            }
+            case '.':
+            {
+                token.type = Tok_Invalid;
+                if(s[p->pos] == '.' && s[p->pos + 1] == '.') { token.type = Tok_Ellipsis; p->pos += 2; }
+                break;
+            }
+            default: token.type = Tok_Invalid; break;
+        }
+    }
+    
+    token.length = p->pos - token.start;
+    p->token = token;
+}
+
+static void ParseError(Parser* p, const char* fmt, ...)
+{
+    if(p->failed) return;
+    
+    p->failed = true;
+    p->errorPos = p->token.start;
+    
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(p->error, sizeof(p->error), fmt, args);
+    va_end(args);
+}
+
+static bool Expect(Parser* p, TokenType type, const char* what)
+{
+    if(p->token.type != type)
+    {
+        ParseError(p, "Expected %s", what);
+        return false;
+    }
+    
+    NextToken(p);
+    return true;
+}
+
+static bool TokenIs(Parser* p, const char* str)
+{
+    int length = (int)strlen(str);
+    return p->token.type == Tok_Ident && p->token.length == length &&
+           memcmp(p->text + p->token.start, str, length) == 0;
+}
+
+static AstRef ParseExpr(Parser* p);
+
+static AstRef ParsePiecewise(Parser* p)
+{
+    // {cond: a, cond: b, else}, without an else branch the result is undefined
+    struct Branch { AstRef cond; AstRef value; };
+    std::vector<Branch> branches;
+    AstRef elseValue = Ast_Null;
+    
+    ++p->piecewiseDepth;
+    while(!p->failed)
+    {
+        AstRef expr = ParseExpr(p);
+        if(p->token.type == Tok_Colon)
+        {
+            NextToken(p);
+            branches.push_back({ expr, ParseExpr(p) });
+        }
+        else if(p->token.type == Tok_RBrace && branches.empty())
+        {
+            // {cond} is 1 where the condition holds
+            branches.push_back({ expr, AstConst(p->ast, 1.0) });
+        }
+        else
+        {
+            elseValue = expr;
+            if(p->token.type != Tok_RBrace) ParseError(p, "The default branch must come last");
+        }
+        
+        if(p->token.type != Tok_Comma) break;
+        NextToken(p);
+    }
+    --p->piecewiseDepth;
+    
+    Expect(p, Tok_RBrace, "'}'");
+    if(p->failed) return Ast_Null;
+    
+    AstRef result = elseValue != Ast_Null ? elseValue : AstConst(p->ast, NAN);
+    for(int i = (int)branches.size() - 1; i >= 0; --i)
+        result = AstOp(p->ast, Op_Select, branches[i].cond, branches[i].value, result);
+    
+    return result;
+}
+
+static bool IsReservedName(Parser* p)
+{
+    for(int op = Op_Sqrt; op <= Op_Mod; ++op)
+        if(TokenIs(p, opInfos[op].name)) return true;
+    for(int i = 0; i < Var_Count; ++i)
+        if(TokenIs(p, varNames[i])) return true;
+    if(p->complex && (TokenIs(p, "z") || TokenIs(p, "i"))) return true;
+    if(p->iteration && TokenIs(p, "c")) return true;
+    
+    return TokenIs(p, "pi") || TokenIs(p, "e") || TokenIs(p, opInfos[Op_Integral].name) || TokenIs(p, opInfos[Op_Sum].name);
+}
+
+// integral(f, a, b) binds x in f, sum(n, a, b, f) binds n in f. The bounds
+// are parsed in the enclosing scope, where the variable doesn't exist.
+static AstRef ParseBinding(Parser* p, OpCode op)
+{
+    NextToken(p);
+    if(!Expect(p, Tok_LParen, "'(' after function name")) return Ast_Null;
+    if(p->numBindings == Ast_MaxBindings)
+    {
+        ParseError(p, "Too many nested integrals and sums");
+        return Ast_Null;
+    }
+    
+    Token variable = {};
+    variable.type = Tok_Ident;
+    variable.start = -1;  // x, see ParsePrimary
+    if(op == Op_Sum)
+    {
+        if(p->token.type != Tok_Ident || IsDigit(p->text[p->token.start]) || IsReservedName(p))
+        {
+            ParseError(p, "Expected the name of the index");
+            return Ast_Null;
+        }
+        
+        variable = p->token;
+        NextToken(p);
+        Expect(p, Tok_Comma, "','");
+    }
+    
+    AstRef args[3] = { Ast_Null, Ast_Null, Ast_Null };  // Body, first, last
+    uint32_t slot = (uint32_t)p->numBindings;
+    for(int i = 0; i < 3 && !p->failed; ++i)
+    {
+        bool isBody = op == Op_Integral ? i == 0 : i == 2;
+        if(i > 0) Expect(p, Tok_Comma, "','");
+        if(isBody) p->bindings[p->numBindings++] = variable;
+        
+        AstRef expr = ParseExpr(p);
+        if(isBody) --p->numBindings;
+        args[isBody ? 0 : (op == Op_Integral ? i : i + 1)] = expr;
+    }
+    
+    if(!p->failed && p->token.type == Tok_Comma)
+        ParseError(p, "%s takes %d arguments", opInfos[op].name, op == Op_Integral ? 3 : 4);
+    Expect(p, Tok_RParen, "')'");
+    if(p->failed) return Ast_Null;
+    return AstBinding(p->ast, op, args[1], args[2], args[0], slot);
+}
+
+static AstRef ParsePrimary(Parser* p)
+{
+    Token token = p->token;
+    switch(token.type)
+    {
+        case Tok_Number:
+        {
+            NextToken(p);
+            return AstConst(p->ast, token.value);
+        }
+        case Tok_LParen:
+        {
+            NextToken(p);
+            AstRef expr = ParseExpr(p);
+            Expect(p, Tok_RParen, "')'");
+            return expr;
+        }
+        case Tok_LBrace:
+        {
+            NextToken(p);
+            return ParsePiecewise(p);
+        }
+        case Tok_Ident:
+        {
+            const char* name = p->text + token.start;
+            
+            if(TokenIs(p, opInfos[Op_Integral].name)) return ParseBinding(p, Op_Integral);
+            if(TokenIs(p, opInfos[Op_Sum].name)) return ParseBinding(p, Op_Sum);
+            
+            // Builtin functions
+            for(int op = Op_Sqrt; op <= Op_Mod; ++op)
+            {
+                if(TokenIs(p, opInfos[op].name))
+                {
+                    NextToken(p);
+                    if(!Expect(p, Tok_LParen, "'(' after function name")) return Ast_Null;
+                    
+                    AstRef args[Ast_MaxChildren] = { Ast_Null, Ast_Null, Ast_Null };
+                    int arity = opInfos[op].arity;
+                    for(int i = 0; i < arity; ++i)
+                    {
+                        if(i > 0 && !Expect(p, Tok_Comma, "','")) return Ast_Null;
+                        args[i] = ParseExpr(p);
+                    }
+                    
+                    if(p->token.type == Tok_Comma)
+                        ParseError(p, "%s takes %d argument%s", opInfos[op].name, arity, arity > 1 ? "s" : "");
+                    Expect(p, Tok_RParen, "')'");
+                    if(p->failed) return Ast_Null;
+                    return AstOp(p->ast, (OpCode)op, args[0], args[1], args[2]);
+                }
+            }
+            
+            if(TokenIs(p, "pi")) { NextToken(p); return AstConst(p->ast, 3.14159265358979323846); }
+            if(TokenIs(p, "e"))  { NextToken(p); return AstConst(p->ast, 2.71828182845904523536); }
+            
+            // Innermost binding first, integrals bind x
+            for(int i = p->numBindings - 1; i >= 0; --i)
+            {
+                const Token* bound = &p->bindings[i];
+                bool match = bound->start < 0 ? TokenIs(p, varNames[Var_X]) :
+                             token.length == bound->length && memcmp(name, p->text + bound->start, token.length) == 0;
+                if(match)
+                {
+                    NextToken(p);
+                    return AstLeaf(p->ast, Op_Bound, i);
+                }
+            }
+            
+            if(p->complex && (TokenIs(p, "z") || TokenIs(p, "i") || (p->iteration && TokenIs(p, "c"))))
+            {
+                Variable var = TokenIs(p, "z") ? Var_Z : TokenIs(p, "i") ? Var_I : Var_C;
+                NextToken(p);
+                return AstLeaf(p->ast, Op_Var, var);
+            }
+            
+            for(int i = 0; i < Var_Count; ++i)
+            {
+                if(TokenIs(p, varNames[i]))
+                {
+                    if(p->complex)
+                    {
+                        ParseError(p, p->iteration ? "Iterated maps only depend on z and c" : "Complex functions only depend on z");
+                        return Ast_Null;
+                    }
+                    
+                    NextToken(p);
+                    return AstLeaf(p->ast, Op_Var, i);
+                }
+            }
+            
+            if(IsDigit(name[0]))
+            {
+                ParseError(p, "Invalid name");
+                return Ast_Null;
+            }
+            
+            NextToken(p);
+            int param = FindOrAddParam(p->params, name, token.length);
+            return AstLeaf(p->ast, Op_Param, param);
+        }
+        default:
+        {
+            ParseError(p, token.type == Tok_EOF ? "Unexpected end of expression" : "Unexpected symbol");
+            return Ast_Null;
+        }
+    }
+}
+
+static AstRef ParseUnary(Parser* p);
+
+static AstRef ParsePower(Parser* p)
+{
+    AstRef base = ParsePrimary(p);
+    if(p->failed) return Ast_Null;
+    
+    if(p->token.type == Tok_Caret)
+    {
+        // Right associative, and binds tighter than unary minus on its left: -x^2 = -(x^2)
+        NextToken(p);
+        AstRef exp = ParseUnary(p);
+        if(p->failed) return Ast_Null;
+        return AstOp(p->ast, Op_Pow, base, exp);
+    }
+    
+    return base;
+}
+
+static AstRef ParseUnary(Parser* p)
+{
+    if(p->token.type == Tok_Minus)
+    {
+        NextToken(p);
+        AstRef operand = ParseUnary(p);
+        if(p->failed) return Ast_Null;
+        return AstOp(p->ast, Op_Neg, operand);
+    }
+    
+    if(p->token.type == Tok_Plus)
+    {
+        NextToken(p);
+        return ParseUnary(p);
+    }
+    
+    return ParsePower(p);
+}
+
+static AstRef ParseTerm(Parser* p)
+{
+    AstRef lhs = ParseUnary(p);
+    while(!p->failed)
+    {
+        TokenType type = p->token.type;
+        if(type == Tok_Star || type == Tok_Slash)
+        {
+            NextToken(p);
+            AstRef rhs = ParseUnary(p);
+            if(p->failed) return Ast_Null;
+            lhs = AstOp(p->ast, type == Tok_Star ? Op_Mul : Op_Div, lhs, rhs);
+        }
+        else if(type == Tok_Number || type == Tok_Ident || type == Tok_LParen)
+        {
+            // Implicit multiplication: 2x, 3sin(x), (x+1)(x-1)
+            AstRef rhs = ParsePower(p);
+            if(p->failed) return Ast_Null;
+            lhs = AstOp(p->ast, Op_Mul, lhs, rhs);
+        }
+        else
+        {
+            break;
+        }
+    }
+    
+    return p->failed ? Ast_Null : lhs;
+}
+
+static AstRef ParseAdditive(Parser* p)
+{
+    AstRef lhs = ParseTerm(p);
+    while(!p->failed && (p->token.type == Tok_Plus || p->token.type == Tok_Minus))
+    {
+        OpCode op = p->token.type == Tok_Plus ? Op_Add : Op_Sub;
+        NextToken(p);
+        AstRef rhs = ParseTerm(p);
+        if(p->failed) return Ast_Null;
+        lhs = AstOp(p->ast, op, lhs, rhs);
+    }
+    
+    return p->failed ? Ast_Null : lhs;
+}
+
+static bool ComparisonOp(Parser* p, OpCode* op)
+{
+    switch(p->token.type)
+    {
+        case Tok_Less:         *op = Op_Less;         return true;
+        case Tok_LessEqual:    *op = Op_LessEqual;    return true;
+        case Tok_Greater:      *op = Op_Greater;      return true;
+        case Tok_GreaterEqual: *op = Op_GreaterEqual; return true;
+        case Tok_Equal:        *op = Op_Equal;        return p->piecewiseDepth > 0;
+        default: return false;
+    }
+}
+
+static AstRef ParseExpr(Parser* p)
+{
+    AstRef lhs = ParseAdditive(p);
+    
+    // Chained comparisons: a < b < c means a < b and b < c
+    AstRef result = Ast_Null;
+    OpCode op;
+    while(!p->failed && ComparisonOp(p, &op))
+    {
+        NextToken(p);
+        AstRef rhs = ParseAdditive(p);
+        if(p->failed) break;
+        
+        AstRef cmp = AstOp(p->ast, op, lhs, rhs);
+        result = result == Ast_Null ? cmp : AstOp(p->ast, Op_And, result, cmp);
+        lhs = rhs;
+    }
+    
+    if(p->failed) return Ast_Null;
+    return result == Ast_Null ? lhs : result;
+}
+
+static void InitParser(Parser* p, const char* text, Ast* ast, ParamTable* params)
+{
+    memset(p, 0, sizeof(Parser));
+    p->text = text;
+    p->ast = ast;
+    p->params = params;
+    NextToken(p);
+}
+
+static bool FinishDefinition(Parser* p, Definition* out)
+{
+    if(!p->failed && p->token.type != Tok_EOF)
+        ParseError(p, "Unexpected symbol");
+    
+    if(p->failed)
+    {
+        out->kind = Def_Invalid;
+        out->numRoots = 0;
+        memcpy(out->error, p->error, sizeof(out->error));
+        out->errorPos = p->errorPos;
+        return false;
+    }
+    
+    return true;
+}
+
+// Consumes the derivative of a variable, x' or y'
+static bool ParsePrimed(Parser* p, Variable var)
+{
+    if(!TokenIs(p, varNames[var])) return false;
+    
+    Parser saved = *p;
+    NextToken(p);
+    if(p->token.type == Tok_Prime)
+    {
+        NextToken(p);
+        return true;
+    }
+    
+    *p = saved;
+    return false;
+}
+
+// y' = f(x, y) and (x', y') = (f(x, y), g(x, y)). Returns false, with the
+// parser untouched, when the text doesn't start like a differential equation.
+static bool ParseDifferential(Parser* p, Definition* out)
+{
+    Parser saved = *p;
+    AstRef roots[2] = { Ast_Null, Ast_Null };
+    if(ParsePrimed(p, Var_Y))
+    {
+        Expect(p, Tok_Equal, "'='");
+        roots[0] = AstConst(p->ast, 1.0);
+        roots[1] = ParseExpr(p);
+        out->kind = Def_SlopeField;
+    }
+    else
+    {
+        if(p->token.type != Tok_LParen) return false;
+        NextToken(p);
+        if(!ParsePrimed(p, Var_X))
+        {
+            *p = saved;
+            return false;
+        }
+        
+        Expect(p, Tok_Comma, "','");
+        if(!p->failed && !ParsePrimed(p, Var_Y)) ParseError(p, "Expected y'");
+        Expect(p, Tok_RParen, "')'");
+        Expect(p, Tok_Equal, "'='");
+        Expect(p, Tok_LParen, "'('");
+        if(!p->failed) roots[0] = ParseExpr(p);
+        Expect(p, Tok_Comma, "','");
+        if(!p->failed) roots[1] = ParseExpr(p);
+        Expect(p, Tok_RParen, "')'");
+        out->kind = Def_VectorField;
+    }
+    
+    if(!p->failed && (AstDependsOn(p->ast, roots[0], Op_Var, Var_T) || AstDependsOn(p->ast, roots[1], Op_Var, Var_T)))
+        ParseError(p, "t can only be used in parametric and polar curves");
+    if(!FinishDefinition(p, out)) return true;
+    
+    out->roots[0] = roots[0];
+    out->roots[1] = roots[1];
+    out->numRoots = 2;
+    return true;
+}
+
+// f(z) = g(z), whatever the name of f. Returns false, with the parser
+// untouched, when the text doesn't start like a complex function.
+static bool ParseComplex(Parser* p, Definition* out)
+{
+    Parser saved = *p;
+    bool matched = p->token.type == Tok_Ident && !IsReservedName(p);
+    if(matched) { NextToken(p); matched = p->token.type == Tok_LParen; }
+    if(matched) { NextToken(p); matched = TokenIs(p, "z"); }
+    if(matched) { NextToken(p); matched = p->token.type == Tok_RParen; }
+    if(matched) { NextToken(p); matched = p->token.type == Tok_Equal; }
+    if(!matched)
+    {
+        *p = saved;
+        return false;
+    }
+    
+    NextToken(p);
+    p->complex = true;
+    AstRef root = ParseExpr(p);
+    if(!FinishDefinition(p, out)) return true;
+    
+    ComplexLowering lowering;
+    lowering.ast = p->ast;
+    lowering.lowered.resize(p->ast->nodes.size());
+    lowering.done.assign(p->ast->nodes.size(), false);
+    lowering.error = nullptr;
+    ComplexNode value = LowerComplex(&lowering, root);
+    if(lowering.error)
+    {
+        ParseError(p, "%s needs real arguments in complex functions", lowering.error);
+        FinishDefinition(p, out);
+        return true;
+    }
+    
+    out->kind = Def_Complex;
+    out->roots[0] = OrZero(p->ast, value.re);
+    out->roots[1] = OrZero(p->ast, value.im);
+    out->numRoots = 2;
+    return true;
+}
+
+// z -> f(z, c). Returns false, with the parser untouched, when the text
+// doesn't start like an iterated map.
+static bool ParseIteration(Parser* p, Definition* out)
+{
+    if(!TokenIs(p, "z")) return false;
+    
+    Parser saved = *p;
+    NextToken(p);
+    if(p->token.type != Tok_Arrow)
+    {
+        *p = saved;
+        return false;
+    }
+    
+    NextToken(p);
+    p->complex = true;
+    p->iteration = true;
+    AstRef root = ParseExpr(p);
+    if(!FinishDefinition(p, out)) return true;
+    
+    ComplexLowering lowering;
+    lowering.ast = p->ast;
+    lowering.lowered.resize(p->ast->nodes.size());
+    lowering.done.assign(p->ast->nodes.size(), false);
+    lowering.error = nullptr;
+    ComplexPolynomial map = ExpandPolynomial(&lowering, root);
+    while(!map.terms.empty() && map.terms.back().re == Ast_Null && map.terms.back().im == Ast_Null)
+        map.terms.pop_back();
+    
+    if(lowering.error) ParseError(p, "%s needs real arguments in complex functions", lowering.error);
+    else if(!map.valid) ParseError(p, "Iterated maps have to be polynomials in z, plus a multiple of c");
+    else if(map.terms.size() > Def_MaxDegree + 1) ParseError(p, "Iterated maps go up to z^%d", Def_MaxDegree);
+    else if(map.terms.size() < 3) ParseError(p, "Iterated maps need z^2 or a higher power");
+    if(!FinishDefinition(p, out)) return true;
+    
+    out->kind = Def_Iteration;
+    out->roots[0] = OrZero(p->ast, map.factor.re);
+    out->roots[1] = OrZero(p->ast, map.factor.im);
+    for(size_t i = 0; i < map.terms.size(); ++i)
+    {
+        out->roots[2 + 2 * i] = OrZero(p->ast, map.terms[i].re);
+        out->roots[3 + 2 * i] = OrZero(p->ast, map.terms[i].im);
+    }
+    out->numRoots = (uint32_t)(2 + 2 * map.terms.size());
+    return true;
+}
+
+// r = f(t), with t the angle, becomes the parametric curve (r cos t, r sin t).
+// Returns false, with the parser untouched, when the text doesn't start like
+// a polar curve or the right side doesn't use t: then r is a parameter.
+static bool ParsePolar(Parser* p, Definition* out)
+{
+    if(!TokenIs(p, "r")) return false;
+    
+    Parser saved = *p;
+    size_t numNodes = p->ast->nodes.size();
+    NextToken(p);
+    if(p->token.type == Tok_Equal)
+    {
+        NextToken(p);
+        AstRef radius = ParseExpr(p);
+        if(!p->failed && AstDependsOn(p->ast, radius, Op_Var, Var_T))
+        {
+            if(AstDependsOn(p->ast, radius, Op_Var, Var_X) || AstDependsOn(p->ast, radius, Op_Var, Var_Y))
+                ParseError(p, "Polar curves only depend on t");
+            if(!FinishDefinition(p, out)) return true;
+            
+            AstRef angle = AstLeaf(p->ast, Op_Var, Var_T);
+            out->kind = Def_Parametric;
+            out->roots[0] = AstOp(p->ast, Op_Mul, radius, AstOp(p->ast, Op_Cos, angle));
+            out->roots[1] = AstOp(p->ast, Op_Mul, radius, AstOp(p->ast, Op_Sin, angle));
+            out->numRoots = 2;
+            return true;
+        }
+    }
+    
+    *p = saved;
+    p->ast->nodes.resize(numNodes);
+    return false;
+}
+
+// a = [1, 2, 3], or ranges a = [1...10] and a = [0, 0.5...10]. Returns false,
+// with the parser untouched, when the text isn't a list assignment.
+static bool ParseList(Parser* p, Definition* out)
+{
+    if(p->token.type != Tok_Ident || IsDigit(p->text[p->token.start]) || IsReservedName(p)) return false;
+    
+    Parser saved = *p;
+    Token name = p->token;
+    NextToken(p);
+    bool matched = p->token.type == Tok_Equal;
+    if(matched) NextToken(p);
+    if(!matched || p->token.type != Tok_LBracket)
+    {
+        *p = saved;
+        return false;
+    }
+    
+    NextToken(p);
+    int param = FindOrAddParam(p->params, p->text + name.start, name.length);
+    out->listRange = false;
+    out->numRoots = 0;
+    while(!p->failed)
+    {
+        if(out->numRoots == Def_MaxRoots)
+        {
+            ParseError(p, "Lists written out have up to %d elements, longer ones are ranges", Def_MaxRoots);
+            break;
+        }
+        
+        AstRef element = ParseExpr(p);
+        if(!p->failed && (AstDependsOn(p->ast, element, Op_Var, Var_X) || AstDependsOn(p->ast, element, Op_Var, Var_Y) ||
+                          AstDependsOn(p->ast, element, Op_Var, Var_T) || AstDependsOn(p->ast, element, Op_Param, param)))
+            ParseError(p, "List elements can only use numbers and other parameters");
+        out->roots[out->numRoots++] = element;
+        
+        if(p->token.type == Tok_Ellipsis)
+        {
+            if(out->numRoots > 2) ParseError(p, "Ranges are [first...last] or [first, second...last]");
+            NextToken(p);
+            out->roots[out->numRoots++] = ParseExpr(p);
+            if(!p->failed && AstDependsOn(p->ast, out->roots[out->numRoots - 1], Op_Param, param))
+                ParseError(p, "List elements can only use numbers and other parameters");
+            out->listRange = true;
+            break;
+        }
+        if(p->token.type != Tok_Comma) break;
+        NextToken(p);
+    }
+    
+    Expect(p, Tok_RBracket, "']'");
+    if(!FinishDefinition(p, out)) return true;
+    
+    out->kind = Def_List;
+    out->param = param;
+    return true;
+}
+
+bool ParseDefinition(const char* text, ParamTable* params, Definition* out)
+{
+    out->kind = Def_Invalid;
+    out->ast.nodes.clear();
+    out->numRoots = 0;
+    out->param = -1;
+    out->listRange = false;
+    out->error[0] = '\0';
+    out->errorPos = 0;
+    
+    Parser p;
+    InitParser(&p, text, &out->ast, params);
+    
+    if(ParseDifferential(&p, out)) return !p.failed;
+    if(ParseComplex(&p, out)) return !p.failed;
+    if(ParseIteration(&p, out)) return !p.failed;
+    if(ParsePolar(&p, out)) return !p.failed;
+    if(ParseList(&p, out)) return !p.failed;
+    
+    // Parametric curves: (x(t), y(t)). If it turns out to be a regular
+    // expression which happens to start with a parenthesis, start over.
+    if(p.token.type == Tok_LParen)
+    {
+        NextToken(&p);
+        AstRef first = ParseExpr(&p);
+        if(!p.failed && p.token.type == Tok_Comma)
+        {
+            NextToken(&p);
+            AstRef second = ParseExpr(&p);
+            Expect(&p, Tok_RParen, "')'");
+            if(!FinishDefinition(&p, out)) return false;
+            
+            out->kind = Def_Parametric;
+            out->roots[0] = first;
+            out->roots[1] = second;
+            out->numRoots = 2;
+            return true;
+        }
+        
+        out->ast.nodes.clear();
+        InitParser(&p, text, &out->ast, params);
+    }
+    
+    AstRef lhs = ParseExpr(&p);
+    AstRef rhs = Ast_Null;
+    if(!p.failed && p.token.type == Tok_Tilde)
+    {
+        // Regressions are resolved against a table later, names can be columns or parameters
+        NextToken(&p);
+        AstRef model = ParseExpr(&p);
+        if(!FinishDefinition(&p, out)) return false;
+        
+        out->kind = Def_Regression;
+        out->roots[0] = lhs;
+        out->roots[1] = model;
+        out->numRoots = 2;
+        return true;
+    }
+    
+    if(!p.failed && p.token.type == Tok_Equal)
+    {
+        NextToken(&p);
+        rhs = ParseExpr(&p);
+    }
+    
+    if(!FinishDefinition(&p, out)) return false;
+    
+    const Ast* ast = &out->ast;
+    const AstNode* lhsNode = &ast->nodes[lhs];
+    AstRef value = rhs != Ast_Null ? rhs : lhs;
+    if(AstDependsOn(ast, lhs, Op_Var, Var_T) || (rhs != Ast_Null && AstDependsOn(ast, rhs, Op_Var, Var_T)))
+    {
+        ParseError(&p, "t can only be used in parametric and polar curves");
+        return FinishDefinition(&p, out);
+    }
+    
+    if(rhs == Ast_Null)
+    {
+        if(AstDependsOn(ast, lhs, Op_Var, Var_Y))
+        {
+            ParseError(&p, "Expressions using y need an equation");
+            return FinishDefinition(&p, out);
+        }
+        
+        out->kind = Def_Explicit;
+    }
+    else if(lhsNode->op == Op_Var && lhsNode->index == Var_Y && !AstDependsOn(ast, rhs, Op_Var, Var_Y))
+    {
+        out->kind = Def_Explicit;
+    }
+    else if(lhsNode->op == Op_Param && !AstDependsOn(ast, rhs, Op_Var, Var_X) &&
+            !AstDependsOn(ast, rhs, Op_Var, Var_Y) && !AstDependsOn(ast, rhs, Op_Param, lhsNode->index))
+    {
+        out->kind = Def_Assignment;
+        out->param = (int)lhsNode->index;
+    }
+    else
+    {
+        out->kind = Def_Implicit;
+        value = AstOp(&out->ast, Op_Sub, lhs, rhs);
+    }
+    
+    out->roots[0] = value;
+    out->numRoots = 1;
+    return true;
+}
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <string>
+
+// Math expression parser. Text is parsed into a flat tree of nodes,
+// which the compiler then turns into a program for the interpreter.
+
+enum OpCode : uint8_t
+{
+    // Leaves
+    Op_Const,
+    Op_Var,
+    Op_Param,
+    Op_Bound,  // Variable of an enclosing integral or sum, index is its binding slot
+    
+    // Arithmetic
+    Op_Neg,
+    Op_Add,
+    Op_Sub,
+    Op_Mul,
+    Op_Div,
+    Op_Pow,
+    
+    // Builtin functions
+    Op_Sqrt,
+    Op_Abs,
+    Op_Exp,
+    Op_Ln,
+    Op_Log10,
+    Op_Log2,
+    Op_Sin,
+    Op_Cos,
+    Op_Tan,
+    Op_Asin,
+    Op_Acos,
+    Op_Atan,
+    Op_Atan2,
+    Op_Sinh,
+    Op_Cosh,
+    Op_Tanh,
+    Op_Floor,
+    Op_Ceil,
+    Op_Round,
+    Op_Sign,
+    Op_Min,
+    Op_Max,
+    Op_Mod,
+    
+    // Conditionals, booleans are represented as 0 and 1
+    Op_Less,
+    Op_LessEqual,
+    Op_Greater,
+    Op_GreaterEqual,
+    Op_Equal,
+    Op_And,
+    Op_Select,  // Condition, then, else
+    
+    // Bindings: the bounds are operands, the body is a third child that
+    // is compiled on its own and evaluated by the operation
+    Op_Integral,  // integral(f, a, b): x is bound in f
+    Op_Sum,       // sum(n, a, b, f): n runs over the integers in [a, b]
+    
+    Op_Count
+};
+
+struct OpInfo
+{
+    const char* name;
+    int arity;
+};
+
+extern const OpInfo opInfos[Op_Count];
+
+enum Variable
+{
+    Var_X = 0,
+    Var_Y,
+    Var_T,
+    Var_Count,
+    
+    // Complex functions only, lowered to x + iy and constants before compiling
+    Var_Z = Var_Count,
+    Var_I,
+    Var_C,  // Iterated maps only
+};
+
+extern const char* varNames[Var_Count];
+
+typedef uint32_t AstRef;
+#define Ast_Null UINT32_MAX
+#define Ast_MaxChildren 3
+#define Ast_MaxBindings 4  // Integrals and sums nested in one another
+
+struct AstNode
+{
+    OpCode op;
+    uint8_t childCount;
+    AstRef children[Ast_MaxChildren];
+    double value;    // Op_Const
+    uint32_t index;  // Op_Var, Op_Param, Op_Bound, and the slot of bindings
+};
+
+struct Ast
+{
+    std::vector<AstNode> nodes;
+};
+
+AstRef AstConst(Ast* ast, double value);
+AstRef AstLeaf(Ast* ast, OpCode op, uint32_t index);
+AstRef AstOp(Ast* ast, OpCode op, AstRef a, AstRef b = Ast_Null, AstRef c = Ast_Null);
+AstRef AstBinding(Ast* ast, OpCode op, AstRef first, AstRef last, AstRef body, uint32_t slot);
+bool AstDependsOn(const Ast* ast, AstRef node, OpCode leafOp, uint32_t index);
+// Appends the derivative of node with respect to a variable or a parameter.
+// Returns Ast_Null where it's zero everywhere, so that those terms vanish
+// instead of being multiplied by zero (which the compiler can't fold).
+AstRef AstDerivative(Ast* ast, AstRef node, OpCode leafOp, uint32_t index);
+
+// Named parameters (sliders), shared between all definitions. Parameters can
+// also hold lists (see Def_List): their value is then the first element, and
+// curves using them are drawn once per element (see curves.h).
+struct ParamTable
+{
+    std::vector<std::string> names;
+    std::vector<double> values;
+    std::vector<std::vector<double>> lists;  // Empty for plain parameters
+    uint32_t listVersion = 0;                // Bumped when a list changes
+};
+
+int FindParam(const ParamTable* table, const char* name, int length);
+int FindOrAddParam(ParamTable* table, const char* name, int length);
+
+enum DefinitionKind
+{
+    Def_Invalid = 0,
+    Def_Explicit,    // y = f(x)
+    Def_Implicit,    // f(x, y) = g(x, y), stored as f - g
+    Def_Parametric,  // (x(t), y(t)), or r = f(t) as (f(t) cos t, f(t) sin t)
+    Def_Assignment,  // a = 3
+    Def_Regression,  // y1 ~ a x1 + b, fitted to table columns: roots are the data and the model
+    
+    // Differential equations, the roots are dx/ds and dy/ds along the solutions
+    Def_SlopeField,   // y' = f(x, y), dx/ds is 1
+    Def_VectorField,  // (x', y') = (f(x, y), g(x, y))
+    
+    // f(z) = g(z), the roots are the real and imaginary parts of g over z = x + iy
+    Def_Complex,
+    
+    // z -> f(z, c), iterated from z = 0 where c is the point, or from the point
+    // when f doesn't use c. f is a polynomial in z plus a multiple of c, the
+    // roots are the real and imaginary parts of the factor of c, then of the
+    // coefficients of z^0 up to z^degree.
+    Def_Iteration,
+    
+    // a = [1, 2, 3], a = [1...10] or a = [0, 0.5...10]. The roots are the
+    // elements, or the ends of the range and the second element.
+    Def_List,
+};
+
+#define Def_MaxRoots 16
+#define Def_MaxDegree (Def_MaxRoots / 2 - 2)  // Of iterated maps
+
+struct Definition
+{
+    DefinitionKind kind;
+    Ast ast;
+    AstRef roots[Def_MaxRoots];
+    uint32_t numRoots;
+    int param;  // Def_Assignment and Def_List: the parameter being assigned
+    bool listRange;  // Def_List: [first...last] or [first, second...last]
+    
+    char error[128];
+    int errorPos;
+};
+
+// Returns false on error, in which case out->error contains the message
+bool ParseDefinition(const char* text, ParamTable* params, Definition* out);
@@ -0,0 +1,142 @@
+#include "plot.h"
+
+#include <stdio.h>
+#include <math.h>
+
+#ifndef IMGUI_DEFINE_MATH_OPERATORS
+#define IMGUI_DEFINE_MATH_OPERATORS
+#endif
+#include "imgui.h"
+
+void InitPlot(Plot* plot, int width, int height)
+{
+    // Same scale on both axes to start with, 20 units across
+    double aspect = width > 0 ? (double)height / width : 1.0;
+    plot->view.xMin = -10.0;
+    plot->view.xMax = 10.0;
+    plot->view.yMin = -10.0 * aspect;
+    plot->view.yMax = 10.0 * aspect;
+    plot->view.width = width;
+    plot->view.height = height;
+}
+
+double PlotPixelWidth(const PlotView* view)
+{
+    return (view->xMax - view->xMin) / (view->width > 0 ? view->width : 1);
+}
+
+double PlotPixelHeight(const PlotView* view)
+{
+    return (view->yMax - view->yMin) / (view->height > 0 ? view->height : 1);
+}
+
+void UpdatePlotView(PlotView* view, int width, int height)
+{
+    // Resizing keeps the center and the scale
+    if((width != view->width || height != view->height) && width > 0 && height > 0 && view->width > 0 && view->height > 0)
+    {
+        double centerX = (view->xMin + view->xMax) * 0.5;
+        double centerY = (view->yMin + view->yMax) * 0.5;
+        double halfWidth = PlotPixelWidth(view) * width * 0.5;
+        double halfHeight = PlotPixelHeight(view) * height * 0.5;
+        view->xMin = centerX - halfWidth;
+        view->xMax = centerX + halfWidth;
+        view->yMin = centerY - halfHeight;
+        view->yMax = centerY + halfHeight;
+    }
+    view->width = width;
+    view->height = height;
+    
+    ImGuiIO& io = ImGui::GetIO();
+    if(io.WantCaptureMouse || io.DisplaySize.x <= 0 || io.DisplaySize.y <= 0) return;
+    
+    // Mouse position as a fraction of the window, y going up
+    double u = io.MousePos.x / io.DisplaySize.x;
+    double v = 1.0 - io.MousePos.y / io.DisplaySize.y;
+    double rangeX = view->xMax - view->xMin;
+    double rangeY = view->yMax - view->yMin;
+    
+    if(ImGui::IsMouseDown(ImGuiMouseButton_Left))
+    {
+        double dx = io.MouseDelta.x / io.DisplaySize.x * rangeX;
+        double dy = io.MouseDelta.y / io.DisplaySize.y * rangeY;
+        view->xMin -= dx;
+        view->xMax -= dx;
+        view->yMin += dy;
+        view->yMax += dy;
+    }
+    
+    // Zoom around the point under the mouse
+    if(io.MouseWheel != 0.0f)
+    {
+        double zoom = pow(0.85, io.MouseWheel);
+        double anchorX = view->xMin + u * rangeX;
+        double anchorY = view->yMin + v * rangeY;
+        view->xMin = anchorX - (anchorX - view->xMin) * zoom;
+        view->xMax = anchorX + (view->xMax - anchorX) * zoom;
+        view->yMin = anchorY - (anchorY - view->yMin) * zoom;
+        view->yMax = anchorY + (view->yMax - anchorY) * zoom;
+    }
+}
+
+// Smallest of 1, 2, 5 times a power of 10 that's at least minStep
+static double GridStep(double minStep)
+{
+    double power = pow(10.0, floor(log10(minStep)));
+    if(power >= minStep) return power;
+    if(power * 2 >= minStep) return power * 2;
+    if(power * 5 >= minStep) return power * 5;
+    return power * 10;
+}
+
+void DrawPlotGrid(const PlotView* view)
+{
+    ImGuiIO& io = ImGui::GetIO();
+    ImVec2 size = io.DisplaySize;
+    double rangeX = view->xMax - view->xMin;
+    double rangeY = view->yMax - view->yMin;
+    if(size.x <= 0 || size.y <= 0 || !(rangeX > 0) || !(rangeY > 0)) return;
+    
+    ImDrawList* drawList = ImGui::GetBackgroundDrawList();
+    const ImU32 gridColor = IM_COL32(255, 255, 255, 28);
+    const ImU32 axisColor = IM_COL32(255, 255, 255, 120);
+    const ImU32 labelColor = IM_COL32(255, 255, 255, 150);
+    const float minSpacing = 90.0f;
+    
+    double stepX = GridStep(rangeX * minSpacing / size.x);
+    double stepY = GridStep(rangeY * minSpacing / size.y);
+    
+    float axisX = (float)((0.0 - view->xMin) / rangeX * size.x);
+    float axisY = (float)((view->yMax - 0.0) / rangeY * size.y);
+    
+    // Labels stick to the edges when the axes are out of view
+    float labelX = axisX < 4.0f ? 4.0f : (axisX > size.x - 60.0f ? size.x - 60.0f : axisX + 4.0f);
+    float labelY = axisY < 4.0f ? 4.0f : (axisY > size.y - 20.0f ? size.y - 20.0f : axisY + 4.0f);
+    
+    char label[64];
+    // Lines are indexed, accumulating the steps would drift when zoomed far from the origin
+    for(double i = ceil(view->xMin / stepX); i <= floor(view->xMax / stepX); ++i)
+    {
+        double x = i * stepX;
+        float sx = (float)((x - view->xMin) / rangeX * size.x);
+        drawList->AddLine(ImVec2(sx, 0), ImVec2(sx, size.y), gridColor);
+        
+        if(fabs(x) < stepX * 1e-6) continue;
+        snprintf(label, sizeof(label), "%g", x);
+        drawList->AddText(ImVec2(sx + 3.0f, labelY), labelColor, label);
+    }
+    
+    for(double i = ceil(view->yMin / stepY); i <= floor(view->yMax / stepY); ++i)
+    {
+        double y = i * stepY;
+        float sy = (float)((view->yMax - y) / rangeY * size.y);
+        drawList->AddLine(ImVec2(0, sy), ImVec2(size.x, sy), gridColor);
+        
+        if(fabs(y) < stepY * 1e-6) continue;
+        snprintf(label, sizeof(label), "%g", y);
+        drawList->AddText(ImVec2(labelX, sy - 16.0f), labelColor, label);
+    }
+    
+    drawList->AddLine(ImVec2(axisX, 0), ImVec2(axisX, size.y), axisColor);
+    drawList->AddLine(ImVec2(0, axisY), ImVec2(size.x, axisY), axisColor);
+}
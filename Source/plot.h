@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vector>
+
+// The plot fills the whole window, behind the ImGui windows. It's drawn at the
+// start of the frame's render pass, and its grid goes on the ImGui background
+// draw list so it's rendered right after.
+
+struct ScatterSeries;
+
+// Visible range in data units, size of the framebuffer in pixels
+struct PlotView
+{
+    double xMin;
+    double xMax;
+    double yMin;
+    double yMax;
+    int width;
+    int height;
+};
+
+struct Plot
+{
+    PlotView view;
+    std::vector<ScatterSeries*> scatter;
+};
+
+void InitPlot(Plot* plot, int width, int height);
+// Keeps the scale on resizes, pans and zooms with the mouse when ImGui doesn't want it
+void UpdatePlotView(PlotView* view, int width, int height);
+void DrawPlotGrid(const PlotView* view);
+
+// Data units per pixel
+double PlotPixelWidth(const PlotView* view);
+double PlotPixelHeight(const PlotView* view);
@@ -0,0 +1,87 @@
+#ifndef PLOTTER_SHM_H
+#define PLOTTER_SHM_H
+
+#include <stdint.h>
+
+/*
+ * Layout of a shared memory feed, for producers living on the same machine.
+ * This header is plain C so it can be included by the producers, see
+ * Examples/shm_producer.c.
+ *
+ * The producer creates a named segment (shm_open on POSIX systems, a named file
+ * mapping on windows) starting with a PlotterShmHeader, followed by one array
+ * of `capacity` values per column. Plotter maps it read only and reads the
+ * columns in place, nothing is copied or parsed on the way.
+ *
+ * Columns are circular: row r is at index r % capacity of every column. To
+ * append rows the producer writes the values of every column, then publishes
+ * them by storing the new row count to writeCursor with release semantics.
+ * Plotter loads writeCursor with acquire semantics and only reads the rows
+ * before it, at most the last capacity of them. Nothing slows the producer
+ * down, so when it laps the reader the oldest rows of a frame can be torn,
+ * those are the ones about to go out of the window anyway.
+ *
+ * schemaSequence works like a seqlock for everything else: the producer makes
+ * it odd before (re)writing the header and the column table, and even once
+ * done. Plotter attaches when it's even and detaches when it changes. A new
+ * segment is all zeros, which reads as not ready until magic is written.
+ * Restarting producers should reuse the segment rather than unlink it: make
+ * the sequence odd, grow the segment if needed (shrinking it would fault the
+ * readers still mapping its end), rewrite the header with writeCursor back to
+ * 0 and make the sequence even again. Plotter then attaches to the new schema
+ * by itself.
+ *
+ * All values are native-endian, offsets are in bytes from the start of the
+ * segment and are multiples of PlotterShm_Alignment.
+ */
+
+#define PlotterShm_Magic 0x4d48535452544c50ull  /* "PLTRTSHM" */
+#define PlotterShm_Version 1
+#define PlotterShm_MaxColumns 16
+#define PlotterShm_Alignment 64
+
+enum PlotterShmType
+{
+    PlotterShm_F32 = 0,
+    PlotterShm_F64 = 1,
+};
+
+typedef struct PlotterShmColumn
+{
+    char name[48];  /* Null terminated */
+    uint32_t type;  /* PlotterShmType */
+    uint32_t reserved;
+    uint64_t offset;  /* Of the column's capacity values */
+} PlotterShmColumn;
+
+typedef struct PlotterShmHeader
+{
+    /* Written once, while schemaSequence is odd */
+    uint64_t magic;
+    uint32_t version;
+    uint32_t headerSize;  /* sizeof(PlotterShmHeader) */
+    uint64_t segmentSize;
+    uint64_t capacity;  /* Rows per column */
+    uint32_t columnCount;
+    uint32_t reserved0;
+    uint64_t reserved1[3];
+    
+    /* Updated by the producer, on their own cache line */
+    uint64_t schemaSequence;
+    uint64_t writeCursor;  /* Rows published since the start */
+    uint64_t reserved2[6];
+    
+    PlotterShmColumn columns[PlotterShm_MaxColumns];
+} PlotterShmHeader;
+
+static inline uint64_t PlotterShmAlign(uint64_t offset)
+{
+    return (offset + PlotterShm_Alignment - 1) & ~(uint64_t)(PlotterShm_Alignment - 1);
+}
+
+static inline uint64_t PlotterShmTypeSize(uint32_t type)
+{
+    return type == PlotterShm_F64 ? 8 : 4;
+}
+
+#endif
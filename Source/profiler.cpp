@@ -0,0 +1,467 @@
+#include "profiler.h"
+#include "core.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include <assert.h>
+
+#ifndef IMGUI_DEFINE_MATH_OPERATORS
+#define IMGUI_DEFINE_MATH_OPERATORS
+#endif
+#include "imgui.h"
+
+struct Profiler
+{
+    std::mutex mutex;
+    
+    ProfileFrame frames[Profile_MaxFrames];
+    uint64_t frameIndex;  // Index of the frame currently being recorded
+    bool paused;
+    
+    const char* threadNames[Profile_MaxThreads];
+    std::atomic<uint32_t> threadCount;
+};
+
+static Profiler profiler;
+
+struct ProfileThreadState
+{
+    int index = -1;
+    uint32_t depth = 0;
+    const char* names[Profile_MaxDepth];
+    uint64_t starts[Profile_MaxDepth];
+};
+
+static thread_local ProfileThreadState profileThread;
+
+static uint32_t GetProfileThreadIndex()
+{
+    if(profileThread.index == -1)
+    {
+        uint32_t index = profiler.threadCount.fetch_add(1);
+        if(index >= Profile_MaxThreads) index = Profile_MaxThreads - 1;
+        profileThread.index = (int)index;
+    }
+    
+    return (uint32_t)profileThread.index;
+}
+
+static ProfileFrame* GetProfileFrame(uint64_t index)
+{
+    ProfileFrame* frame = &profiler.frames[index % Profile_MaxFrames];
+    if(frame->index != index) return nullptr;
+    return frame;
+}
+
+void ProfilerBeginFrame()
+{
+    std::lock_guard<std::mutex> lock(profiler.mutex);
+    if(profiler.paused) return;
+    
+    ++profiler.frameIndex;
+    ProfileFrame* frame = &profiler.frames[profiler.frameIndex % Profile_MaxFrames];
+    frame->index = profiler.frameIndex;
+    frame->start = GetTimeNs();
+    frame->end = 0;
+    frame->eventCount = 0;
+    frame->droppedEvents = 0;
+    frame->hasGpuTime = false;
+}
+
+void ProfilerEndFrame()
+{
+    std::lock_guard<std::mutex> lock(profiler.mutex);
+    if(profiler.paused) return;
+    
+    ProfileFrame* frame = GetProfileFrame(profiler.frameIndex);
+    if(frame) frame->end = GetTimeNs();
+}
+
+void ProfilerBeginZone(const char* name)
+{
+    ProfileThreadState& state = profileThread;
+    if(state.depth < Profile_MaxDepth)
+    {
+        state.names[state.depth] = name;
+        state.starts[state.depth] = GetTimeNs();
+    }
+    
+    ++state.depth;
+}
+
+void ProfilerEndZone()
+{
+    ProfileThreadState& state = profileThread;
+    assert(state.depth > 0);
+    --state.depth;
+    if(state.depth >= Profile_MaxDepth) return;
+    
+    ProfileEvent event;
+    event.name   = state.names[state.depth];
+    event.start  = state.starts[state.depth];
+    event.end    = GetTimeNs();
+    event.thread = GetProfileThreadIndex();
+    event.depth  = state.depth;
+    
+    // Zones go in the frame in which they end
+    std::lock_guard<std::mutex> lock(profiler.mutex);
+    if(profiler.paused) return;
+    
+    ProfileFrame* frame = GetProfileFrame(profiler.frameIndex);
+    if(!frame) return;
+    
+    if(frame->eventCount < Profile_MaxEventsPerFrame)
+        frame->events[frame->eventCount++] = event;
+    else
+        ++frame->droppedEvents;
+}
+
+void ProfilerSetThreadName(const char* name)
+{
+    uint32_t index = GetProfileThreadIndex();
+    std::lock_guard<std::mutex> lock(profiler.mutex);
+    profiler.threadNames[index] = name;
+}
+
+bool ProfilerExportChromeTrace(const char* path)
+{
+    FILE* file = fopen(path, "wb");
+    if(!file) return false;
+    
+    std::lock_guard<std::mutex> lock(profiler.mutex);
+    
+    // Find the oldest frame which is still available
+    uint64_t first = profiler.frameIndex;
+    while(first > 1 && GetProfileFrame(first - 1) && profiler.frameIndex - (first - 1) < Profile_MaxFrames)
+        --first;
+    
+    ProfileFrame* firstFrame = GetProfileFrame(first);
+    uint64_t origin = firstFrame ? firstFrame->start : 0;
+    const uint32_t gpuThread = Profile_MaxThreads;
+    
+    fprintf(file, "{\"traceEvents\":[\n");
+    
+    uint32_t threadCount = profiler.threadCount.load();
+    if(threadCount > Profile_MaxThreads) threadCount = Profile_MaxThreads;
+    for(uint32_t i = 0; i < threadCount; ++i)
+    {
+        const char* name = profiler.threadNames[i] ? profiler.threadNames[i] : "Worker";
+        fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"%s\"}},\n", i, name);
+    }
+    fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"GPU\"}}", gpuThread);
+    
+    for(uint64_t i = first; i <= profiler.frameIndex; ++i)
+    {
+        ProfileFrame* frame = GetProfileFrame(i);
+        if(!frame || frame->end == 0) continue;
+        
+        fprintf(file, ",\n{\"name\":\"Frame %llu\",\"ph\":\"X\",\"pid\":0,\"tid\":0,\"ts\":%.3f,\"dur\":%.3f}",
+                (unsigned long long)frame->index,
+                (frame->start - origin) / 1000.0, (frame->end - frame->start) / 1000.0);
+        
+        for(uint32_t j = 0; j < frame->eventCount; ++j)
+        {
+            ProfileEvent* event = &frame->events[j];
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                    event->name, event->thread,
+                    (event->start - origin) / 1000.0, (event->end - event->start) / 1000.0);
+        }
+        
+        if(frame->hasGpuTime)
+        {
+            fprintf(file, ",\n{\"name\":\"Render pass\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                    gpuThread, (frame->gpuStart - origin) / 1000.0, (frame->gpuEnd - frame->gpuStart) / 1000.0);
+        }
+    }
+    
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    return true;
+}
+
+// Stable color for each zone name, so the same zone is easy to follow across frames
+static ImU32 ProfileZoneColor(const char* name)
+{
+    uint32_t hash = 2166136261u;
+    for(const char* c = name; *c; ++c)
+        hash = (hash ^ (uint8_t)*c) * 16777619u;
+    
+    float hue = (hash % 360) / 360.0f;
+    float r, g, b;
+    ImGui::ColorConvertHSVtoRGB(hue, 0.55f, 0.8f, r, g, b);
+    return ImGui::GetColorU32(ImVec4(r, g, b, 1.0f));
+}
+
+void ShowProfilerWindow(bool* open)
+{
+    if(!ImGui::Begin("Profiler", open))
+    {
+        ImGui::End();
+        return;
+    }
+    
+    static ProfileFrame selected;
+    static int frameOffset = 0;  // 0 is the latest completed frame
+    static float frameTimes[Profile_MaxFrames];
+    static char exportPath[256] = "plotter_trace.json";
+    static bool exportFailed = false;
+    
+    int historyCount = 0;
+    bool hasSelected = false;
+    uint32_t threadCount;
+    const char* threadNames[Profile_MaxThreads + 1];
+    
+    {
+        std::lock_guard<std::mutex> lock(profiler.mutex);
+        
+        for(int i = Profile_MaxFrames - 1; i >= 0; --i)
+        {
+            uint64_t index = profiler.frameIndex - 1 - i;
+            ProfileFrame* frame = index < profiler.frameIndex ? GetProfileFrame(index) : nullptr;
+            if(!frame || frame->end == 0) continue;
+            frameTimes[historyCount++] = (frame->end - frame->start) / 1000000.0f;
+        }
+        
+        uint64_t selectedIndex = profiler.frameIndex - 1 - frameOffset;
+        ProfileFrame* frame = selectedIndex < profiler.frameIndex ? GetProfileFrame(selectedIndex) : nullptr;
+        if(frame && frame->end != 0)
+        {
+            memcpy(&selected, frame, sizeof(ProfileFrame));
+            hasSelected = true;
+        }
+        
+        threadCount = profiler.threadCount.load();
+        if(threadCount > Profile_MaxThreads) threadCount = Profile_MaxThreads;
+        for(uint32_t i = 0; i < threadCount; ++i)
+            threadNames[i] = profiler.threadNames[i] ? profiler.threadNames[i] : "Worker";
+        
+        ImGui::Checkbox("Paused", &profiler.paused);
+    }
+    
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(200.0f);
+    ImGui::InputText("##ExportPath", exportPath, sizeof(exportPath));
+    ImGui::SameLine();
+    if(ImGui::Button("Export Chrome trace"))
+        exportFailed = !ProfilerExportChromeTrace(exportPath);
+    if(exportFailed)
+    {
+        ImGui::SameLine();
+        ImGui::TextColored(ImVec4(1, 0.4f, 0.4f, 1), "Could not write file");
+    }
+    
+    // Rolling frame time history
+    float maxTime = 1000.0f / 60.0f;
+    for(int i = 0; i < historyCount; ++i)
+        if(frameTimes[i] > maxTime) maxTime = frameTimes[i];
+    
+    ImGui::PlotHistogram("##FrameTimes", frameTimes, historyCount, 0, "Frame time (ms)", 0.0f, maxTime,
+                         ImVec2(ImGui::GetContentRegionAvail().x, 60.0f));
+    ImGui::SliderInt("Frames ago", &frameOffset, 0, Profile_MaxFrames - 2);
+    
+    if(!hasSelected)
+    {
+        ImGui::TextUnformatted("No frame recorded yet.");
+        ImGui::End();
+        return;
+    }
+    
+    uint64_t frameDuration = selected.end - selected.start;
+    ImGui::Text("Frame %llu: %.3f ms", (unsigned long long)selected.index, frameDuration / 1000000.0);
+    if(selected.hasGpuTime)
+    {
+        ImGui::SameLine();
+        ImGui::Text("(GPU render pass: %.3f ms)", (selected.gpuEnd - selected.gpuStart) / 1000000.0);
+    }
+    if(selected.droppedEvents > 0)
+    {
+        ImGui::SameLine();
+        ImGui::TextColored(ImVec4(1, 0.8f, 0.3f, 1), "%u zones dropped", selected.droppedEvents);
+    }
+    
+    // Timeline of the selected frame, one lane per thread with nested zones stacked below.
+    // Zones can start in the previous frame, so the visible range covers those as well.
+    uint64_t rangeStart = selected.start;
+    uint64_t rangeEnd = selected.end;
+    for(uint32_t i = 0; i < selected.eventCount; ++i)
+    {
+        if(selected.events[i].start < rangeStart) rangeStart = selected.events[i].start;
+        if(selected.events[i].end > rangeEnd)     rangeEnd = selected.events[i].end;
+    }
+    if(selected.hasGpuTime && selected.gpuEnd > rangeEnd) rangeEnd = selected.gpuEnd;
+    
+    uint32_t laneDepth[Profile_MaxThreads + 1] = {0};
+    for(uint32_t i = 0; i < selected.eventCount; ++i)
+    {
+        ProfileEvent* event = &selected.events[i];
+        if(event->depth + 1 > laneDepth[event->thread]) laneDepth[event->thread] = event->depth + 1;
+    }
+    const uint32_t gpuLane = Profile_MaxThreads;
+    threadNames[gpuLane] = "GPU";
+    laneDepth[gpuLane] = selected.hasGpuTime ? 1 : 0;
+    
+    const float rowHeight = ImGui::GetTextLineHeight() + 4.0f;
+    const float labelWidth = 80.0f;
+    
+    ImDrawList* drawList = ImGui::GetWindowDrawList();
+    ImVec2 origin = ImGui::GetCursorScreenPos();
+    float width = ImGui::GetContentRegionAvail().x - labelWidth;
+    if(width < 50.0f) width = 50.0f;
+    double nsToPixels = width / (double)(rangeEnd - rangeStart > 0 ? rangeEnd - rangeStart : 1);
+    
+    float y = origin.y;
+    for(uint32_t lane = 0; lane <= Profile_MaxThreads; ++lane)
+    {
+        if(laneDepth[lane] == 0) continue;
+        if(lane < Profile_MaxThreads && lane >= threadCount) continue;
+        
+        drawList->AddText(ImVec2(origin.x, y), ImGui::GetColorU32(ImGuiCol_Text), threadNames[lane]);
+        
+        auto drawZone = [&](const char* name, uint64_t start, uint64_t end, uint32_t depth)
+        {
+            ImVec2 min = ImVec2(origin.x + labelWidth + (float)((start - rangeStart) * nsToPixels), y + depth * rowHeight);
+            ImVec2 max = ImVec2(origin.x + labelWidth + (float)((end - rangeStart) * nsToPixels), min.y + rowHeight - 1.0f);
+            if(max.x - min.x < 1.0f) max.x = min.x + 1.0f;
+            
+            drawList->AddRectFilled(min, max, ProfileZoneColor(name));
+            if(max.x - min.x > ImGui::CalcTextSize(name).x + 4.0f)
+            {
+                drawList->PushClipRect(min, max, true);
+                drawList->AddText(ImVec2(min.x + 2.0f, min.y + 2.0f), IM_COL32(0, 0, 0, 255), name);
+                drawList->PopClipRect();
+            }
+            
+            if(ImGui::IsMouseHoveringRect(min, max))
+                ImGui::SetTooltip("%s: %.3f ms", name, (end - start) / 1000000.0);
+        };
+        
+        if(lane == gpuLane)
+        {
+            drawZone("Render pass", selected.gpuStart, selected.gpuEnd, 0);
+        }
+        else
+        {
+            for(uint32_t i = 0; i < selected.eventCount; ++i)
+            {
+                ProfileEvent* event = &selected.events[i];
+                if(event->thread == lane)
+                    drawZone(event->name, event->start, event->end, event->depth);
+            }
+        }
+        
+        y += laneDepth[lane] * rowHeight + 4.0f;
+    }
+    
+    ImGui::Dummy(ImVec2(labelWidth + width, y - origin.y));
+    ImGui::End();
+}
+
+static void OnGPUReadbackMapped(WGPUBufferMapAsyncStatus status, void* userData)
+{
+    auto readback = (GPUReadback*)userData;
+    readback->busy = false;
+    if(status != WGPUBufferMapAsyncStatus_Success) return;
+    
+    auto timestamps = (const uint64_t*)wgpuBufferGetConstMappedRange(readback->buffer, 0, 2 * sizeof(uint64_t));
+    uint64_t duration = timestamps && timestamps[1] > timestamps[0] ? timestamps[1] - timestamps[0] : 0;
+    wgpuBufferUnmap(readback->buffer);
+    
+    std::lock_guard<std::mutex> lock(profiler.mutex);
+    ProfileFrame* frame = GetProfileFrame(readback->frameIndex);
+    if(!frame) return;
+    
+    frame->hasGpuTime = true;
+    frame->gpuStart = readback->submitTime;
+    frame->gpuEnd = readback->submitTime + duration;
+}
+
+void InitGPUProfiler(GPUProfiler* prof, WGPUDevice device, bool supported)
+{
+    memset(prof, 0, sizeof(GPUProfiler));
+    prof->supported = supported;
+    prof->current = -1;
+    if(!supported) return;
+    
+    WGPUQuerySetDescriptor querySetDesc = WGPU_QUERY_SET_DESCRIPTOR_INIT;
+    querySetDesc.label = "Timestamp queries";
+    querySetDesc.type = WGPUQueryType_Timestamp;
+    querySetDesc.count = 2;
+    prof->querySet = wgpuDeviceCreateQuerySet(device, &querySetDesc);
+    
+    WGPUBufferDescriptor resolveDesc = WGPU_BUFFER_DESCRIPTOR_INIT;
+    resolveDesc.label = "Timestamp resolve";
+    resolveDesc.usage = WGPUBufferUsage_QueryResolve | WGPUBufferUsage_CopySrc;
+    resolveDesc.size = 2 * sizeof(uint64_t);
+    prof->resolveBuffer = wgpuDeviceCreateBuffer(device, &resolveDesc);
+    
+    for(int i = 0; i < GPUProfile_NumReadbacks; ++i)
+    {
+        WGPUBufferDescriptor readbackDesc = WGPU_BUFFER_DESCRIPTOR_INIT;
+        readbackDesc.label = "Timestamp readback";
+        readbackDesc.usage = WGPUBufferUsage_MapRead | WGPUBufferUsage_CopyDst;
+        readbackDesc.size = 2 * sizeof(uint64_t);
+        prof->readbacks[i].buffer = wgpuDeviceCreateBuffer(device, &readbackDesc);
+    }
+}
+
+void CleanupGPUProfiler(GPUProfiler* prof)
+{
+    if(!prof->supported) return;
+    
+    for(int i = 0; i < GPUProfile_NumReadbacks; ++i)
+        wgpuBufferRelease(prof->readbacks[i].buffer);
+    wgpuBufferRelease(prof->resolveBuffer);
+    wgpuQuerySetRelease(prof->querySet);
+    memset(prof, 0, sizeof(GPUProfiler));
+}
+
+void GPUProfilerBeginPass(GPUProfiler* prof, WGPURenderPassDescriptor* desc, WGPURenderPassTimestampWrites* writes)
+{
+    prof->current = -1;
+    if(!prof->supported) return;
+    
+    // Skip this frame if the previous readbacks haven't come back yet
+    for(int i = 0; i < GPUProfile_NumReadbacks; ++i)
+    {
+        if(!prof->readbacks[i].busy)
+        {
+            prof->current = i;
+            break;
+        }
+    }
+    
+    if(prof->current == -1) return;
+    
+    *writes = WGPU_RENDER_PASS_TIMESTAMP_WRITES_INIT;
+    writes->querySet = prof->querySet;
+    writes->beginningOfPassWriteIndex = 0;
+    writes->endOfPassWriteIndex = 1;
+    desc->timestampWrites = writes;
+}
+
+void GPUProfilerResolve(GPUProfiler* prof, WGPUCommandEncoder encoder)
+{
+    if(prof->current == -1) return;
+    
+    GPUReadback* readback = &prof->readbacks[prof->current];
+    wgpuCommandEncoderResolveQuerySet(encoder, prof->querySet, 0, 2, prof->resolveBuffer, 0);
+    wgpuCommandEncoderCopyBufferToBuffer(encoder, prof->resolveBuffer, 0, readback->buffer, 0, 2 * sizeof(uint64_t));
+}
+
+void GPUProfilerAfterSubmit(GPUProfiler* prof)
+{
+    if(prof->current == -1) return;
+    
+    GPUReadback* readback = &prof->readbacks[prof->current];
+    readback->busy = true;
+    readback->submitTime = GetTimeNs();
+    {
+        std::lock_guard<std::mutex> lock(profiler.mutex);
+        readback->frameIndex = profiler.frameIndex;
+    }
+    
+    wgpuBufferMapAsync(readback->buffer, WGPUMapMode_Read, 0, 2 * sizeof(uint64_t), OnGPUReadbackMapped, readback);
+    prof->current = -1;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "webgpu/webgpu.h"
+
+// Frame profiler. CPU zones can be opened from any thread with ProfileScope,
+// GPU timings come from timestamp queries written around the render pass
+// (only if the adapter supports the TimestampQuery feature). The last
+// Profile_MaxFrames frames are kept around, so they can be inspected in the
+// profiler window or exported as a Chrome trace (chrome://tracing, perfetto).
+
+#define Profile_MaxFrames 240
+#define Profile_MaxEventsPerFrame 512
+#define Profile_MaxThreads 64
+#define Profile_MaxDepth 32
+
+struct ProfileEvent
+{
+    const char* name;  // Must be a string literal (or otherwise outlive the profiler)
+    uint64_t start;
+    uint64_t end;
+    uint32_t thread;
+    uint32_t depth;
+};
+
+struct ProfileFrame
+{
+    uint64_t index;
+    uint64_t start;
+    uint64_t end;
+    
+    ProfileEvent events[Profile_MaxEventsPerFrame];
+    uint32_t eventCount;
+    uint32_t droppedEvents;
+    
+    // Duration of the render pass on the GPU, filled in asynchronously
+    // a couple of frames later. There's no way to correlate the GPU clock
+    // with the CPU one, so the GPU zone is placed at submit time.
+    bool hasGpuTime;
+    uint64_t gpuStart;
+    uint64_t gpuEnd;
+};
+
+void ProfilerBeginFrame();
+void ProfilerEndFrame();
+void ProfilerBeginZone(const char* name);
+void ProfilerEndZone();
+void ProfilerSetThreadName(const char* name);
+bool ProfilerExportChromeTrace(const char* path);
+void ShowProfilerWindow(bool* open);
+
+struct ProfileZoneScope
+{
+    ProfileZoneScope(const char* name) { ProfilerBeginZone(name); }
+    ~ProfileZoneScope() { ProfilerEndZone(); }
+};
+
+#define ProfileConcat_(a, b) a##b
+#define ProfileConcat(a, b) ProfileConcat_(a, b)
+#define ProfileScope(name) ProfileZoneScope ProfileConcat(profileZone, __LINE__)(name)
+
+// GPU timestamps
+#define GPUProfile_NumReadbacks 3
+
+struct GPUReadback
+{
+    WGPUBuffer buffer;
+    bool busy;
+    uint64_t frameIndex;
+    uint64_t submitTime;
+};
+
+struct GPUProfiler
+{
+    bool supported;
+    WGPUQuerySet querySet;
+    WGPUBuffer resolveBuffer;
+    GPUReadback readbacks[GPUProfile_NumReadbacks];
+    int current;  // Readback used for this frame, -1 if all of them are still in flight
+};
+
+void InitGPUProfiler(GPUProfiler* prof, WGPUDevice device, bool supported);
+void CleanupGPUProfiler(GPUProfiler* prof);
+// Hooks up the timestamp writes to the render pass (if possible this frame)
+void GPUProfilerBeginPass(GPUProfiler* prof, WGPURenderPassDescriptor* desc, WGPURenderPassTimestampWrites* writes);
+// Copies the timestamps to the readback buffer, call after the pass has ended
+void GPUProfilerResolve(GPUProfiler* prof, WGPUCommandEncoder encoder);
+// Starts the readback, call after the command buffer has been submitted
+void GPUProfilerAfterSubmit(GPUProfiler* prof);
@@ -0,0 +1,323 @@
+#include "pyramid.h"
+#include "jobs.h"
+
+#include <math.h>
+#include <algorithm>
+
+struct Extent
+{
+    double min;
+    double max;
+    int64_t minPos;  // Only used to order the min and the max
+    int64_t maxPos;
+};
+
+static Extent EmptyExtent()
+{
+    return { INFINITY, -INFINITY, 0, 0 };
+}
+
+static void AddValue(Extent* extent, double min, double max, int64_t minPos, int64_t maxPos)
+{
+    if(min < extent->min)
+    {
+        extent->min = min;
+        extent->minPos = minPos;
+    }
+    if(max > extent->max)
+    {
+        extent->max = max;
+        extent->maxPos = maxPos;
+    }
+}
+
+static void BuildBaseBuckets(PyramidLevel* level, const double* values, int64_t count, int64_t first, int64_t last)
+{
+    for(int64_t b = first; b < last; ++b)
+    {
+        int64_t start = b * Pyramid_BaseBucket;
+        int64_t end = std::min(start + Pyramid_BaseBucket, count);
+        
+        Extent extent = EmptyExtent();
+        for(int64_t i = start; i < end; ++i)
+            AddValue(&extent, values[i], values[i], i, i);  // NaNs fail both comparisons
+        
+        level->mins[b] = extent.min;
+        level->maxs[b] = extent.max;
+        level->minFirst[b] = extent.minPos <= extent.maxPos;
+    }
+}
+
+static void BuildMergedBuckets(PyramidLevel* level, const PyramidLevel* below, int64_t belowCount, int64_t first, int64_t last)
+{
+    for(int64_t b = first; b < last; ++b)
+    {
+        int64_t left = b * 2;
+        int64_t right = left + 1;
+        if(right >= belowCount)
+        {
+            level->mins[b] = below->mins[left];
+            level->maxs[b] = below->maxs[left];
+            level->minFirst[b] = below->minFirst[left];
+            continue;
+        }
+        
+        // Ties go to the left bucket, like they do for the samples of a bucket
+        bool minLeft = below->mins[left] <= below->mins[right];
+        bool maxLeft = below->maxs[left] >= below->maxs[right];
+        level->mins[b] = minLeft ? below->mins[left] : below->mins[right];
+        level->maxs[b] = maxLeft ? below->maxs[left] : below->maxs[right];
+        
+        if(minLeft != maxLeft)
+            level->minFirst[b] = minLeft;
+        else
+            level->minFirst[b] = minLeft ? below->minFirst[left] : below->minFirst[right];
+    }
+}
+
+static void ResizeLevel(PyramidLevel* level, int64_t buckets)
+{
+    level->mins.resize(buckets);
+    level->maxs.resize(buckets);
+    level->minFirst.resize(buckets);
+}
+
+void UpdatePyramid(MinMaxPyramid* pyramid, const double* values, int64_t count)
+{
+    if(count < pyramid->count) ClearPyramid(pyramid);
+    if(count == pyramid->count) return;
+    
+    // Only the buckets touched by the new samples are rebuilt,
+    // the first of them might have been partial until now
+    int64_t buckets = (count + Pyramid_BaseBucket - 1) / Pyramid_BaseBucket;
+    int64_t dirty = pyramid->count / Pyramid_BaseBucket;
+    
+    PyramidLevel* base = &pyramid->levels[0];
+    ResizeLevel(base, buckets);
+    ParallelFor(buckets - dirty, 1 << 14, [&](int64_t begin, int64_t end, int task)
+    {
+        BuildBaseBuckets(base, values, count, dirty + begin, dirty + end);
+    });
+    
+    int numLevels = 1;
+    while(buckets > 1 && numLevels < Pyramid_MaxLevels)
+    {
+        int64_t belowCount = buckets;
+        buckets = (buckets + 1) / 2;
+        dirty /= 2;
+        
+        PyramidLevel* level = &pyramid->levels[numLevels];
+        const PyramidLevel* below = &pyramid->levels[numLevels - 1];
+        ResizeLevel(level, buckets);
+        ParallelFor(buckets - dirty, 1 << 14, [&](int64_t begin, int64_t end, int task)
+        {
+            BuildMergedBuckets(level, below, belowCount, dirty + begin, dirty + end);
+        });
+        
+        ++numLevels;
+    }
+    
+    pyramid->numLevels = numLevels;
+    pyramid->count = count;
+}
+
+void ClearPyramid(MinMaxPyramid* pyramid)
+{
+    for(int i = 0; i < Pyramid_MaxLevels; ++i)
+    {
+        pyramid->levels[i].mins.clear();
+        pyramid->levels[i].maxs.clear();
+        pyramid->levels[i].minFirst.clear();
+    }
+    
+    pyramid->numLevels = 0;
+    pyramid->count = 0;
+}
+
+static void AddBucket(Extent* extent, const MinMaxPyramid* pyramid, int level, int64_t bucket)
+{
+    const PyramidLevel* l = &pyramid->levels[level];
+    
+    // Buckets are disjoint and have at least 2 samples, so start and start + 1
+    // are enough to order them against anything else in the range
+    int64_t start = (bucket * Pyramid_BaseBucket) << level;
+    int64_t minPos = l->minFirst[bucket] ? start : start + 1;
+    int64_t maxPos = l->minFirst[bucket] ? start + 1 : start;
+    AddValue(extent, l->mins[bucket], l->maxs[bucket], minPos, maxPos);
+}
+
+// Min and max of ys[begin, end), using the largest buckets that fit
+static Extent RangeExtent(const MinMaxPyramid* pyramid, const double* ys, int64_t begin, int64_t end)
+{
+    Extent extent = EmptyExtent();
+    
+    int64_t b0 = (begin + Pyramid_BaseBucket - 1) / Pyramid_BaseBucket;
+    int64_t b1 = std::min(end, pyramid->count) / Pyramid_BaseBucket;
+    if(b0 >= b1)
+    {
+        for(int64_t i = begin; i < end; ++i)
+            AddValue(&extent, ys[i], ys[i], i, i);
+        return extent;
+    }
+    
+    for(int64_t i = begin; i < b0 * Pyramid_BaseBucket; ++i)
+        AddValue(&extent, ys[i], ys[i], i, i);
+    for(int64_t i = b1 * Pyramid_BaseBucket; i < end; ++i)
+        AddValue(&extent, ys[i], ys[i], i, i);
+    
+    for(int level = 0; b0 < b1; ++level)
+    {
+        if(b0 & 1) AddBucket(&extent, pyramid, level, b0++);
+        if(b1 & 1) AddBucket(&extent, pyramid, level, --b1);
+        b0 >>= 1;
+        b1 >>= 1;
+    }
+    
+    return extent;
+}
+
+// First index with x >= value
+static int64_t LowerBound(const double* xs, int64_t count, double value)
+{
+    if(!xs)
+    {
+        if(value <= 0) return 0;
+        return std::min((int64_t)ceil(value), count);
+    }
+    
+    return std::lower_bound(xs, xs + count, value) - xs;
+}
+
+int64_t DownsampleSeries(const MinMaxPyramid* pyramid, const double* xs, const double* ys, int64_t count,
+                         double xMin, double xMax, int pixels, DownsampleMode mode,
+                         std::vector<double>* outX, std::vector<double>* outY)
+{
+    outX->clear();
+    outY->clear();
+    count = std::min(count, pyramid->count);
+    if(count <= 0 || pixels <= 0 || !(xMax > xMin)) return 0;
+    
+    // One extra sample on each side, so lines continue past the edges
+    int64_t first = std::max(LowerBound(xs, count, xMin) - 1, (int64_t)0);
+    int64_t last = std::min(LowerBound(xs, count, xMax) + 1, count);
+    
+    if(last - first <= (int64_t)pixels * 2)
+    {
+        for(int64_t i = first; i < last; ++i)
+        {
+            outX->push_back(xs ? xs[i] : (double)i);
+            outY->push_back(ys[i]);
+        }
+        return (int64_t)outX->size();
+    }
+    
+    outX->reserve(pixels * 2 + 2);
+    outY->reserve(pixels * 2 + 2);
+    outX->push_back(xs ? xs[first] : (double)first);
+    outY->push_back(ys[first]);
+    
+    double width = (xMax - xMin) / pixels;
+    int64_t begin = first + 1;
+    for(int p = 0; p < pixels; ++p)
+    {
+        int64_t end = p == pixels - 1 ? last - 1 : std::max(LowerBound(xs, count, xMin + (p + 1) * width), begin);
+        Extent extent = RangeExtent(pyramid, ys, begin, end);
+        begin = end;
+        if(extent.min > extent.max) continue;
+        
+        double x = xMin + (p + 0.5) * width;
+        bool minFirst = extent.minPos <= extent.maxPos;
+        outX->push_back(x);
+        outY->push_back(minFirst ? extent.min : extent.max);
+        if(extent.min != extent.max)
+        {
+            outX->push_back(x);
+            outY->push_back(minFirst ? extent.max : extent.min);
+        }
+    }
+    
+    outX->push_back(xs ? xs[last - 1] : (double)(last - 1));
+    outY->push_back(ys[last - 1]);
+    
+    // The envelope is already small, so selecting from it is cheap
+    if(mode == Downsample_LTTB && (int64_t)outX->size() > pixels)
+    {
+        std::vector<double> envelopeX, envelopeY;
+        envelopeX.swap(*outX);
+        envelopeY.swap(*outY);
+        DownsampleLTTB(envelopeX.data(), envelopeY.data(), (int64_t)envelopeX.size(), pixels, outX, outY);
+    }
+    
+    return (int64_t)outX->size();
+}
+
+int64_t DownsampleLTTB(const double* xs, const double* ys, int64_t count, int64_t threshold,
+                       std::vector<double>* outX, std::vector<double>* outY)
+{
+    outX->clear();
+    outY->clear();
+    
+    if(threshold >= count || threshold < 3)
+    {
+        outX->assign(xs, xs + count);
+        outY->assign(ys, ys + count);
+        return count;
+    }
+    
+    outX->reserve(threshold);
+    outY->reserve(threshold);
+    outX->push_back(xs[0]);
+    outY->push_back(ys[0]);
+    
+    // The first and last points are always kept, the ones in between are split
+    // in threshold - 2 buckets. Each bucket keeps the point forming the largest
+    // triangle with the previously kept point and the average of the next bucket.
+    double bucketSize = (double)(count - 2) / (threshold - 2);
+    int64_t kept = 0;
+    for(int64_t b = 0; b < threshold - 2; ++b)
+    {
+        int64_t start = (int64_t)(b * bucketSize) + 1;
+        int64_t end = (int64_t)((b + 1) * bucketSize) + 1;
+        int64_t nextStart = end;
+        int64_t nextEnd = std::min((int64_t)((b + 2) * bucketSize) + 1, count);
+        
+        double avgX = 0, avgY = 0;
+        for(int64_t i = nextStart; i < nextEnd; ++i)
+        {
+            avgX += xs[i];
+            avgY += ys[i];
+        }
+        int64_t nextCount = nextEnd - nextStart;
+        if(nextCount > 0)
+        {
+            avgX /= nextCount;
+            avgY /= nextCount;
+        }
+        else
+        {
+            avgX = xs[count - 1];
+            avgY = ys[count - 1];
+        }
+        
+        double ax = xs[kept], ay = ys[kept];
+        double maxArea = -1;
+        int64_t best = start;
+        for(int64_t i = start; i < end; ++i)
+        {
+            double area = fabs((ax - avgX) * (ys[i] - ay) - (ax - xs[i]) * (avgY - ay));
+            if(area > maxArea)
+            {
+                maxArea = area;
+                best = i;
+            }
+        }
+        
+        outX->push_back(xs[best]);
+        outY->push_back(ys[best]);
+        kept = best;
+    }
+    
+    outX->push_back(xs[count - 1]);
+    outY->push_back(ys[count - 1]);
+    return threshold;
+}
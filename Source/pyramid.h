@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// Multi-resolution min/max summaries of a data column, so drawing a series
+// costs O(pixels) instead of O(samples). Level 0 has one bucket per
+// Pyramid_BaseBucket samples, and every level above merges pairs of buckets.
+// Any index range is covered by O(log n) buckets plus a few raw samples at
+// the edges, which gives the exact min and max of every pixel column.
+
+#define Pyramid_BaseBucket 8
+#define Pyramid_MaxLevels 48
+
+struct PyramidLevel
+{
+    std::vector<double> mins;  // +inf/-inf if the bucket only has NaNs
+    std::vector<double> maxs;
+    std::vector<uint8_t> minFirst;  // Whether the min comes before the max
+};
+
+struct MinMaxPyramid
+{
+    PyramidLevel levels[Pyramid_MaxLevels];
+    int numLevels;
+    int64_t count;  // Samples covered so far
+};
+
+// Summarizes values[pyramid->count, count), rebuilding only the trailing bucket
+// of each level that was still partial. Starting from an empty pyramid this
+// is the full (parallel) build.
+void UpdatePyramid(MinMaxPyramid* pyramid, const double* values, int64_t count);
+void ClearPyramid(MinMaxPyramid* pyramid);
+
+enum DownsampleMode
+{
+    Downsample_MinMax = 0,  // Up to 2 points per pixel column, exact envelope (lines)
+    Downsample_LTTB,        // About 1 point per pixel column, keeps the visual shape (markers)
+};
+
+// Points of the series (xs[i], ys[i]) within [xMin, xMax], reduced for a plot
+// pixels wide. xs must be sorted, or null to use the sample index as x.
+// Returns the number of points written to outX/outY (both are overwritten).
+int64_t DownsampleSeries(const MinMaxPyramid* pyramid, const double* xs, const double* ys, int64_t count,
+                         double xMin, double xMax, int pixels, DownsampleMode mode,
+                         std::vector<double>* outX, std::vector<double>* outY);
+
+// Largest-Triangle-Three-Buckets, keeps threshold points of the input
+int64_t DownsampleLTTB(const double* xs, const double* ys, int64_t count, int64_t threshold,
+                       std::vector<double>* outX, std::vector<double>* outY);
@@ -0,0 +1,574 @@
+#include "scatter.h"
+#include "core.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#ifndef IMGUI_DEFINE_MATH_OPERATORS
+#define IMGUI_DEFINE_MATH_OPERATORS
+#endif
+#include "imgui.h"
+
+static const char* markerNames[Marker_Count] = { "Circle", "Square", "Diamond", "Cross" };
+static const char* scatterModeNames[Scatter_ModeCount] = { "Auto", "Markers", "Density" };
+
+// Must match the layout of Uniforms in scatterShader
+struct ScatterUniforms
+{
+    float offset[2];    // Center of the view, high floats
+    float offsetLo[2];  // And what they round off
+    float scale[2];     // Data units to clip space
+    float pixel[2];     // Size of a pixel in clip space
+    float radius;       // Of the marker, in pixels
+    uint32_t marker;
+    float padding[2];
+    float color[4];
+};
+
+struct ResolveUniforms
+{
+    float exposure;
+    float padding[3];
+};
+
+static const char* scatterShader = R"(
+struct Uniforms
+{
+    offset: vec2f,
+    offsetLo: vec2f,
+    scale: vec2f,
+    pixel: vec2f,
+    radius: f32,
+    marker: u32,
+    color: vec4f,
+};
+
+@group(0) @binding(0) var<uniform> u: Uniforms;
+@group(0) @binding(1) var<storage, read> xs: array<f32>;
+@group(0) @binding(2) var<storage, read> ys: array<f32>;
+
+struct VertexOut
+{
+    @builtin(position) position: vec4f,
+    @location(0) uv: vec2f,  // Marker space, the marker fits in [-1, 1]
+};
+
+fn IsNaN(v: f32) -> bool
+{
+    return (bitcast<u32>(v) & 0x7fffffffu) > 0x7f800000u;
+}
+
+@vertex
+fn vs_main(@builtin(vertex_index) vertex: u32, @builtin(instance_index) instance: u32) -> VertexOut
+{
+    var corners = array<vec2f, 6>(vec2f(-1, -1), vec2f(1, -1), vec2f(-1, 1),
+                                  vec2f(-1, 1), vec2f(1, -1), vec2f(1, 1));
+
+    var out: VertexOut;
+    let data = vec2f(xs[instance], ys[instance]);
+    if(IsNaN(data.x) || IsNaN(data.y))
+    {
+        out.position = vec4f(2, 2, 2, 1);  // Outside the clip volume
+        out.uv = vec2f(0);
+        return out;
+    }
+
+    // One pixel of margin for the antialiasing
+    let extent = u.radius + 1.0;
+    let corner = corners[vertex];
+    // Near the offset the first difference is exact, far from it the low part doesn't matter
+    let center = ((data - u.offset) - u.offsetLo) * u.scale;
+    out.position = vec4f(center + corner * extent * u.pixel, 0, 1);
+    out.uv = corner * extent / u.radius;
+    return out;
+}
+
+fn MarkerDistance(uv: vec2f) -> f32
+{
+    let a = abs(uv);
+    switch(u.marker)
+    {
+        case 1u: { return max(a.x, a.y) - 1.0; }
+        case 2u: { return (a.x + a.y - 1.0) * 0.70710678; }
+        case 3u: { return min(max(a.x - 1.0, a.y - 0.25), max(a.y - 1.0, a.x - 0.25)); }
+        default: { return length(uv) - 1.0; }
+    }
+}
+
+fn Coverage(uv: vec2f) -> f32
+{
+    return clamp(0.5 - MarkerDistance(uv) * u.radius, 0.0, 1.0);
+}
+
+@fragment
+fn fs_marker(in: VertexOut) -> @location(0) vec4f
+{
+    let coverage = Coverage(in.uv);
+    if(coverage <= 0.0) { discard; }
+    return vec4f(u.color.rgb, u.color.a * coverage);
+}
+
+@fragment
+fn fs_density(in: VertexOut) -> @location(0) vec4f
+{
+    let coverage = Coverage(in.uv);
+    if(coverage <= 0.0) { discard; }
+    return vec4f(coverage, 0, 0, 0);
+}
+)";
+
+static const char* resolveShader = R"(
+struct Uniforms
+{
+    exposure: f32,
+};
+
+@group(0) @binding(0) var<uniform> u: Uniforms;
+@group(0) @binding(1) var density: texture_2d<f32>;
+
+@vertex
+fn vs_main(@builtin(vertex_index) vertex: u32) -> @builtin(position) vec4f
+{
+    // Single triangle covering the screen
+    let uv = vec2f(f32((vertex << 1u) & 2u), f32(vertex & 2u));
+    return vec4f(uv * 2.0 - 1.0, 0, 1);
+}
+
+@fragment
+fn fs_main(@builtin(position) position: vec4f) -> @location(0) vec4f
+{
+    let d = textureLoad(density, vec2i(position.xy), 0).r;
+    if(d <= 0.0) { discard; }
+
+    // Saturating exposure curve, then a dark blue -> cyan -> yellow ramp
+    let t = 1.0 - exp(-d * u.exposure);
+    let low = mix(vec3f(0.15, 0.1, 0.5), vec3f(0.1, 0.75, 0.85), clamp(t * 2.0, 0.0, 1.0));
+    let color = mix(low, vec3f(1.0, 0.95, 0.3), clamp(t * 2.0 - 1.0, 0.0, 1.0));
+    return vec4f(color, clamp(0.35 + t * 2.0, 0.0, 1.0));
+}
+)";
+
+WGPUShaderModule CreateShaderModule(WGPUDevice device, const char* code, const char* label)
+{
+    WGPUShaderModuleWGSLDescriptor wgslDesc = WGPU_SHADER_MODULE_WGSL_DESCRIPTOR_INIT;
+    wgslDesc.chain.sType = WGPUSType_ShaderModuleWGSLDescriptor;
+    wgslDesc.code = code;
+    
+    WGPUShaderModuleDescriptor desc = WGPU_SHADER_MODULE_DESCRIPTOR_INIT;
+    desc.nextInChain = &wgslDesc.chain;
+    desc.label = label;
+    return wgpuDeviceCreateShaderModule(device, &desc);
+}
+
+static WGPURenderPipeline CreatePipeline(WGPUDevice device, WGPUBindGroupLayout layout, WGPUShaderModule module,
+                                         const char* fragmentEntry, WGPUTextureFormat format, const WGPUBlendState* blend,
+                                         const char* label)
+{
+    WGPUPipelineLayoutDescriptor layoutDesc = WGPU_PIPELINE_LAYOUT_DESCRIPTOR_INIT;
+    layoutDesc.bindGroupLayoutCount = 1;
+    layoutDesc.bindGroupLayouts = &layout;
+    WGPUPipelineLayout pipelineLayout = wgpuDeviceCreatePipelineLayout(device, &layoutDesc);
+    
+    WGPUColorTargetState target = WGPU_COLOR_TARGET_STATE_INIT;
+    target.format = format;
+    target.blend = blend;
+    target.writeMask = WGPUColorWriteMask_All;
+    
+    WGPUFragmentState fragment = WGPU_FRAGMENT_STATE_INIT;
+    fragment.module = module;
+    fragment.entryPoint = fragmentEntry;
+    fragment.targetCount = 1;
+    fragment.targets = &target;
+    
+    WGPURenderPipelineDescriptor desc = WGPU_RENDER_PIPELINE_DESCRIPTOR_INIT;
+    desc.label = label;
+    desc.layout = pipelineLayout;
+    desc.vertex.module = module;
+    desc.vertex.entryPoint = "vs_main";
+    desc.primitive.topology = WGPUPrimitiveTopology_TriangleList;
+    desc.primitive.cullMode = WGPUCullMode_None;
+    desc.fragment = &fragment;
+    
+    WGPURenderPipeline pipeline = wgpuDeviceCreateRenderPipeline(device, &desc);
+    wgpuPipelineLayoutRelease(pipelineLayout);
+    return pipeline;
+}
+
+void InitScatterRenderer(ScatterRenderer* renderer, WGPUDevice device, WGPUTextureFormat targetFormat)
+{
+    memset(renderer, 0, sizeof(ScatterRenderer));
+    renderer->device = device;
+    renderer->queue = wgpuDeviceGetQueue(device);
+    
+    // Series: uniforms, x and y
+    {
+        WGPUBindGroupLayoutEntry entries[3];
+        for(int i = 0; i < 3; ++i)
+        {
+            entries[i] = WGPU_BIND_GROUP_LAYOUT_ENTRY_INIT;
+            entries[i].binding = i;
+            entries[i].visibility = WGPUShaderStage_Vertex | WGPUShaderStage_Fragment;
+            entries[i].buffer.type = i == 0 ? WGPUBufferBindingType_Uniform : WGPUBufferBindingType_ReadOnlyStorage;
+        }
+        entries[0].buffer.minBindingSize = sizeof(ScatterUniforms);
+        
+        WGPUBindGroupLayoutDescriptor desc = WGPU_BIND_GROUP_LAYOUT_DESCRIPTOR_INIT;
+        desc.label = "Scatter series";
+        desc.entryCount = ArrayCount(entries);
+        desc.entries = entries;
+        renderer->seriesLayout = wgpuDeviceCreateBindGroupLayout(device, &desc);
+    }
+    
+    WGPUShaderModule module = CreateShaderModule(device, scatterShader, "Scatter");
+    
+    WGPUBlendState alphaBlend = WGPU_BLEND_STATE_INIT;
+    alphaBlend.color.srcFactor = WGPUBlendFactor_SrcAlpha;
+    alphaBlend.color.dstFactor = WGPUBlendFactor_OneMinusSrcAlpha;
+    alphaBlend.alpha.srcFactor = WGPUBlendFactor_One;
+    alphaBlend.alpha.dstFactor = WGPUBlendFactor_OneMinusSrcAlpha;
+    
+    WGPUBlendState additive = WGPU_BLEND_STATE_INIT;
+    additive.color.dstFactor = WGPUBlendFactor_One;
+    additive.alpha.dstFactor = WGPUBlendFactor_One;
+    
+    renderer->markerPipeline = CreatePipeline(device, renderer->seriesLayout, module, "fs_marker", targetFormat, &alphaBlend, "Scatter markers");
+    renderer->densityPipeline = CreatePipeline(device, renderer->seriesLayout, module, "fs_density", WGPUTextureFormat_R16Float, &additive, "Scatter density");
+    wgpuShaderModuleRelease(module);
+    
+    // Resolve: uniforms and the density texture
+    {
+        WGPUBindGroupLayoutEntry entries[2];
+        entries[0] = WGPU_BIND_GROUP_LAYOUT_ENTRY_INIT;
+        entries[0].binding = 0;
+        entries[0].visibility = WGPUShaderStage_Fragment;
+        entries[0].buffer.type = WGPUBufferBindingType_Uniform;
+        entries[0].buffer.minBindingSize = sizeof(ResolveUniforms);
+        entries[1] = WGPU_BIND_GROUP_LAYOUT_ENTRY_INIT;
+        entries[1].binding = 1;
+        entries[1].visibility = WGPUShaderStage_Fragment;
+        entries[1].texture.sampleType = WGPUTextureSampleType_UnfilterableFloat;
+        entries[1].texture.viewDimension = WGPUTextureViewDimension_2D;
+        
+        WGPUBindGroupLayoutDescriptor desc = WGPU_BIND_GROUP_LAYOUT_DESCRIPTOR_INIT;
+        desc.label = "Scatter resolve";
+        desc.entryCount = ArrayCount(entries);
+        desc.entries = entries;
+        renderer->resolveLayout = wgpuDeviceCreateBindGroupLayout(device, &desc);
+    }
+    
+    WGPUShaderModule resolveModule = CreateShaderModule(device, resolveShader, "Scatter resolve");
+    renderer->resolvePipeline = CreatePipeline(device, renderer->resolveLayout, resolveModule, "fs_main", targetFormat, &alphaBlend, "Scatter resolve");
+    wgpuShaderModuleRelease(resolveModule);
+    
+    WGPUBufferDescriptor bufferDesc = WGPU_BUFFER_DESCRIPTOR_INIT;
+    bufferDesc.label = "Scatter resolve uniforms";
+    bufferDesc.usage = WGPUBufferUsage_Uniform | WGPUBufferUsage_CopyDst;
+    bufferDesc.size = sizeof(ResolveUniforms);
+    renderer->resolveUniforms = wgpuDeviceCreateBuffer(device, &bufferDesc);
+}
+
+static void ReleaseDensityTexture(ScatterRenderer* renderer)
+{
+    if(renderer->resolveBindGroup) wgpuBindGroupRelease(renderer->resolveBindGroup);
+    if(renderer->densityView) wgpuTextureViewRelease(renderer->densityView);
+    if(renderer->density) wgpuTextureRelease(renderer->density);
+    renderer->resolveBindGroup = nullptr;
+    renderer->densityView = nullptr;
+    renderer->density = nullptr;
+    renderer->densityWidth = 0;
+    renderer->densityHeight = 0;
+}
+
+void CleanupScatterRenderer(ScatterRenderer* renderer)
+{
+    ReleaseDensityTexture(renderer);
+    wgpuBufferRelease(renderer->resolveUniforms);
+    wgpuRenderPipelineRelease(renderer->resolvePipeline);
+    wgpuBindGroupLayoutRelease(renderer->resolveLayout);
+    wgpuRenderPipelineRelease(renderer->densityPipeline);
+    wgpuRenderPipelineRelease(renderer->markerPipeline);
+    wgpuBindGroupLayoutRelease(renderer->seriesLayout);
+    wgpuQueueRelease(renderer->queue);
+    memset(renderer, 0, sizeof(ScatterRenderer));
+}
+
+static void ResizeDensityTexture(ScatterRenderer* renderer, int width, int height)
+{
+    if(renderer->density && renderer->densityWidth == width && renderer->densityHeight == height) return;
+    
+    ReleaseDensityTexture(renderer);
+    
+    WGPUTextureDescriptor desc = WGPU_TEXTURE_DESCRIPTOR_INIT;
+    desc.label = "Scatter density";
+    desc.usage = WGPUTextureUsage_RenderAttachment | WGPUTextureUsage_TextureBinding;
+    desc.dimension = WGPUTextureDimension_2D;
+    desc.size = { (uint32_t)width, (uint32_t)height, 1 };
+    desc.format = WGPUTextureFormat_R16Float;
+    desc.mipLevelCount = 1;
+    desc.sampleCount = 1;
+    renderer->density = wgpuDeviceCreateTexture(renderer->device, &desc);
+    renderer->densityView = wgpuTextureCreateView(renderer->density, nullptr);
+    renderer->densityWidth = width;
+    renderer->densityHeight = height;
+    
+    WGPUBindGroupEntry entries[2];
+    entries[0] = WGPU_BIND_GROUP_ENTRY_INIT;
+    entries[0].binding = 0;
+    entries[0].buffer = renderer->resolveUniforms;
+    entries[0].size = sizeof(ResolveUniforms);
+    entries[1] = WGPU_BIND_GROUP_ENTRY_INIT;
+    entries[1].binding = 1;
+    entries[1].textureView = renderer->densityView;
+    
+    WGPUBindGroupDescriptor groupDesc = WGPU_BIND_GROUP_DESCRIPTOR_INIT;
+    groupDesc.layout = renderer->resolveLayout;
+    groupDesc.entryCount = ArrayCount(entries);
+    groupDesc.entries = entries;
+    renderer->resolveBindGroup = wgpuDeviceCreateBindGroup(renderer->device, &groupDesc);
+}
+
+static WGPUBuffer CreateColumnBuffer(ScatterRenderer* renderer, const float* values, uint32_t count, const char* label)
+{
+    WGPUBufferDescriptor desc = WGPU_BUFFER_DESCRIPTOR_INIT;
+    desc.label = label;
+    desc.usage = WGPUBufferUsage_Storage | WGPUBufferUsage_CopyDst;
+    desc.size = (uint64_t)count * sizeof(float);
+    WGPUBuffer buffer = wgpuDeviceCreateBuffer(renderer->device, &desc);
+    if(values) wgpuQueueWriteBuffer(renderer->queue, buffer, 0, values, desc.size);
+    return buffer;
+}
+
+ScatterSeries* CreateScatterSeries(ScatterRenderer* renderer, const char* name, const float* xs, const float* ys, int64_t count)
+{
+    ScatterSeries* series = new ScatterSeries();
+    snprintf(series->name, sizeof(series->name), "%s", name);
+    series->count = count;
+    series->visible = true;
+    series->mode = Scatter_Auto;
+    series->marker = Marker_Circle;
+    series->size = 5.0f;
+    series->color[0] = 0.35f;
+    series->color[1] = 0.7f;
+    series->color[2] = 1.0f;
+    series->color[3] = 0.8f;
+    
+    WGPUBufferDescriptor uniformDesc = WGPU_BUFFER_DESCRIPTOR_INIT;
+    uniformDesc.label = "Scatter uniforms";
+    uniformDesc.usage = WGPUBufferUsage_Uniform | WGPUBufferUsage_CopyDst;
+    uniformDesc.size = sizeof(ScatterUniforms);
+    series->uniforms = wgpuDeviceCreateBuffer(renderer->device, &uniformDesc);
+    
+    for(int64_t start = 0; start < count; start += Scatter_MaxChunkPoints)
+    {
+        ScatterChunk chunk;
+        chunk.capacity = (uint32_t)(count - start < Scatter_MaxChunkPoints ? count - start : Scatter_MaxChunkPoints);
+        chunk.count = xs && ys ? chunk.capacity : 0;
+        chunk.xBuffer = CreateColumnBuffer(renderer, xs ? xs + start : nullptr, chunk.capacity, "Scatter x");
+        chunk.yBuffer = CreateColumnBuffer(renderer, ys ? ys + start : nullptr, chunk.capacity, "Scatter y");
+        
+        WGPUBindGroupEntry entries[3];
+        WGPUBuffer buffers[3] = { series->uniforms, chunk.xBuffer, chunk.yBuffer };
+        uint64_t sizes[3] = { sizeof(ScatterUniforms), chunk.capacity * sizeof(float), chunk.capacity * sizeof(float) };
+        for(int i = 0; i < 3; ++i)
+        {
+            entries[i] = WGPU_BIND_GROUP_ENTRY_INIT;
+            entries[i].binding = i;
+            entries[i].buffer = buffers[i];
+            entries[i].size = sizes[i];
+        }
+        
+        WGPUBindGroupDescriptor groupDesc = WGPU_BIND_GROUP_DESCRIPTOR_INIT;
+        groupDesc.layout = renderer->seriesLayout;
+        groupDesc.entryCount = ArrayCount(entries);
+        groupDesc.entries = entries;
+        chunk.bindGroup = wgpuDeviceCreateBindGroup(renderer->device, &groupDesc);
+        
+        series->chunks.push_back(chunk);
+    }
+    
+    if(!xs || !ys) series->count = 0;
+    return series;
+}
+
+void WriteScatterPoints(ScatterRenderer* renderer, ScatterSeries* series, int64_t first, const float* xs, const float* ys, int64_t count)
+{
+    int64_t drawn = 0;
+    for(size_t i = 0; i < series->chunks.size(); ++i)
+    {
+        ScatterChunk* chunk = &series->chunks[i];
+        int64_t chunkStart = (int64_t)i * Scatter_MaxChunkPoints;
+        int64_t begin = first > chunkStart ? first : chunkStart;
+        int64_t end = first + count < chunkStart + chunk->capacity ? first + count : chunkStart + chunk->capacity;
+        
+        if(begin < end)
+        {
+            uint64_t offset = (begin - chunkStart) * sizeof(float);
+            uint64_t size = (end - begin) * sizeof(float);
+            wgpuQueueWriteBuffer(renderer->queue, chunk->xBuffer, offset, xs + (begin - first), size);
+            wgpuQueueWriteBuffer(renderer->queue, chunk->yBuffer, offset, ys + (begin - first), size);
+            if(end - chunkStart > chunk->count) chunk->count = (uint32_t)(end - chunkStart);
+        }
+        
+        drawn += chunk->count;
+    }
+    
+    series->count = drawn;
+}
+
+// At most two writes per column when the window wraps around
+void UploadLiveScatter(ScatterRenderer* renderer, ScatterSeries* series)
+{
+    if(!series->liveSource) return;
+    
+    int64_t total = *series->liveTotal;
+    int64_t capacity = series->liveCapacity;
+    int64_t row = series->liveUploaded > total - capacity ? series->liveUploaded : total - capacity;
+    while(row < total)
+    {
+        int64_t slot = row % capacity;
+        int64_t count = total - row < capacity - slot ? total - row : capacity - slot;
+        WriteScatterPoints(renderer, series, slot, series->liveX + slot, series->liveY + slot, count);
+        row += count;
+    }
+    
+    series->liveUploaded = total;
+}
+
+void DestroyScatterSeries(ScatterSeries* series)
+{
+    for(ScatterChunk& chunk : series->chunks)
+    {
+        wgpuBindGroupRelease(chunk.bindGroup);
+        wgpuBufferRelease(chunk.xBuffer);
+        wgpuBufferRelease(chunk.yBuffer);
+    }
+    
+    wgpuBufferRelease(series->uniforms);
+    delete series;
+}
+
+static void DrawSeries(WGPURenderPassEncoder pass, const ScatterSeries* series)
+{
+    for(const ScatterChunk& chunk : series->chunks)
+    {
+        wgpuRenderPassEncoderSetBindGroup(pass, 0, chunk.bindGroup, 0, nullptr);
+        wgpuRenderPassEncoderDraw(pass, 6, chunk.count, 0, 0);
+    }
+}
+
+void PrepareScatter(ScatterRenderer* renderer, WGPUCommandEncoder encoder, const Plot* plot)
+{
+    const PlotView* view = &plot->view;
+    renderer->hasDensity = false;
+    if(view->width <= 0 || view->height <= 0) return;
+    
+    int64_t pixels = (int64_t)view->width * view->height;
+    int64_t densityPoints = 0;
+    for(ScatterSeries* series : plot->scatter)
+    {
+        if(!series->visible) continue;
+        
+        series->drawDensity = series->mode == Scatter_Density || (series->mode == Scatter_Auto && series->count > pixels);
+        if(series->drawDensity) densityPoints += series->count;
+        
+        // Density splats cover about one pixel, markers use their full size
+        ScatterUniforms uniforms = {};
+        double centerX = (view->xMin + view->xMax) * 0.5;
+        double centerY = (view->yMin + view->yMax) * 0.5;
+        uniforms.offset[0] = (float)centerX;
+        uniforms.offset[1] = (float)centerY;
+        uniforms.offsetLo[0] = (float)(centerX - uniforms.offset[0]);
+        uniforms.offsetLo[1] = (float)(centerY - uniforms.offset[1]);
+        uniforms.scale[0] = (float)(2.0 / (view->xMax - view->xMin));
+        uniforms.scale[1] = (float)(2.0 / (view->yMax - view->yMin));
+        uniforms.pixel[0] = 2.0f / view->width;
+        uniforms.pixel[1] = 2.0f / view->height;
+        uniforms.radius = series->drawDensity ? 0.6f : series->size * 0.5f;
+        uniforms.marker = series->drawDensity ? Marker_Circle : series->marker;
+        memcpy(uniforms.color, series->color, sizeof(uniforms.color));
+        wgpuQueueWriteBuffer(renderer->queue, series->uniforms, 0, &uniforms, sizeof(uniforms));
+    }
+    
+    if(densityPoints == 0) return;
+    
+    ResizeDensityTexture(renderer, view->width, view->height);
+    
+    // Normalized so that the average density lands at the start of the ramp
+    ResolveUniforms resolve = {};
+    double average = (double)densityPoints / pixels;
+    resolve.exposure = (float)(0.5 / (average > 0.05 ? average : 0.05));
+    renderer->densityExposure = resolve.exposure;
+    wgpuQueueWriteBuffer(renderer->queue, renderer->resolveUniforms, 0, &resolve, sizeof(resolve));
+    
+    WGPURenderPassColorAttachment attachment = WGPU_RENDER_PASS_COLOR_ATTACHMENT_INIT;
+    attachment.view = renderer->densityView;
+    attachment.depthSlice = WGPU_DEPTH_SLICE_UNDEFINED;
+    attachment.loadOp = WGPULoadOp_Clear;
+    attachment.storeOp = WGPUStoreOp_Store;
+    attachment.clearValue = { 0, 0, 0, 0 };
+    
+    WGPURenderPassDescriptor passDesc = WGPU_RENDER_PASS_DESCRIPTOR_INIT;
+    passDesc.label = "Scatter density";
+    passDesc.colorAttachmentCount = 1;
+    passDesc.colorAttachments = &attachment;
+    
+    WGPURenderPassEncoder pass = wgpuCommandEncoderBeginRenderPass(encoder, &passDesc);
+    wgpuRenderPassEncoderSetPipeline(pass, renderer->densityPipeline);
+    for(const ScatterSeries* series : plot->scatter)
+    {
+        if(series->visible && series->drawDensity)
+            DrawSeries(pass, series);
+    }
+    wgpuRenderPassEncoderEnd(pass);
+    wgpuRenderPassEncoderRelease(pass);
+    
+    renderer->hasDensity = true;
+}
+
+void DrawScatter(ScatterRenderer* renderer, WGPURenderPassEncoder pass, const Plot* plot)
+{
+    if(plot->view.width <= 0 || plot->view.height <= 0) return;
+    
+    if(renderer->hasDensity)
+    {
+        wgpuRenderPassEncoderSetPipeline(pass, renderer->resolvePipeline);
+        wgpuRenderPassEncoderSetBindGroup(pass, 0, renderer->resolveBindGroup, 0, nullptr);
+        wgpuRenderPassEncoderDraw(pass, 3, 1, 0, 0);
+    }
+    
+    wgpuRenderPassEncoderSetPipeline(pass, renderer->markerPipeline);
+    for(const ScatterSeries* series : plot->scatter)
+    {
+        if(series->visible && !series->drawDensity)
+            DrawSeries(pass, series);
+    }
+}
+
+bool ShowScatterSettings(ScatterSeries* series)
+{
+    bool keep = true;
+    ImGui::PushID(series);
+    
+    ImGui::Checkbox("##visible", &series->visible);
+    ImGui::SameLine();
+    ImGui::Text("%s (%lld points%s)", series->name, (long long)series->count, series->drawDensity ? ", density" : "");
+    
+    ImGui::SetNextItemWidth(90.0f);
+    int mode = series->mode;
+    if(ImGui::Combo("Mode", &mode, scatterModeNames, Scatter_ModeCount)) series->mode = (ScatterMode)mode;
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(90.0f);
+    int marker = series->marker;
+    if(ImGui::Combo("Marker", &marker, markerNames, Marker_Count)) series->marker = (MarkerShape)marker;
+    
+    ImGui::SetNextItemWidth(120.0f);
+    ImGui::SliderFloat("Size", &series->size, 1.0f, 32.0f, "%.1f px");
+    ImGui::SameLine();
+    ImGui::ColorEdit4("Color", series->color, ImGuiColorEditFlags_NoInputs);
+    ImGui::SameLine();
+    if(ImGui::Button("Remove")) keep = false;
+    
+    ImGui::PopID();
+    return keep;
+}
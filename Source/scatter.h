@@ -0,0 +1,115 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "webgpu/webgpu.h"
+#include "plot.h"
+
+// GPU scatter plots. Positions are read by the vertex shader straight from
+// storage buffers holding the float copies of two data columns, one instanced
+// quad per point, and the marker shape is a signed distance evaluated in the
+// fragment shader (so it's antialiased at any size). There's no per-point
+// work on the CPU after the upload.
+// When the points pile up they're instead splatted additively into a density
+// texture, which is then colormapped over the plot.
+
+// Points per storage buffer binding, to stay under maxStorageBufferBindingSize
+#define Scatter_MaxChunkPoints (1 << 24)
+
+enum MarkerShape
+{
+    Marker_Circle = 0,
+    Marker_Square,
+    Marker_Diamond,
+    Marker_Cross,
+    Marker_Count
+};
+
+enum ScatterMode
+{
+    Scatter_Auto = 0,  // Density once there are more points than pixels
+    Scatter_Markers,
+    Scatter_Density,
+    Scatter_ModeCount
+};
+
+struct ScatterChunk
+{
+    WGPUBuffer xBuffer;
+    WGPUBuffer yBuffer;
+    WGPUBindGroup bindGroup;
+    uint32_t count;  // Drawn
+    uint32_t capacity;
+};
+
+struct ScatterSeries
+{
+    char name[128];
+    int64_t count;
+    std::vector<ScatterChunk> chunks;
+    WGPUBuffer uniforms;
+    
+    bool visible;
+    ScatterMode mode;
+    MarkerShape marker;
+    float size;  // Diameter in pixels
+    float color[4];
+    bool drawDensity;  // Resolved mode for the current frame
+    
+    // Live series follow circular columns (row r at index r % liveCapacity)
+    // that keep growing, see UploadLiveScatter
+    const void* liveSource;  // Stream or shared memory feed owning the columns
+    const float* liveX;
+    const float* liveY;
+    int64_t liveCapacity;
+    const int64_t* liveTotal;  // Rows appended since the start
+    int64_t liveUploaded;  // Rows already on the GPU
+};
+
+struct ScatterRenderer
+{
+    WGPUDevice device;
+    WGPUQueue queue;
+    
+    WGPUBindGroupLayout seriesLayout;
+    WGPURenderPipeline markerPipeline;
+    WGPURenderPipeline densityPipeline;
+    
+    WGPUBindGroupLayout resolveLayout;
+    WGPURenderPipeline resolvePipeline;
+    WGPUBuffer resolveUniforms;
+    WGPUBindGroup resolveBindGroup;
+    
+    // Same size as the framebuffer, recreated when it changes
+    WGPUTexture density;
+    WGPUTextureView densityView;
+    int densityWidth;
+    int densityHeight;
+    bool hasDensity;  // Something was splatted this frame
+    float densityExposure;
+};
+
+// Shared with the other plot renderers
+WGPUShaderModule CreateShaderModule(WGPUDevice device, const char* code, const char* label);
+
+void InitScatterRenderer(ScatterRenderer* renderer, WGPUDevice device, WGPUTextureFormat targetFormat);
+void CleanupScatterRenderer(ScatterRenderer* renderer);
+
+// Uploads the columns, they can be freed right after. Without columns the
+// buffers are left empty, to be filled later with WriteScatterPoints.
+ScatterSeries* CreateScatterSeries(ScatterRenderer* renderer, const char* name, const float* xs, const float* ys, int64_t count);
+// Overwrites points [first, first + count), and extends the drawn range to include them
+void WriteScatterPoints(ScatterRenderer* renderer, ScatterSeries* series, int64_t first, const float* xs, const float* ys, int64_t count);
+void DestroyScatterSeries(ScatterSeries* series);
+// Sends the rows of a live series added since the last call, straight from its columns
+void UploadLiveScatter(ScatterRenderer* renderer, ScatterSeries* series);
+
+// Writes the uniforms and encodes the density pass, has to be called before
+// the frame's render pass begins
+void PrepareScatter(ScatterRenderer* renderer, WGPUCommandEncoder encoder, const Plot* plot);
+// Draws into the frame's render pass, over the domain coloring and under anything else
+void DrawScatter(ScatterRenderer* renderer, WGPURenderPassEncoder pass, const Plot* plot);
+
+// Style settings for one series, returns false if it should be removed
+bool ShowScatterSettings(ScatterSeries* series);
@@ -0,0 +1,506 @@
+#include "session.h"
+#include "core.h"
+#include "os.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <string>
+
+static void SetSessionError(char* error, int errorSize, const char* fmt, ...)
+{
+    if(!error || errorSize <= 0) return;
+    
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(error, errorSize, fmt, args);
+    va_end(args);
+}
+
+static bool IsNativeTable(const char* path)
+{
+    size_t length = strlen(path);
+    size_t extension = sizeof(Data_FileExtension) - 1;
+    return length >= extension && strcmp(path + length - extension, Data_FileExtension) == 0;
+}
+
+// All of them or none, a session doesn't open with some of its tables missing
+static bool OpenSessionTables(const std::vector<std::string>& paths, std::vector<DataTable*>* out, char* error, int errorSize)
+{
+    for(const std::string& path : paths)
+    {
+        DataTable* table = new DataTable();
+        bool ok = IsNativeTable(path.c_str()) ? LoadDataTable(path.c_str(), table, error, errorSize) :
+                                                ImportCSV(path.c_str(), table, error, errorSize);
+        if(ok)
+        {
+            out->push_back(table);
+            continue;
+        }
+        
+        delete table;
+        for(DataTable* opened : *out)
+        {
+            FreeDataTable(opened);
+            delete opened;
+        }
+        out->clear();
+        return false;
+    }
+    return true;
+}
+
+// Replaces what the session had, the arrays of the curves are at their
+// offsets from base
+static void RestoreSession(Session* session, const SessionFileHeader* header, const SessionFileParam* params,
+                           const SessionFileCurve* curves, const uint8_t* base, std::vector<DataTable*>* tables)
+{
+    for(DataTable* table : *session->tables)
+    {
+        FreeDataTable(table);
+        delete table;
+    }
+    session->tables->swap(*tables);
+    
+    // New ids, so nothing cached for the curves that were there is taken for these
+    CurveList* list = session->curves;
+    FreeCurves(list);
+    list->params = ParamTable();
+    list->subterms = SubtermTable();
+    for(uint32_t i = 0; i < header->paramCount; ++i)
+    {
+        int param = FindOrAddParam(&list->params, params[i].name, (int)strlen(params[i].name));
+        list->params.values[param] = params[i].value;
+    }
+    
+    for(uint32_t i = 0; i < header->curveCount; ++i)
+    {
+        const SessionFileCurve* desc = &curves[i];
+        Curve* curve = AddPendingCurve(list, desc->text);
+        curve->version = desc->version;
+        curve->visible = desc->visible != 0;
+        memcpy(curve->color, desc->color, sizeof(curve->color));
+        
+        const double* starts = (const double*)(base + desc->startsOffset);
+        curve->starts.assign(starts, starts + desc->startCount);
+        
+        curve->sampleLevel = desc->sampleLevel;
+        curve->sampleStep = desc->sampleStep;
+        curve->firstSample = desc->firstSample;
+        curve->doubleDouble = desc->doubleDouble != 0;
+        curve->sampleKey = desc->sampleKey;
+        memcpy(curve->sampleArea, desc->sampleArea, sizeof(curve->sampleArea));
+        curve->listParam = desc->listParam;
+        curve->listRows = desc->listRows;
+        const double* xs = (const double*)(base + desc->xsOffset);
+        const double* ys = (const double*)(base + desc->ysOffset);
+        curve->xs.assign(xs, xs + desc->sampleCount);
+        curve->ys.assign(ys, ys + desc->sampleCount);
+    }
+    
+    // The lists come out the same as they were saved, so the samples taken over them still hold
+    for(uint32_t i = 0; i < header->curveCount; ++i)
+    {
+        if(curves[i].defines) CompileCurve(list, list->curves[i]);
+    }
+    list->params.listVersion = header->listVersion;
+    
+    session->view->xMin = header->view[0];
+    session->view->xMax = header->view[1];
+    session->view->yMin = header->view[2];
+    session->view->yMax = header->view[3];
+    
+    Animator* animator = session->animator;
+    animator->param = header->animatedParam < (int32_t)header->paramCount ? header->animatedParam : -1;
+    animator->min = header->animation[0];
+    animator->max = header->animation[1];
+    animator->seconds = header->animation[2];
+    animator->playing = false;
+    animator->frame = 0;
+    animator->time = 0.0;
+    
+    if(header->odeMethod >= 0 && header->odeMethod < Ode_MethodCount)
+        *session->odeMethod = (OdeMethod)header->odeMethod;
+}
+
+static void FillSessionHeader(const Session* session, SessionFileHeader* header)
+{
+    *header = {};
+    memcpy(header->magic, Session_FileMagic, sizeof(Session_FileMagic));
+    header->version = Session_FileVersion;
+    header->curveCount = (uint32_t)session->curves->curves.size();
+    header->paramCount = (uint32_t)session->curves->params.names.size();
+    header->tableCount = (uint32_t)session->tables->size();
+    header->listVersion = session->curves->params.listVersion;
+    header->animatedParam = session->animator->param;
+    header->odeMethod = (int32_t)*session->odeMethod;
+    header->view[0] = session->view->xMin;
+    header->view[1] = session->view->xMax;
+    header->view[2] = session->view->yMin;
+    header->view[3] = session->view->yMax;
+    header->animation[0] = session->animator->min;
+    header->animation[1] = session->animator->max;
+    header->animation[2] = session->animator->seconds;
+}
+
+// Pending curves haven't been parsed, but they're never definitions: those are compiled on load
+static bool DefinesParam(const Curve* curve)
+{
+    return !curve->pending && (curve->def.kind == Def_Assignment || curve->def.kind == Def_List);
+}
+
+static uint64_t AlignSessionOffset(uint64_t value)
+{
+    return (value + Session_FileAlignment - 1) / Session_FileAlignment * Session_FileAlignment;
+}
+
+static bool WriteSessionArray(FILE* file, uint64_t* written, uint64_t offset, const double* values, uint64_t count)
+{
+    static const uint8_t zeros[Session_FileAlignment] = {};
+    if(offset > *written && fwrite(zeros, 1, offset - *written, file) != offset - *written) return false;
+    if(count > 0 && fwrite(values, sizeof(double), count, file) != count) return false;
+    
+    *written = offset + count * sizeof(double);
+    return true;
+}
+
+bool SaveSession(const char* path, const Session* session, char* error, int errorSize)
+{
+    const CurveList* list = session->curves;
+    SessionFileHeader header;
+    FillSessionHeader(session, &header);
+    
+    std::vector<SessionFileParam> params(header.paramCount);
+    for(uint32_t i = 0; i < header.paramCount; ++i)
+    {
+        const std::string& name = list->params.names[i];
+        if(name.size() >= Session_MaxNameLength)
+        {
+            SetSessionError(error, errorSize, "Parameter '%s' has too long a name to save", name.c_str());
+            return false;
+        }
+        params[i] = {};
+        memcpy(params[i].name, name.c_str(), name.size());
+        params[i].value = list->params.values[i];
+    }
+    
+    std::vector<SessionFileTable> tables(header.tableCount);
+    for(uint32_t i = 0; i < header.tableCount; ++i)
+    {
+        tables[i] = {};
+        memcpy(tables[i].path, (*session->tables)[i]->source, sizeof(tables[i].path));
+    }
+    
+    // Layout of the arrays, after the descriptors
+    uint64_t descsEnd = sizeof(SessionFileHeader) + header.paramCount * sizeof(SessionFileParam) +
+                        header.curveCount * sizeof(SessionFileCurve) + header.tableCount * sizeof(SessionFileTable);
+    uint64_t offset = descsEnd;
+    std::vector<SessionFileCurve> curves(header.curveCount);
+    for(uint32_t i = 0; i < header.curveCount; ++i)
+    {
+        const Curve* curve = list->curves[i];
+        SessionFileCurve* desc = &curves[i];
+        *desc = {};
+        memcpy(desc->text, curve->text, sizeof(desc->text));
+        desc->version = curve->version;
+        desc->visible = curve->visible;
+        desc->defines = DefinesParam(curve);
+        desc->doubleDouble = curve->doubleDouble;
+        memcpy(desc->color, curve->color, sizeof(desc->color));
+        
+        // Samples of a curve that was never sampled, or of an older text, aren't worth keeping
+        bool sampled = !curve->pending && curve->def.kind != Def_Invalid && curve->xs.size() == curve->ys.size();
+        desc->sampleLevel = curve->sampleLevel;
+        desc->listParam = curve->listParam;
+        desc->sampleStep = curve->sampleStep;
+        desc->firstSample = curve->firstSample;
+        desc->listRows = curve->listRows;
+        desc->sampleKey = sampled ? curve->sampleKey : 0;
+        memcpy(desc->sampleArea, curve->sampleArea, sizeof(desc->sampleArea));
+        desc->sampleCount = sampled ? curve->ys.size() : 0;
+        
+        offset = AlignSessionOffset(offset);
+        desc->xsOffset = offset;
+        offset += desc->sampleCount * sizeof(double);
+        offset = AlignSessionOffset(offset);
+        desc->ysOffset = offset;
+        offset += desc->sampleCount * sizeof(double);
+        offset = AlignSessionOffset(offset);
+        desc->startCount = curve->starts.size();
+        desc->startsOffset = offset;
+        offset += desc->startCount * sizeof(double);
+    }
+    
+    FILE* file = fopen(path, "wb");
+    if(!file)
+    {
+        SetSessionError(error, errorSize, "Could not write '%s'", path);
+        return false;
+    }
+    
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    if(header.paramCount > 0) ok &= fwrite(params.data(), sizeof(SessionFileParam), header.paramCount, file) == header.paramCount;
+    if(header.curveCount > 0) ok &= fwrite(curves.data(), sizeof(SessionFileCurve), header.curveCount, file) == header.curveCount;
+    if(header.tableCount > 0) ok &= fwrite(tables.data(), sizeof(SessionFileTable), header.tableCount, file) == header.tableCount;
+    
+    uint64_t written = descsEnd;
+    for(uint32_t i = 0; ok && i < header.curveCount; ++i)
+    {
+        const Curve* curve = list->curves[i];
+        const SessionFileCurve* desc = &curves[i];
+        ok &= WriteSessionArray(file, &written, desc->xsOffset, curve->xs.data(), desc->sampleCount);
+        ok &= WriteSessionArray(file, &written, desc->ysOffset, curve->ys.data(), desc->sampleCount);
+        ok &= WriteSessionArray(file, &written, desc->startsOffset, curve->starts.data(), desc->startCount);
+    }
+    
+    ok &= fclose(file) == 0;
+    if(!ok) SetSessionError(error, errorSize, "Could not write '%s'", path);
+    return ok;
+}
+
+bool LoadSession(const char* path, Session* session, char* error, int errorSize)
+{
+    MappedFile file;
+    if(!MapFileRead(path, &file))
+    {
+        SetSessionError(error, errorSize, "Could not open '%s'", path);
+        return false;
+    }
+    
+    auto fail = [&](const char* message)
+    {
+        SetSessionError(error, errorSize, "'%s': %s", path, message);
+        UnmapFile(&file);
+        return false;
+    };
+    
+    if(file.size < sizeof(SessionFileHeader)) return fail("Not a session file");
+    
+    const uint8_t* base = (const uint8_t*)file.data;
+    const SessionFileHeader* header = (const SessionFileHeader*)base;
+    if(memcmp(header->magic, Session_FileMagic, sizeof(Session_FileMagic)) != 0) return fail("Not a session file");
+    if(header->version != Session_FileVersion) return fail("Unsupported version");
+    
+    uint64_t paramsStart = sizeof(SessionFileHeader);
+    uint64_t curvesStart = paramsStart + (uint64_t)header->paramCount * sizeof(SessionFileParam);
+    uint64_t tablesStart = curvesStart + (uint64_t)header->curveCount * sizeof(SessionFileCurve);
+    uint64_t descsEnd = tablesStart + (uint64_t)header->tableCount * sizeof(SessionFileTable);
+    if(descsEnd > file.size) return fail("File is truncated");
+    
+    // Strings are terminated in place, the mapping is read only so they're checked instead
+    const SessionFileParam* params = (const SessionFileParam*)(base + paramsStart);
+    const SessionFileCurve* curves = (const SessionFileCurve*)(base + curvesStart);
+    const SessionFileTable* tables = (const SessionFileTable*)(base + tablesStart);
+    auto inFile = [&](uint64_t offset, uint64_t count)
+    {
+        return offset % sizeof(double) == 0 && offset <= file.size && count <= (file.size - offset) / sizeof(double);
+    };
+    for(uint32_t i = 0; i < header->paramCount; ++i)
+    {
+        if(!memchr(params[i].name, 0, sizeof(params[i].name))) return fail("File is corrupted");
+    }
+    for(uint32_t i = 0; i < header->curveCount; ++i)
+    {
+        const SessionFileCurve* desc = &curves[i];
+        if(!memchr(desc->text, 0, sizeof(desc->text)) || !inFile(desc->xsOffset, desc->sampleCount) ||
+           !inFile(desc->ysOffset, desc->sampleCount) || !inFile(desc->startsOffset, desc->startCount))
+        {
+            return fail("File is truncated or corrupted");
+        }
+    }
+    
+    std::vector<std::string> paths;
+    for(uint32_t i = 0; i < header->tableCount; ++i)
+    {
+        if(!memchr(tables[i].path, 0, sizeof(tables[i].path))) return fail("File is corrupted");
+        paths.push_back(tables[i].path);
+    }
+    
+    std::vector<DataTable*> opened;
+    if(!OpenSessionTables(paths, &opened, error, errorSize))
+    {
+        UnmapFile(&file);
+        return false;
+    }
+    
+    RestoreSession(session, header, params, curves, base, &opened);
+    UnmapFile(&file);
+    return true;
+}
+
+bool SaveSessionText(const char* path, const Session* session, char* error, int errorSize)
+{
+    FILE* file = fopen(path, "wb");
+    if(!file)
+    {
+        SetSessionError(error, errorSize, "Could not write '%s'", path);
+        return false;
+    }
+    
+    // Shortest round trip formatting isn't available everywhere, 17 digits always round trips
+    const CurveList* list = session->curves;
+    const PlotView* view = session->view;
+    fprintf(file, "view %.17g %.17g %.17g %.17g\n", view->xMin, view->xMax, view->yMin, view->yMax);
+    for(size_t i = 0; i < list->params.names.size(); ++i)
+        fprintf(file, "param %s %.17g\n", list->params.names[i].c_str(), list->params.values[i]);
+    
+    for(const Curve* curve : list->curves)
+    {
+        fprintf(file, "%s %d %g %g %g %g %s\n", DefinesParam(curve) ? "define" : "curve", curve->visible ? 1 : 0,
+                curve->color[0], curve->color[1], curve->color[2], curve->color[3], curve->text);
+        for(size_t i = 0; i + 1 < curve->starts.size(); i += 2)
+            fprintf(file, "start %.17g %.17g\n", curve->starts[i], curve->starts[i + 1]);
+    }
+    
+    for(const DataTable* table : *session->tables)
+        fprintf(file, "table %s\n", table->source);
+    
+    const Animator* animator = session->animator;
+    if(animator->param >= 0)
+    {
+        fprintf(file, "animate %s %.17g %.17g %.17g\n", list->params.names[animator->param].c_str(), animator->min,
+                animator->max, animator->seconds);
+    }
+    fprintf(file, "ode %d\n", (int)*session->odeMethod);
+    
+    bool ok = !ferror(file);
+    ok &= fclose(file) == 0;
+    if(!ok) SetSessionError(error, errorSize, "Could not write '%s'", path);
+    return ok;
+}
+
+// Reads count numbers separated by spaces, moving str past them
+static bool ParseSessionNumbers(const char** str, double* out, int count)
+{
+    for(int i = 0; i < count; ++i)
+    {
+        char* end;
+        out[i] = strtod(*str, &end);
+        if(end == *str) return false;
+        *str = end;
+    }
+    return true;
+}
+
+bool LoadSessionText(const char* path, Session* session, char* error, int errorSize)
+{
+    MappedFile file;
+    if(!MapFileRead(path, &file))
+    {
+        SetSessionError(error, errorSize, "Could not open '%s'", path);
+        return false;
+    }
+    
+    // Into the same records as the binary format, the starts one array after the other
+    SessionFileHeader header;
+    FillSessionHeader(session, &header);
+    header.curveCount = header.paramCount = header.tableCount = 0;
+    header.animatedParam = -1;
+    std::vector<SessionFileParam> params;
+    std::vector<SessionFileCurve> curves;
+    std::vector<double> starts;
+    std::vector<std::string> paths;
+    std::string animated;
+    
+    const char* text = (const char*)file.data;
+    const char* end = text + file.size;
+    int lineNumber = 0;
+    bool ok = true;
+    for(const char* line = text; ok && line < end; ++lineNumber)
+    {
+        const char* lineEnd = (const char*)memchr(line, '\n', end - line);
+        if(!lineEnd) lineEnd = end;
+        std::string content(line, lineEnd);
+        line = lineEnd + 1;
+        while(!content.empty() && (content.back() == '\r' || content.back() == ' ')) content.pop_back();
+        
+        const char* c = content.c_str();
+        size_t keywordLength = strcspn(c, " ");
+        std::string keyword(c, keywordLength);
+        c += keywordLength;
+        if(*c == ' ') ++c;
+        
+        double numbers[5];
+        if(keyword == "view")
+        {
+            ok = ParseSessionNumbers(&c, header.view, 4);
+        }
+        else if(keyword == "param" || keyword == "animate")
+        {
+            size_t nameLength = strcspn(c, " ");
+            std::string name(c, nameLength);
+            c += nameLength;
+            ok = nameLength > 0 && nameLength < Session_MaxNameLength &&
+                 ParseSessionNumbers(&c, keyword == "param" ? numbers : header.animation, keyword == "param" ? 1 : 3);
+            if(ok && keyword == "animate")
+            {
+                animated = name;
+            }
+            else if(ok)
+            {
+                params.push_back({});
+                memcpy(params.back().name, name.c_str(), nameLength);
+                params.back().value = numbers[0];
+            }
+        }
+        else if(keyword == "curve" || keyword == "define")
+        {
+            ok = ParseSessionNumbers(&c, numbers, 5) && (*c == ' ' || *c == '\0') && strlen(c) < Curve_MaxText;
+            if(ok)
+            {
+                if(*c == ' ') ++c;
+                curves.push_back({});
+                SessionFileCurve* desc = &curves.back();
+                snprintf(desc->text, sizeof(desc->text), "%s", c);
+                desc->version = 1;
+                desc->visible = numbers[0] != 0.0;
+                desc->defines = keyword == "define";
+                desc->listParam = -1;
+                for(int i = 0; i < 4; ++i)
+                    desc->color[i] = (float)numbers[i + 1];
+                desc->startsOffset = starts.size() * sizeof(double);
+            }
+        }
+        else if(keyword == "start")
+        {
+            ok = !curves.empty() && ParseSessionNumbers(&c, numbers, 2);
+            if(ok)
+            {
+                starts.push_back(numbers[0]);
+                starts.push_back(numbers[1]);
+                curves.back().startCount += 2;
+            }
+        }
+        else if(keyword == "table")
+        {
+            ok = *c && strlen(c) < Data_MaxPath;
+            if(ok) paths.push_back(c);
+        }
+        else if(keyword == "ode")
+        {
+            ok = ParseSessionNumbers(&c, numbers, 1);
+            if(ok) header.odeMethod = (int32_t)numbers[0];
+        }
+    }
+    UnmapFile(&file);
+    
+    if(!ok)
+    {
+        SetSessionError(error, errorSize, "'%s' line %d: Not a session line", path, lineNumber);
+        return false;
+    }
+    
+    header.paramCount = (uint32_t)params.size();
+    header.curveCount = (uint32_t)curves.size();
+    for(uint32_t i = 0; i < header.paramCount; ++i)
+    {
+        if(animated == params[i].name) header.animatedParam = (int32_t)i;
+    }
+    
+    std::vector<DataTable*> opened;
+    if(!OpenSessionTables(paths, &opened, error, errorSize)) return false;
+    
+    RestoreSession(session, &header, params.data(), curves.data(), (const uint8_t*)starts.data(), &opened);
+    return true;
+}
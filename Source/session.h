@@ -0,0 +1,111 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "plot.h"
+#include "curves.h"
+#include "datatable.h"
+#include "animation.h"
+#include "ode.h"
+
+// Sessions save what's being plotted: the curves, the parameters, the view,
+// the animation and ODE settings, and the tables by the files they were read
+// from. The binary format also has the samples of the curves, and is read in
+// place from a mapping: opening it copies arrays and parses nothing. The
+// curves come back pending (see AddPendingCurve), compiled the first time
+// they're visible, and their sample keys make the first frame reuse the
+// saved samples when the view and parameters are the same. Assignments and
+// lists are compiled right away, they define what the others read.
+//
+// The text format has one line per item and no samples, for keeping
+// sessions under version control:
+//
+//   view -10 10 -7.5 7.5
+//   param a 1.5
+//   define 1 0.86 0.3 0.26 1 a = [1...10]
+//   curve 1 0.22 0.52 0.86 1 y = a sin(x)
+//   start 0.5 1
+//   table data.pcol
+//   animate a 0 10 5
+//   ode 1
+//
+// Curves and definitions have their visibility and color before the text,
+// starts are the points of the field solutions of the curve above them.
+// Unknown lines are skipped, so older versions open newer files.
+
+#define Session_FileMagic "PLOTSES"
+#define Session_FileVersion 1
+#define Session_FileAlignment 64
+#define Session_FileExtension ".psession"
+#define Session_MaxNameLength 64
+
+struct SessionFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t curveCount;
+    uint32_t paramCount;
+    uint32_t tableCount;
+    uint32_t listVersion;
+    int32_t animatedParam;  // -1 for none
+    int32_t odeMethod;
+    uint32_t reserved;
+    double view[4];       // xMin, xMax, yMin, yMax
+    double animation[3];  // Min, max and seconds
+};
+
+struct SessionFileParam
+{
+    char name[Session_MaxNameLength];
+    double value;
+};
+
+struct SessionFileCurve
+{
+    char text[Curve_MaxText];
+    uint32_t version;
+    uint8_t visible;
+    uint8_t defines;  // Assignment or list, compiled on load
+    uint8_t doubleDouble;
+    uint8_t reserved;
+    float color[4];
+    
+    // Samples, as SampleCurve left them
+    int32_t sampleLevel;
+    int32_t listParam;
+    double sampleStep;
+    int64_t firstSample;
+    int64_t listRows;
+    uint64_t sampleKey;
+    double sampleArea[4];
+    uint64_t sampleCount;
+    uint64_t xsOffset;  // From the start of the file
+    uint64_t ysOffset;
+    
+    uint64_t startCount;  // Doubles, two per point
+    uint64_t startsOffset;
+};
+
+struct SessionFileTable
+{
+    char path[Data_MaxPath];
+};
+
+// What a session saves and restores, owned by the application
+struct Session
+{
+    CurveList* curves;
+    std::vector<DataTable*>* tables;
+    PlotView* view;  // Only the ranges, the size is the window's
+    Animator* animator;
+    OdeMethod* odeMethod;
+};
+
+// Error messages are written to error (if not null) on failure. Loading
+// leaves the session as it was when it fails, tables that can't be opened
+// included.
+bool SaveSession(const char* path, const Session* session, char* error, int errorSize);
+bool LoadSession(const char* path, Session* session, char* error, int errorSize);
+bool SaveSessionText(const char* path, const Session* session, char* error, int errorSize);
+bool LoadSessionText(const char* path, Session* session, char* error, int errorSize);
@@ -0,0 +1,172 @@
+#include "shmfeed.h"
+#include "core.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+
+#define ShmFeed_RetryNs 100000000
+
+// The counters are plain integers in the layout so it stays C, they're
+// accessed as atomics that have the same representation
+static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t) && std::atomic<uint64_t>::is_always_lock_free, "Shared counters need lock free 64 bit atomics");
+
+static uint64_t LoadShared(const uint64_t* value)
+{
+    return reinterpret_cast<const std::atomic<uint64_t>*>(value)->load(std::memory_order_acquire);
+}
+
+static void DetachShmFeed(ShmFeed* feed)
+{
+    if(feed->memory.data) CloseSharedMemory(&feed->memory);
+    feed->header = nullptr;
+    feed->columnCount = 0;
+    feed->capacity = 0;
+    for(std::vector<float>& mirror : feed->mirrors)
+        std::vector<float>().swap(mirror);
+}
+
+static bool FailAttach(ShmFeed* feed, ShmFeedStatus status, const char* error)
+{
+    DetachShmFeed(feed);
+    feed->status = status;
+    snprintf(feed->error, sizeof(feed->error), "%s", error);
+    return false;
+}
+
+// Maps the segment again every time, a producer rewriting it may also grow it
+static bool AttachShmFeed(ShmFeed* feed)
+{
+    DetachShmFeed(feed);
+    if(!OpenSharedMemory(feed->name, &feed->memory)) return FailAttach(feed, ShmFeed_Error, "Shared memory not found");
+    if(feed->memory.size < sizeof(PlotterShmHeader)) return FailAttach(feed, ShmFeed_Waiting, "");
+    
+    const PlotterShmHeader* header = (const PlotterShmHeader*)feed->memory.data;
+    uint64_t sequence = LoadShared(&header->schemaSequence);
+    if((sequence & 1) || header->magic != PlotterShm_Magic) return FailAttach(feed, ShmFeed_Waiting, "");
+    
+    // Copy the schema, then check it wasn't rewritten meanwhile
+    PlotterShmHeader schema;
+    memcpy(&schema, header, sizeof(schema));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if(LoadShared(&header->schemaSequence) != sequence) return FailAttach(feed, ShmFeed_Waiting, "");
+    
+    if(schema.version != PlotterShm_Version) return FailAttach(feed, ShmFeed_Error, "Unsupported layout version");
+    if(schema.headerSize != sizeof(PlotterShmHeader)) return FailAttach(feed, ShmFeed_Error, "Unexpected header size");
+    if(schema.columnCount == 0 || schema.columnCount > PlotterShm_MaxColumns) return FailAttach(feed, ShmFeed_Error, "Invalid column count");
+    if(schema.capacity == 0 || schema.segmentSize > feed->memory.size) return FailAttach(feed, ShmFeed_Error, "Invalid capacity or segment size");
+    
+    for(uint32_t c = 0; c < schema.columnCount; ++c)
+    {
+        const PlotterShmColumn* column = &schema.columns[c];
+        if(column->type != PlotterShm_F32 && column->type != PlotterShm_F64) return FailAttach(feed, ShmFeed_Error, "Invalid column type");
+        
+        uint64_t size = schema.capacity * PlotterShmTypeSize(column->type);
+        bool inside = column->offset >= sizeof(PlotterShmHeader) && column->offset <= schema.segmentSize && size <= schema.segmentSize - column->offset;
+        if(!inside || column->offset % PlotterShm_Alignment != 0 || size / schema.capacity != PlotterShmTypeSize(column->type))
+            return FailAttach(feed, ShmFeed_Error, "Column outside of the segment");
+        
+        snprintf(feed->names[c], sizeof(feed->names[c]), "%.*s", (int)sizeof(column->name), column->name);
+        if(!feed->names[c][0]) snprintf(feed->names[c], sizeof(feed->names[c]), "column %u", c + 1);
+        feed->types[c] = column->type;
+        feed->columns[c] = (const char*)feed->memory.data + column->offset;
+        if(column->type == PlotterShm_F64) feed->mirrors[c].resize(schema.capacity);
+    }
+    
+    feed->header = header;
+    feed->sequence = sequence;
+    feed->columnCount = schema.columnCount;
+    feed->capacity = (int64_t)schema.capacity;
+    feed->total = 0;
+    feed->converted = 0;
+    feed->status = ShmFeed_Attached;
+    feed->error[0] = '\0';
+    return true;
+}
+
+ShmFeed* OpenShmFeed(const char* name, char* error, int errorSize)
+{
+    ShmFeed* feed = new ShmFeed();
+    snprintf(feed->name, sizeof(feed->name), "%s", name);
+    
+    if(!AttachShmFeed(feed) && feed->status == ShmFeed_Error)
+    {
+        if(error) snprintf(error, errorSize, "Could not attach to '%s': %s", name, feed->error);
+        DetachShmFeed(feed);
+        delete feed;
+        return nullptr;
+    }
+    
+    feed->rateStart = GetTimeNs();
+    return feed;
+}
+
+void CloseShmFeed(ShmFeed* feed)
+{
+    DetachShmFeed(feed);
+    delete feed;
+}
+
+int64_t UpdateShmFeed(ShmFeed* feed)
+{
+    uint64_t now = GetTimeNs();
+    if(feed->status != ShmFeed_Attached)
+    {
+        // The new rows are picked up from the next update
+        if(now - feed->rateStart > ShmFeed_RetryNs)
+        {
+            feed->rateStart = now;
+            AttachShmFeed(feed);
+        }
+        return 0;
+    }
+    
+    const PlotterShmHeader* header = feed->header;
+    int64_t cursor = (int64_t)LoadShared(&header->writeCursor);
+    if(LoadShared(&header->schemaSequence) != feed->sequence || cursor < feed->total)
+    {
+        DetachShmFeed(feed);
+        feed->status = ShmFeed_Waiting;
+        feed->rateStart = now;
+        feed->rateRows = 0;
+        return -1;
+    }
+    
+    // Only the double columns are touched, float ones are used in place
+    int64_t row = feed->converted > cursor - feed->capacity ? feed->converted : cursor - feed->capacity;
+    while(row < cursor)
+    {
+        int64_t slot = row % feed->capacity;
+        int64_t count = cursor - row < feed->capacity - slot ? cursor - row : feed->capacity - slot;
+        for(uint32_t c = 0; c < feed->columnCount; ++c)
+        {
+            if(feed->types[c] != PlotterShm_F64) continue;
+            
+            const double* values = (const double*)feed->columns[c] + slot;
+            float* mirror = feed->mirrors[c].data() + slot;
+            for(int64_t i = 0; i < count; ++i)
+                mirror[i] = (float)values[i];
+        }
+        row += count;
+    }
+    
+    int64_t added = cursor - feed->total;
+    feed->converted = cursor;
+    feed->total = cursor;
+    
+    feed->rateRows += added;
+    if(now - feed->rateStart > 500000000)
+    {
+        feed->rowsPerSecond = feed->rateRows * 1e9 / (now - feed->rateStart);
+        feed->rateRows = 0;
+        feed->rateStart = now;
+    }
+    
+    return added;
+}
+
+const float* ShmFeedColumn(const ShmFeed* feed, uint32_t column)
+{
+    if(feed->types[column] == PlotterShm_F32) return (const float*)feed->columns[column];
+    return feed->mirrors[column].data();
+}
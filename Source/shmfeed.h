@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "os.h"
+#include "plotter_shm.h"
+
+// Zero copy feeds from producers on the same machine, through a shared memory
+// segment laid out as documented in plotter_shm.h. Float columns are read in
+// place, so the GPU uploads of live series come straight from the mapping.
+// Double columns go through a float mirror, converting only the new rows.
+
+enum ShmFeedStatus
+{
+    ShmFeed_Attached = 0,
+    ShmFeed_Waiting,  // For the producer to create or finish rewriting the segment
+    ShmFeed_Error,
+};
+
+struct ShmFeed
+{
+    char name[128];
+    ShmFeedStatus status;
+    char error[128];
+    
+    SharedMemory memory;
+    const PlotterShmHeader* header;
+    uint64_t sequence;  // Schema sequence of the attached segment
+    
+    // Only valid while attached
+    uint32_t columnCount;
+    int64_t capacity;
+    char names[PlotterShm_MaxColumns][64];
+    uint32_t types[PlotterShm_MaxColumns];
+    const void* columns[PlotterShm_MaxColumns];
+    std::vector<float> mirrors[PlotterShm_MaxColumns];  // Double columns only
+    
+    int64_t total;  // Rows published as of the last update
+    int64_t converted;  // Rows of the double columns already mirrored
+    
+    uint64_t rateStart;
+    int64_t rateRows;
+    double rowsPerSecond;
+};
+
+// Fails if the segment can't be found, a producer that isn't done writing
+// the header is waited for
+ShmFeed* OpenShmFeed(const char* name, char* error, int errorSize);
+void CloseShmFeed(ShmFeed* feed);
+// Picks up the rows published since the last update and returns their count,
+// or -1 when the producer rewrote the segment: the columns are gone, and the
+// feed attaches again once the new schema is complete.
+int64_t UpdateShmFeed(ShmFeed* feed);
+// Circular column of capacity floats, row r at index r % capacity
+const float* ShmFeedColumn(const ShmFeed* feed, uint32_t column);
@@ -0,0 +1,406 @@
+#include "streaming.h"
+#include "core.h"
+#include "datatable.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+
+#define Stream_ReadBufferSize (1 << 16)
+#define Stream_ReadTimeoutMs 50
+
+void InitSampleRing(SampleRing* ring, uint32_t stride, uint64_t capacity)
+{
+    ring->records = new double[capacity * stride];
+    ring->stride = stride;
+    ring->capacity = capacity;
+    ring->writeIndex.store(0);
+    ring->readIndex.store(0);
+    ring->cachedReadIndex = 0;
+    ring->cachedWriteIndex = 0;
+}
+
+void FreeSampleRing(SampleRing* ring)
+{
+    delete[] ring->records;
+    ring->records = nullptr;
+    ring->capacity = 0;
+}
+
+uint64_t RingPush(SampleRing* ring, const double* records, uint64_t count)
+{
+    uint64_t write = ring->writeIndex.load(std::memory_order_relaxed);
+    uint64_t free = ring->capacity - (write - ring->cachedReadIndex);
+    if(free < count)
+    {
+        ring->cachedReadIndex = ring->readIndex.load(std::memory_order_acquire);
+        free = ring->capacity - (write - ring->cachedReadIndex);
+    }
+    
+    uint64_t pushed = std::min(count, free);
+    uint64_t first = write & (ring->capacity - 1);
+    uint64_t beforeWrap = std::min(pushed, ring->capacity - first);
+    memcpy(ring->records + first * ring->stride, records, beforeWrap * ring->stride * sizeof(double));
+    memcpy(ring->records, records + beforeWrap * ring->stride, (pushed - beforeWrap) * ring->stride * sizeof(double));
+    
+    ring->writeIndex.store(write + pushed, std::memory_order_release);
+    return pushed;
+}
+
+uint64_t RingReadable(SampleRing* ring)
+{
+    uint64_t read = ring->readIndex.load(std::memory_order_relaxed);
+    if(ring->cachedWriteIndex == read)
+        ring->cachedWriteIndex = ring->writeIndex.load(std::memory_order_acquire);
+    return ring->cachedWriteIndex - read;
+}
+
+const double* RingRecord(const SampleRing* ring, uint64_t i)
+{
+    uint64_t index = (ring->readIndex.load(std::memory_order_relaxed) + i) & (ring->capacity - 1);
+    return ring->records + index * ring->stride;
+}
+
+void RingConsume(SampleRing* ring, uint64_t count)
+{
+    uint64_t read = ring->readIndex.load(std::memory_order_relaxed);
+    ring->readIndex.store(read + count, std::memory_order_release);
+}
+
+void InitStreamWindow(StreamWindow* window, uint32_t channels, int64_t capacity)
+{
+    window->channels = channels;
+    window->capacity = capacity;
+    window->total = 0;
+    window->values.assign((size_t)channels * capacity, NAN);
+    window->valuesF32.assign((size_t)channels * capacity, NAN);
+}
+
+void AppendToWindow(StreamWindow* window, SampleRing* ring, uint64_t count)
+{
+    // Rows that would be overwritten within this same call are skipped
+    uint64_t skip = count > (uint64_t)window->capacity ? count - window->capacity : 0;
+    window->total += skip;
+    
+    uint32_t channels = window->channels;
+    int64_t capacity = window->capacity;
+    double* values = window->values.data();
+    float* valuesF32 = window->valuesF32.data();
+    for(uint64_t i = skip; i < count; ++i)
+    {
+        const double* record = RingRecord(ring, i);
+        int64_t slot = window->total % capacity;
+        for(uint32_t c = 0; c < channels; ++c)
+        {
+            values[c * capacity + slot] = record[c];
+            valuesF32[c * capacity + slot] = (float)record[c];
+        }
+        ++window->total;
+    }
+}
+
+int64_t WindowRowCount(const StreamWindow* window)
+{
+    return std::min(window->total, window->capacity);
+}
+
+static inline bool IsSeparator(char c)
+{
+    return c == ' ' || c == ',' || c == ';' || c == '\t' || c == '\r';
+}
+
+int64_t ParseStreamText(const char* text, int64_t size, uint32_t channels, std::vector<double>* out)
+{
+    out->clear();
+    
+    const char* end = text + size;
+    const char* line = text;
+    while(line < end)
+    {
+        const char* lineEnd = (const char*)memchr(line, '\n', end - line);
+        if(!lineEnd) break;
+        
+        const char* p = line;
+        while(p < lineEnd && IsSeparator(*p)) ++p;
+        if(p < lineEnd && *p != '#')
+        {
+            for(uint32_t c = 0; c < channels; ++c)
+            {
+                while(p < lineEnd && IsSeparator(*p)) ++p;
+                
+                double value = NAN;
+                int consumed = p < lineEnd ? ParseNumber(p, lineEnd, &value) : 0;
+                if(consumed == 0) value = NAN;
+                out->push_back(value);
+                
+                // Skips whatever is left of the field if it wasn't a number
+                p += consumed;
+                while(p < lineEnd && !IsSeparator(*p)) ++p;
+            }
+        }
+        
+        line = lineEnd + 1;
+    }
+    
+    return line - text;
+}
+
+static int CountFields(const char* line, const char* lineEnd)
+{
+    int count = 0;
+    const char* p = line;
+    while(p < lineEnd)
+    {
+        while(p < lineEnd && IsSeparator(*p)) ++p;
+        if(p == lineEnd) break;
+        ++count;
+        while(p < lineEnd && !IsSeparator(*p)) ++p;
+    }
+    
+    return count;
+}
+
+static bool StartsWith(const char* str, const char* end, const char* prefix)
+{
+    size_t length = strlen(prefix);
+    return (size_t)(end - str) >= length && memcmp(str, prefix, length) == 0;
+}
+
+// Returns the size of the header line to skip (0 if there's no header), -1 on errors
+static int64_t ParseStreamHeader(DataStream* stream, const char* line, const char* lineEnd)
+{
+    if(!StartsWith(line, lineEnd, "#plotter"))
+    {
+        int fields = CountFields(line, lineEnd);
+        stream->format = StreamFormat_Text;
+        stream->channels = (uint32_t)std::min(fields, Stream_MaxChannels);
+        if(stream->channels == 0)
+        {
+            snprintf(stream->error, sizeof(stream->error), "First line has no values");
+            return -1;
+        }
+        return 0;
+    }
+    
+    stream->format = StreamFormat_Text;
+    stream->channels = 0;
+    
+    const char* p = line + strlen("#plotter");
+    while(p < lineEnd)
+    {
+        while(p < lineEnd && (*p == ' ' || *p == '\t' || *p == '\r')) ++p;
+        const char* token = p;
+        while(p < lineEnd && *p != ' ' && *p != '\t' && *p != '\r') ++p;
+        
+        if(StartsWith(token, p, "channels="))
+        {
+            stream->channels = (uint32_t)atoi(token + strlen("channels="));
+        }
+        else if(StartsWith(token, p, "format="))
+        {
+            const char* format = token + strlen("format=");
+            if(StartsWith(format, p, "f64")) stream->format = StreamFormat_F64;
+            else if(StartsWith(format, p, "f32")) stream->format = StreamFormat_F32;
+            else if(StartsWith(format, p, "text")) stream->format = StreamFormat_Text;
+            else
+            {
+                snprintf(stream->error, sizeof(stream->error), "Unknown format '%.*s'", (int)(p - format), format);
+                return -1;
+            }
+        }
+        else if(StartsWith(token, p, "names="))
+        {
+            const char* name = token + strlen("names=");
+            for(int c = 0; c < Stream_MaxChannels && name < p; ++c)
+            {
+                const char* nameEnd = name;
+                while(nameEnd < p && *nameEnd != ',') ++nameEnd;
+                int length = std::min((int)(nameEnd - name), 63);
+                memcpy(stream->names[c], name, length);
+                stream->names[c][length] = '\0';
+                name = nameEnd + 1;
+            }
+        }
+    }
+    
+    if(stream->channels < 1 || stream->channels > Stream_MaxChannels)
+    {
+        snprintf(stream->error, sizeof(stream->error), "Expected between 1 and %d channels", Stream_MaxChannels);
+        return -1;
+    }
+    
+    return lineEnd - line + 1;
+}
+
+static void PushRows(DataStream* stream, const double* rows, uint64_t count)
+{
+    // The producer waits for the render thread rather than dropping samples,
+    // which pushes back on the writer through the pipe
+    while(count > 0 && !stream->stop.load(std::memory_order_relaxed))
+    {
+        uint64_t pushed = RingPush(&stream->ring, rows, count);
+        rows += pushed * stream->channels;
+        count -= pushed;
+        stream->received.fetch_add(pushed, std::memory_order_relaxed);
+        
+        if(count > 0)
+        {
+            stream->stalls.fetch_add(1, std::memory_order_relaxed);
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    }
+}
+
+static void ConvertBinaryRows(const char* data, uint64_t rowCount, uint32_t channels, StreamFormat format, std::vector<double>* out)
+{
+    uint64_t valueCount = rowCount * channels;
+    out->resize(valueCount);
+    if(format == StreamFormat_F64)
+    {
+        memcpy(out->data(), data, valueCount * sizeof(double));
+        return;
+    }
+    
+    for(uint64_t i = 0; i < valueCount; ++i)
+    {
+        float value;
+        memcpy(&value, data + i * sizeof(float), sizeof(float));
+        (*out)[i] = value;
+    }
+}
+
+static void StreamReaderThread(DataStream* stream)
+{
+    std::vector<char> buffer(Stream_ReadBufferSize);
+    std::vector<double> rows;
+    int64_t filled = 0;
+    bool connected = false;
+    
+    while(!stream->stop.load(std::memory_order_relaxed))
+    {
+        int64_t bytes = ReadStream(&stream->input, buffer.data() + filled, buffer.size() - filled, Stream_ReadTimeoutMs);
+        if(bytes < 0) break;
+        if(bytes == 0) continue;
+        filled += bytes;
+        
+        if(!connected)
+        {
+            const char* newline = (const char*)memchr(buffer.data(), '\n', filled);
+            if(!newline)
+            {
+                if(filled < (int64_t)buffer.size()) continue;
+                snprintf(stream->error, sizeof(stream->error), "First line is too long");
+                stream->status.store(Stream_Error, std::memory_order_release);
+                return;
+            }
+            
+            int64_t headerSize = ParseStreamHeader(stream, buffer.data(), newline);
+            if(headerSize < 0)
+            {
+                stream->channels = 0;
+                stream->status.store(Stream_Error, std::memory_order_release);
+                return;
+            }
+            
+            for(uint32_t c = 0; c < stream->channels; ++c)
+            {
+                if(!stream->names[c][0])
+                    snprintf(stream->names[c], sizeof(stream->names[c]), "c%u", c + 1);
+            }
+            
+            memmove(buffer.data(), buffer.data() + headerSize, filled - headerSize);
+            filled -= headerSize;
+            
+            InitSampleRing(&stream->ring, stream->channels, Stream_RingRecords);
+            stream->status.store(Stream_Connected, std::memory_order_release);
+            connected = true;
+        }
+        
+        int64_t consumed;
+        if(stream->format == StreamFormat_Text)
+        {
+            consumed = ParseStreamText(buffer.data(), filled, stream->channels, &rows);
+            
+            // A single line filling the whole buffer is dropped
+            if(consumed == 0 && filled == (int64_t)buffer.size()) consumed = filled;
+        }
+        else
+        {
+            int64_t rowSize = stream->channels * (stream->format == StreamFormat_F64 ? sizeof(double) : sizeof(float));
+            uint64_t rowCount = filled / rowSize;
+            ConvertBinaryRows(buffer.data(), rowCount, stream->channels, stream->format, &rows);
+            consumed = rowCount * rowSize;
+        }
+        
+        PushRows(stream, rows.data(), rows.size() / stream->channels);
+        
+        memmove(buffer.data(), buffer.data() + consumed, filled - consumed);
+        filled -= consumed;
+    }
+    
+    if(stream->status.load() != Stream_Error)
+        stream->status.store(Stream_Closed, std::memory_order_release);
+}
+
+DataStream* OpenDataStream(const char* source, int64_t windowRows, char* error, int errorSize)
+{
+    DataStream* stream = new DataStream();
+    snprintf(stream->source, sizeof(stream->source), "%s", source);
+    stream->windowCapacity = windowRows > 0 ? windowRows : 1;
+    
+    bool ok;
+    if(strncmp(source, "unix:", 5) == 0)
+        ok = ListenUnixSocket(source + 5, &stream->input);
+    else
+        ok = OpenStreamFile(source, &stream->input);
+    
+    if(!ok)
+    {
+        if(error) snprintf(error, errorSize, "Could not open '%s'", source);
+        delete stream;
+        return nullptr;
+    }
+    
+    stream->rateStart = GetTimeNs();
+    stream->reader = std::thread(StreamReaderThread, stream);
+    return stream;
+}
+
+void CloseDataStream(DataStream* stream)
+{
+    stream->stop.store(true);
+    if(stream->reader.joinable()) stream->reader.join();
+    
+    CloseStream(&stream->input);
+    if(stream->ring.records) FreeSampleRing(&stream->ring);
+    delete stream;
+}
+
+int64_t UpdateDataStream(DataStream* stream)
+{
+    // The channel count and the ring are set up by the reader before it
+    // publishes the connected status, and they don't change after that
+    int status = stream->status.load(std::memory_order_acquire);
+    if(status == Stream_Waiting || stream->channels == 0) return 0;
+    
+    if(stream->window.channels == 0)
+        InitStreamWindow(&stream->window, stream->channels, stream->windowCapacity);
+    
+    uint64_t count = RingReadable(&stream->ring);
+    AppendToWindow(&stream->window, &stream->ring, count);
+    RingConsume(&stream->ring, count);
+    
+    stream->rateRows += count;
+    uint64_t now = GetTimeNs();
+    if(now - stream->rateStart > 500000000)
+    {
+        stream->rowsPerSecond = stream->rateRows * 1e9 / (now - stream->rateStart);
+        stream->rateRows = 0;
+        stream->rateStart = now;
+    }
+    
+    return (int64_t)count;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "os.h"
+
+// Live data streams from acquisition processes. A reader thread pulls samples
+// from a pipe or a socket and pushes them into a lock-free single producer,
+// single consumer ring. The render thread drains the ring once per frame into
+// a fixed-size rolling window, and only the rows that changed since the last
+// frame are uploaded to the GPU.
+//
+// Protocol: an optional first line "#plotter channels=N format=text|f32|f64 names=a,b,c",
+// followed by the samples. Text samples are one row per line, with the values
+// separated by spaces, commas, semicolons or tabs. Binary samples are rows of
+// N native-endian values. Without the header line the stream is text, with as
+// many channels as there are values on the first line.
+
+#define Stream_MaxChannels 16
+#define Stream_RingRecords (1 << 20)  // Per stream, a power of 2
+#define Stream_CacheLine 64
+
+struct SampleRing
+{
+    double* records;
+    uint32_t stride;  // Values per record
+    uint64_t capacity;  // In records, a power of 2
+    
+    // Each side caches the other one's index, so the shared cache lines
+    // are only touched when the cached value says the ring is full/empty
+    alignas(Stream_CacheLine) std::atomic<uint64_t> writeIndex;
+    uint64_t cachedReadIndex;
+    alignas(Stream_CacheLine) std::atomic<uint64_t> readIndex;
+    uint64_t cachedWriteIndex;
+};
+
+void InitSampleRing(SampleRing* ring, uint32_t stride, uint64_t capacity);
+void FreeSampleRing(SampleRing* ring);
+// Producer side, returns the number of records that fit
+uint64_t RingPush(SampleRing* ring, const double* records, uint64_t count);
+// Consumer side, the readable records are RingRecord(ring, i) for i in [0, count)
+uint64_t RingReadable(SampleRing* ring);
+const double* RingRecord(const SampleRing* ring, uint64_t i);
+void RingConsume(SampleRing* ring, uint64_t count);
+
+// The last capacity rows of the stream, stored as circular columns:
+// row r is at index r % capacity of every column
+struct StreamWindow
+{
+    uint32_t channels;
+    int64_t capacity;
+    int64_t total;  // Rows appended since the start
+    std::vector<double> values;  // Column-major, channels * capacity
+    std::vector<float> valuesF32;
+};
+
+void InitStreamWindow(StreamWindow* window, uint32_t channels, int64_t capacity);
+void AppendToWindow(StreamWindow* window, SampleRing* ring, uint64_t count);
+int64_t WindowRowCount(const StreamWindow* window);
+
+enum StreamFormat
+{
+    StreamFormat_Text = 0,
+    StreamFormat_F32,
+    StreamFormat_F64,
+};
+
+enum StreamStatus
+{
+    Stream_Waiting = 0,  // For the producer or its header
+    Stream_Connected,
+    Stream_Closed,
+    Stream_Error,
+};
+
+struct DataStream
+{
+    char source[256];
+    char names[Stream_MaxChannels][64];
+    uint32_t channels;  // Only valid once connected
+    StreamFormat format;
+    
+    OSStream input;
+    SampleRing ring;
+    std::thread reader;
+    std::atomic<bool> stop;
+    std::atomic<int> status;
+    char error[128];
+    
+    // Written by the reader
+    std::atomic<uint64_t> received;
+    std::atomic<uint64_t> stalls;  // Times the ring was full
+    
+    // Render thread side
+    StreamWindow window;
+    int64_t windowCapacity;
+    uint64_t rateStart;
+    int64_t rateRows;
+    double rowsPerSecond;
+};
+
+// source is "unix:<path>" to listen on a socket, otherwise a FIFO, named pipe or file path
+DataStream* OpenDataStream(const char* source, int64_t windowRows, char* error, int errorSize);
+void CloseDataStream(DataStream* stream);
+// Drains the ring into the window, returns the number of new rows
+int64_t UpdateDataStream(DataStream* stream);
+
+// Text protocol parsing, exposed for the benchmark. Parses the complete lines of
+// text and returns the number of bytes consumed; rows go to out, channels values each.
+int64_t ParseStreamText(const char* text, int64_t size, uint32_t channels, std::vector<double>* out);
@@ -0,0 +1,76 @@
+#include "subterms.h"
+#include "core.h"
+
+static bool IsCommutativeOp(OpCode op)
+{
+    return op == Op_Add || op == Op_Mul || op == Op_Min || op == Op_Max || op == Op_Equal || op == Op_And;
+}
+
+static void HashNode(const Ast* ast, AstRef ref, std::vector<SubtermNode>* nodes)
+{
+    SubtermNode* result = &(*nodes)[ref];
+    if(result->visited) return;
+    
+    const AstNode* node = &ast->nodes[ref];
+    uint64_t children[Ast_MaxChildren] = { 0, 0, 0 };
+    uint32_t size = 1;
+    bool usesX = node->op == Op_Var && node->index == Var_X;
+    for(int i = 0; i < node->childCount; ++i)
+    {
+        HashNode(ast, node->children[i], nodes);
+        const SubtermNode* child = &(*nodes)[node->children[i]];
+        children[i] = child->hash;
+        size += child->size;
+        usesX |= child->usesX;
+    }
+    
+    // a + b and b + a are the same subexpression
+    if(IsCommutativeOp(node->op) && children[0] > children[1])
+    {
+        uint64_t tmp = children[0];
+        children[0] = children[1];
+        children[1] = tmp;
+    }
+    
+    uint64_t hash = HashBytes(Hash_Seed, &node->op, sizeof(node->op));
+    if(node->op == Op_Const) hash = HashBytes(hash, &node->value, sizeof(node->value));
+    else if(node->childCount == 0 || node->op == Op_Integral || node->op == Op_Sum) hash = HashBytes(hash, &node->index, sizeof(node->index));
+    hash = HashBytes(hash, children, node->childCount * sizeof(uint64_t));
+    
+    result->hash = hash;
+    result->size = size;
+    result->usesX = usesX;
+    result->visited = true;
+}
+
+void HashSubterms(const Ast* ast, AstRef root, std::vector<SubtermNode>* nodes)
+{
+    nodes->assign(ast->nodes.size(), SubtermNode());
+    HashNode(ast, root, nodes);
+}
+
+AstRef CopySubterm(const Ast* ast, AstRef ref, const std::vector<SubtermNode>* nodes, const uint64_t* replaced,
+                   int numReplaced, Ast* out)
+{
+    for(int k = 0; k < numReplaced; ++k)
+    {
+        if((*nodes)[ref].hash == replaced[k]) return AstLeaf(out, Op_Bound, (uint32_t)k);
+    }
+    
+    const AstNode* node = &ast->nodes[ref];
+    switch(node->op)
+    {
+        case Op_Const: return AstConst(out, node->value);
+        case Op_Var:
+        case Op_Param:
+        case Op_Bound: return AstLeaf(out, node->op, node->index);
+        default: break;
+    }
+    
+    AstRef children[Ast_MaxChildren] = { Ast_Null, Ast_Null, Ast_Null };
+    for(int i = 0; i < node->childCount; ++i)
+        children[i] = CopySubterm(ast, node->children[i], nodes, replaced, numReplaced, out);
+    if(node->op == Op_Integral || node->op == Op_Sum)
+        return AstBinding(out, node->op, children[0], children[1], children[2], node->index);
+    return AstOp(out, node->op, children[0], children[1], children[2]);
+}
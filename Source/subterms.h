@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <unordered_map>
+
+#include "parser.h"
+#include "compiler.h"
+
+// Subexpressions shared between explicit curves, like sqrt(x^2 + 1) in
+// several definitions, are sampled once per frame instead of once per curve.
+// The trees of the visible curves are hash-consed into one table: every node
+// gets a hash of its operation, its value or index and the hashes of its
+// children (in a canonical order for commutative operations), so equal
+// subexpressions have equal hashes whichever definition they come from.
+// Those depending on x, large enough and found in at least two curves are
+// compiled on their own and sampled on the explicit grid (see curves.h), and
+// the curves read their values back as Op_Bound inputs in place of the
+// subtrees. Definitions with integrals or sums, which use the bound slots
+// themselves, aren't shared.
+
+#define Subterm_MinNodes 4  // Smaller subexpressions are cheaper to compute again than to read back
+
+struct SubtermNode
+{
+    uint64_t hash;
+    uint32_t size;  // Nodes in the subtree
+    bool usesX;
+    bool visited;
+};
+
+struct Subterm
+{
+    Ast ast;  // Copy of the subexpression alone
+    AstRef root;
+    Program program;
+    uint32_t numCurves;  // Distinct curves it was found in, as of the last plan
+    
+    // Samples on the explicit grid, kept while panning like those of the curves
+    uint64_t sampleKey;
+    int64_t firstSample;
+    std::vector<double> values;
+};
+
+struct SubtermTable
+{
+    std::unordered_map<uint64_t, Subterm> terms;  // By hash
+    uint64_t planKey = 0;  // Curves the sharing was planned for
+};
+
+// Hashes the nodes reachable from root, nodes is indexed by AstRef
+void HashSubterms(const Ast* ast, AstRef root, std::vector<SubtermNode>* nodes);
+// Copies the subtree under node into out, replacing the subtrees whose hash is
+// replaced[k] by Op_Bound leaves of slot k. Returns the root of the copy.
+AstRef CopySubterm(const Ast* ast, AstRef node, const std::vector<SubtermNode>* nodes, const uint64_t* replaced,
+                   int numReplaced, Ast* out);
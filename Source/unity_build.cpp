@@ -1,6 +1,34 @@
 
 #include "main.cpp"
 #include "core.cpp"
+#include "profiler.cpp"
+#include "os.cpp"
+#include "diskcache.cpp"
+#include "jobs.cpp"
+#include "parser.cpp"
+#include "compiler.cpp"
+#include "interpreter.cpp"
+#include "interval.cpp"
+#include "ddouble.cpp"
+#include "batch.cpp"
+#include "pyramid.cpp"
+#include "datatable.cpp"
+#include "plot.cpp"
+#include "scatter.cpp"
+#include "streaming.cpp"
+#include "shmfeed.cpp"
+#include "fit.cpp"
+#include "histogram.cpp"
+#include "ode.cpp"
+#include "subterms.cpp"
+#include "curves.cpp"
+#include "analysis.cpp"
+#include "animation.cpp"
+#include "session.cpp"
+#include "fields.cpp"
+#include "curvelines.cpp"
+#include "fractal.cpp"
+#include "domain.cpp"
 
 // Utility function for glfw-webgpu compatibility
 #include "glfw3webgpu.c"
@@ -0,0 +1,11 @@
+#!/bin/sh
+
+# Only the headless tools are built on linux for now
+mkdir -p Build/Linux64
+cd Build/Linux64
+
+# Headless benchmark of the evaluation engine, always optimized
+g++ -std=c++20 -O2 -DNDEBUG -I../../Source ../../Source/bench_build.cpp -o plotter_bench -lpthread -lrt
+
+# Example producer for the shared memory feed
+cc -O2 -I../../Source ../../Examples/shm_producer.c -o shm_producer -lm -lrt
@@ -31,6 +31,9 @@ REM Development build, debug is enabled, profiling and optimization disabled
 cl /Zi /DDEBUG /Od %common%
 set build_ret=%errorlevel%
 
+REM Headless benchmark of the evaluation engine, always optimized
+cl /nologo /std:c++20 /O2 /DNDEBUG /FC /MT /I..\..\Source ..\..\Source\bench_build.cpp /link /out:plotter_bench.exe
+
 echo Done.
 
 popd
\ No newline at end of file